@@ -30,11 +30,23 @@
  */
 
 #define POLARSSL_AES_C 1
+#define POLARSSL_CIPHER_MODE_CFB 1
 #define POLARSSL_CIPHER_MODE_CTR 1
 
+/*
+ * Tables: by default the constant arrays aes_gentab writes to aes_tables.h
+ * at build time. POLARSSL_AES_ROM_TABLES uses the arrays below instead,
+ * POLARSSL_AES_RUNTIME_TABLES computes them once on first key setup.
+ */
+
 #if defined(POLARSSL_AES_C)
 
 #include "aes.h"
+#include "aesni.h"
+#include "xor.h"
+
+#include <stdint.h>
+#include <pthread.h>
 
 /*
  * 32-bit integer manipulation macros (little endian)
@@ -59,6 +71,26 @@
 }
 #endif
 
+/*
+ * Same, as one native unaligned load/store where the host is little endian
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define GET_WORD_LE(n,b,i)                              \
+{                                                       \
+    uint32_t w_;                                        \
+    memcpy( &w_, (b) + (i), 4 );                        \
+    (n) = w_;                                           \
+}
+#define PUT_WORD_LE(n,b,i)                              \
+{                                                       \
+    uint32_t w_ = (uint32_t) (n);                       \
+    memcpy( (b) + (i), &w_, 4 );                        \
+}
+#else
+#define GET_WORD_LE GET_ULONG_LE
+#define PUT_WORD_LE PUT_ULONG_LE
+#endif
+
 #if defined(POLARSSL_AES_ROM_TABLES)
 /*
  * Forward S-box
@@ -170,9 +202,14 @@ static const unsigned char FSb[256] =
     V(CB,B0,B0,7B), V(FC,54,54,A8), V(D6,BB,BB,6D), V(3A,16,16,2C)
 
 #define V(a,b,c,d) 0x##a##b##c##d
+static const uint32_t FT32[256] = { FT };
+#if !defined(POLARSSL_AES_FEWER_TABLES)
 static const unsigned long FT0[256] = { FT };
+#endif
 #undef V
 
+#if !defined(POLARSSL_AES_FEWER_TABLES)
+
 #define V(a,b,c,d) 0x##b##c##d##a
 static const unsigned long FT1[256] = { FT };
 #undef V
@@ -184,6 +221,7 @@ static const unsigned long FT2[256] = { FT };
 #define V(a,b,c,d) 0x##d##a##b##c
 static const unsigned long FT3[256] = { FT };
 #undef V
+#endif
 
 #undef FT
 
@@ -297,9 +335,14 @@ static const unsigned char RSb[256] =
     V(61,84,CB,7B), V(70,B6,32,D5), V(74,5C,6C,48), V(42,57,B8,D0)
 
 #define V(a,b,c,d) 0x##a##b##c##d
+static const uint32_t RT32[256] = { RT };
+#if !defined(POLARSSL_AES_FEWER_TABLES)
 static const unsigned long RT0[256] = { RT };
+#endif
 #undef V
 
+#if !defined(POLARSSL_AES_FEWER_TABLES)
+
 #define V(a,b,c,d) 0x##b##c##d##a
 static const unsigned long RT1[256] = { RT };
 #undef V
@@ -311,6 +354,7 @@ static const unsigned long RT2[256] = { RT };
 #define V(a,b,c,d) 0x##d##a##b##c
 static const unsigned long RT3[256] = { RT };
 #undef V
+#endif
 
 #undef RT
 
@@ -324,7 +368,7 @@ static const unsigned long RCON[10] =
     0x0000001B, 0x00000036
 };
 
-#else
+#elif defined(POLARSSL_AES_RUNTIME_TABLES)
 
 /*
  * Forward S-box & tables
@@ -334,6 +378,7 @@ static unsigned long FT0[256];
 static unsigned long FT1[256]; 
 static unsigned long FT2[256]; 
 static unsigned long FT3[256]; 
+static uint32_t FT32[256];
 
 /*
  * Reverse S-box & tables
@@ -343,6 +388,7 @@ static unsigned long RT0[256];
 static unsigned long RT1[256];
 static unsigned long RT2[256];
 static unsigned long RT3[256];
+static uint32_t RT32[256];
 
 /*
  * Round constants
@@ -356,7 +402,7 @@ static unsigned long RCON[10];
 #define XTIME(x) ( ( x << 1 ) ^ ( ( x & 0x80 ) ? 0x1B : 0x00 ) )
 #define MUL(x,y) ( ( x && y ) ? pow[(log[x]+log[y]) % 255] : 0 )
 
-static int aes_init_done = 0;
+static pthread_once_t aes_tables_once = PTHREAD_ONCE_INIT;
 
 static void aes_gen_tables( void )
 {
@@ -431,26 +477,67 @@ static void aes_gen_tables( void )
         RT1[i] = ROTL8( RT0[i] );
         RT2[i] = ROTL8( RT1[i] );
         RT3[i] = ROTL8( RT2[i] );
+
+        FT32[i] = (uint32_t) FT0[i];
+        RT32[i] = (uint32_t) RT0[i];
     }
 }
 
+#else
+
+/*
+ * Tables emitted at build time by aes_gentab from the code above
+ */
+#include "aes_tables.h"
+
 #endif
 
+/*
+ * Round table lookups: T( n, x ) is FTn[x] (RTn[x]). The full layout
+ * keeps all four rotations as unsigned long tables; the compact one keeps
+ * a single 32-bit table per direction and rotates on lookup.
+ */
+#define ROTL32(x,n)     ( (uint32_t)( (x) << (n) ) | ( (x) >> ( ( 32 - (n) ) & 31 ) ) )
+
+#define FT_FULL(n,x)    FT##n[x]
+#define RT_FULL(n,x)    RT##n[x]
+#define FT_COMPACT(n,x) ROTL32( FT32[x], 8 * n )
+#define RT_COMPACT(n,x) ROTL32( RT32[x], 8 * n )
+
+/*
+ * The schedules are the same bytes either way; with AES-NI present the
+ * aeskeygenassist expansion fills them, otherwise the table code does
+ */
+static pthread_once_t aes_aesni_once = PTHREAD_ONCE_INIT;
+static int aes_aesni;
+
+static void aes_check_aesni( void )
+{
+    aes_aesni = CheckAESSupport() != 0;
+}
+
+/*
+ * Key expansion selection
+ */
+void aes_setkey_aesni( int enable )
+{
+    pthread_once( &aes_aesni_once, aes_check_aesni );
+
+    aes_aesni = enable && CheckAESSupport();
+}
+
 /*
  * AES key schedule (encryption)
  */
 int aes_setkey_enc( aes_context *ctx, const unsigned char *key, unsigned int keysize )
 {
     unsigned int i;
-    unsigned long *RK;
+    uint32_t *RK;
 
-#if !defined(POLARSSL_AES_ROM_TABLES)
-    if( aes_init_done == 0 )
-    {
-        aes_gen_tables();
-        aes_init_done = 1;
-    }
+#if defined(POLARSSL_AES_RUNTIME_TABLES)
+    pthread_once( &aes_tables_once, aes_gen_tables );
 #endif
+    pthread_once( &aes_aesni_once, aes_check_aesni );
 
     switch( keysize )
     {
@@ -460,11 +547,21 @@ int aes_setkey_enc( aes_context *ctx, const unsigned char *key, unsigned int key
         default : return( POLARSSL_ERR_AES_INVALID_KEY_LENGTH );
     }
 
-#if defined(PADLOCK_ALIGN16)
-    ctx->rk = RK = PADLOCK_ALIGN16( ctx->buf );
-#else
-    ctx->rk = RK = ctx->buf;
-#endif
+    ctx->compact = 0;
+
+    if( aes_aesni )
+    {
+        switch( ctx->nr )
+        {
+            case 10: AES_128_Key_Expansion( key, ctx->ni ); break;
+            case 12: AES_192_Key_Expansion( key, ctx->ni ); break;
+            default: AES_256_Key_Expansion( key, ctx->ni ); break;
+        }
+
+        return( 0 );
+    }
+
+    RK = ctx->rk;
 
     for( i = 0; i < (keysize >> 5); i++ )
     {
@@ -521,6 +618,9 @@ int aes_setkey_enc( aes_context *ctx, const unsigned char *key, unsigned int key
                 RK[10] = RK[2] ^ RK[9];
                 RK[11] = RK[3] ^ RK[10];
 
+                if( i == 6 )
+                    break;
+
                 RK[12] = RK[4] ^
                 ( (unsigned long) FSb[ ( RK[11]       ) & 0xFF ]       ) ^
                 ( (unsigned long) FSb[ ( RK[11] >>  8 ) & 0xFF ] <<  8 ) ^
@@ -548,8 +648,8 @@ int aes_setkey_dec( aes_context *ctx, const unsigned char *key, unsigned int key
 {
     int i, j;
     aes_context cty;
-    unsigned long *RK;
-    unsigned long *SK;
+    uint32_t *RK;
+    const uint32_t *SK;
     int ret;
 
     switch( keysize )
@@ -560,16 +660,21 @@ int aes_setkey_dec( aes_context *ctx, const unsigned char *key, unsigned int key
         default : return( POLARSSL_ERR_AES_INVALID_KEY_LENGTH );
     }
 
-#if defined(PADLOCK_ALIGN16)
-    ctx->rk = RK = PADLOCK_ALIGN16( ctx->buf );
-#else
-    ctx->rk = RK = ctx->buf;
-#endif
+    ctx->compact = 0;
+
+    RK = ctx->rk;
 
     ret = aes_setkey_enc( &cty, key, keysize );
     if( ret != 0 )
         return( ret );
 
+    if( aes_aesni )
+    {
+        AES_invert_key( cty.ni, ctx->ni, ctx->nr );
+        memset( &cty, 0, sizeof( aes_context ) );
+        return( 0 );
+    }
+
     SK = cty.rk + cty.nr * 4;
 
     *RK++ = *SK++;
@@ -581,10 +686,10 @@ int aes_setkey_dec( aes_context *ctx, const unsigned char *key, unsigned int key
     {
         for( j = 0; j < 4; j++, SK++ )
         {
-            *RK++ = RT0[ FSb[ ( *SK       ) & 0xFF ] ] ^
-                    RT1[ FSb[ ( *SK >>  8 ) & 0xFF ] ] ^
-                    RT2[ FSb[ ( *SK >> 16 ) & 0xFF ] ] ^
-                    RT3[ FSb[ ( *SK >> 24 ) & 0xFF ] ];
+            *RK++ = RT_COMPACT( 0, FSb[ ( *SK       ) & 0xFF ] ) ^
+                    RT_COMPACT( 1, FSb[ ( *SK >>  8 ) & 0xFF ] ) ^
+                    RT_COMPACT( 2, FSb[ ( *SK >> 16 ) & 0xFF ] ) ^
+                    RT_COMPACT( 3, FSb[ ( *SK >> 24 ) & 0xFF ] );
         }
     }
 
@@ -598,52 +703,184 @@ int aes_setkey_dec( aes_context *ctx, const unsigned char *key, unsigned int key
     return( 0 );
 }
 
-#define AES_FROUND(X0,X1,X2,X3,Y0,Y1,Y2,Y3)     \
-{                                               \
-    X0 = *RK++ ^ FT0[ ( Y0       ) & 0xFF ] ^   \
-                 FT1[ ( Y1 >>  8 ) & 0xFF ] ^   \
-                 FT2[ ( Y2 >> 16 ) & 0xFF ] ^   \
-                 FT3[ ( Y3 >> 24 ) & 0xFF ];    \
-                                                \
-    X1 = *RK++ ^ FT0[ ( Y1       ) & 0xFF ] ^   \
-                 FT1[ ( Y2 >>  8 ) & 0xFF ] ^   \
-                 FT2[ ( Y3 >> 16 ) & 0xFF ] ^   \
-                 FT3[ ( Y0 >> 24 ) & 0xFF ];    \
-                                                \
-    X2 = *RK++ ^ FT0[ ( Y2       ) & 0xFF ] ^   \
-                 FT1[ ( Y3 >>  8 ) & 0xFF ] ^   \
-                 FT2[ ( Y0 >> 16 ) & 0xFF ] ^   \
-                 FT3[ ( Y1 >> 24 ) & 0xFF ];    \
-                                                \
-    X3 = *RK++ ^ FT0[ ( Y3       ) & 0xFF ] ^   \
-                 FT1[ ( Y0 >>  8 ) & 0xFF ] ^   \
-                 FT2[ ( Y1 >> 16 ) & 0xFF ] ^   \
-                 FT3[ ( Y2 >> 24 ) & 0xFF ];    \
+/*
+ * Table layout selection
+ */
+int aes_set_compact_tables( aes_context *ctx, int compact )
+{
+#if defined(POLARSSL_AES_FEWER_TABLES)
+    if( !compact )
+        return( POLARSSL_ERR_AES_FEATURE_UNAVAILABLE );
+#endif
+
+    ctx->compact = ( compact != 0 );
+
+    return( 0 );
+}
+
+#define AES_FROUND(T,X0,X1,X2,X3,Y0,Y1,Y2,Y3)          \
+{                                                      \
+    X0 = *RK++ ^ T( 0, ( Y0       ) & 0xFF ) ^         \
+                 T( 1, ( Y1 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y2 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y3 >> 24 ) & 0xFF );          \
+                                                       \
+    X1 = *RK++ ^ T( 0, ( Y1       ) & 0xFF ) ^         \
+                 T( 1, ( Y2 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y3 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y0 >> 24 ) & 0xFF );          \
+                                                       \
+    X2 = *RK++ ^ T( 0, ( Y2       ) & 0xFF ) ^         \
+                 T( 1, ( Y3 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y0 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y1 >> 24 ) & 0xFF );          \
+                                                       \
+    X3 = *RK++ ^ T( 0, ( Y3       ) & 0xFF ) ^         \
+                 T( 1, ( Y0 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y1 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y2 >> 24 ) & 0xFF );          \
 }
 
-#define AES_RROUND(X0,X1,X2,X3,Y0,Y1,Y2,Y3)     \
-{                                               \
-    X0 = *RK++ ^ RT0[ ( Y0       ) & 0xFF ] ^   \
-                 RT1[ ( Y3 >>  8 ) & 0xFF ] ^   \
-                 RT2[ ( Y2 >> 16 ) & 0xFF ] ^   \
-                 RT3[ ( Y1 >> 24 ) & 0xFF ];    \
-                                                \
-    X1 = *RK++ ^ RT0[ ( Y1       ) & 0xFF ] ^   \
-                 RT1[ ( Y0 >>  8 ) & 0xFF ] ^   \
-                 RT2[ ( Y3 >> 16 ) & 0xFF ] ^   \
-                 RT3[ ( Y2 >> 24 ) & 0xFF ];    \
-                                                \
-    X2 = *RK++ ^ RT0[ ( Y2       ) & 0xFF ] ^   \
-                 RT1[ ( Y1 >>  8 ) & 0xFF ] ^   \
-                 RT2[ ( Y0 >> 16 ) & 0xFF ] ^   \
-                 RT3[ ( Y3 >> 24 ) & 0xFF ];    \
-                                                \
-    X3 = *RK++ ^ RT0[ ( Y3       ) & 0xFF ] ^   \
-                 RT1[ ( Y2 >>  8 ) & 0xFF ] ^   \
-                 RT2[ ( Y1 >> 16 ) & 0xFF ] ^   \
-                 RT3[ ( Y0 >> 24 ) & 0xFF ];    \
+#define AES_RROUND(T,X0,X1,X2,X3,Y0,Y1,Y2,Y3)          \
+{                                                      \
+    X0 = *RK++ ^ T( 0, ( Y0       ) & 0xFF ) ^         \
+                 T( 1, ( Y3 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y2 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y1 >> 24 ) & 0xFF );          \
+                                                       \
+    X1 = *RK++ ^ T( 0, ( Y1       ) & 0xFF ) ^         \
+                 T( 1, ( Y0 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y3 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y2 >> 24 ) & 0xFF );          \
+                                                       \
+    X2 = *RK++ ^ T( 0, ( Y2       ) & 0xFF ) ^         \
+                 T( 1, ( Y1 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y0 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y3 >> 24 ) & 0xFF );          \
+                                                       \
+    X3 = *RK++ ^ T( 0, ( Y3       ) & 0xFF ) ^         \
+                 T( 1, ( Y2 >>  8 ) & 0xFF ) ^         \
+                 T( 2, ( Y1 >> 16 ) & 0xFF ) ^         \
+                 T( 3, ( Y0 >> 24 ) & 0xFF );          \
 }
 
+/*
+ * One block function per direction and table layout
+ */
+#define AES_ENCRYPT_FN(NAME,T)                                         \
+static inline void NAME( const aes_context *ctx,                       \
+                         const unsigned char input[16],                \
+                         unsigned char output[16] )                    \
+{                                                                      \
+    int i;                                                             \
+    const uint32_t *RK = ctx->rk;                                      \
+    unsigned long X0, X1, X2, X3, Y0, Y1, Y2, Y3;                      \
+                                                                       \
+    GET_WORD_LE( X0, input,  0 ); X0 ^= *RK++;                         \
+    GET_WORD_LE( X1, input,  4 ); X1 ^= *RK++;                         \
+    GET_WORD_LE( X2, input,  8 ); X2 ^= *RK++;                         \
+    GET_WORD_LE( X3, input, 12 ); X3 ^= *RK++;                         \
+                                                                       \
+    for( i = (ctx->nr >> 1) - 1; i > 0; i-- )                          \
+    {                                                                  \
+        AES_FROUND( T, Y0, Y1, Y2, Y3, X0, X1, X2, X3 );               \
+        AES_FROUND( T, X0, X1, X2, X3, Y0, Y1, Y2, Y3 );               \
+    }                                                                  \
+                                                                       \
+    AES_FROUND( T, Y0, Y1, Y2, Y3, X0, X1, X2, X3 );                   \
+                                                                       \
+    X0 = *RK++ ^                                                       \
+            ( (unsigned long) FSb[ ( Y0       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) FSb[ ( Y1 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) FSb[ ( Y2 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) FSb[ ( Y3 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    X1 = *RK++ ^                                                       \
+            ( (unsigned long) FSb[ ( Y1       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) FSb[ ( Y2 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) FSb[ ( Y3 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) FSb[ ( Y0 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    X2 = *RK++ ^                                                       \
+            ( (unsigned long) FSb[ ( Y2       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) FSb[ ( Y3 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) FSb[ ( Y0 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) FSb[ ( Y1 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    X3 = *RK++ ^                                                       \
+            ( (unsigned long) FSb[ ( Y3       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) FSb[ ( Y0 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) FSb[ ( Y1 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) FSb[ ( Y2 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    PUT_WORD_LE( X0, output,  0 );                                     \
+    PUT_WORD_LE( X1, output,  4 );                                     \
+    PUT_WORD_LE( X2, output,  8 );                                     \
+    PUT_WORD_LE( X3, output, 12 );                                     \
+}
+
+#define AES_DECRYPT_FN(NAME,T)                                         \
+static inline void NAME( const aes_context *ctx,                       \
+                         const unsigned char input[16],                \
+                         unsigned char output[16] )                    \
+{                                                                      \
+    int i;                                                             \
+    const uint32_t *RK = ctx->rk;                                      \
+    unsigned long X0, X1, X2, X3, Y0, Y1, Y2, Y3;                      \
+                                                                       \
+    GET_WORD_LE( X0, input,  0 ); X0 ^= *RK++;                         \
+    GET_WORD_LE( X1, input,  4 ); X1 ^= *RK++;                         \
+    GET_WORD_LE( X2, input,  8 ); X2 ^= *RK++;                         \
+    GET_WORD_LE( X3, input, 12 ); X3 ^= *RK++;                         \
+                                                                       \
+    for( i = (ctx->nr >> 1) - 1; i > 0; i-- )                          \
+    {                                                                  \
+        AES_RROUND( T, Y0, Y1, Y2, Y3, X0, X1, X2, X3 );               \
+        AES_RROUND( T, X0, X1, X2, X3, Y0, Y1, Y2, Y3 );               \
+    }                                                                  \
+                                                                       \
+    AES_RROUND( T, Y0, Y1, Y2, Y3, X0, X1, X2, X3 );                   \
+                                                                       \
+    X0 = *RK++ ^                                                       \
+            ( (unsigned long) RSb[ ( Y0       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) RSb[ ( Y3 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) RSb[ ( Y2 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) RSb[ ( Y1 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    X1 = *RK++ ^                                                       \
+            ( (unsigned long) RSb[ ( Y1       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) RSb[ ( Y0 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) RSb[ ( Y3 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) RSb[ ( Y2 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    X2 = *RK++ ^                                                       \
+            ( (unsigned long) RSb[ ( Y2       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) RSb[ ( Y1 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) RSb[ ( Y0 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) RSb[ ( Y3 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    X3 = *RK++ ^                                                       \
+            ( (unsigned long) RSb[ ( Y3       ) & 0xFF ]       ) ^     \
+            ( (unsigned long) RSb[ ( Y2 >>  8 ) & 0xFF ] <<  8 ) ^     \
+            ( (unsigned long) RSb[ ( Y1 >> 16 ) & 0xFF ] << 16 ) ^     \
+            ( (unsigned long) RSb[ ( Y0 >> 24 ) & 0xFF ] << 24 );      \
+                                                                       \
+    PUT_WORD_LE( X0, output,  0 );                                     \
+    PUT_WORD_LE( X1, output,  4 );                                     \
+    PUT_WORD_LE( X2, output,  8 );                                     \
+    PUT_WORD_LE( X3, output, 12 );                                     \
+}
+
+#if !defined(POLARSSL_AES_FEWER_TABLES)
+AES_ENCRYPT_FN( aes_encrypt_block_full, FT_FULL )
+AES_DECRYPT_FN( aes_decrypt_block_full, RT_FULL )
+#define AES_COMPACT(ctx)    ( (ctx)->compact )
+#else
+#define AES_COMPACT(ctx)    1
+#endif
+AES_ENCRYPT_FN( aes_encrypt_block_compact, FT_COMPACT )
+AES_DECRYPT_FN( aes_decrypt_block_compact, RT_COMPACT )
+
 /*
  * AES-ECB block encryption/decryption
  */
@@ -652,9 +889,6 @@ int aes_crypt_ecb( aes_context *ctx,
                     const unsigned char input[16],
                     unsigned char output[16] )
 {
-    int i;
-    unsigned long *RK, X0, X1, X2, X3, Y0, Y1, Y2, Y3;
-
 #if defined(POLARSSL_PADLOCK_C) && defined(POLARSSL_HAVE_X86)
     if( padlock_supports( PADLOCK_ACE ) )
     {
@@ -667,86 +901,49 @@ int aes_crypt_ecb( aes_context *ctx,
     }
 #endif
 
-    RK = ctx->rk;
-
-    GET_ULONG_LE( X0, input,  0 ); X0 ^= *RK++;
-    GET_ULONG_LE( X1, input,  4 ); X1 ^= *RK++;
-    GET_ULONG_LE( X2, input,  8 ); X2 ^= *RK++;
-    GET_ULONG_LE( X3, input, 12 ); X3 ^= *RK++;
-
-    if( mode == AES_DECRYPT )
+    if( AES_COMPACT( ctx ) )
     {
-        for( i = (ctx->nr >> 1) - 1; i > 0; i-- )
-        {
-            AES_RROUND( Y0, Y1, Y2, Y3, X0, X1, X2, X3 );
-            AES_RROUND( X0, X1, X2, X3, Y0, Y1, Y2, Y3 );
-        }
-
-        AES_RROUND( Y0, Y1, Y2, Y3, X0, X1, X2, X3 );
-
-        X0 = *RK++ ^ \
-                ( (unsigned long) RSb[ ( Y0       ) & 0xFF ]       ) ^
-                ( (unsigned long) RSb[ ( Y3 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) RSb[ ( Y2 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) RSb[ ( Y1 >> 24 ) & 0xFF ] << 24 );
-
-        X1 = *RK++ ^ \
-                ( (unsigned long) RSb[ ( Y1       ) & 0xFF ]       ) ^
-                ( (unsigned long) RSb[ ( Y0 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) RSb[ ( Y3 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) RSb[ ( Y2 >> 24 ) & 0xFF ] << 24 );
-
-        X2 = *RK++ ^ \
-                ( (unsigned long) RSb[ ( Y2       ) & 0xFF ]       ) ^
-                ( (unsigned long) RSb[ ( Y1 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) RSb[ ( Y0 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) RSb[ ( Y3 >> 24 ) & 0xFF ] << 24 );
-
-        X3 = *RK++ ^ \
-                ( (unsigned long) RSb[ ( Y3       ) & 0xFF ]       ) ^
-                ( (unsigned long) RSb[ ( Y2 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) RSb[ ( Y1 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) RSb[ ( Y0 >> 24 ) & 0xFF ] << 24 );
+        if( mode == AES_DECRYPT )
+            aes_decrypt_block_compact( ctx, input, output );
+        else
+            aes_encrypt_block_compact( ctx, input, output );
     }
-    else /* AES_ENCRYPT */
-    {
-        for( i = (ctx->nr >> 1) - 1; i > 0; i-- )
-        {
-            AES_FROUND( Y0, Y1, Y2, Y3, X0, X1, X2, X3 );
-            AES_FROUND( X0, X1, X2, X3, Y0, Y1, Y2, Y3 );
-        }
+#if !defined(POLARSSL_AES_FEWER_TABLES)
+    else if( mode == AES_DECRYPT )
+        aes_decrypt_block_full( ctx, input, output );
+    else
+        aes_encrypt_block_full( ctx, input, output );
+#endif
 
-        AES_FROUND( Y0, Y1, Y2, Y3, X0, X1, X2, X3 );
-
-        X0 = *RK++ ^ \
-                ( (unsigned long) FSb[ ( Y0       ) & 0xFF ]       ) ^
-                ( (unsigned long) FSb[ ( Y1 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) FSb[ ( Y2 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) FSb[ ( Y3 >> 24 ) & 0xFF ] << 24 );
-
-        X1 = *RK++ ^ \
-                ( (unsigned long) FSb[ ( Y1       ) & 0xFF ]       ) ^
-                ( (unsigned long) FSb[ ( Y2 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) FSb[ ( Y3 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) FSb[ ( Y0 >> 24 ) & 0xFF ] << 24 );
-
-        X2 = *RK++ ^ \
-                ( (unsigned long) FSb[ ( Y2       ) & 0xFF ]       ) ^
-                ( (unsigned long) FSb[ ( Y3 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) FSb[ ( Y0 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) FSb[ ( Y1 >> 24 ) & 0xFF ] << 24 );
-
-        X3 = *RK++ ^ \
-                ( (unsigned long) FSb[ ( Y3       ) & 0xFF ]       ) ^
-                ( (unsigned long) FSb[ ( Y0 >>  8 ) & 0xFF ] <<  8 ) ^
-                ( (unsigned long) FSb[ ( Y1 >> 16 ) & 0xFF ] << 16 ) ^
-                ( (unsigned long) FSb[ ( Y2 >> 24 ) & 0xFF ] << 24 );
-    }
+    return( 0 );
+}
+
+/*
+ * AES-ECB buffer encryption/decryption
+ */
+int aes_crypt_ecb_blocks( aes_context *ctx,
+                           int mode,
+                           size_t length,
+                           const unsigned char *input,
+                           unsigned char *output )
+{
+    if( length % 16 )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
 
-    PUT_ULONG_LE( X0, output,  0 );
-    PUT_ULONG_LE( X1, output,  4 );
-    PUT_ULONG_LE( X2, output,  8 );
-    PUT_ULONG_LE( X3, output, 12 );
+    if( AES_COMPACT( ctx ) && mode == AES_DECRYPT )
+        for( ; length > 0; length -= 16, input += 16, output += 16 )
+            aes_decrypt_block_compact( ctx, input, output );
+    else if( AES_COMPACT( ctx ) )
+        for( ; length > 0; length -= 16, input += 16, output += 16 )
+            aes_encrypt_block_compact( ctx, input, output );
+#if !defined(POLARSSL_AES_FEWER_TABLES)
+    else if( mode == AES_DECRYPT )
+        for( ; length > 0; length -= 16, input += 16, output += 16 )
+            aes_decrypt_block_full( ctx, input, output );
+    else
+        for( ; length > 0; length -= 16, input += 16, output += 16 )
+            aes_encrypt_block_full( ctx, input, output );
+#endif
 
     return( 0 );
 }
@@ -762,7 +959,8 @@ int aes_crypt_cbc( aes_context *ctx,
                     unsigned char *output )
 {
     int i;
-    unsigned char temp[16];
+    size_t n;
+    unsigned char temp[AES_BATCH_BLOCKS * 16], chain[AES_BATCH_BLOCKS * 16 + 16];
 
     if( length % 16 )
         return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
@@ -781,19 +979,23 @@ int aes_crypt_cbc( aes_context *ctx,
 
     if( mode == AES_DECRYPT )
     {
+        /*
+         * A batch of blocks through the buffer decryption, then each XORed
+         * with the ciphertext before it (saved first, output may be input)
+         */
         while( length > 0 )
         {
-            memcpy( temp, input, 16 );
-            aes_crypt_ecb( ctx, mode, input, output );
-
-            for( i = 0; i < 16; i++ )
-                output[i] = (unsigned char)( output[i] ^ iv[i] );
+            n = ( length < sizeof( temp ) ) ? length : sizeof( temp );
 
-            memcpy( iv, temp, 16 );
+            memcpy( chain, iv, 16 );
+            memcpy( chain + 16, input, n );
+            aes_crypt_ecb_blocks( ctx, mode, n, input, temp );
+            xor_keystream( output, temp, chain, n );
+            memcpy( iv, chain + n, 16 );
 
-            input  += 16;
-            output += 16;
-            length -= 16;
+            input  += n;
+            output += n;
+            length -= n;
         }
     }
     else
@@ -818,6 +1020,11 @@ int aes_crypt_cbc( aes_context *ctx,
 #if defined(POLARSSL_CIPHER_MODE_CFB)
 /*
  * AES-CFB128 buffer encryption/decryption
+ *
+ * Only the bytes that finish a started block or start an unfinished one go
+ * through iv[] one at a time; whole blocks go through xor_keystream
+ * against a keystream block computed from the previous ciphertext. On
+ * decryption those are all known, so their keystream comes in batches.
  */
 int aes_crypt_cfb128( aes_context *ctx,
                        int mode,
@@ -827,32 +1034,64 @@ int aes_crypt_cfb128( aes_context *ctx,
                        const unsigned char *input,
                        unsigned char *output )
 {
+    unsigned char ks[AES_BATCH_BLOCKS * 16];
     int c, n = *iv_off;
+    size_t b;
 
-    if( mode == AES_DECRYPT )
+    while( n != 0 && length > 0 )
     {
-        while( length-- )
+        c = *input++;
+        if( mode == AES_DECRYPT )
         {
-            if( n == 0 )
-                aes_crypt_ecb( ctx, AES_ENCRYPT, iv, iv );
-
-            c = *input++;
             *output++ = (unsigned char)( c ^ iv[n] );
             iv[n] = (unsigned char) c;
-
-            n = (n + 1) & 0x0F;
         }
+        else
+            iv[n] = *output++ = (unsigned char)( iv[n] ^ c );
+
+        n = (n + 1) & 0x0F;
+        length--;
     }
-    else
+
+    /* decryption has every feedback block up front: batch them */
+    while( mode == AES_DECRYPT && length >= 16 )
+    {
+        b = ( length < sizeof( ks ) ) ? length & ~(size_t) 15 : sizeof( ks );
+
+        memcpy( ks, iv, 16 );
+        memcpy( ks + 16, input, b - 16 );
+        memcpy( iv, input + b - 16, 16 );
+        aes_crypt_ecb_blocks( ctx, AES_ENCRYPT, b, ks, ks );
+        xor_keystream( output, input, ks, b );
+
+        input  += b;
+        output += b;
+        length -= b;
+    }
+
+    for( ; length >= 16; length -= 16, input += 16, output += 16 )
+    {
+        aes_crypt_ecb( ctx, AES_ENCRYPT, iv, iv );
+        xor_keystream( output, input, iv, 16 );
+        memcpy( iv, output, 16 );
+    }
+
+    if( length > 0 )
     {
+        aes_crypt_ecb( ctx, AES_ENCRYPT, iv, iv );
+
         while( length-- )
         {
-            if( n == 0 )
-                aes_crypt_ecb( ctx, AES_ENCRYPT, iv, iv );
-
-            iv[n] = *output++ = (unsigned char)( iv[n] ^ *input++ );
+            c = *input++;
+            if( mode == AES_DECRYPT )
+            {
+                *output++ = (unsigned char)( c ^ iv[n] );
+                iv[n] = (unsigned char) c;
+            }
+            else
+                iv[n] = *output++ = (unsigned char)( iv[n] ^ c );
 
-            n = (n + 1) & 0x0F;
+            n++;
         }
     }
 
@@ -863,41 +1102,103 @@ int aes_crypt_cfb128( aes_context *ctx,
 #endif /*POLARSSL_CIPHER_MODE_CFB */
 
 #if defined(POLARSSL_CIPHER_MODE_CTR)
+/*
+ * Increment a 128-bit big-endian counter block
+ */
+static void aes_ctr_inc( unsigned char counter[16] )
+{
+    int i;
+
+    for( i = 15; i >= 0; i-- )
+        if( ++counter[i] != 0 )
+            break;
+}
+
 /*
  * AES-CTR buffer encryption/decryption
+ *
+ * Keystream for AES_BATCH_BLOCKS counter blocks is generated into a local
+ * buffer and applied with xor_keystream, as is a partial last block;
+ * stream_block and nc_off are only touched for a block the call leaves
+ * unfinished.
  */
 int aes_crypt_ctr( aes_context *ctx,
-                       int length,
+                       size_t length,
                        int *nc_off,
                        unsigned char nonce_counter[16],
                        unsigned char stream_block[16],
                        const unsigned char *input,
                        unsigned char *output )
 {
-    int c, n = *nc_off, i, cb;
+    unsigned char ks[AES_BATCH_BLOCKS * 16];
+    size_t i, n;
+    int c = *nc_off;
 
-    while( length-- )
+    while( c != 0 && length > 0 )
     {
-        if( n == 0 ) {
-            aes_crypt_ecb( ctx, AES_ENCRYPT, nonce_counter, stream_block );
+        *output++ = (unsigned char)( *input++ ^ stream_block[c] );
+        c = (c + 1) & 0x0F;
+        length--;
+    }
 
-            i = 15;
-            do {
-               nonce_counter[i]++;
-               cb = nonce_counter[i] == 0;
-            } while( i-- && cb );
+    while( length >= 16 )
+    {
+        n = ( length < sizeof( ks ) ) ? length & ~(size_t) 15 : sizeof( ks );
 
+        for( i = 0; i < n; i += 16 )
+        {
+            memcpy( ks + i, nonce_counter, 16 );
+            aes_ctr_inc( nonce_counter );
         }
-        c = *input++;
-        *output++ = (unsigned char)( c ^ stream_block[n] );
+        aes_crypt_ecb_blocks( ctx, AES_ENCRYPT, n, ks, ks );
 
-        n = (n + 1) & 0x0F;
+        xor_keystream( output, input, ks, n );
+
+        input  += n;
+        output += n;
+        length -= n;
     }
 
-    *nc_off = n;
+    if( length > 0 )
+    {
+        aes_crypt_ecb( ctx, AES_ENCRYPT, nonce_counter, stream_block );
+        aes_ctr_inc( nonce_counter );
+
+        xor_keystream( output, input, stream_block, length );
+        c = (int) length;
+    }
+
+    *nc_off = c;
 
     return( 0 );
 }
+
+/*
+ * AES-CTR buffer encryption/decryption at an absolute block offset
+ */
+int aes_crypt_ctr_at( aes_context *ctx,
+                       size_t length,
+                       const unsigned char nonce_counter[16],
+                       unsigned long long block_offset,
+                       const unsigned char *input,
+                       unsigned char *output )
+{
+    unsigned char counter[16], stream_block[16];
+    unsigned int c;
+    int i, nc_off = 0;
+
+    /* counter = nonce_counter + block_offset (mod 2^128) */
+    for( c = 0, i = 15; i >= 0; i-- )
+    {
+        c += nonce_counter[i] + (unsigned int)( block_offset & 0xFF );
+        counter[i] = (unsigned char) c;
+        c >>= 8;
+        block_offset >>= 8;
+    }
+
+    return( aes_crypt_ctr( ctx, length, &nc_off, counter, stream_block,
+                           input, output ) );
+}
 #endif /* POLARSSL_CIPHER_MODE_CTR */
 
 #if defined(POLARSSL_SELF_TEST)
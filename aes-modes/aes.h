@@ -28,21 +28,45 @@
 #define POLARSSL_AES_H
 
 #include <string.h>
+#include <stdint.h>
 
 #define AES_ENCRYPT     1
 #define AES_DECRYPT     0
 
+#define AES_BATCH_BLOCKS 8      /**< blocks per aes_crypt_ecb_blocks call in the table modes */
+
 #define POLARSSL_ERR_AES_INVALID_KEY_LENGTH                -0x0020  /**< Invalid key length. */
 #define POLARSSL_ERR_AES_INVALID_INPUT_LENGTH              -0x0022  /**< Invalid data input length. */
+#define POLARSSL_ERR_AES_FEATURE_UNAVAILABLE               -0x0023  /**< Feature not available, e.g. the full tables in a POLARSSL_AES_FEWER_TABLES build. */
+
+#if !defined(ALIGN64)
+# if defined(__GNUC__)
+#  define ALIGN64 __attribute__ ( (aligned (64)))
+# else
+#  define ALIGN64 __declspec (align (64))
+# endif
+#endif
 
 /**
  * \brief          AES context structure
+ *
+ * The round keys are 32-bit words in memory order, which on a little
+ * endian host is byte for byte the AES-NI schedule of the same key (the
+ * decryption schedule is the equivalent inverse cipher in both), so one
+ * expansion serves both backends: pass ni and nr to the aesni.h
+ * functions. Where the CPU has AES-NI the setkey functions expand keys
+ * with it (see aes_setkey_aesni). The context is 256 bytes, cache line
+ * aligned; allocate it with 64-byte alignment when it lives on the heap.
  */
-typedef struct
+typedef struct ALIGN64
 {
+    union
+    {
+        uint32_t rk[60];        /*!<  AES round keys    */
+        unsigned char ni[240];  /*!<  same, as an AES-NI schedule */
+    };
     int nr;                     /*!<  number of rounds  */
-    unsigned long *rk;          /*!<  AES round keys    */
-    unsigned long buf[68];      /*!<  unaligned data    */
+    int compact;                /*!<  use the 1 KiB tables */
 }
 aes_context;
 
@@ -72,6 +96,33 @@ int aes_setkey_enc( aes_context *ctx, const unsigned char *key, unsigned int key
  */
 int aes_setkey_dec( aes_context *ctx, const unsigned char *key, unsigned int keysize );
 
+/**
+ * \brief          Select how aes_setkey_enc and aes_setkey_dec expand
+ *                 keys: with AES-NI (the default when the CPU has it)
+ *                 or with the table code. Both give the same schedule.
+ *                 Not to be called while other threads set keys.
+ *
+ * \param enable   nonzero for AES-NI; ignored without CPU support
+ */
+void aes_setkey_aesni( int enable );
+
+/**
+ * \brief          Select the round table layout for this context
+ *
+ * The default layout has four 256-entry unsigned long tables per
+ * direction (8 KiB each way on LP64). The compact layout has one 32-bit
+ * table per direction (1 KiB) and rotates its entries instead, trading a
+ * few instructions per round for a much smaller L1 footprint. Building
+ * with POLARSSL_AES_FEWER_TABLES leaves only the compact layout.
+ *
+ * \param ctx      AES context, after aes_setkey_enc or aes_setkey_dec
+ *                 (both reset it to the default layout)
+ * \param compact  1 for the compact layout, 0 for the four-table one
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_FEATURE_UNAVAILABLE
+ */
+int aes_set_compact_tables( aes_context *ctx, int compact );
+
 /**
  * \brief          AES-ECB block encryption/decryption
  *
@@ -87,6 +138,27 @@ int aes_crypt_ecb( aes_context *ctx,
                     const unsigned char input[16],
                     unsigned char output[16] );
 
+/**
+ * \brief          AES-ECB buffer encryption/decryption
+ *
+ * Same as aes_crypt_ecb on each 16-byte block in turn, without the
+ * per-call overhead: the mode is checked once and blocks are loaded and
+ * stored as native words. The table modes are built on this.
+ *
+ * \param ctx      AES context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the input data, a multiple of 16
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data (may equal input)
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int aes_crypt_ecb_blocks( aes_context *ctx,
+                           int mode,
+                           size_t length,
+                           const unsigned char *input,
+                           unsigned char *output );
+
 /**
  * \brief          AES-CBC buffer encryption/decryption
  *                 Length should be a multiple of the block
@@ -111,6 +183,9 @@ int aes_crypt_cbc( aes_context *ctx,
 /**
  * \brief          AES-CFB128 buffer encryption/decryption.
  *
+ * Any length may be passed and calls may be chained; whole blocks are
+ * processed a word at a time.
+ *
  * \param ctx      AES context
  * \param mode     AES_ENCRYPT or AES_DECRYPT
  * \param length   length of the input data
@@ -147,12 +222,36 @@ int aes_crypt_cfb128( aes_context *ctx,
  * \return         0 if successful
  */
 int aes_crypt_ctr( aes_context *ctx,
-                       int length,
+                       size_t length,
                        int *nc_off,
                        unsigned char nonce_counter[16],
                        unsigned char stream_block[16],
                        const unsigned char *input,
                        unsigned char *output );
+
+/*
+ * \brief               AES-CTR buffer encryption/decryption at an absolute
+ *                      block offset
+ *
+ * Block i of the call is encrypted with nonce_counter + block_offset + i,
+ * carried over all 128 bits. Nothing is updated, so disjoint ranges of one
+ * message can be processed separately (e.g. one per thread) and still
+ * match a single pass from block 0.
+ *
+ * \param length        The length of the data
+ * \param nonce_counter The 128-bit nonce and counter of block 0
+ * \param block_offset  Index of the first block of input in the message
+ * \param input         The input data stream
+ * \param output        The output data stream
+ *
+ * \return         0 if successful
+ */
+int aes_crypt_ctr_at( aes_context *ctx,
+                       size_t length,
+                       const unsigned char nonce_counter[16],
+                       unsigned long long block_offset,
+                       const unsigned char *input,
+                       unsigned char *output );
 /**
  * \brief          Checkup routine
  *
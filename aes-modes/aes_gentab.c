@@ -0,0 +1,72 @@
+/*
+ *  AES table generator
+ *
+ *  Builds aes.c with its run-time table code and prints the tables that
+ *  code computes as constant arrays. The Makefile writes the output to
+ *  aes_tables.h, which the default build of aes.c includes, so no table
+ *  is computed when the library runs.
+ */
+
+#define POLARSSL_AES_RUNTIME_TABLES
+#include "aes.c"
+
+#include <stdio.h>
+
+static void print_bytes( const char *name, const unsigned char *t, int n )
+{
+    int i;
+
+    printf( "static const unsigned char %s[%d] =\n{", name, n );
+    for( i = 0; i < n; i++ )
+        printf( "%s0x%02X%s", ( i % 8 ) ? " " : "\n    ", t[i], ( i < n - 1 ) ? "," : "" );
+    printf( "\n};\n\n" );
+}
+
+static void print_words( const char *name, const unsigned long *t, int n )
+{
+    int i;
+
+    printf( "static const unsigned long %s[%d] =\n{", name, n );
+    for( i = 0; i < n; i++ )
+        printf( "%s0x%08lX%s", ( i % 4 ) ? " " : "\n    ", t[i], ( i < n - 1 ) ? "," : "" );
+    printf( "\n};\n\n" );
+}
+
+static void print_words32( const char *name, const uint32_t *t, int n )
+{
+    int i;
+
+    printf( "static const uint32_t %s[%d] =\n{", name, n );
+    for( i = 0; i < n; i++ )
+        printf( "%s0x%08lX%s", ( i % 4 ) ? " " : "\n    ", (unsigned long) t[i], ( i < n - 1 ) ? "," : "" );
+    printf( "\n};\n\n" );
+}
+
+int main( void )
+{
+    aes_gen_tables();
+
+    printf( "/*\n * Generated by aes_gentab, do not edit\n */\n\n" );
+
+    print_bytes( "FSb", FSb, 256 );
+    print_bytes( "RSb", RSb, 256 );
+
+    print_words32( "FT32", FT32, 256 );
+    print_words32( "RT32", RT32, 256 );
+
+    printf( "#if !defined(POLARSSL_AES_FEWER_TABLES)\n\n" );
+    print_words( "FT0", FT0, 256 );
+    print_words( "FT1", FT1, 256 );
+    print_words( "FT2", FT2, 256 );
+    print_words( "FT3", FT3, 256 );
+
+    print_words( "RT0", RT0, 256 );
+    print_words( "RT1", RT1, 256 );
+    print_words( "RT2", RT2, 256 );
+    print_words( "RT3", RT3, 256 );
+    printf( "#endif\n\n" );
+
+    print_words( "RCON", RCON, 10 );
+
+    return( 0 );
+}
@@ -0,0 +1,619 @@
+/*
+ *  Bitsliced constant-time AES
+ *
+ *  The representation follows Käsper and Schwabe ("Faster and
+ *  Timing-Attack Resistant AES-GCM", CHES 2009) as laid out in BearSSL's
+ *  64-bit "ct64" code: q[0..7] hold bit 0..7 of every state byte of 4
+ *  blocks, 16 bits per block-row in each 64-bit word. Here each q[i] is
+ *  an SSE register whose two 64-bit lanes carry two such groups, so one
+ *  pass covers 8 blocks. SubBytes is the Boyar-Peralta circuit (113
+ *  gates), ShiftRows is masks and shifts, MixColumns is rotations.
+ */
+
+#include "aesbs.h"
+#include "xor.h"
+
+#define XOR(a,b)    _mm_xor_si128( (a), (b) )
+#define AND(a,b)    _mm_and_si128( (a), (b) )
+#define OR(a,b)     _mm_or_si128( (a), (b) )
+#define XNOR(a,b)   _mm_xor_si128( _mm_xor_si128( (a), (b) ), ONES )
+#define C64(x)      _mm_set1_epi64x( (long long)(x) )
+
+/* 64-bit rotations used by MixColumns */
+#define ROTR16(x)   _mm_shufflehi_epi16( _mm_shufflelo_epi16( (x), 0x39 ), 0x39 )
+#define ROTR32(x)   _mm_shuffle_epi32( (x), 0xB1 )
+
+/*
+ * SubBytes: Boyar and Peralta, "A new combinational logic minimization
+ * technique with applications to cryptology". x0 is the high bit.
+ */
+static inline void bs_sbox( __m128i *q )
+{
+    const __m128i ONES = _mm_set1_epi32( -1 );
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7;
+    __m128i y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+    __m128i y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    __m128i z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    __m128i z10, z11, z12, z13, z14, z15, z16, z17;
+    __m128i t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    __m128i t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    __m128i t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    __m128i t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    __m128i t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    __m128i t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    __m128i t60, t61, t62, t63, t64, t65, t66, t67;
+
+    x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+    x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+    /* top linear transformation */
+    y14 = XOR( x3, x5 );
+    y13 = XOR( x0, x6 );
+    y9  = XOR( x0, x3 );
+    y8  = XOR( x0, x5 );
+    t0  = XOR( x1, x2 );
+    y1  = XOR( t0, x7 );
+    y4  = XOR( y1, x3 );
+    y12 = XOR( y13, y14 );
+    y2  = XOR( y1, x0 );
+    y5  = XOR( y1, x6 );
+    y3  = XOR( y5, y8 );
+    t1  = XOR( x4, y12 );
+    y15 = XOR( t1, x5 );
+    y20 = XOR( t1, x1 );
+    y6  = XOR( y15, x7 );
+    y10 = XOR( y15, t0 );
+    y11 = XOR( y20, y9 );
+    y7  = XOR( x7, y11 );
+    y17 = XOR( y10, y11 );
+    y19 = XOR( y10, y8 );
+    y16 = XOR( t0, y11 );
+    y21 = XOR( y13, y16 );
+    y18 = XOR( x0, y16 );
+
+    /* non-linear section */
+    t2  = AND( y12, y15 );
+    t3  = AND( y3, y6 );
+    t4  = XOR( t3, t2 );
+    t5  = AND( y4, x7 );
+    t6  = XOR( t5, t2 );
+    t7  = AND( y13, y16 );
+    t8  = AND( y5, y1 );
+    t9  = XOR( t8, t7 );
+    t10 = AND( y2, y7 );
+    t11 = XOR( t10, t7 );
+    t12 = AND( y9, y11 );
+    t13 = AND( y14, y17 );
+    t14 = XOR( t13, t12 );
+    t15 = AND( y8, y10 );
+    t16 = XOR( t15, t12 );
+    t17 = XOR( t4, t14 );
+    t18 = XOR( t6, t16 );
+    t19 = XOR( t9, t14 );
+    t20 = XOR( t11, t16 );
+    t21 = XOR( t17, y20 );
+    t22 = XOR( t18, y19 );
+    t23 = XOR( t19, y21 );
+    t24 = XOR( t20, y18 );
+
+    t25 = XOR( t21, t22 );
+    t26 = AND( t21, t23 );
+    t27 = XOR( t24, t26 );
+    t28 = AND( t25, t27 );
+    t29 = XOR( t28, t22 );
+    t30 = XOR( t23, t24 );
+    t31 = XOR( t22, t26 );
+    t32 = AND( t31, t30 );
+    t33 = XOR( t32, t24 );
+    t34 = XOR( t23, t33 );
+    t35 = XOR( t27, t33 );
+    t36 = AND( t24, t35 );
+    t37 = XOR( t36, t34 );
+    t38 = XOR( t27, t36 );
+    t39 = AND( t29, t38 );
+    t40 = XOR( t25, t39 );
+
+    t41 = XOR( t40, t37 );
+    t42 = XOR( t29, t33 );
+    t43 = XOR( t29, t40 );
+    t44 = XOR( t33, t37 );
+    t45 = XOR( t42, t41 );
+    z0  = AND( t44, y15 );
+    z1  = AND( t37, y6 );
+    z2  = AND( t33, x7 );
+    z3  = AND( t43, y16 );
+    z4  = AND( t40, y1 );
+    z5  = AND( t29, y7 );
+    z6  = AND( t42, y11 );
+    z7  = AND( t45, y17 );
+    z8  = AND( t41, y10 );
+    z9  = AND( t44, y12 );
+    z10 = AND( t37, y3 );
+    z11 = AND( t33, y4 );
+    z12 = AND( t43, y13 );
+    z13 = AND( t40, y5 );
+    z14 = AND( t29, y2 );
+    z15 = AND( t42, y9 );
+    z16 = AND( t45, y14 );
+    z17 = AND( t41, y8 );
+
+    /* bottom linear transformation */
+    t46 = XOR( z15, z16 );
+    t47 = XOR( z10, z11 );
+    t48 = XOR( z5, z13 );
+    t49 = XOR( z9, z10 );
+    t50 = XOR( z2, z12 );
+    t51 = XOR( z2, z5 );
+    t52 = XOR( z7, z8 );
+    t53 = XOR( z0, z3 );
+    t54 = XOR( z6, z7 );
+    t55 = XOR( z16, z17 );
+    t56 = XOR( z12, t48 );
+    t57 = XOR( t50, t53 );
+    t58 = XOR( z4, t46 );
+    t59 = XOR( z3, t54 );
+    t60 = XOR( t46, t57 );
+    t61 = XOR( z14, t57 );
+    t62 = XOR( t52, t58 );
+    t63 = XOR( t49, t58 );
+    t64 = XOR( z4, t59 );
+    t65 = XOR( t61, t62 );
+    t66 = XOR( z1, t63 );
+    t67 = XOR( t64, t65 );
+
+    q[7] = XOR( t59, t63 );
+    q[1] = XNOR( t56, t62 );
+    q[0] = XNOR( t48, t60 );
+    q[4] = XOR( t53, t66 );
+    q[3] = XOR( t51, t66 );
+    q[2] = XOR( t47, t65 );
+    q[6] = XNOR( t64, q[4] );
+    q[5] = XNOR( t55, t67 );
+}
+
+/*
+ * InvSubBytes = L o SubBytes o L, with L the inverse affine map
+ */
+static inline void bs_inv_affine( __m128i *q )
+{
+    const __m128i ONES = _mm_set1_epi32( -1 );
+    __m128i q0, q1, q2, q3, q4, q5, q6, q7;
+
+    q0 = XOR( q[0], ONES );
+    q1 = XOR( q[1], ONES );
+    q2 = q[2];
+    q3 = q[3];
+    q4 = q[4];
+    q5 = XOR( q[5], ONES );
+    q6 = XOR( q[6], ONES );
+    q7 = q[7];
+    q[7] = XOR( XOR( q1, q4 ), q6 );
+    q[6] = XOR( XOR( q0, q3 ), q5 );
+    q[5] = XOR( XOR( q7, q2 ), q4 );
+    q[4] = XOR( XOR( q6, q1 ), q3 );
+    q[3] = XOR( XOR( q5, q0 ), q2 );
+    q[2] = XOR( XOR( q4, q7 ), q1 );
+    q[1] = XOR( XOR( q3, q6 ), q0 );
+    q[0] = XOR( XOR( q2, q5 ), q7 );
+}
+
+static inline void bs_inv_sbox( __m128i *q )
+{
+    bs_inv_affine( q );
+    bs_sbox( q );
+    bs_inv_affine( q );
+}
+
+/*
+ * Transpose between the byte layout and the bit planes (3 rounds of
+ * swaps between registers)
+ */
+#define SWAPN(cl, ch, s, x, y)   do {                                   \
+    __m128i a_ = (x), b_ = (y);                                         \
+    (x) = OR( AND( a_, C64(cl) ), _mm_slli_epi64( AND( b_, C64(cl) ), (s) ) ); \
+    (y) = OR( _mm_srli_epi64( AND( a_, C64(ch) ), (s) ), AND( b_, C64(ch) ) ); \
+} while( 0 )
+
+#define SWAP2(x, y)  SWAPN( 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, x, y )
+#define SWAP4(x, y)  SWAPN( 0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, x, y )
+#define SWAP8(x, y)  SWAPN( 0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, x, y )
+
+static inline void bs_ortho( __m128i *q )
+{
+    SWAP2( q[0], q[1] );
+    SWAP2( q[2], q[3] );
+    SWAP2( q[4], q[5] );
+    SWAP2( q[6], q[7] );
+
+    SWAP4( q[0], q[2] );
+    SWAP4( q[1], q[3] );
+    SWAP4( q[4], q[6] );
+    SWAP4( q[5], q[7] );
+
+    SWAP8( q[0], q[4] );
+    SWAP8( q[1], q[5] );
+    SWAP8( q[2], q[6] );
+    SWAP8( q[3], q[7] );
+}
+
+/*
+ * Spread the 32-bit words of block a (low lane) and block b (high lane)
+ * so that ortho() can transpose them
+ */
+static inline void bs_interleave_in( __m128i *q0, __m128i *q1, __m128i a, __m128i b )
+{
+    const __m128i M32 = C64( 0x00000000FFFFFFFFULL );
+    const __m128i M16 = C64( 0x0000FFFF0000FFFFULL );
+    const __m128i M8  = C64( 0x00FF00FF00FF00FFULL );
+    __m128i lo = _mm_unpacklo_epi64( a, b ), hi = _mm_unpackhi_epi64( a, b );
+    __m128i x0, x1, x2, x3;
+
+    x0 = AND( lo, M32 );
+    x1 = _mm_srli_epi64( lo, 32 );
+    x2 = AND( hi, M32 );
+    x3 = _mm_srli_epi64( hi, 32 );
+    x0 = AND( OR( x0, _mm_slli_epi64( x0, 16 ) ), M16 );
+    x1 = AND( OR( x1, _mm_slli_epi64( x1, 16 ) ), M16 );
+    x2 = AND( OR( x2, _mm_slli_epi64( x2, 16 ) ), M16 );
+    x3 = AND( OR( x3, _mm_slli_epi64( x3, 16 ) ), M16 );
+    x0 = AND( OR( x0, _mm_slli_epi64( x0, 8 ) ), M8 );
+    x1 = AND( OR( x1, _mm_slli_epi64( x1, 8 ) ), M8 );
+    x2 = AND( OR( x2, _mm_slli_epi64( x2, 8 ) ), M8 );
+    x3 = AND( OR( x3, _mm_slli_epi64( x3, 8 ) ), M8 );
+    *q0 = OR( x0, _mm_slli_epi64( x2, 8 ) );
+    *q1 = OR( x1, _mm_slli_epi64( x3, 8 ) );
+}
+
+static inline void bs_interleave_out( __m128i *a, __m128i *b, __m128i q0, __m128i q1 )
+{
+    const __m128i M32 = C64( 0x00000000FFFFFFFFULL );
+    const __m128i M16 = C64( 0x0000FFFF0000FFFFULL );
+    const __m128i M8  = C64( 0x00FF00FF00FF00FFULL );
+    __m128i x0, x1, x2, x3, lo, hi;
+
+    x0 = AND( q0, M8 );
+    x1 = AND( q1, M8 );
+    x2 = AND( _mm_srli_epi64( q0, 8 ), M8 );
+    x3 = AND( _mm_srli_epi64( q1, 8 ), M8 );
+    x0 = AND( OR( x0, _mm_srli_epi64( x0, 8 ) ), M16 );
+    x1 = AND( OR( x1, _mm_srli_epi64( x1, 8 ) ), M16 );
+    x2 = AND( OR( x2, _mm_srli_epi64( x2, 8 ) ), M16 );
+    x3 = AND( OR( x3, _mm_srli_epi64( x3, 8 ) ), M16 );
+    x0 = AND( OR( x0, _mm_srli_epi64( x0, 16 ) ), M32 );
+    x1 = AND( OR( x1, _mm_srli_epi64( x1, 16 ) ), M32 );
+    x2 = AND( OR( x2, _mm_srli_epi64( x2, 16 ) ), M32 );
+    x3 = AND( OR( x3, _mm_srli_epi64( x3, 16 ) ), M32 );
+    lo = OR( x0, _mm_slli_epi64( x1, 32 ) );
+    hi = OR( x2, _mm_slli_epi64( x3, 32 ) );
+    *a = _mm_unpacklo_epi64( lo, hi );
+    *b = _mm_unpackhi_epi64( lo, hi );
+}
+
+static inline void bs_load( __m128i *q, const unsigned char *in )
+{
+    int i;
+
+    for( i = 0; i < 4; i++ )
+        bs_interleave_in( &q[i], &q[i + 4],
+                          _mm_loadu_si128( (const __m128i *) in + i ),
+                          _mm_loadu_si128( (const __m128i *) in + i + 4 ) );
+    bs_ortho( q );
+}
+
+static inline void bs_store( unsigned char *out, __m128i *q )
+{
+    __m128i a, b;
+    int i;
+
+    bs_ortho( q );
+    for( i = 0; i < 4; i++ )
+    {
+        bs_interleave_out( &a, &b, q[i], q[i + 4] );
+        _mm_storeu_si128( (__m128i *) out + i, a );
+        _mm_storeu_si128( (__m128i *) out + i + 4, b );
+    }
+}
+
+static inline void bs_add_round_key( __m128i *q, const __m128i *sk )
+{
+    q[0] = XOR( q[0], sk[0] ); q[1] = XOR( q[1], sk[1] );
+    q[2] = XOR( q[2], sk[2] ); q[3] = XOR( q[3], sk[3] );
+    q[4] = XOR( q[4], sk[4] ); q[5] = XOR( q[5], sk[5] );
+    q[6] = XOR( q[6], sk[6] ); q[7] = XOR( q[7], sk[7] );
+}
+
+static inline void bs_shift_rows( __m128i *q )
+{
+    __m128i x;
+    int i;
+
+    for( i = 0; i < 8; i++ )
+    {
+        x = q[i];
+        q[i] = OR( OR( OR( AND( x, C64( 0x000000000000FFFFULL ) ),
+                           _mm_srli_epi64( AND( x, C64( 0x00000000FFF00000ULL ) ), 4 ) ),
+                       OR( _mm_slli_epi64( AND( x, C64( 0x00000000000F0000ULL ) ), 12 ),
+                           _mm_srli_epi64( AND( x, C64( 0x0000FF0000000000ULL ) ), 8 ) ) ),
+                   OR( OR( _mm_slli_epi64( AND( x, C64( 0x000000FF00000000ULL ) ), 8 ),
+                           _mm_srli_epi64( AND( x, C64( 0xF000000000000000ULL ) ), 12 ) ),
+                       _mm_slli_epi64( AND( x, C64( 0x0FFF000000000000ULL ) ), 4 ) ) );
+    }
+}
+
+static inline void bs_inv_shift_rows( __m128i *q )
+{
+    __m128i x;
+    int i;
+
+    for( i = 0; i < 8; i++ )
+    {
+        x = q[i];
+        q[i] = OR( OR( OR( AND( x, C64( 0x000000000000FFFFULL ) ),
+                           _mm_slli_epi64( AND( x, C64( 0x000000000FFF0000ULL ) ), 4 ) ),
+                       OR( _mm_srli_epi64( AND( x, C64( 0x00000000F0000000ULL ) ), 12 ),
+                           _mm_slli_epi64( AND( x, C64( 0x000000FF00000000ULL ) ), 8 ) ) ),
+                   OR( OR( _mm_srli_epi64( AND( x, C64( 0x0000FF0000000000ULL ) ), 8 ),
+                           _mm_slli_epi64( AND( x, C64( 0x000F000000000000ULL ) ), 12 ) ),
+                       _mm_srli_epi64( AND( x, C64( 0xFFF0000000000000ULL ) ), 4 ) ) );
+    }
+}
+
+static inline void bs_mix_columns( __m128i *q )
+{
+    __m128i q0, q1, q2, q3, q4, q5, q6, q7;
+    __m128i r0, r1, r2, r3, r4, r5, r6, r7;
+
+    q0 = q[0]; q1 = q[1]; q2 = q[2]; q3 = q[3];
+    q4 = q[4]; q5 = q[5]; q6 = q[6]; q7 = q[7];
+    r0 = ROTR16( q0 ); r1 = ROTR16( q1 ); r2 = ROTR16( q2 ); r3 = ROTR16( q3 );
+    r4 = ROTR16( q4 ); r5 = ROTR16( q5 ); r6 = ROTR16( q6 ); r7 = ROTR16( q7 );
+
+    q[0] = XOR( XOR( q7, r7 ), XOR( r0, ROTR32( XOR( q0, r0 ) ) ) );
+    q[1] = XOR( XOR( XOR( q0, r0 ), XOR( q7, r7 ) ), XOR( r1, ROTR32( XOR( q1, r1 ) ) ) );
+    q[2] = XOR( XOR( q1, r1 ), XOR( r2, ROTR32( XOR( q2, r2 ) ) ) );
+    q[3] = XOR( XOR( XOR( q2, r2 ), XOR( q7, r7 ) ), XOR( r3, ROTR32( XOR( q3, r3 ) ) ) );
+    q[4] = XOR( XOR( XOR( q3, r3 ), XOR( q7, r7 ) ), XOR( r4, ROTR32( XOR( q4, r4 ) ) ) );
+    q[5] = XOR( XOR( q4, r4 ), XOR( r5, ROTR32( XOR( q5, r5 ) ) ) );
+    q[6] = XOR( XOR( q5, r5 ), XOR( r6, ROTR32( XOR( q6, r6 ) ) ) );
+    q[7] = XOR( XOR( q6, r6 ), XOR( r7, ROTR32( XOR( q7, r7 ) ) ) );
+}
+
+/*
+ * InvMixColumns = MixColumns o (column * {05} + rotated column * {04}),
+ * i.e. the {0e 0b 0d 09} circulant factors as {02 03 01 01} x {05 00 04 00}
+ */
+static inline void bs_inv_mix_columns( __m128i *q )
+{
+    __m128i q0, q1, q2, q3, q4, q5, q6, q7;
+    __m128i s0, s1, s2, s3, s4, s5, s6, s7;
+
+    /* s = q ^ rot2(q), then q ^= {04} * s */
+    q0 = q[0]; q1 = q[1]; q2 = q[2]; q3 = q[3];
+    q4 = q[4]; q5 = q[5]; q6 = q[6]; q7 = q[7];
+    s0 = XOR( q0, ROTR32( q0 ) ); s1 = XOR( q1, ROTR32( q1 ) );
+    s2 = XOR( q2, ROTR32( q2 ) ); s3 = XOR( q3, ROTR32( q3 ) );
+    s4 = XOR( q4, ROTR32( q4 ) ); s5 = XOR( q5, ROTR32( q5 ) );
+    s6 = XOR( q6, ROTR32( q6 ) ); s7 = XOR( q7, ROTR32( q7 ) );
+
+    /* {04} * s: bit i of the product is s[i-2] plus the x^8 reductions */
+    q[0] = XOR( q0, s6 );
+    q[1] = XOR( q1, XOR( s6, s7 ) );
+    q[2] = XOR( q2, XOR( s0, s7 ) );
+    q[3] = XOR( q3, XOR( s1, s6 ) );
+    q[4] = XOR( q4, XOR( XOR( s2, s6 ), s7 ) );
+    q[5] = XOR( q5, XOR( s3, s7 ) );
+    q[6] = XOR( q6, s4 );
+    q[7] = XOR( q7, s5 );
+
+    bs_mix_columns( q );
+}
+
+static void bs_encrypt( const aesbs_context *ctx, __m128i *q )
+{
+    int r;
+
+    bs_add_round_key( q, ctx->sk );
+    for( r = 1; r < ctx->nr; r++ )
+    {
+        bs_sbox( q );
+        bs_shift_rows( q );
+        bs_mix_columns( q );
+        bs_add_round_key( q, ctx->sk + 8 * r );
+    }
+    bs_sbox( q );
+    bs_shift_rows( q );
+    bs_add_round_key( q, ctx->sk + 8 * r );
+}
+
+static void bs_decrypt( const aesbs_context *ctx, __m128i *q )
+{
+    int r;
+
+    bs_add_round_key( q, ctx->sk + 8 * ctx->nr );
+    for( r = ctx->nr - 1; r > 0; r-- )
+    {
+        bs_inv_shift_rows( q );
+        bs_inv_sbox( q );
+        bs_add_round_key( q, ctx->sk + 8 * r );
+        bs_inv_mix_columns( q );
+    }
+    bs_inv_shift_rows( q );
+    bs_inv_sbox( q );
+    bs_add_round_key( q, ctx->sk );
+}
+
+/*
+ * Encrypt/decrypt 8 blocks in place
+ */
+static void aesbs_crypt8( const aesbs_context *ctx, int mode, unsigned char buf[128] )
+{
+    __m128i q[8];
+
+    bs_load( q, buf );
+    if( mode == AES_DECRYPT )
+        bs_decrypt( ctx, q );
+    else
+        bs_encrypt( ctx, q );
+    bs_store( buf, q );
+}
+
+/*
+ * Round keys from the regular key schedule, each broadcast to all 8
+ * block slots and bitsliced
+ */
+int aesbs_setkey( aesbs_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    aes_context tmp;
+    __m128i rk;
+    int r, i, ret;
+
+    if( ( ret = aes_setkey_enc( &tmp, key, keysize ) ) != 0 )
+        return( ret );
+
+    ctx->nr = tmp.nr;
+    for( r = 0; r <= ctx->nr; r++ )
+    {
+        rk = _mm_set_epi32( (int) tmp.rk[4 * r + 3], (int) tmp.rk[4 * r + 2],
+                            (int) tmp.rk[4 * r + 1], (int) tmp.rk[4 * r] );
+        for( i = 0; i < 4; i++ )
+            bs_interleave_in( &ctx->sk[8 * r + i], &ctx->sk[8 * r + i + 4], rk, rk );
+        bs_ortho( ctx->sk + 8 * r );
+    }
+
+    memset( &tmp, 0, sizeof( tmp ) );
+
+    return( 0 );
+}
+
+int aesbs_crypt_ecb( aesbs_context *ctx,
+                     int mode,
+                     size_t length,
+                     const unsigned char *input,
+                     unsigned char *output )
+{
+    unsigned char buf[128];
+    __m128i q[8];
+
+    if( length % 16 )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    for( ; length >= 128; length -= 128, input += 128, output += 128 )
+    {
+        bs_load( q, input );
+        if( mode == AES_DECRYPT )
+            bs_decrypt( ctx, q );
+        else
+            bs_encrypt( ctx, q );
+        bs_store( output, q );
+    }
+
+    if( length > 0 )
+    {
+        memset( buf, 0, sizeof( buf ) );
+        memcpy( buf, input, length );
+        aesbs_crypt8( ctx, mode, buf );
+        memcpy( output, buf, length );
+    }
+
+    return( 0 );
+}
+
+int aesbs_crypt_cbc( aesbs_context *ctx,
+                     int mode,
+                     size_t length,
+                     unsigned char iv[16],
+                     const unsigned char *input,
+                     unsigned char *output )
+{
+    unsigned char buf[128];
+    unsigned char last[16];
+    size_t n, i;
+
+    if( length % 16 )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    if( mode == AES_ENCRYPT )
+    {
+        memset( buf, 0, sizeof( buf ) );
+        for( ; length > 0; length -= 16, input += 16, output += 16 )
+        {
+            for( i = 0; i < 16; i++ )
+                buf[i] = input[i] ^ iv[i];
+            aesbs_crypt8( ctx, AES_ENCRYPT, buf );
+            memcpy( output, buf, 16 );
+            memcpy( iv, buf, 16 );
+        }
+        return( 0 );
+    }
+
+    while( length > 0 )
+    {
+        n = ( length < 128 ) ? length : 128;
+
+        memset( buf, 0, sizeof( buf ) );
+        memcpy( buf, input, n );
+        memcpy( last, input + n - 16, 16 );
+        aesbs_crypt8( ctx, AES_DECRYPT, buf );
+
+        /* input may alias output: chain from the saved ciphertext */
+        for( i = n; i-- > 16; )
+            output[i] = buf[i] ^ input[i - 16];
+        for( i = 0; i < 16; i++ )
+            output[i] = buf[i] ^ iv[i];
+
+        memcpy( iv, last, 16 );
+        input += n;
+        output += n;
+        length -= n;
+    }
+
+    return( 0 );
+}
+
+int aesbs_crypt_ctr( aesbs_context *ctx,
+                     size_t length,
+                     const unsigned char nonce_counter[16],
+                     unsigned long long block_offset,
+                     const unsigned char *input,
+                     unsigned char *output )
+{
+    unsigned char buf[128];
+    unsigned char counter[16];
+    unsigned int c;
+    size_t n, i;
+    int j, cb;
+
+    /* counter = nonce_counter + block_offset (mod 2^128) */
+    for( c = 0, j = 15; j >= 0; j-- )
+    {
+        c += nonce_counter[j] + (unsigned int)( block_offset & 0xFF );
+        counter[j] = (unsigned char) c;
+        c >>= 8;
+        block_offset >>= 8;
+    }
+
+    while( length > 0 )
+    {
+        for( i = 0; i < 8; i++ )
+        {
+            memcpy( buf + 16 * i, counter, 16 );
+
+            j = 15;
+            do {
+               counter[j]++;
+               cb = counter[j] == 0;
+            } while( j-- && cb );
+        }
+
+        aesbs_crypt8( ctx, AES_ENCRYPT, buf );
+
+        n = ( length < 128 ) ? length : 128;
+        xor_keystream( output, input, buf, n );
+
+        input += n;
+        output += n;
+        length -= n;
+    }
+
+    return( 0 );
+}
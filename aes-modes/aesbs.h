@@ -0,0 +1,105 @@
+/**
+ * \file aesbs.h
+ *
+ * \brief Bitsliced, constant-time AES on SSE2 (8 blocks per pass)
+ *
+ * No table lookups and no data-dependent branches or addresses, so it
+ * does not leak through the cache where AES-NI is unavailable. Every
+ * call works on groups of 8 blocks; shorter inputs cost a full group.
+ */
+#ifndef POLARSSL_AESBS_H
+#define POLARSSL_AESBS_H
+
+#include <string.h>
+#include <emmintrin.h>
+
+#include "aes.h"
+
+/**
+ * \brief          Bitsliced AES context structure
+ */
+typedef struct
+{
+    int nr;                     /*!<  number of rounds                      */
+    __m128i sk[15 * 8];         /*!<  round keys, bitsliced, 8 per round    */
+}
+aesbs_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Bitsliced AES key schedule (both directions)
+ *
+ * \param ctx      context to be initialized
+ * \param key      key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int aesbs_setkey( aesbs_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          AES-ECB buffer encryption/decryption
+ *
+ * \param ctx      context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the input data, a multiple of 16
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int aesbs_crypt_ecb( aesbs_context *ctx,
+                     int mode,
+                     size_t length,
+                     const unsigned char *input,
+                     unsigned char *output );
+
+/**
+ * \brief          AES-CBC buffer encryption/decryption. Decryption runs
+ *                 8 blocks per pass; encryption is inherently serial and
+ *                 costs a full pass per block.
+ *
+ * \param ctx      context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the input data, a multiple of 16
+ * \param iv       initialization vector (updated after use)
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int aesbs_crypt_cbc( aesbs_context *ctx,
+                     int mode,
+                     size_t length,
+                     unsigned char iv[16],
+                     const unsigned char *input,
+                     unsigned char *output );
+
+/**
+ * \brief          AES-CTR at an absolute block offset, same counter
+ *                 semantics as aes_crypt_ctr_at
+ *
+ * \param ctx           context
+ * \param length        The length of the data
+ * \param nonce_counter The 128-bit nonce and counter of block 0
+ * \param block_offset  Index of the first block of input in the message
+ * \param input         The input data stream
+ * \param output        The output data stream
+ *
+ * \return         0 if successful
+ */
+int aesbs_crypt_ctr( aesbs_context *ctx,
+                     size_t length,
+                     const unsigned char nonce_counter[16],
+                     unsigned long long block_offset,
+                     const unsigned char *input,
+                     unsigned char *output );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* aesbs.h */
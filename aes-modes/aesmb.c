@@ -0,0 +1,395 @@
+/*
+ *  Multi-buffer job manager for independent AES-NI streams
+ *
+ *  Every pass takes one block from each occupied lane (the next CBC
+ *  input xored into the chain, the next counter block, or the next CMAC
+ *  block), encrypts them side by side under their own schedules with the
+ *  4- or 8-block kernel, and writes the results back. A CMAC job spends
+ *  its first pass on E(0), from which its subkeys and last block follow,
+ *  so subkey generation is interleaved with the other lanes as well.
+ */
+
+#include "aesmb.h"
+#include "cmac.h"
+#include "xor.h"
+
+#define BSWAP_MASK  _mm_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
+
+/*
+ * CMAC message blocks, counting the padded block of an empty message
+ */
+static size_t aesmb_cmac_blocks( size_t length )
+{
+    return( length == 0 ? 1 : ( length + 15 ) / 16 );
+}
+
+/*
+ * 128-bit increment of a byte-reversed counter block
+ */
+static inline __m128i aesmb_ctr_inc( __m128i c )
+{
+    c = _mm_add_epi64( c, _mm_set_epi64x( 0, 1 ) );
+    if( _mm_testz_si128( c, _mm_set_epi64x( 0, -1 ) ) )
+        c = _mm_add_epi64( c, _mm_set_epi64x( 1, 0 ) );
+
+    return( c );
+}
+
+/*
+ * CMAC subkeys from L = E(0), and the last block from them
+ */
+static void aesmb_cmac_last( aesmb_job *job, __m128i L )
+{
+    unsigned char k1[16], k2[16];
+    size_t n = aesmb_cmac_blocks( job->length ) - 1;
+
+    _mm_storeu_si128( (__m128i *) k1, L );
+    cmac_dbl( k1, k1 );
+    cmac_dbl( k2, k1 );
+
+    cmac_last( k1, k2, job->in + 16 * n, job->length - 16 * n, job->last );
+
+    memset( k1, 0, 16 );
+    memset( k2, 0, 16 );
+}
+
+static void aesmb_complete( aesmb_manager *mgr, aesmb_job *job )
+{
+    job->status = AESMB_STATUS_COMPLETED;
+    job->next = NULL;
+
+    if( mgr->done_tail != NULL )
+        mgr->done_tail->next = job;
+    else
+        mgr->done_head = job;
+    mgr->done_tail = job;
+}
+
+static aesmb_job *aesmb_pop( aesmb_manager *mgr )
+{
+    aesmb_job *job = mgr->done_head;
+
+    if( job != NULL )
+    {
+        mgr->done_head = job->next;
+        if( mgr->done_head == NULL )
+            mgr->done_tail = NULL;
+        job->next = NULL;
+    }
+
+    return( job );
+}
+
+/*
+ * One block from every occupied lane through one interleaved AES pass
+ */
+static void aesmb_pass( aesmb_manager *mgr )
+{
+    __m128i b[AESMB_LANES], p;
+    const __m128i *k[AESMB_LANES];
+    unsigned char tmp[16];
+    int lane[AESMB_LANES];
+    int i, n = 0;
+
+    for( i = 0; i < mgr->lanes; i++ )
+    {
+        aesmb_job *job = mgr->job[i];
+        size_t off;
+
+        if( job == NULL )
+            continue;
+        off = job->offset;
+
+        switch( job->mode )
+        {
+            case AESMB_CBC_ENCRYPT:
+                b[n] = _mm_xor_si128( mgr->state[i],
+                                      _mm_loadu_si128( (const __m128i *)( job->in + off ) ) );
+                break;
+
+            case AESMB_CTR:
+                b[n] = _mm_shuffle_epi8( mgr->state[i], BSWAP_MASK );
+                break;
+
+            default:
+                if( job->blocks == aesmb_cmac_blocks( job->length ) + 1 )
+                    b[n] = _mm_setzero_si128();
+                else if( job->blocks == 1 )
+                    b[n] = _mm_xor_si128( mgr->state[i],
+                                          _mm_loadu_si128( (const __m128i *) job->last ) );
+                else
+                    b[n] = _mm_xor_si128( mgr->state[i],
+                                          _mm_loadu_si128( (const __m128i *)( job->in + off ) ) );
+                break;
+        }
+
+        k[n] = (const __m128i *) job->key->ni;
+        lane[n++] = i;
+    }
+
+    if( n == 0 )
+        return;
+
+    /*
+     * Unused kernel slots run under any live schedule and are discarded
+     */
+    for( i = n; i < ( n > 4 ? 8 : 4 ); i++ )
+    {
+        b[i] = _mm_setzero_si128();
+        k[i] = k[0];
+    }
+
+    if( n > 4 )
+        AES_encrypt8_keys( b, k, mgr->nr );
+    else
+        AES_encrypt4_keys( b, k, mgr->nr );
+
+    for( i = 0; i < n; i++ )
+    {
+        int l = lane[i];
+        aesmb_job *job = mgr->job[l];
+        size_t off = job->offset, use;
+
+        switch( job->mode )
+        {
+            case AESMB_CBC_ENCRYPT:
+                _mm_storeu_si128( (__m128i *)( job->out + off ), b[i] );
+                mgr->state[l] = b[i];
+                job->offset += 16;
+                break;
+
+            case AESMB_CTR:
+                use = ( job->length - off < 16 ) ? job->length - off : 16;
+                if( use == 16 )
+                {
+                    p = _mm_loadu_si128( (const __m128i *)( job->in + off ) );
+                    _mm_storeu_si128( (__m128i *)( job->out + off ), _mm_xor_si128( b[i], p ) );
+                }
+                else
+                {
+                    _mm_storeu_si128( (__m128i *) tmp, b[i] );
+                    xor_keystream( job->out + off, job->in + off, tmp, use );
+                }
+                mgr->state[l] = aesmb_ctr_inc( mgr->state[l] );
+                job->offset += use;
+                break;
+
+            default:
+                if( job->blocks == aesmb_cmac_blocks( job->length ) + 1 )
+                {
+                    aesmb_cmac_last( job, b[i] );
+                    mgr->state[l] = _mm_setzero_si128();
+                }
+                else
+                {
+                    mgr->state[l] = b[i];
+                    job->offset += 16;
+                }
+                break;
+        }
+
+        if( --job->blocks > 0 )
+            continue;
+
+        if( job->mode == AESMB_CBC_ENCRYPT )
+            _mm_storeu_si128( (__m128i *) job->iv, mgr->state[l] );
+        else if( job->mode == AESMB_CTR )
+            _mm_storeu_si128( (__m128i *) job->iv, _mm_shuffle_epi8( mgr->state[l], BSWAP_MASK ) );
+        else
+        {
+            _mm_storeu_si128( (__m128i *) job->out, mgr->state[l] );
+            memset( job->last, 0, 16 );
+        }
+
+        mgr->job[l] = NULL;
+        mgr->busy--;
+        aesmb_complete( mgr, job );
+    }
+}
+
+/*
+ * `count` passes in which no lane starts or finishes a job: no CMAC E(0)
+ * pass, no last block, every block full. Lane state stays in registers.
+ */
+static void aesmb_stream( aesmb_manager *mgr, size_t count )
+{
+    __m128i b[AESMB_LANES], st[AESMB_LANES];
+    const __m128i *k[AESMB_LANES];
+    const unsigned char *src[AESMB_LANES];
+    unsigned char *dst[AESMB_LANES];
+    int mode[AESMB_LANES], lane[AESMB_LANES];
+    aesmb_job *job;
+    size_t c;
+    int i, n = 0, width;
+
+    for( i = 0; i < mgr->lanes; i++ )
+    {
+        if( ( job = mgr->job[i] ) == NULL )
+            continue;
+
+        k[n] = (const __m128i *) job->key->ni;
+        src[n] = job->in + job->offset;
+        dst[n] = job->out + job->offset;
+        mode[n] = job->mode;
+        st[n] = mgr->state[i];
+        lane[n++] = i;
+    }
+
+    width = ( n > 4 ) ? 8 : 4;
+    for( i = n; i < width; i++ )
+    {
+        b[i] = _mm_setzero_si128();
+        k[i] = k[0];
+    }
+
+    for( c = 0; c < count; c++ )
+    {
+        for( i = 0; i < n; i++ )
+        {
+            if( mode[i] == AESMB_CTR )
+                b[i] = _mm_shuffle_epi8( st[i], BSWAP_MASK );
+            else
+                b[i] = _mm_xor_si128( st[i], _mm_loadu_si128( (const __m128i *) src[i] ) );
+        }
+
+        if( width == 8 )
+            AES_encrypt8_keys( b, k, mgr->nr );
+        else
+            AES_encrypt4_keys( b, k, mgr->nr );
+
+        for( i = 0; i < n; i++ )
+        {
+            if( mode[i] == AESMB_CTR )
+            {
+                b[i] = _mm_xor_si128( b[i], _mm_loadu_si128( (const __m128i *) src[i] ) );
+                st[i] = aesmb_ctr_inc( st[i] );
+            }
+            else
+                st[i] = b[i];
+
+            if( mode[i] != AESMB_CMAC )
+                _mm_storeu_si128( (__m128i *) dst[i], b[i] );
+            src[i] += 16;
+            dst[i] += 16;
+        }
+    }
+
+    for( i = 0; i < n; i++ )
+    {
+        job = mgr->job[lane[i]];
+        job->offset += 16 * count;
+        job->blocks -= count;
+        mgr->state[lane[i]] = st[i];
+    }
+}
+
+/*
+ * Advance the occupied lanes until the shortest job completes. Jobs
+ * start (CMAC E(0)) only on the first pass and end (CMAC masking, CTR
+ * tail) only on the last, so the passes in between take the plain path.
+ */
+static void aesmb_run( aesmb_manager *mgr )
+{
+    size_t steps = 0;
+    int i;
+
+    for( i = 0; i < mgr->lanes; i++ )
+        if( mgr->job[i] != NULL && ( steps == 0 || mgr->job[i]->blocks < steps ) )
+            steps = mgr->job[i]->blocks;
+
+    if( steps == 0 )
+        return;
+
+    aesmb_pass( mgr );
+    if( steps > 2 )
+        aesmb_stream( mgr, steps - 2 );
+    if( steps > 1 )
+        aesmb_pass( mgr );
+}
+
+int aesmb_init( aesmb_manager *mgr, int lanes, unsigned int keysize )
+{
+    if( lanes < 4 || lanes > AESMB_LANES )
+        return( POLARSSL_ERR_AESMB_BAD_INPUT );
+
+    switch( keysize )
+    {
+        case 128: mgr->nr = 10; break;
+        case 192: mgr->nr = 12; break;
+        case 256: mgr->nr = 14; break;
+        default : return( POLARSSL_ERR_AESMB_BAD_INPUT );
+    }
+
+    mgr->lanes = lanes;
+    mgr->busy = 0;
+    memset( mgr->job, 0, sizeof( mgr->job ) );
+    mgr->done_head = mgr->done_tail = NULL;
+
+    return( 0 );
+}
+
+int aesmb_submit( aesmb_manager *mgr, aesmb_job *job, aesmb_job **done )
+{
+    int i;
+
+    *done = NULL;
+
+    if( job->key == NULL || job->key->nr != mgr->nr )
+        return( POLARSSL_ERR_AESMB_BAD_INPUT );
+
+    switch( job->mode )
+    {
+        case AESMB_CBC_ENCRYPT:
+            if( job->length % 16 != 0 )
+                return( POLARSSL_ERR_AESMB_BAD_INPUT );
+            job->blocks = job->length / 16;
+            break;
+
+        case AESMB_CTR:
+            job->blocks = ( job->length + 15 ) / 16;
+            break;
+
+        case AESMB_CMAC:
+            job->blocks = aesmb_cmac_blocks( job->length ) + 1;
+            break;
+
+        default:
+            return( POLARSSL_ERR_AESMB_BAD_INPUT );
+    }
+
+    job->status = AESMB_STATUS_BEING_PROCESSED;
+    job->offset = 0;
+
+    if( job->blocks == 0 )
+        aesmb_complete( mgr, job );
+    else
+    {
+        for( i = 0; mgr->job[i] != NULL; i++ )
+            ;
+
+        mgr->job[i] = job;
+        mgr->busy++;
+
+        if( job->mode == AESMB_CBC_ENCRYPT )
+            mgr->state[i] = _mm_loadu_si128( (const __m128i *) job->iv );
+        else if( job->mode == AESMB_CTR )
+            mgr->state[i] = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *) job->iv ), BSWAP_MASK );
+        else
+            mgr->state[i] = _mm_setzero_si128();
+
+        if( mgr->busy == mgr->lanes )
+            aesmb_run( mgr );
+    }
+
+    *done = aesmb_pop( mgr );
+
+    return( 0 );
+}
+
+aesmb_job *aesmb_flush( aesmb_manager *mgr )
+{
+    if( mgr->done_head == NULL && mgr->busy > 0 )
+        aesmb_run( mgr );
+
+    return( aesmb_pop( mgr ) );
+}
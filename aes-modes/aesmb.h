@@ -0,0 +1,117 @@
+/**
+ * \file aesmb.h
+ *
+ * \brief Multi-buffer job manager for independent AES-NI streams
+ *
+ * A CBC encryption or CMAC chain waits for each block before starting the
+ * next, and a short CTR message is over before the pipeline fills, so one
+ * stream per call leaves the AES unit mostly idle. The manager keeps up
+ * to AESMB_LANES jobs in lanes, each with its own key, mode and IV, and
+ * advances all of them one block per interleaved pass. Jobs are submitted
+ * one at a time; once the lanes are full the manager runs until the
+ * shortest job completes and hands completed jobs back.
+ */
+#ifndef POLARSSL_AESMB_H
+#define POLARSSL_AESMB_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+
+#define AESMB_LANES         8   /**< maximum jobs in flight */
+
+#define AESMB_CBC_ENCRYPT   0
+#define AESMB_CTR           1
+#define AESMB_CMAC          2
+
+#define AESMB_STATUS_BEING_PROCESSED    0
+#define AESMB_STATUS_COMPLETED          1
+
+#define POLARSSL_ERR_AESMB_BAD_INPUT                       -0x0028  /**< Bad input parameters to function. */
+
+/**
+ * \brief          Job structure; the caller owns it until it completes
+ */
+typedef struct aesmb_job
+{
+    const aes_context *key;             /*!<  encryption schedule, all modes */
+    int mode;                           /*!<  AESMB_CBC_ENCRYPT, _CTR, _CMAC */
+    unsigned char iv[16];               /*!<  CBC IV or CTR counter block,
+                                              updated to continue the stream */
+    const unsigned char *in;            /*!<  input data                     */
+    unsigned char *out;                 /*!<  output data, or the CMAC tag   */
+    size_t length;                      /*!<  bytes; a multiple of 16 for CBC */
+    int status;                         /*!<  AESMB_STATUS_*                 */
+    void *user;                         /*!<  caller's data, untouched       */
+
+    size_t blocks;                      /*!<  internal: AES passes left      */
+    size_t offset;                      /*!<  internal: bytes processed      */
+    unsigned char last[16];             /*!<  internal: CMAC last block      */
+    struct aesmb_job *next;             /*!<  internal: completion queue     */
+}
+aesmb_job;
+
+/**
+ * \brief          Manager structure
+ */
+typedef struct
+{
+    int lanes;                          /*!<  lanes in use, 4 to 8       */
+    int nr;                             /*!<  rounds shared by all jobs  */
+    int busy;                           /*!<  occupied lanes             */
+    aesmb_job *job[AESMB_LANES];        /*!<  NULL for a free lane       */
+    __m128i state[AESMB_LANES];         /*!<  chain value or counter     */
+    aesmb_job *done_head;               /*!<  completed, not yet returned */
+    aesmb_job *done_tail;
+}
+aesmb_manager;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Manager initialization
+ *
+ * \param mgr      manager to be initialized
+ * \param lanes    jobs in flight, 4 to AESMB_LANES
+ * \param keysize  128, 192 or 256; every job's key must have this size
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AESMB_BAD_INPUT
+ */
+int aesmb_init( aesmb_manager *mgr, int lanes, unsigned int keysize );
+
+/**
+ * \brief          Hand a job to the manager
+ *
+ *                 The job is placed in a free lane. If that fills the
+ *                 last lane, every lane advances until at least one job
+ *                 completes. A CMAC job writes its 16-byte tag to out.
+ *
+ * \param mgr      manager
+ * \param job      job to process; must stay valid until it is returned
+ * \param done     receives a completed job, or NULL if none is ready
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AESMB_BAD_INPUT
+ *                 (the job was not accepted)
+ */
+int aesmb_submit( aesmb_manager *mgr, aesmb_job *job, aesmb_job **done );
+
+/**
+ * \brief          Return a completed job without waiting for full lanes
+ *
+ *                 Runs the lanes that are occupied until one completes.
+ *                 Call until it returns NULL to drain the manager.
+ *
+ * \param mgr      manager
+ *
+ * \return         a completed job, or NULL when no job is left
+ */
+aesmb_job *aesmb_flush( aesmb_manager *mgr );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* aesmb.h */
@@ -1,4 +1,6 @@
+#include <string.h>
 #include "aesni.h"
+#include "xor.h"
 
 #define cpuid(func,ax,bx,cx,dx)\
 		__asm__ __volatile__ ("cpuid":\
@@ -10,6 +12,121 @@ int CheckAESSupport() {
 	return (c & 0x2000000);
 }
 
+int CheckPCLMULSupport() {
+	unsigned int a,b,c,d;
+	cpuid(1,a,b,c,d);
+	return (c & 0x2);
+}
+
+__m128i AES_128_ASSIST (__m128i temp1, __m128i temp2) {
+	__m128i temp3;
+	temp2 = _mm_shuffle_epi32 (temp2 ,0xff);
+	temp3 = _mm_slli_si128 (temp1, 0x4);
+	temp1 = _mm_xor_si128 (temp1, temp3);
+	temp3 = _mm_slli_si128 (temp3, 0x4);
+	temp1 = _mm_xor_si128 (temp1, temp3);
+	temp3 = _mm_slli_si128 (temp3, 0x4);
+	temp1 = _mm_xor_si128 (temp1, temp3);
+	temp1 = _mm_xor_si128 (temp1, temp2);
+	return temp1;
+}
+
+void AES_128_Key_Expansion (const unsigned char *userkey, unsigned char *key) {
+	__m128i temp1, temp2;
+	__m128i *Key_Schedule = (__m128i*)key;
+
+	temp1 = _mm_loadu_si128((__m128i*)userkey);
+	Key_Schedule[0] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1 ,0x1);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[1] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x2);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[2] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x4);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[3] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x8);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[4] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x10);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[5] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x20);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[6] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x40);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[7] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x80);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[8] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x1b);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[9] = temp1;
+	temp2 = _mm_aeskeygenassist_si128 (temp1,0x36);
+	temp1 = AES_128_ASSIST(temp1, temp2);
+	Key_Schedule[10] = temp1;
+}
+
+void KEY_192_ASSIST(__m128i* temp1, __m128i * temp2, __m128i * temp3) {
+	__m128i temp4;
+	*temp2 = _mm_shuffle_epi32 (*temp2, 0x55);
+	temp4 = _mm_slli_si128 (*temp1, 0x4);
+	*temp1 = _mm_xor_si128 (*temp1, temp4);
+	temp4 = _mm_slli_si128 (temp4, 0x4);
+	*temp1 = _mm_xor_si128 (*temp1, temp4);
+	temp4 = _mm_slli_si128 (temp4, 0x4);
+	*temp1 = _mm_xor_si128 (*temp1, temp4);
+	*temp1 = _mm_xor_si128 (*temp1, *temp2);
+	*temp2 = _mm_shuffle_epi32(*temp1, 0xff);
+	temp4 = _mm_slli_si128 (*temp3, 0x4);
+	*temp3 = _mm_xor_si128 (*temp3, temp4);
+	*temp3 = _mm_xor_si128 (*temp3, *temp2);
+}
+
+void AES_192_Key_Expansion (const unsigned char *userkey, unsigned char *key) {
+	__m128i temp1, temp2, temp3;
+	__m128i *Key_Schedule = (__m128i*)key;
+
+	/* only 8 bytes follow the first 16, don't read past the user key */
+	temp1 = _mm_loadu_si128((__m128i*)userkey);
+	temp3 = _mm_loadl_epi64((__m128i*)(userkey+16));
+	Key_Schedule[0]=temp1;
+	Key_Schedule[1]=temp3;
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x1);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[1] = (__m128i)_mm_shuffle_pd((__m128d)Key_Schedule[1], (__m128d)temp1,0);
+	Key_Schedule[2] = (__m128i)_mm_shuffle_pd((__m128d)temp1,(__m128d)temp3,1);
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x2);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[3]=temp1;
+	Key_Schedule[4]=temp3;
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x4);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[4] = (__m128i)_mm_shuffle_pd((__m128d)Key_Schedule[4], (__m128d)temp1,0);
+	Key_Schedule[5] = (__m128i)_mm_shuffle_pd((__m128d)temp1,(__m128d)temp3,1);
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x8);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[6]=temp1;
+	Key_Schedule[7]=temp3;
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x10);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[7] = (__m128i)_mm_shuffle_pd((__m128d)Key_Schedule[7], (__m128d)temp1,0);
+	Key_Schedule[8] = (__m128i)_mm_shuffle_pd((__m128d)temp1,(__m128d)temp3,1);
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x20);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[9]=temp1;
+	Key_Schedule[10]=temp3;
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x40);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[10] = (__m128i)_mm_shuffle_pd((__m128d)Key_Schedule[10], (__m128d)temp1,0);
+	Key_Schedule[11] = (__m128i)_mm_shuffle_pd((__m128d)temp1,(__m128d)temp3,1);
+	temp2=_mm_aeskeygenassist_si128 (temp3,0x80);
+	KEY_192_ASSIST(&temp1, &temp2, &temp3);
+	Key_Schedule[12]=temp1;
+}
+
 void KEY_256_ASSIST_1(__m128i* temp1, __m128i * temp2) {
 	__m128i temp4; 
 	*temp2 = _mm_shuffle_epi32(*temp2, 0xff); 
@@ -76,16 +193,94 @@ void AES_256_Key_Expansion (const unsigned char *userkey, unsigned char *key) {
 	Key_Schedule[14]=temp1; 
 }
 
+int AES_set_encrypt_key (const unsigned char *userKey,
+						 const int bits,
+						 AES_KEY *key)
+{
+	if (!userKey || !key)
+		return -1;
+	if (bits == 128) {
+		AES_128_Key_Expansion (userKey,key->KEY);
+		key->nr = 10;
+		return 0;
+	}
+	else if (bits == 192) {
+		AES_192_Key_Expansion (userKey,key->KEY);
+		key->nr = 12;
+		return 0;
+	}
+	else if (bits == 256) {
+		AES_256_Key_Expansion (userKey,key->KEY);
+		key->nr = 14;
+		return 0;
+	}
+	return -2;
+}
+
+/*
+ * The decryption schedule is the encryption schedule in reverse order,
+ * with InvMixColumns (aesimc) applied to every round key except the
+ * first and last, as aesdec expects for the Equivalent Inverse Cipher.
+ */
+void AES_invert_key (const unsigned char *enc,
+					 unsigned char *dec,
+					 int nr)
+{
+	int i;
+	const __m128i *Enc_Schedule = (const __m128i*)enc;
+	__m128i *Dec_Schedule = (__m128i*)dec;
+
+	Dec_Schedule[nr] = Enc_Schedule[0];
+	for(i=1; i < nr; i++)
+		Dec_Schedule[nr-i] = _mm_aesimc_si128(Enc_Schedule[i]);
+	Dec_Schedule[0] = Enc_Schedule[nr];
+}
+
+int AES_set_decrypt_key (const unsigned char *userKey,
+						 const int bits,
+						 AES_KEY *key)
+{
+	AES_KEY temp_key;
+
+	if (!userKey || !key)
+		return -1;
+	if (AES_set_encrypt_key(userKey,bits,&temp_key) == -2)
+		return -2;
+
+	key->nr = temp_key.nr;
+	AES_invert_key(temp_key.KEY, key->KEY, temp_key.nr);
+
+	memset(&temp_key, 0, sizeof(temp_key));
+	return 0;
+}
+
 void AES_ECB_encrypt(const unsigned char *in, //pointer to the PLAINTEXT 
 				     unsigned char *out,	//pointer to the CIPHERTEXT buffer
                      unsigned long length,	//text length in bytes 
                      const unsigned char *key,	//pointer to the expanded key schedule 
                      int number_of_rounds)	//number of AES rounds 10,12 or 14
 { 
-	__m128i tmp; int i,j;
+	__m128i tmp, b[8];
+	unsigned long i;
+	int j;
 	if(length%16) length = length/16+1; else length = length/16;
 
-	for(i=0; i < length; i++) { 
+	for(i=0; i+8 <= length; i+=8) {
+		for(j=0; j < 8; j++)
+			b[j] = _mm_loadu_si128 (&((__m128i*)in)[i+j]);
+		AES_encrypt8(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 8; j++)
+			_mm_storeu_si128 (&((__m128i*)out)[i+j], b[j]);
+	}
+	if(i+4 <= length) {
+		for(j=0; j < 4; j++)
+			b[j] = _mm_loadu_si128 (&((__m128i*)in)[i+j]);
+		AES_encrypt4(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 4; j++)
+			_mm_storeu_si128 (&((__m128i*)out)[i+j], b[j]);
+		i += 4;
+	}
+	for(; i < length; i++) { 
 		tmp = _mm_loadu_si128 (&((__m128i*)in)[i]); 
 		tmp = _mm_xor_si128 (tmp,((__m128i*)key)[0]); 
 		for(j=1; j <number_of_rounds; j++){
@@ -102,11 +297,27 @@ void AES_ECB_decrypt(const unsigned char *in, //pointer to the CIPHERTEXT
 				     const char *key,	//pointer to the expanded key schedule 
 				     int number_of_rounds)	//number of AES rounds 10,12 or 14
 { 
-	__m128i tmp; 
-	int i,j;
+	__m128i tmp, b[8];
+	unsigned long i;
+	int j;
 	if(length%16) length = length/16+1; else length = length/16;
 
-	for(i=0; i < length; i++) { 
+	for(i=0; i+8 <= length; i+=8) {
+		for(j=0; j < 8; j++)
+			b[j] = _mm_loadu_si128 (&((__m128i*)in)[i+j]);
+		AES_decrypt8(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 8; j++)
+			_mm_storeu_si128 (&((__m128i*)out)[i+j], b[j]);
+	}
+	if(i+4 <= length) {
+		for(j=0; j < 4; j++)
+			b[j] = _mm_loadu_si128 (&((__m128i*)in)[i+j]);
+		AES_decrypt4(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 4; j++)
+			_mm_storeu_si128 (&((__m128i*)out)[i+j], b[j]);
+		i += 4;
+	}
+	for(; i < length; i++) { 
 		tmp = _mm_loadu_si128 (&((__m128i*)in)[i]); 
 		tmp = _mm_xor_si128 (tmp,((__m128i*)key)[0]); 
 		for(j=1; j <number_of_rounds; j++){
@@ -125,20 +336,46 @@ void AES_CTR_encrypt (const unsigned char *in,
 					  const unsigned char *key,
 					  int number_of_rounds)
 {
-	__m128i ctr_block, tmp, ONE, BSWAP_EPI64;
-	int i,j;
-	if (length%16) length = length/16 + 1; else length /= 16;
+	__m128i ctr_block, tmp, ONE, BSWAP_EPI64, b[8];
+	ALIGN16 unsigned char last[16];
+	unsigned long i, blocks = length/16;
+	int j;
 
 	ONE = _mm_set_epi32(0,1,0,0);
 	BSWAP_EPI64 = _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
 
+	ctr_block = _mm_setzero_si128();
 	ctr_block = _mm_insert_epi64(ctr_block, *(long long*)ivec, 1);
-	ctr_block = (__m128i)_mm_insert_epi32(ctr_block, *(long*)nonce, 1);
+	ctr_block = _mm_insert_epi32(ctr_block, *(int*)nonce, 1);
 	ctr_block = _mm_srli_si128(ctr_block, 4);
 	ctr_block = _mm_shuffle_epi8(ctr_block, BSWAP_EPI64);
 	ctr_block = _mm_add_epi64(ctr_block, ONE);
 
-	for(i=0; i < length; i++) {
+	for(i=0; i+8 <= blocks; i+=8) {
+		for(j=0; j < 8; j++) {
+			b[j] = _mm_shuffle_epi8(ctr_block, BSWAP_EPI64);
+			ctr_block = _mm_add_epi64(ctr_block, ONE);
+		}
+		AES_encrypt8(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 8; j++) {
+			tmp = _mm_xor_si128(b[j],_mm_loadu_si128(&((__m128i*)in)[i+j]));
+			_mm_storeu_si128 (&((__m128i*)out)[i+j],tmp);
+		}
+	}
+	if(i+4 <= blocks) {
+		for(j=0; j < 4; j++) {
+			b[j] = _mm_shuffle_epi8(ctr_block, BSWAP_EPI64);
+			ctr_block = _mm_add_epi64(ctr_block, ONE);
+		}
+		AES_encrypt4(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 4; j++) {
+			tmp = _mm_xor_si128(b[j],_mm_loadu_si128(&((__m128i*)in)[i+j]));
+			_mm_storeu_si128 (&((__m128i*)out)[i+j],tmp);
+		}
+		i += 4;
+	}
+	//finish the remaining whole blocks and a trailing partial block
+	for(; 16*i < length; i++) {
 		tmp = _mm_shuffle_epi8(ctr_block, BSWAP_EPI64);
 		ctr_block = _mm_add_epi64(ctr_block, ONE);
 		tmp = _mm_xor_si128(tmp, ((__m128i*)key)[0]);
@@ -146,18 +383,308 @@ void AES_CTR_encrypt (const unsigned char *in,
 			tmp = _mm_aesenc_si128 (tmp, ((__m128i*)key)[j]);
 		}
 		tmp = _mm_aesenclast_si128 (tmp, ((__m128i*)key)[j]);
+		if(16*i+16 <= length) {
+			tmp = _mm_xor_si128(tmp,_mm_loadu_si128(&((__m128i*)in)[i]));
+			_mm_storeu_si128 (&((__m128i*)out)[i],tmp);
+		} else {
+			_mm_store_si128((__m128i*)last, tmp);
+			xor_keystream(out + 16*i, in + 16*i, last, length - 16*i);
+		}
+	}
+}
+
+/*
+ * Counter block for the 128-bit big-endian counter hi:lo, which is then
+ * advanced with a full carry.
+ */
+static inline __m128i CTR128_next(unsigned long long *hi, unsigned long long *lo)
+{
+	__m128i ctr = _mm_set_epi64x((long long)*lo, (long long)*hi);
+
+	if(++*lo == 0)
+		++*hi;
+	return _mm_shuffle_epi8(ctr, _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8));
+}
+
+void AES_CTR128_encrypt(const unsigned char *in,
+						unsigned char *out,
+						const unsigned char counter[16],
+						unsigned long long block_offset,
+						unsigned long length,
+						const unsigned char *key,
+						int number_of_rounds)
+{
+	ALIGN16 unsigned char last[16];
+	__m128i tmp, b[8];
+	unsigned long long hi = 0, lo = 0;
+	unsigned long i, blocks = length / 16;
+	int j;
+
+	for(j=0; j < 8; j++) {
+		hi = (hi << 8) | counter[j];
+		lo = (lo << 8) | counter[j+8];
+	}
+	lo += block_offset;
+	if(lo < block_offset)
+		hi++;
+
+	for(i=0; i+8 <= blocks; i+=8) {
+		for(j=0; j < 8; j++)
+			b[j] = CTR128_next(&hi, &lo);
+		AES_encrypt8(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 8; j++) {
+			tmp = _mm_xor_si128(b[j],_mm_loadu_si128(&((__m128i*)in)[i+j]));
+			_mm_storeu_si128 (&((__m128i*)out)[i+j],tmp);
+		}
+	}
+	if(i+4 <= blocks) {
+		for(j=0; j < 4; j++)
+			b[j] = CTR128_next(&hi, &lo);
+		AES_encrypt4(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 4; j++) {
+			tmp = _mm_xor_si128(b[j],_mm_loadu_si128(&((__m128i*)in)[i+j]));
+			_mm_storeu_si128 (&((__m128i*)out)[i+j],tmp);
+		}
+		i += 4;
+	}
+	for(; i < blocks; i++) {
+		tmp = CTR128_next(&hi, &lo);
+		tmp = _mm_xor_si128(tmp, ((__m128i*)key)[0]);
+		for(j=1; j <number_of_rounds; j++) {
+			tmp = _mm_aesenc_si128 (tmp, ((__m128i*)key)[j]);
+		}
+		tmp = _mm_aesenclast_si128 (tmp, ((__m128i*)key)[j]);
 		tmp = _mm_xor_si128(tmp,_mm_loadu_si128(&((__m128i*)in)[i]));
 		_mm_storeu_si128 (&((__m128i*)out)[i],tmp);
 	}
+	if(length % 16) {
+		b[0] = CTR128_next(&hi, &lo);
+		AES_ECB_encrypt((unsigned char*)b, last, 16, key, number_of_rounds);
+		xor_keystream(out + 16*i, in + 16*i, last, length % 16);
+	}
+}
+
+void AES_CBC_encrypt(const unsigned char *in,
+					 unsigned char *out,
+					 unsigned char ivec[16],
+					 unsigned long length,
+					 const unsigned char *key,
+					 int number_of_rounds)
+{
+	__m128i feedback, data;
+	unsigned long i;
+	int j;
+	if (length%16) length = length/16+1; else length /= 16;
+
+	feedback = _mm_loadu_si128((__m128i*)ivec);
+	for(i=0; i < length; i++) {
+		data = _mm_loadu_si128(&((__m128i*)in)[i]);
+		feedback = _mm_xor_si128(data, feedback);
+		feedback = _mm_xor_si128(feedback, ((__m128i*)key)[0]);
+		for(j=1; j < number_of_rounds; j++)
+			feedback = _mm_aesenc_si128(feedback, ((__m128i*)key)[j]);
+		feedback = _mm_aesenclast_si128(feedback, ((__m128i*)key)[j]);
+		_mm_storeu_si128(&((__m128i*)out)[i], feedback);
+	}
+	_mm_storeu_si128((__m128i*)ivec, feedback);
+}
+
+/*
+ * Every plaintext block only depends on two ciphertext blocks, so decrypt
+ * runs 8 blocks at a time. All 8 are loaded before anything is stored,
+ * which keeps in == out working.
+ */
+void AES_CBC_decrypt(const unsigned char *in,
+					 unsigned char *out,
+					 unsigned char ivec[16],
+					 unsigned long length,
+					 const unsigned char *key,
+					 int number_of_rounds)
+{
+	__m128i feedback, last_in, b[8], c[8];
+	unsigned long i;
+	int j;
+	if (length%16) length = length/16+1; else length /= 16;
+
+	feedback = _mm_loadu_si128((__m128i*)ivec);
+	for(i=0; i+8 <= length; i+=8) {
+		for(j=0; j < 8; j++)
+			b[j] = c[j] = _mm_loadu_si128(&((__m128i*)in)[i+j]);
+		AES_decrypt8(b, (const __m128i*)key, number_of_rounds);
+		_mm_storeu_si128(&((__m128i*)out)[i], _mm_xor_si128(b[0], feedback));
+		for(j=1; j < 8; j++)
+			_mm_storeu_si128(&((__m128i*)out)[i+j], _mm_xor_si128(b[j], c[j-1]));
+		feedback = c[7];
+	}
+	if(i+4 <= length) {
+		for(j=0; j < 4; j++)
+			b[j] = c[j] = _mm_loadu_si128(&((__m128i*)in)[i+j]);
+		AES_decrypt4(b, (const __m128i*)key, number_of_rounds);
+		_mm_storeu_si128(&((__m128i*)out)[i], _mm_xor_si128(b[0], feedback));
+		for(j=1; j < 4; j++)
+			_mm_storeu_si128(&((__m128i*)out)[i+j], _mm_xor_si128(b[j], c[j-1]));
+		feedback = c[3];
+		i += 4;
+	}
+	for(; i < length; i++) {
+		last_in = _mm_loadu_si128(&((__m128i*)in)[i]);
+		b[0] = _mm_xor_si128(last_in, ((__m128i*)key)[0]);
+		for(j=1; j < number_of_rounds; j++)
+			b[0] = _mm_aesdec_si128(b[0], ((__m128i*)key)[j]);
+		b[0] = _mm_aesdeclast_si128(b[0], ((__m128i*)key)[j]);
+		_mm_storeu_si128(&((__m128i*)out)[i], _mm_xor_si128(b[0], feedback));
+		feedback = last_in;
+	}
+	_mm_storeu_si128((__m128i*)ivec, feedback);
 }
 
+/*
+ * CFB128: a keystream block is the encryption of the previous ciphertext
+ * block. Encryption has to wait for each ciphertext it produces, but
+ * decryption has all of them up front, so it runs 8 blocks at a time
+ * like CBC decryption (with the encryption schedule). Both resume at byte
+ * `*num` of the current block and leave ivec/num ready for the next call.
+ */
+static inline __m128i CFB128_encrypt1(__m128i x, const __m128i *k, int number_of_rounds)
+{
+	int j;
 
+	x = _mm_xor_si128(x, k[0]);
+	for(j=1; j < number_of_rounds; j++)
+		x = _mm_aesenc_si128(x, k[j]);
+	return _mm_aesenclast_si128(x, k[j]);
+}
 
+void AES_CFB128_encrypt(const unsigned char *in,
+						unsigned char *out,
+						unsigned char ivec[16],
+						int *num,
+						unsigned long length,
+						const unsigned char *key,
+						int number_of_rounds)
+{
+	__m128i feedback;
+	int n = *num;
 
+	for(; n != 0 && length > 0; n = (n+1) & 15, length--)
+		ivec[n] = *out++ = *in++ ^ ivec[n];
 
+	feedback = _mm_loadu_si128((__m128i*)ivec);
+	for(; length >= 16; length -= 16, in += 16, out += 16) {
+		feedback = CFB128_encrypt1(feedback, (const __m128i*)key, number_of_rounds);
+		feedback = _mm_xor_si128(feedback, _mm_loadu_si128((__m128i*)in));
+		_mm_storeu_si128((__m128i*)out, feedback);
+	}
+	if(length > 0)
+		feedback = CFB128_encrypt1(feedback, (const __m128i*)key, number_of_rounds);
+	_mm_storeu_si128((__m128i*)ivec, feedback);
 
+	for(; length > 0; n++, length--)
+		ivec[n] = *out++ = *in++ ^ ivec[n];
+	*num = n;
+}
 
+void AES_CFB128_decrypt(const unsigned char *in,
+						unsigned char *out,
+						unsigned char ivec[16],
+						int *num,
+						unsigned long length,
+						const unsigned char *key,
+						int number_of_rounds)
+{
+	__m128i feedback, b[8], c[8];
+	unsigned char ch;
+	int j, n = *num;
 
+	for(; n != 0 && length > 0; n = (n+1) & 15, length--) {
+		ch = *in++;
+		*out++ = ch ^ ivec[n];
+		ivec[n] = ch;
+	}
 
+	feedback = _mm_loadu_si128((__m128i*)ivec);
+	for(; length >= 128; length -= 128, in += 128, out += 128) {
+		b[0] = feedback;
+		for(j=0; j < 8; j++) {
+			c[j] = _mm_loadu_si128(&((__m128i*)in)[j]);
+			if(j < 7) b[j+1] = c[j];
+		}
+		AES_encrypt8(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 8; j++)
+			_mm_storeu_si128(&((__m128i*)out)[j], _mm_xor_si128(b[j], c[j]));
+		feedback = c[7];
+	}
+	if(length >= 64) {
+		b[0] = feedback;
+		for(j=0; j < 4; j++) {
+			c[j] = _mm_loadu_si128(&((__m128i*)in)[j]);
+			if(j < 3) b[j+1] = c[j];
+		}
+		AES_encrypt4(b, (const __m128i*)key, number_of_rounds);
+		for(j=0; j < 4; j++)
+			_mm_storeu_si128(&((__m128i*)out)[j], _mm_xor_si128(b[j], c[j]));
+		feedback = c[3];
+		length -= 64; in += 64; out += 64;
+	}
+	for(; length >= 16; length -= 16, in += 16, out += 16) {
+		c[0] = _mm_loadu_si128((__m128i*)in);
+		b[0] = CFB128_encrypt1(feedback, (const __m128i*)key, number_of_rounds);
+		_mm_storeu_si128((__m128i*)out, _mm_xor_si128(b[0], c[0]));
+		feedback = c[0];
+	}
+	if(length > 0)
+		feedback = CFB128_encrypt1(feedback, (const __m128i*)key, number_of_rounds);
+	_mm_storeu_si128((__m128i*)ivec, feedback);
+
+	for(; length > 0; n++, length--) {
+		ch = *in++;
+		*out++ = ch ^ ivec[n];
+		ivec[n] = ch;
+	}
+	*num = n;
+}
 
+/*
+ * A single CBC encryption is a serial chain, but independent streams are
+ * not: push up to 8 of them through the rounds together, one block from
+ * each per step.
+ */
+void AES_CBC_encrypt_multi(const unsigned char **in,
+						   unsigned char **out,
+						   unsigned char **ivec,
+						   unsigned long length,
+						   int num_streams,
+						   const unsigned char *key,
+						   int number_of_rounds)
+{
+	__m128i b[8];
+	unsigned long i, blocks;
+	int s, j, n;
+	if (length%16) blocks = length/16+1; else blocks = length/16;
+
+	for(s=0; s < num_streams; s += n) {
+		n = num_streams - s;
+		if(n >= 8) n = 8;
+		else if(n >= 4) n = 4;
+		else {
+			for(; s < num_streams; s++)
+				AES_CBC_encrypt(in[s], out[s], ivec[s], length, key, number_of_rounds);
+			return;
+		}
 
+		for(j=0; j < n; j++)
+			b[j] = _mm_loadu_si128((__m128i*)ivec[s+j]);
+		for(i=0; i < blocks; i++) {
+			for(j=0; j < n; j++)
+				b[j] = _mm_xor_si128(b[j], _mm_loadu_si128(&((__m128i*)in[s+j])[i]));
+			if(n == 8)
+				AES_encrypt8(b, (const __m128i*)key, number_of_rounds);
+			else
+				AES_encrypt4(b, (const __m128i*)key, number_of_rounds);
+			for(j=0; j < n; j++)
+				_mm_storeu_si128(&((__m128i*)out[s+j])[i], b[j]);
+		}
+		for(j=0; j < n; j++)
+			_mm_storeu_si128((__m128i*)ivec[s+j], b[j]);
+	}
+}
@@ -1,4 +1,8 @@
+#ifndef AESNI_H
+#define AESNI_H
+
 #include <wmmintrin.h>
+#include <smmintrin.h>
 
 #if !defined (ALIGN16) 
 # if defined (__GNUC__) 
@@ -8,9 +12,31 @@
 # endif 
 #endif
 
+typedef struct KEY_SCHEDULE {
+	ALIGN16 unsigned char KEY[16*15];	//round keys, 16-byte aligned for aesenc/aesdec
+	unsigned int nr;					//number of AES rounds 10,12 or 14
+} AES_KEY;
+
 int CheckAESSupport();
+int CheckPCLMULSupport();
+void AES_128_Key_Expansion (const unsigned char *userkey, unsigned char *key);
+void AES_192_Key_Expansion (const unsigned char *userkey, unsigned char *key);
 void AES_256_Key_Expansion (const unsigned char *userkey, unsigned char *key);
 
+/*
+ * Expand a 128, 192 or 256-bit user key into `key`. The decryption
+ * schedule is the one AES_ECB_decrypt expects (aesimc applied).
+ * Return 0 on success, -1 on NULL arguments and -2 on a bad key size.
+ */
+int AES_set_encrypt_key (const unsigned char *userKey, const int bits, AES_KEY *key);
+int AES_set_decrypt_key (const unsigned char *userKey, const int bits, AES_KEY *key);
+
+/*
+ * Decryption schedule of `nr` rounds from the encryption schedule `enc`
+ * (16-byte aligned, not in place): the layout AES_ECB_decrypt expects.
+ */
+void AES_invert_key (const unsigned char *enc, unsigned char *dec, int nr);
+
 void AES_ECB_encrypt(const unsigned char *in, //pointer to the PLAINTEXT 
 				     unsigned char *out,	//pointer to the CIPHERTEXT buffer
                      unsigned long length,	//text length in bytes 
@@ -31,3 +57,251 @@ void AES_CTR_encrypt (const unsigned char *in,
 					  const unsigned char *key,
 					  int number_of_rounds);
 
+/*
+ * CTR over a full 128-bit big-endian counter block, starting
+ * `block_offset` blocks past `counter` (carries propagate through all 128
+ * bits). Slices of one message encrypted at their own offsets, in any
+ * order or on any thread, give the same output as one serial call.
+ * As with AES_CTR_encrypt, a partial last block writes only `length` bytes.
+ */
+void AES_CTR128_encrypt(const unsigned char *in,
+						unsigned char *out,
+						const unsigned char counter[16],
+						unsigned long long block_offset,
+						unsigned long length,
+						const unsigned char *key,
+						int number_of_rounds);
+
+/*
+ * CBC with `ivec` updated to the last ciphertext block, so consecutive
+ * calls continue the same chain. Decryption expects the schedule from
+ * AES_set_decrypt_key.
+ */
+void AES_CBC_encrypt(const unsigned char *in,
+					 unsigned char *out,
+					 unsigned char ivec[16],
+					 unsigned long length,
+					 const unsigned char *key,
+					 int number_of_rounds);
+
+void AES_CBC_decrypt(const unsigned char *in,
+					 unsigned char *out,
+					 unsigned char ivec[16],
+					 unsigned long length,
+					 const unsigned char *key,
+					 int number_of_rounds);
+
+/*
+ * CFB128 with `ivec` and the byte offset `num` (0 at the start of a
+ * stream) updated after use, so consecutive calls of any length continue
+ * the same stream. Both directions take the encryption schedule;
+ * decryption runs 8 blocks in flight.
+ */
+void AES_CFB128_encrypt(const unsigned char *in,
+						unsigned char *out,
+						unsigned char ivec[16],
+						int *num,
+						unsigned long length,
+						const unsigned char *key,
+						int number_of_rounds);
+
+void AES_CFB128_decrypt(const unsigned char *in,
+						unsigned char *out,
+						unsigned char ivec[16],
+						int *num,
+						unsigned long length,
+						const unsigned char *key,
+						int number_of_rounds);
+
+/*
+ * CBC-encrypt `num_streams` independent streams of `length` bytes each
+ * under one key, e.g. the sectors of a volume with per-sector IVs.
+ * in[s], out[s] and ivec[s] describe stream s.
+ */
+void AES_CBC_encrypt_multi(const unsigned char **in,
+						   unsigned char **out,
+						   unsigned char **ivec,
+						   unsigned long length,
+						   int num_streams,
+						   const unsigned char *key,
+						   int number_of_rounds);
+
+/*
+ * Interleaved round kernels.
+ *
+ * aesenc/aesdec have a latency of several cycles but can issue every
+ * cycle, so a single block chain leaves the AES unit mostly idle. These
+ * run 4 or 8 independent blocks through the rounds side by side, which
+ * is what lets the parallel modes run at throughput instead of latency.
+ * `k` is an expanded schedule of number_of_rounds+1 round keys.
+ */
+static inline void AES_encrypt4(__m128i *b, const __m128i *k, int number_of_rounds)
+{
+	int j;
+
+	b[0] = _mm_xor_si128(b[0], k[0]);
+	b[1] = _mm_xor_si128(b[1], k[0]);
+	b[2] = _mm_xor_si128(b[2], k[0]);
+	b[3] = _mm_xor_si128(b[3], k[0]);
+	for(j=1; j < number_of_rounds; j++) {
+		b[0] = _mm_aesenc_si128(b[0], k[j]);
+		b[1] = _mm_aesenc_si128(b[1], k[j]);
+		b[2] = _mm_aesenc_si128(b[2], k[j]);
+		b[3] = _mm_aesenc_si128(b[3], k[j]);
+	}
+	b[0] = _mm_aesenclast_si128(b[0], k[j]);
+	b[1] = _mm_aesenclast_si128(b[1], k[j]);
+	b[2] = _mm_aesenclast_si128(b[2], k[j]);
+	b[3] = _mm_aesenclast_si128(b[3], k[j]);
+}
+
+static inline void AES_encrypt8(__m128i *b, const __m128i *k, int number_of_rounds)
+{
+	int j;
+
+	b[0] = _mm_xor_si128(b[0], k[0]);
+	b[1] = _mm_xor_si128(b[1], k[0]);
+	b[2] = _mm_xor_si128(b[2], k[0]);
+	b[3] = _mm_xor_si128(b[3], k[0]);
+	b[4] = _mm_xor_si128(b[4], k[0]);
+	b[5] = _mm_xor_si128(b[5], k[0]);
+	b[6] = _mm_xor_si128(b[6], k[0]);
+	b[7] = _mm_xor_si128(b[7], k[0]);
+	for(j=1; j < number_of_rounds; j++) {
+		b[0] = _mm_aesenc_si128(b[0], k[j]);
+		b[1] = _mm_aesenc_si128(b[1], k[j]);
+		b[2] = _mm_aesenc_si128(b[2], k[j]);
+		b[3] = _mm_aesenc_si128(b[3], k[j]);
+		b[4] = _mm_aesenc_si128(b[4], k[j]);
+		b[5] = _mm_aesenc_si128(b[5], k[j]);
+		b[6] = _mm_aesenc_si128(b[6], k[j]);
+		b[7] = _mm_aesenc_si128(b[7], k[j]);
+	}
+	b[0] = _mm_aesenclast_si128(b[0], k[j]);
+	b[1] = _mm_aesenclast_si128(b[1], k[j]);
+	b[2] = _mm_aesenclast_si128(b[2], k[j]);
+	b[3] = _mm_aesenclast_si128(b[3], k[j]);
+	b[4] = _mm_aesenclast_si128(b[4], k[j]);
+	b[5] = _mm_aesenclast_si128(b[5], k[j]);
+	b[6] = _mm_aesenclast_si128(b[6], k[j]);
+	b[7] = _mm_aesenclast_si128(b[7], k[j]);
+}
+
+static inline void AES_decrypt4(__m128i *b, const __m128i *k, int number_of_rounds)
+{
+	int j;
+
+	b[0] = _mm_xor_si128(b[0], k[0]);
+	b[1] = _mm_xor_si128(b[1], k[0]);
+	b[2] = _mm_xor_si128(b[2], k[0]);
+	b[3] = _mm_xor_si128(b[3], k[0]);
+	for(j=1; j < number_of_rounds; j++) {
+		b[0] = _mm_aesdec_si128(b[0], k[j]);
+		b[1] = _mm_aesdec_si128(b[1], k[j]);
+		b[2] = _mm_aesdec_si128(b[2], k[j]);
+		b[3] = _mm_aesdec_si128(b[3], k[j]);
+	}
+	b[0] = _mm_aesdeclast_si128(b[0], k[j]);
+	b[1] = _mm_aesdeclast_si128(b[1], k[j]);
+	b[2] = _mm_aesdeclast_si128(b[2], k[j]);
+	b[3] = _mm_aesdeclast_si128(b[3], k[j]);
+}
+
+static inline void AES_decrypt8(__m128i *b, const __m128i *k, int number_of_rounds)
+{
+	int j;
+
+	b[0] = _mm_xor_si128(b[0], k[0]);
+	b[1] = _mm_xor_si128(b[1], k[0]);
+	b[2] = _mm_xor_si128(b[2], k[0]);
+	b[3] = _mm_xor_si128(b[3], k[0]);
+	b[4] = _mm_xor_si128(b[4], k[0]);
+	b[5] = _mm_xor_si128(b[5], k[0]);
+	b[6] = _mm_xor_si128(b[6], k[0]);
+	b[7] = _mm_xor_si128(b[7], k[0]);
+	for(j=1; j < number_of_rounds; j++) {
+		b[0] = _mm_aesdec_si128(b[0], k[j]);
+		b[1] = _mm_aesdec_si128(b[1], k[j]);
+		b[2] = _mm_aesdec_si128(b[2], k[j]);
+		b[3] = _mm_aesdec_si128(b[3], k[j]);
+		b[4] = _mm_aesdec_si128(b[4], k[j]);
+		b[5] = _mm_aesdec_si128(b[5], k[j]);
+		b[6] = _mm_aesdec_si128(b[6], k[j]);
+		b[7] = _mm_aesdec_si128(b[7], k[j]);
+	}
+	b[0] = _mm_aesdeclast_si128(b[0], k[j]);
+	b[1] = _mm_aesdeclast_si128(b[1], k[j]);
+	b[2] = _mm_aesdeclast_si128(b[2], k[j]);
+	b[3] = _mm_aesdeclast_si128(b[3], k[j]);
+	b[4] = _mm_aesdeclast_si128(b[4], k[j]);
+	b[5] = _mm_aesdeclast_si128(b[5], k[j]);
+	b[6] = _mm_aesdeclast_si128(b[6], k[j]);
+	b[7] = _mm_aesdeclast_si128(b[7], k[j]);
+}
+
+
+/*
+ * As AES_encrypt4/8, but block i runs under its own schedule k[i], for
+ * lanes that carry unrelated streams. All schedules have the same
+ * number_of_rounds. The blocks and schedule pointers are held in locals:
+ * __m128i stores may alias the pointer array, so working on b[] would
+ * reload every k[i] each round.
+ */
+static inline void AES_encrypt4_keys(__m128i *b, const __m128i *const *k, int number_of_rounds)
+{
+	const __m128i *k0 = k[0], *k1 = k[1], *k2 = k[2], *k3 = k[3];
+	__m128i x0, x1, x2, x3;
+	int j;
+
+	x0 = _mm_xor_si128(b[0], k0[0]);
+	x1 = _mm_xor_si128(b[1], k1[0]);
+	x2 = _mm_xor_si128(b[2], k2[0]);
+	x3 = _mm_xor_si128(b[3], k3[0]);
+	for(j=1; j < number_of_rounds; j++) {
+		x0 = _mm_aesenc_si128(x0, k0[j]);
+		x1 = _mm_aesenc_si128(x1, k1[j]);
+		x2 = _mm_aesenc_si128(x2, k2[j]);
+		x3 = _mm_aesenc_si128(x3, k3[j]);
+	}
+	b[0] = _mm_aesenclast_si128(x0, k0[j]);
+	b[1] = _mm_aesenclast_si128(x1, k1[j]);
+	b[2] = _mm_aesenclast_si128(x2, k2[j]);
+	b[3] = _mm_aesenclast_si128(x3, k3[j]);
+}
+
+static inline void AES_encrypt8_keys(__m128i *b, const __m128i *const *k, int number_of_rounds)
+{
+	const __m128i *k0 = k[0], *k1 = k[1], *k2 = k[2], *k3 = k[3];
+	const __m128i *k4 = k[4], *k5 = k[5], *k6 = k[6], *k7 = k[7];
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7;
+	int j;
+
+	x0 = _mm_xor_si128(b[0], k0[0]);
+	x1 = _mm_xor_si128(b[1], k1[0]);
+	x2 = _mm_xor_si128(b[2], k2[0]);
+	x3 = _mm_xor_si128(b[3], k3[0]);
+	x4 = _mm_xor_si128(b[4], k4[0]);
+	x5 = _mm_xor_si128(b[5], k5[0]);
+	x6 = _mm_xor_si128(b[6], k6[0]);
+	x7 = _mm_xor_si128(b[7], k7[0]);
+	for(j=1; j < number_of_rounds; j++) {
+		x0 = _mm_aesenc_si128(x0, k0[j]);
+		x1 = _mm_aesenc_si128(x1, k1[j]);
+		x2 = _mm_aesenc_si128(x2, k2[j]);
+		x3 = _mm_aesenc_si128(x3, k3[j]);
+		x4 = _mm_aesenc_si128(x4, k4[j]);
+		x5 = _mm_aesenc_si128(x5, k5[j]);
+		x6 = _mm_aesenc_si128(x6, k6[j]);
+		x7 = _mm_aesenc_si128(x7, k7[j]);
+	}
+	b[0] = _mm_aesenclast_si128(x0, k0[j]);
+	b[1] = _mm_aesenclast_si128(x1, k1[j]);
+	b[2] = _mm_aesenclast_si128(x2, k2[j]);
+	b[3] = _mm_aesenclast_si128(x3, k3[j]);
+	b[4] = _mm_aesenclast_si128(x4, k4[j]);
+	b[5] = _mm_aesenclast_si128(x5, k5[j]);
+	b[6] = _mm_aesenclast_si128(x6, k6[j]);
+	b[7] = _mm_aesenclast_si128(x7, k7[j]);
+}
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ *  AES front-end with one-time CPU dispatch
+ *
+ *  Backends are listed fastest first. A constructor walks the list once
+ *  and keeps the first one the CPU supports; aesx_setkey stores that
+ *  backend in the context so the per-call cost is one indirect call.
+ *  Without AES-NI the SSSE3 vector permute engine comes first, then the
+ *  bitsliced one, then the tables: the first two are faster on bulk data
+ *  and neither leaks through cache timing.
+ */
+
+#include "aesx.h"
+#include "vaes.h"
+
+/*
+ * Table backend (aes.c)
+ */
+static int table_available( void )
+{
+    return( 1 );
+}
+
+/*
+ * The table schedules double as the AES-NI and VAES ones
+ */
+static int table_setkey( aesx_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    int ret;
+
+    if( ( ret = aes_setkey_enc( &ctx->enc, key, keysize ) ) != 0 )
+        return( ret );
+
+    return( aes_setkey_dec( &ctx->dec, key, keysize ) );
+}
+
+static int table_crypt_ecb( aesx_context *ctx, int mode, size_t length,
+                            const unsigned char *input, unsigned char *output )
+{
+    return( aes_crypt_ecb_blocks( ( mode == AES_DECRYPT ) ? &ctx->dec : &ctx->enc,
+                                  mode, length, input, output ) );
+}
+
+static int table_crypt_cbc( aesx_context *ctx, int mode, size_t length, unsigned char iv[16],
+                            const unsigned char *input, unsigned char *output )
+{
+    return( aes_crypt_cbc( ( mode == AES_DECRYPT ) ? &ctx->dec : &ctx->enc,
+                           mode, length, iv, input, output ) );
+}
+
+static int table_crypt_ctr( aesx_context *ctx, size_t length, const unsigned char nonce_counter[16],
+                            unsigned long long block_offset,
+                            const unsigned char *input, unsigned char *output )
+{
+    return( aes_crypt_ctr_at( &ctx->enc, length, nonce_counter, block_offset, input, output ) );
+}
+
+/*
+ * Bitsliced backend (aesbs.c): constant time without AES-NI
+ */
+static int bs_available( void )
+{
+    return( 1 );
+}
+
+static int bs_setkey( aesx_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    return( aesbs_setkey( &ctx->bs, key, keysize ) );
+}
+
+static int bs_crypt_ecb( aesx_context *ctx, int mode, size_t length,
+                         const unsigned char *input, unsigned char *output )
+{
+    return( aesbs_crypt_ecb( &ctx->bs, mode, length, input, output ) );
+}
+
+static int bs_crypt_cbc( aesx_context *ctx, int mode, size_t length, unsigned char iv[16],
+                         const unsigned char *input, unsigned char *output )
+{
+    return( aesbs_crypt_cbc( &ctx->bs, mode, length, iv, input, output ) );
+}
+
+static int bs_crypt_ctr( aesx_context *ctx, size_t length, const unsigned char nonce_counter[16],
+                         unsigned long long block_offset,
+                         const unsigned char *input, unsigned char *output )
+{
+    return( aesbs_crypt_ctr( &ctx->bs, length, nonce_counter, block_offset, input, output ) );
+}
+
+/*
+ * Vector permute backend (vpaes.c): constant time on SSSE3
+ */
+static int vp_available( void )
+{
+    return( CheckSSSE3Support() );
+}
+
+static int vp_setkey( aesx_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    int ret;
+
+    if( ( ret = vpaes_setkey_enc( &ctx->venc, key, keysize ) ) != 0 )
+        return( ret );
+
+    return( vpaes_setkey_dec( &ctx->vdec, key, keysize ) );
+}
+
+static int vp_crypt_ecb( aesx_context *ctx, int mode, size_t length,
+                         const unsigned char *input, unsigned char *output )
+{
+    vpaes_context *c = ( mode == AES_DECRYPT ) ? &ctx->vdec : &ctx->venc;
+
+    for( ; length > 0; length -= 16, input += 16, output += 16 )
+        vpaes_crypt_ecb( c, mode, input, output );
+
+    return( 0 );
+}
+
+static int vp_crypt_cbc( aesx_context *ctx, int mode, size_t length, unsigned char iv[16],
+                         const unsigned char *input, unsigned char *output )
+{
+    return( vpaes_crypt_cbc( ( mode == AES_DECRYPT ) ? &ctx->vdec : &ctx->venc,
+                             mode, length, iv, input, output ) );
+}
+
+static int vp_crypt_ctr( aesx_context *ctx, size_t length, const unsigned char nonce_counter[16],
+                         unsigned long long block_offset,
+                         const unsigned char *input, unsigned char *output )
+{
+    return( vpaes_crypt_ctr_at( &ctx->venc, length, nonce_counter, block_offset, input, output ) );
+}
+
+/*
+ * AES-NI backend (aesni.c)
+ */
+static int aesni_available( void )
+{
+    return( CheckAESSupport() != 0 );
+}
+
+static int aesni_crypt_ecb( aesx_context *ctx, int mode, size_t length,
+                            const unsigned char *input, unsigned char *output )
+{
+    if( mode == AES_DECRYPT )
+        AES_ECB_decrypt( input, output, length, (const char *) ctx->dec.ni, ctx->dec.nr );
+    else
+        AES_ECB_encrypt( input, output, length, ctx->enc.ni, ctx->enc.nr );
+
+    return( 0 );
+}
+
+static int aesni_crypt_cbc( aesx_context *ctx, int mode, size_t length, unsigned char iv[16],
+                            const unsigned char *input, unsigned char *output )
+{
+    if( mode == AES_DECRYPT )
+        AES_CBC_decrypt( input, output, iv, length, ctx->dec.ni, ctx->dec.nr );
+    else
+        AES_CBC_encrypt( input, output, iv, length, ctx->enc.ni, ctx->enc.nr );
+
+    return( 0 );
+}
+
+static int aesni_crypt_ctr( aesx_context *ctx, size_t length, const unsigned char nonce_counter[16],
+                            unsigned long long block_offset,
+                            const unsigned char *input, unsigned char *output )
+{
+    AES_CTR128_encrypt( input, output, nonce_counter, block_offset, length,
+                        ctx->enc.ni, ctx->enc.nr );
+
+    return( 0 );
+}
+
+/*
+ * VAES backend (vaes.c), AES-NI schedules; CBC stays on AES-NI
+ */
+static int vaes_available( void )
+{
+    return( CheckVAESSupport() != 0 );
+}
+
+static int vaes_crypt_ecb( aesx_context *ctx, int mode, size_t length,
+                           const unsigned char *input, unsigned char *output )
+{
+    if( mode == AES_DECRYPT )
+        AES_ECB_decrypt_vaes( input, output, length, (const char *) ctx->dec.ni, ctx->dec.nr );
+    else
+        AES_ECB_encrypt_vaes( input, output, length, ctx->enc.ni, ctx->enc.nr );
+
+    return( 0 );
+}
+
+static int vaes_crypt_ctr( aesx_context *ctx, size_t length, const unsigned char nonce_counter[16],
+                           unsigned long long block_offset,
+                           const unsigned char *input, unsigned char *output )
+{
+    AES_CTR128_encrypt_vaes( input, output, nonce_counter, block_offset, length,
+                             ctx->enc.ni, ctx->enc.nr );
+
+    return( 0 );
+}
+
+static const aesx_backend aesx_backends[] =
+{
+    { "vaes",      vaes_available,  table_setkey, vaes_crypt_ecb,  aesni_crypt_cbc, vaes_crypt_ctr  },
+    { "aesni",     aesni_available, table_setkey, aesni_crypt_ecb, aesni_crypt_cbc, aesni_crypt_ctr },
+    { "vpaes",     vp_available,    vp_setkey,    vp_crypt_ecb,    vp_crypt_cbc,    vp_crypt_ctr    },
+    { "bitsliced", bs_available,    bs_setkey,    bs_crypt_ecb,    bs_crypt_cbc,    bs_crypt_ctr    },
+    { "table",     table_available, table_setkey, table_crypt_ecb, table_crypt_cbc, table_crypt_ctr },
+};
+
+#define AESX_BACKENDS   (int)( sizeof( aesx_backends ) / sizeof( aesx_backends[0] ) )
+
+static const aesx_backend *aesx_default = &aesx_backends[AESX_BACKENDS - 1];
+
+static void aesx_probe( void ) __attribute__ ((constructor));
+
+static void aesx_probe( void )
+{
+    int i;
+
+    for( i = 0; i < AESX_BACKENDS; i++ )
+    {
+        if( aesx_backends[i].available() )
+        {
+            aesx_default = &aesx_backends[i];
+            return;
+        }
+    }
+}
+
+const char *aesx_backend_name( void )
+{
+    return( aesx_default->name );
+}
+
+int aesx_backend_select( const char *name )
+{
+    int i;
+
+    for( i = 0; i < AESX_BACKENDS; i++ )
+    {
+        if( strcmp( aesx_backends[i].name, name ) == 0 )
+        {
+            if( !aesx_backends[i].available() )
+                break;
+
+            aesx_default = &aesx_backends[i];
+            return( 0 );
+        }
+    }
+
+    return( POLARSSL_ERR_AESX_BACKEND_UNAVAILABLE );
+}
+
+int aesx_backend_count( void )
+{
+    return( AESX_BACKENDS );
+}
+
+const aesx_backend *aesx_backend_get( int i )
+{
+    return( ( i >= 0 && i < AESX_BACKENDS ) ? &aesx_backends[i] : NULL );
+}
+
+int aesx_setkey( aesx_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    ctx->backend = aesx_default;
+
+    return( ctx->backend->setkey( ctx, key, keysize ) );
+}
+
+int aesx_crypt_ecb( aesx_context *ctx,
+                    int mode,
+                    size_t length,
+                    const unsigned char *input,
+                    unsigned char *output )
+{
+    if( length % 16 )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    return( ctx->backend->crypt_ecb( ctx, mode, length, input, output ) );
+}
+
+int aesx_crypt_cbc( aesx_context *ctx,
+                    int mode,
+                    size_t length,
+                    unsigned char iv[16],
+                    const unsigned char *input,
+                    unsigned char *output )
+{
+    if( length % 16 )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    return( ctx->backend->crypt_cbc( ctx, mode, length, iv, input, output ) );
+}
+
+int aesx_crypt_ctr( aesx_context *ctx,
+                    size_t length,
+                    const unsigned char nonce_counter[16],
+                    unsigned long long block_offset,
+                    const unsigned char *input,
+                    unsigned char *output )
+{
+    return( ctx->backend->crypt_ctr( ctx, length, nonce_counter, block_offset, input, output ) );
+}
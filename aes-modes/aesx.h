@@ -0,0 +1,158 @@
+/**
+ * \file aesx.h
+ *
+ * \brief One AES API over the table, bitsliced, vector permute, AES-NI and
+ *        VAES implementations
+ *
+ * The fastest backend the CPU supports is chosen once, at startup, and
+ * aesx_setkey binds a context to it. Every call after that is a single
+ * indirect call with no feature checks, and the same binary runs on any
+ * x86-64 host.
+ */
+#ifndef POLARSSL_AESX_H
+#define POLARSSL_AESX_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+#include "aesbs.h"
+#include "vpaes.h"
+
+#define POLARSSL_ERR_AESX_BACKEND_UNAVAILABLE              -0x0024  /**< Backend unknown or not supported by this CPU. */
+
+typedef struct aesx_context aesx_context;
+
+/**
+ * \brief          AES backend: a name, a CPU check and the kernels.
+ *                 ECB/CBC lengths reaching the kernels are already a
+ *                 multiple of 16.
+ */
+typedef struct
+{
+    const char *name;
+    int (*available)( void );
+    int (*setkey)( aesx_context *ctx, const unsigned char *key, unsigned int keysize );
+    int (*crypt_ecb)( aesx_context *ctx, int mode, size_t length,
+                      const unsigned char *input, unsigned char *output );
+    int (*crypt_cbc)( aesx_context *ctx, int mode, size_t length, unsigned char iv[16],
+                      const unsigned char *input, unsigned char *output );
+    int (*crypt_ctr)( aesx_context *ctx, size_t length, const unsigned char nonce_counter[16],
+                      unsigned long long block_offset,
+                      const unsigned char *input, unsigned char *output );
+}
+aesx_backend;
+
+/**
+ * \brief          AES context: both directions, for whichever backend
+ *                 it was keyed with
+ */
+struct aesx_context
+{
+    const aesx_backend *backend;    /*!<  bound by aesx_setkey          */
+    aes_context enc;                /*!<  table and AES-NI/VAES schedules */
+    aes_context dec;
+    aesbs_context bs;               /*!<  bitsliced round keys          */
+    vpaes_context venc;             /*!<  vector permute schedules      */
+    vpaes_context vdec;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Name of the backend new contexts are bound to
+ */
+const char *aesx_backend_name( void );
+
+/**
+ * \brief          Bind new contexts to another backend, e.g. to compare
+ *                 them. Contexts keyed earlier keep their backend.
+ *
+ * \param name     backend name ("vaes", "aesni", "vpaes", "bitsliced",
+ *                 "table")
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AESX_BACKEND_UNAVAILABLE
+ */
+int aesx_backend_select( const char *name );
+
+/**
+ * \brief          Number of backends compiled in, and the i-th one
+ *                 (available or not), for listing
+ */
+int aesx_backend_count( void );
+const aesx_backend *aesx_backend_get( int i );
+
+/**
+ * \brief          AES key schedule (encryption and decryption)
+ *
+ * \param ctx      AES context to be initialized
+ * \param key      key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int aesx_setkey( aesx_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          AES-ECB buffer encryption/decryption
+ *
+ * \param ctx      AES context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the input data, a multiple of 16
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int aesx_crypt_ecb( aesx_context *ctx,
+                    int mode,
+                    size_t length,
+                    const unsigned char *input,
+                    unsigned char *output );
+
+/**
+ * \brief          AES-CBC buffer encryption/decryption
+ *
+ * \param ctx      AES context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the input data, a multiple of 16
+ * \param iv       initialization vector (updated after use)
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int aesx_crypt_cbc( aesx_context *ctx,
+                    int mode,
+                    size_t length,
+                    unsigned char iv[16],
+                    const unsigned char *input,
+                    unsigned char *output );
+
+/**
+ * \brief          AES-CTR buffer encryption/decryption at an absolute
+ *                 block offset (see aes_crypt_ctr_at)
+ *
+ * \param ctx           AES context
+ * \param length        The length of the data
+ * \param nonce_counter The 128-bit nonce and counter of block 0
+ * \param block_offset  Index of the first block of input in the message
+ * \param input         The input data stream
+ * \param output        The output data stream
+ *
+ * \return         0 if successful
+ */
+int aesx_crypt_ctr( aesx_context *ctx,
+                    size_t length,
+                    const unsigned char nonce_counter[16],
+                    unsigned long long block_offset,
+                    const unsigned char *input,
+                    unsigned char *output );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* aesx.h */
@@ -0,0 +1,399 @@
+/*
+ *  AES-CCM
+ *
+ *  http://csrc.nist.gov/publications/nistpubs/800-38C/SP800-38C_updated-July20_2007.pdf
+ *
+ *  CCM is a CBC-MAC over the plaintext plus CTR encryption. Run as two
+ *  passes, the MAC chain leaves the AES unit idle between its dependent
+ *  calls and the data is read twice. Here each step encrypts the next
+ *  MAC block and one counter block in the same rounds. Decryption needs
+ *  the keystream before it can MAC, so there the counter block of step
+ *  i is the one for block i + 1.
+ */
+
+#include "ccm.h"
+
+#define BSWAP_MASK  _mm_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
+
+static inline void ccm_encrypt1( ccm_context *ctx, __m128i *a )
+{
+    const __m128i *k = (const __m128i *) ctx->ctx.ni;
+    unsigned char x[16];
+    int j;
+
+    if( !ctx->aesni )
+    {
+        _mm_storeu_si128( (__m128i *) x, *a );
+        aes_crypt_ecb( &ctx->ctx, AES_ENCRYPT, x, x );
+        *a = _mm_loadu_si128( (__m128i *) x );
+        return;
+    }
+
+    *a = _mm_xor_si128( *a, k[0] );
+    for( j = 1; j < ctx->ctx.nr; j++ )
+        *a = _mm_aesenc_si128( *a, k[j] );
+    *a = _mm_aesenclast_si128( *a, k[j] );
+}
+
+/*
+ * The MAC block a and the counter block b share every AES-NI round
+ */
+static inline void ccm_encrypt2( ccm_context *ctx, __m128i *a, __m128i *b )
+{
+    const __m128i *k = (const __m128i *) ctx->ctx.ni;
+    int j;
+
+    if( !ctx->aesni )
+    {
+        ccm_encrypt1( ctx, a );
+        ccm_encrypt1( ctx, b );
+        return;
+    }
+
+    *a = _mm_xor_si128( *a, k[0] );
+    *b = _mm_xor_si128( *b, k[0] );
+    for( j = 1; j < ctx->ctx.nr; j++ )
+    {
+        *a = _mm_aesenc_si128( *a, k[j] );
+        *b = _mm_aesenc_si128( *b, k[j] );
+    }
+    *a = _mm_aesenclast_si128( *a, k[j] );
+    *b = _mm_aesenclast_si128( *b, k[j] );
+}
+
+int ccm_init( ccm_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    if( aes_setkey_enc( &ctx->ctx, key, keysize ) != 0 )
+        return( POLARSSL_ERR_CCM_BAD_INPUT );
+
+    ctx->aesni = CheckAESSupport();
+
+    return( 0 );
+}
+
+int ccm_crypt_and_tag( ccm_context *ctx,
+                       int mode,
+                       size_t length,
+                       const unsigned char *iv,
+                       size_t iv_len,
+                       const unsigned char *add,
+                       size_t add_len,
+                       const unsigned char *input,
+                       unsigned char *output,
+                       size_t tag_len,
+                       unsigned char *tag )
+{
+    ALIGN16 unsigned char b[16];
+    const __m128i one = _mm_set_epi64x( 0, 1 );
+    __m128i x, s0, cb, ks, p;
+    unsigned long long len;
+    size_t q = 15 - iv_len, i, n, use;
+
+    if( iv_len < 7 || iv_len > 13 || tag_len < 4 || tag_len > 16 || tag_len % 2 != 0 )
+        return( POLARSSL_ERR_CCM_BAD_INPUT );
+
+    if( q < sizeof( size_t ) && ( length >> ( 8 * q ) ) != 0 )
+        return( POLARSSL_ERR_CCM_BAD_INPUT );
+
+    /*
+     * B0 = flags || N || length, Ctr_0 = q - 1 || N || 0; the first MAC
+     * step also yields S0 = E(Ctr_0) for the tag
+     */
+    b[0] = (unsigned char)( ( add_len > 0 ? 64 : 0 ) | ( ( tag_len - 2 ) / 2 ) << 3 | ( q - 1 ) );
+    memcpy( b + 1, iv, iv_len );
+    for( i = 0, len = length; i < q; i++, len >>= 8 )
+        b[15 - i] = (unsigned char) len;
+    x = _mm_load_si128( (__m128i *) b );
+
+    b[0] = (unsigned char)( q - 1 );
+    memset( b + 1 + iv_len, 0, q );
+    s0 = _mm_load_si128( (__m128i *) b );
+    cb = _mm_shuffle_epi8( s0, BSWAP_MASK );
+
+    ccm_encrypt2( ctx, &x, &s0 );
+
+    /*
+     * Associated data, prefixed with its encoded length and zero padded
+     */
+    if( add_len > 0 )
+    {
+        memset( b, 0, 16 );
+        len = add_len;
+        if( len < 0xFF00 )
+            use = 2;
+        else
+        {
+            b[0] = 0xFF;
+            b[1] = ( len <= 0xFFFFFFFFULL ) ? 0xFE : 0xFF;
+            use = ( len <= 0xFFFFFFFFULL ) ? 6 : 10;
+        }
+        for( i = use; i > ( use == 2 ? 0 : 2 ); i--, len >>= 8 )
+            b[i - 1] = (unsigned char) len;
+
+        do
+        {
+            n = ( add_len < 16 - use ) ? add_len : 16 - use;
+            memcpy( b + use, add, n );
+            add += n;
+            add_len -= n;
+
+            x = _mm_xor_si128( x, _mm_load_si128( (__m128i *) b ) );
+            ccm_encrypt1( ctx, &x );
+
+            memset( b, 0, 16 );
+            use = 0;
+        }
+        while( add_len > 0 );
+    }
+
+    /*
+     * Payload: one MAC block and one keystream block per step
+     */
+    if( mode == CCM_ENCRYPT )
+    {
+        for( ; length > 0; length -= n, input += n, output += n )
+        {
+            n = ( length < 16 ) ? length : 16;
+
+            if( n == 16 )
+                p = _mm_loadu_si128( (const __m128i *) input );
+            else
+            {
+                memset( b, 0, 16 );
+                memcpy( b, input, n );
+                p = _mm_load_si128( (__m128i *) b );
+            }
+
+            x = _mm_xor_si128( x, p );
+            cb = _mm_add_epi64( cb, one );
+            ks = _mm_shuffle_epi8( cb, BSWAP_MASK );
+            ccm_encrypt2( ctx, &x, &ks );
+
+            if( n == 16 )
+                _mm_storeu_si128( (__m128i *) output, _mm_xor_si128( ks, p ) );
+            else
+            {
+                _mm_store_si128( (__m128i *) b, _mm_xor_si128( ks, p ) );
+                memcpy( output, b, n );
+            }
+        }
+    }
+    else if( length > 0 )
+    {
+        cb = _mm_add_epi64( cb, one );
+        ks = _mm_shuffle_epi8( cb, BSWAP_MASK );
+        ccm_encrypt1( ctx, &ks );
+
+        for( ; length > 0; length -= n, input += n, output += n )
+        {
+            n = ( length < 16 ) ? length : 16;
+
+            if( n == 16 )
+            {
+                p = _mm_xor_si128( ks, _mm_loadu_si128( (const __m128i *) input ) );
+                _mm_storeu_si128( (__m128i *) output, p );
+            }
+            else
+            {
+                memset( b, 0, 16 );
+                memcpy( b, input, n );
+                _mm_store_si128( (__m128i *) b, _mm_xor_si128( ks, _mm_load_si128( (__m128i *) b ) ) );
+                memset( b + n, 0, 16 - n );
+                memcpy( output, b, n );
+                p = _mm_load_si128( (__m128i *) b );
+            }
+
+            x = _mm_xor_si128( x, p );
+            if( length > n )
+            {
+                cb = _mm_add_epi64( cb, one );
+                ks = _mm_shuffle_epi8( cb, BSWAP_MASK );
+                ccm_encrypt2( ctx, &x, &ks );
+            }
+            else
+                ccm_encrypt1( ctx, &x );
+        }
+    }
+
+    /*
+     * T = MAC ^ S0
+     */
+    _mm_store_si128( (__m128i *) b, _mm_xor_si128( x, s0 ) );
+    memcpy( tag, b, tag_len );
+
+    return( 0 );
+}
+
+int ccm_auth_decrypt( ccm_context *ctx,
+                      size_t length,
+                      const unsigned char *iv,
+                      size_t iv_len,
+                      const unsigned char *add,
+                      size_t add_len,
+                      const unsigned char *tag,
+                      size_t tag_len,
+                      const unsigned char *input,
+                      unsigned char *output )
+{
+    unsigned char check_tag[16];
+    size_t i;
+    int ret, diff;
+
+    if( ( ret = ccm_crypt_and_tag( ctx, CCM_DECRYPT, length, iv, iv_len,
+                                   add, add_len, input, output,
+                                   tag_len, check_tag ) ) != 0 )
+        return( ret );
+
+    /* Check tag in "constant-time" */
+    for( diff = 0, i = 0; i < tag_len; i++ )
+        diff |= tag[i] ^ check_tag[i];
+
+    if( diff != 0 )
+    {
+        memset( output, 0, length );
+        return( POLARSSL_ERR_CCM_AUTH_FAILED );
+    }
+
+    return( 0 );
+}
+
+#if defined(POLARSSL_SELF_TEST)
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Examples 1 to 4 from SP800-38C Appendix C:
+ *
+ * http://csrc.nist.gov/publications/nistpubs/800-38C/SP800-38C_updated-July20_2007.pdf
+ *
+ * and packet vector #1 from RFC 3610:
+ *
+ * http://tools.ietf.org/html/rfc3610
+ *
+ * Example 4 has 2^16 bytes of associated data (0x00..0xFF repeated),
+ * which needs the 6-byte length encoding; it is built at run time.
+ */
+#define NB_TESTS 5
+
+static const unsigned char key[2][16] =
+{
+    { 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+      0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f },
+    { 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+      0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf }
+};
+
+static const unsigned char iv[2][13] =
+{
+    { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+      0x18, 0x19, 0x1a, 0x1b, 0x1c },
+    { 0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xa0,
+      0xa1, 0xa2, 0xa3, 0xa4, 0xa5 }
+};
+
+static const unsigned char msg[2][32] =
+{
+    { 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+      0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+      0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+      0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f },
+    { 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+      0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e }
+};
+
+static const int test_index[NB_TESTS] = { 0, 0, 0, 0, 1 };
+static const size_t iv_len [NB_TESTS] = { 7, 8,  12, 13,    13 };
+static const size_t add_len[NB_TESTS] = { 8, 16, 20, 65536, 8 };
+static const size_t msg_len[NB_TESTS] = { 4, 16, 24, 32,    23 };
+static const size_t tag_len[NB_TESTS] = { 4, 6,  8,  14,    8 };
+
+static const unsigned char res[NB_TESTS][46] =
+{
+    { 0x71, 0x62, 0x01, 0x5b, 0x4d, 0xac, 0x25, 0x5d },
+    { 0xd2, 0xa1, 0xf0, 0xe0, 0x51, 0xea, 0x5f, 0x62,
+      0x08, 0x1a, 0x77, 0x92, 0x07, 0x3d, 0x59, 0x3d,
+      0x1f, 0xc6, 0x4f, 0xbf, 0xac, 0xcd },
+    { 0xe3, 0xb2, 0x01, 0xa9, 0xf5, 0xb7, 0x1a, 0x7a,
+      0x9b, 0x1c, 0xea, 0xec, 0xcd, 0x97, 0xe7, 0x0b,
+      0x61, 0x76, 0xaa, 0xd9, 0xa4, 0x42, 0x8a, 0xa5,
+      0x48, 0x43, 0x92, 0xfb, 0xc1, 0xb0, 0x99, 0x51 },
+    { 0x69, 0x91, 0x5d, 0xad, 0x1e, 0x84, 0xc6, 0x37,
+      0x6a, 0x68, 0xc2, 0x96, 0x7e, 0x4d, 0xab, 0x61,
+      0x5a, 0xe0, 0xfd, 0x1f, 0xae, 0xc4, 0x4c, 0xc4,
+      0x84, 0x82, 0x85, 0x29, 0x46, 0x3c, 0xcf, 0x72,
+      0xb4, 0xac, 0x6b, 0xec, 0x93, 0xe8, 0x59, 0x8e,
+      0x7f, 0x0d, 0xad, 0xbc, 0xea, 0x5b },
+    { 0x58, 0x8c, 0x97, 0x9a, 0x61, 0xc6, 0x63, 0xd2,
+      0xf0, 0x66, 0xd0, 0xc2, 0xc0, 0xf9, 0x89, 0x80,
+      0x6d, 0x5f, 0x6b, 0x61, 0xda, 0xc3, 0x84, 0x17,
+      0xe8, 0xd1, 0x2c, 0xfd, 0xf9, 0x26, 0xe0 }
+};
+
+/*
+ * Checkup routine
+ */
+int ccm_self_test( int verbose )
+{
+    ccm_context ctx;
+    unsigned char *ad;
+    unsigned char out[46];
+    int i, n, path, ret = 0;
+
+    if( ( ad = malloc( 65536 ) ) == NULL )
+        return( 1 );
+
+    /*
+     * The associated data of the SP800-38C examples is 00 01 02 ...,
+     * that of the RFC 3610 packet the first 8 bytes 00..07 as well
+     */
+    for( i = 0; i < 65536; i++ )
+        ad[i] = (unsigned char) i;
+
+    /*
+     * The AES-NI path (when available) and the aes_crypt_ecb path
+     */
+    for( path = CheckAESSupport() ? 1 : 0; path >= 0 && ret == 0; path-- )
+    {
+        for( i = 0; i < NB_TESTS; i++ )
+        {
+            n = test_index[i];
+
+            if( verbose != 0 )
+                printf( "  CCM-AES #%d (%s): ", i + 1, path ? "aesni" : "table" );
+
+            ccm_init( &ctx, key[n], 128 );
+            ctx.aesni = path;
+
+            ccm_crypt_and_tag( &ctx, CCM_ENCRYPT, msg_len[i], iv[n], iv_len[i],
+                               ad, add_len[i], msg[n], out,
+                               tag_len[i], out + msg_len[i] );
+
+            if( memcmp( out, res[i], msg_len[i] + tag_len[i] ) != 0 ||
+                ccm_auth_decrypt( &ctx, msg_len[i], iv[n], iv_len[i],
+                                  ad, add_len[i], res[i] + msg_len[i], tag_len[i],
+                                  res[i], out ) != 0 ||
+                memcmp( out, msg[n], msg_len[i] ) != 0 )
+            {
+                if( verbose != 0 )
+                    printf( "failed\n" );
+
+                ret = 1;
+                break;
+            }
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+    }
+
+    free( ad );
+
+    if( verbose != 0 )
+        printf( "\n" );
+
+    return( ret );
+}
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * \file ccm.h
+ *
+ * \brief AES-CCM (NIST SP 800-38C, RFC 3610)
+ *
+ * The CBC-MAC chain and the CTR keystream are computed in the same
+ * loop: each AES-NI pass runs one MAC block and one counter block side
+ * by side, so the independent CTR work fills the latency of the serial
+ * MAC. Without AES-NI the same loop runs on aes_crypt_ecb.
+ */
+#ifndef POLARSSL_CCM_H
+#define POLARSSL_CCM_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+
+#define CCM_ENCRYPT     1
+#define CCM_DECRYPT     0
+
+#define POLARSSL_ERR_CCM_BAD_INPUT                         -0x000D  /**< Bad input parameters to function. */
+#define POLARSSL_ERR_CCM_AUTH_FAILED                       -0x000F  /**< Authenticated decryption failed. */
+
+/**
+ * \brief          CCM context structure
+ */
+typedef struct
+{
+    int aesni;                          /*!<  use the AES-NI path            */
+    aes_context ctx;                    /*!<  encryption schedule, both paths */
+}
+ccm_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          CCM initialization (encryption)
+ *
+ * \param ctx      CCM context to be initialized
+ * \param key      encryption key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_CCM_BAD_INPUT
+ */
+int ccm_init( ccm_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          CCM buffer encryption/decryption using AES
+ *
+ * \param ctx      CCM context
+ * \param mode     CCM_ENCRYPT or CCM_DECRYPT
+ * \param length   length of the input data
+ * \param iv       nonce
+ * \param iv_len   length of the nonce (7 to 13 bytes); the remaining
+ *                 15 - iv_len bytes encode the length, which must fit
+ * \param add      additional data
+ * \param add_len  length of additional data
+ * \param input    buffer holding the input data
+ * \param output   buffer for holding the output data
+ * \param tag_len  length of the tag to generate (4, 6, ..., 16 bytes)
+ * \param tag      buffer for holding the tag
+ *
+ * \return         0 if successful, or POLARSSL_ERR_CCM_BAD_INPUT
+ */
+int ccm_crypt_and_tag( ccm_context *ctx,
+                       int mode,
+                       size_t length,
+                       const unsigned char *iv,
+                       size_t iv_len,
+                       const unsigned char *add,
+                       size_t add_len,
+                       const unsigned char *input,
+                       unsigned char *output,
+                       size_t tag_len,
+                       unsigned char *tag );
+
+/**
+ * \brief          CCM buffer authenticated decryption using AES
+ *
+ * \param ctx      CCM context
+ * \param length   length of the input data
+ * \param iv       nonce
+ * \param iv_len   length of the nonce
+ * \param add      additional data
+ * \param add_len  length of additional data
+ * \param tag      buffer holding the tag
+ * \param tag_len  length of the tag
+ * \param input    buffer holding the input data
+ * \param output   buffer for holding the output data
+ *
+ * \return         0 if successful and authenticated,
+ *                 POLARSSL_ERR_CCM_AUTH_FAILED if tag does not match
+ *                 (output is then zeroed)
+ */
+int ccm_auth_decrypt( ccm_context *ctx,
+                      size_t length,
+                      const unsigned char *iv,
+                      size_t iv_len,
+                      const unsigned char *add,
+                      size_t add_len,
+                      const unsigned char *tag,
+                      size_t tag_len,
+                      const unsigned char *input,
+                      unsigned char *output );
+
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int ccm_self_test( int verbose );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ccm.h */
@@ -0,0 +1,393 @@
+/*
+ *  AES-CMAC
+ *
+ *  http://tools.ietf.org/html/rfc4493
+ *
+ *  One CMAC is a CBC-MAC chain: every AES call waits for the previous
+ *  one, so a single message runs at the latency of aesenc rather than its
+ *  throughput. The batch entry point keeps CMAC_LANES independent chains
+ *  in the 8-block kernel instead; each pass advances every chain by one
+ *  block and a chain that finishes hands its slot to the next message.
+ */
+
+#include "cmac.h"
+
+/*
+ * Multiplication by x in GF(2^128), big-endian bit order (RFC 4493 2.3)
+ */
+void cmac_dbl( unsigned char out[16], const unsigned char in[16] )
+{
+    unsigned char msb = in[0] >> 7;
+    int i;
+
+    for( i = 0; i < 15; i++ )
+        out[i] = (unsigned char)( ( in[i] << 1 ) | ( in[i + 1] >> 7 ) );
+
+    out[15] = (unsigned char)( ( in[15] << 1 ) ^ ( -msb & 0x87 ) );
+}
+
+/*
+ * The last block of a message from its remaining 0..16 bytes: masked
+ * with K1 when complete, padded with 10* and masked with K2 otherwise
+ */
+void cmac_last( const unsigned char K1[16], const unsigned char K2[16],
+                const unsigned char *p, size_t left, unsigned char blk[16] )
+{
+    int i;
+
+    if( left == 16 )
+    {
+        for( i = 0; i < 16; i++ )
+            blk[i] = p[i] ^ K1[i];
+        return;
+    }
+
+    memset( blk, 0, 16 );
+    if( left > 0 )
+        memcpy( blk, p, left );
+    blk[left] = 0x80;
+
+    for( i = 0; i < 16; i++ )
+        blk[i] ^= K2[i];
+}
+
+int cmac_setkey( cmac_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    unsigned char L[16];
+    int ret;
+
+    if( ( ret = aes_setkey_enc( &ctx->ctx, key, keysize ) ) != 0 )
+        return( ret );
+
+    ctx->aesni = CheckAESSupport();
+
+    memset( L, 0, sizeof( L ) );
+    aes_crypt_ecb( &ctx->ctx, AES_ENCRYPT, L, L );
+
+    cmac_dbl( ctx->K1, L );
+    cmac_dbl( ctx->K2, ctx->K1 );
+
+    memset( L, 0, sizeof( L ) );
+
+    return( 0 );
+}
+
+/*
+ * One chain on AES-NI, the state kept in a register
+ */
+static void cmac_aesni( const cmac_context *ctx, const unsigned char *input, size_t ilen,
+                        unsigned char mac[16] )
+{
+    const __m128i *k = (const __m128i *) ctx->ctx.ni;
+    int nr = ctx->ctx.nr, j;
+    unsigned char blk[16];
+    __m128i x = _mm_setzero_si128();
+
+    for( ;; )
+    {
+        if( ilen > 16 )
+            x = _mm_xor_si128( x, _mm_loadu_si128( (const __m128i *) input ) );
+        else
+        {
+            cmac_last( ctx->K1, ctx->K2, input, ilen, blk );
+            x = _mm_xor_si128( x, _mm_loadu_si128( (const __m128i *) blk ) );
+        }
+
+        x = _mm_xor_si128( x, k[0] );
+        for( j = 1; j < nr; j++ )
+            x = _mm_aesenc_si128( x, k[j] );
+        x = _mm_aesenclast_si128( x, k[j] );
+
+        if( ilen <= 16 )
+            break;
+
+        input += 16;
+        ilen -= 16;
+    }
+
+    _mm_storeu_si128( (__m128i *) mac, x );
+}
+
+/*
+ * AES-CMAC of one message
+ */
+int cmac( cmac_context *ctx,
+          const unsigned char *input,
+          size_t ilen,
+          unsigned char mac[16] )
+{
+    unsigned char x[16], blk[16];
+    int i;
+
+    if( ctx->aesni )
+    {
+        cmac_aesni( ctx, input, ilen, mac );
+        return( 0 );
+    }
+
+    memset( x, 0, sizeof( x ) );
+
+    for( ; ilen > 16; ilen -= 16, input += 16 )
+    {
+        for( i = 0; i < 16; i++ )
+            x[i] ^= input[i];
+        aes_crypt_ecb( &ctx->ctx, AES_ENCRYPT, x, x );
+    }
+
+    cmac_last( ctx->K1, ctx->K2, input, ilen, blk );
+    for( i = 0; i < 16; i++ )
+        x[i] ^= blk[i];
+    aes_crypt_ecb( &ctx->ctx, AES_ENCRYPT, x, mac );
+
+    return( 0 );
+}
+
+/*
+ * AES-CMAC of n independent messages
+ */
+int cmac_batch( cmac_context *ctx,
+                size_t n,
+                const unsigned char *const input[],
+                const size_t ilen[],
+                unsigned char *const mac[] )
+{
+    const __m128i *k = (const __m128i *) ctx->ctx.ni;
+    const unsigned char *p[CMAC_LANES];
+    size_t left[CMAC_LANES], id[CMAC_LANES], next = 0;
+    int live[CMAC_LANES], last[CMAC_LANES], active = 0, i, j;
+    unsigned char blk[16];
+    __m128i x[CMAC_LANES], b[CMAC_LANES];
+
+    if( !ctx->aesni )
+    {
+        for( next = 0; next < n; next++ )
+            cmac( ctx, input[next], ilen[next], mac[next] );
+        return( 0 );
+    }
+
+    for( i = 0; i < CMAC_LANES; i++ )
+    {
+        live[i] = ( next < n );
+        if( live[i] )
+        {
+            id[i] = next;
+            p[i] = input[next];
+            left[i] = ilen[next];
+            x[i] = _mm_setzero_si128();
+            next++;
+            active++;
+        }
+    }
+
+    while( active > 0 )
+    {
+        for( i = 0; i < CMAC_LANES; i++ )
+        {
+            last[i] = 0;
+            if( !live[i] )
+                b[i] = _mm_setzero_si128();
+            else if( left[i] > 16 )
+            {
+                b[i] = _mm_xor_si128( x[i], _mm_loadu_si128( (const __m128i *) p[i] ) );
+                p[i] += 16;
+                left[i] -= 16;
+            }
+            else
+            {
+                cmac_last( ctx->K1, ctx->K2, p[i], left[i], blk );
+                b[i] = _mm_xor_si128( x[i], _mm_loadu_si128( (const __m128i *) blk ) );
+                last[i] = 1;
+            }
+        }
+
+        if( live[4] | live[5] | live[6] | live[7] )
+            AES_encrypt8( b, k, ctx->ctx.nr );
+        else
+            AES_encrypt4( b, k, ctx->ctx.nr );
+
+        for( i = 0; i < CMAC_LANES; i++ )
+        {
+            if( !live[i] )
+                continue;
+
+            x[i] = b[i];
+            if( !last[i] )
+                continue;
+
+            _mm_storeu_si128( (__m128i *) mac[id[i]], x[i] );
+
+            /* hand the slot to the next message */
+            if( next < n )
+            {
+                id[i] = next;
+                p[i] = input[next];
+                left[i] = ilen[next];
+                x[i] = _mm_setzero_si128();
+                next++;
+            }
+            else
+            {
+                live[i] = 0;
+                active--;
+            }
+        }
+
+        /* once messages run out, move chains down so the tail can use
+         * the 4-block kernel */
+        for( i = 0, j = 4; i < 4 && j < CMAC_LANES; i++ )
+        {
+            if( live[i] )
+                continue;
+
+            while( j < CMAC_LANES && !live[j] )
+                j++;
+            if( j == CMAC_LANES )
+                break;
+
+            id[i] = id[j];
+            p[i] = p[j];
+            left[i] = left[j];
+            x[i] = x[j];
+            live[i] = 1;
+            live[j] = 0;
+        }
+    }
+
+    return( 0 );
+}
+
+#if defined(POLARSSL_SELF_TEST)
+
+#include <stdio.h>
+
+/*
+ * RFC 4493 Section 4 examples 1 to 4: the key and message are those of
+ * SP 800-38A F.1 (the message truncated to 0, 16, 40 and 64 bytes)
+ */
+#define NB_TESTS 4
+
+static const unsigned char cmac_test_key[16] =
+{
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static const unsigned char cmac_test_msg[64] =
+{
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+    0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11,
+    0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17,
+    0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+
+static const size_t cmac_test_len[NB_TESTS] = { 0, 16, 40, 64 };
+
+static const unsigned char cmac_test_mac[NB_TESTS][16] =
+{
+    { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28,
+      0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 },
+    { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+      0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c },
+    { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30,
+      0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 },
+    { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92,
+      0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe }
+};
+
+/*
+ * cmac_batch over more messages than lanes, of mixed lengths (empty,
+ * whole blocks, partial blocks), so slots are refilled unevenly and the
+ * tail drops to the 4-block kernel
+ */
+#define CMAC_BATCH_N    27
+
+static const size_t cmac_batch_len[CMAC_BATCH_N] =
+{
+      0,  16,   1,  64, 128,  15,  17,  31,  32,
+     33,  48, 100,   0,   7,  80, 129,  16,  63,
+     65,  96, 112,   3,  47, 200,   1,  24, 256
+};
+
+/*
+ * Checkup routine
+ */
+int cmac_self_test( int verbose )
+{
+    cmac_context ctx;
+    unsigned char buf[CMAC_BATCH_N * 13 + 256];
+    unsigned char tag[CMAC_BATCH_N][16], ref[CMAC_BATCH_N][16];
+    const unsigned char *in[CMAC_BATCH_N];
+    unsigned char *out[CMAC_BATCH_N];
+    int i, path;
+
+    for( i = 0; i < (int) sizeof( buf ); i++ )
+        buf[i] = (unsigned char)( i * 7 + 3 );
+
+    for( i = 0; i < CMAC_BATCH_N; i++ )
+    {
+        in[i] = buf + 13 * i;
+        out[i] = tag[i];
+    }
+
+    cmac_setkey( &ctx, cmac_test_key, 128 );
+
+    /*
+     * The AES-NI path (when available) and the aes_crypt_ecb path
+     */
+    for( path = CheckAESSupport() ? 1 : 0; path >= 0; path-- )
+    {
+        ctx.aesni = path;
+
+        for( i = 0; i < NB_TESTS; i++ )
+        {
+            if( verbose != 0 )
+                printf( "  AES-CMAC-128 #%d (%s): ", i + 1, path ? "aesni" : "table" );
+
+            cmac( &ctx, cmac_test_msg, cmac_test_len[i], tag[0] );
+
+            if( memcmp( tag[0], cmac_test_mac[i], 16 ) != 0 )
+                goto fail;
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+
+        if( verbose != 0 )
+            printf( "  AES-CMAC-128 batch of %d (%s): ", CMAC_BATCH_N,
+                    path ? "aesni" : "table" );
+
+        cmac_batch( &ctx, CMAC_BATCH_N, in, cmac_batch_len, out );
+
+        for( i = 0; i < CMAC_BATCH_N; i++ )
+        {
+            if( path == 0 && CheckAESSupport() &&
+                memcmp( tag[i], ref[i], 16 ) != 0 )
+                goto fail;
+
+            cmac( &ctx, in[i], cmac_batch_len[i], ref[i] );
+
+            if( memcmp( tag[i], ref[i], 16 ) != 0 )
+                goto fail;
+        }
+
+        if( verbose != 0 )
+            printf( "passed\n" );
+    }
+
+    if( verbose != 0 )
+        printf( "\n" );
+
+    return( 0 );
+
+fail:
+    if( verbose != 0 )
+        printf( "failed\n\n" );
+
+    return( 1 );
+}
+
+#endif
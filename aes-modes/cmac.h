@@ -0,0 +1,119 @@
+/**
+ * \file cmac.h
+ *
+ * \brief AES-CMAC (RFC 4493, NIST SP 800-38B)
+ *
+ * A single CMAC is one serial chain of AES calls. cmac_batch computes
+ * many independent CMACs at once, one message per AES-NI pipeline slot,
+ * so throughput on small records is not bound by the latency of a
+ * single chain. Without AES-NI the table implementation is used.
+ */
+#ifndef POLARSSL_CMAC_H
+#define POLARSSL_CMAC_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+
+#define CMAC_LANES      8       /**< messages in flight in cmac_batch */
+
+/**
+ * \brief          CMAC context structure
+ */
+typedef struct
+{
+    int aesni;                          /*!<  use the AES-NI path              */
+    aes_context ctx;                    /*!<  encryption schedule, both paths  */
+    unsigned char K1[16];               /*!<  subkey for a complete last block */
+    unsigned char K2[16];               /*!<  subkey for a padded last block   */
+}
+cmac_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          CMAC key schedule and subkey generation
+ *
+ * \param ctx      CMAC context to be initialized
+ * \param key      AES key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int cmac_setkey( cmac_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          AES-CMAC of one message
+ *
+ * \param ctx      CMAC context
+ * \param input    message
+ * \param ilen     length of the message (may be 0)
+ * \param mac      16-byte output tag
+ *
+ * \return         0 if successful
+ */
+int cmac( cmac_context *ctx,
+          const unsigned char *input,
+          size_t ilen,
+          unsigned char mac[16] );
+
+/**
+ * \brief          AES-CMAC of n independent messages under one key
+ *
+ *                 Up to CMAC_LANES messages advance together, one block
+ *                 each per AES pass; a slot freed by a finished message
+ *                 takes the next one, so messages may have any mix of
+ *                 lengths.
+ *
+ * \param ctx      CMAC context
+ * \param n        number of messages
+ * \param input    n message pointers
+ * \param ilen     n message lengths
+ * \param mac      n 16-byte output tags
+ *
+ * \return         0 if successful
+ */
+int cmac_batch( cmac_context *ctx,
+                size_t n,
+                const unsigned char *const input[],
+                const size_t ilen[],
+                unsigned char *const mac[] );
+
+/**
+ * \brief          Multiplication by x in GF(2^128), big-endian bit order
+ *                 (RFC 4493 2.3); also the OCB doubling (RFC 7253 2)
+ *
+ * \param out      16-byte result (may equal in)
+ * \param in       16-byte input
+ */
+void cmac_dbl( unsigned char out[16], const unsigned char in[16] );
+
+/**
+ * \brief          The CMAC last block: the remaining bytes of a message
+ *                 xored with K1 when they fill a block, padded with 10*
+ *                 and xored with K2 otherwise
+ *
+ * \param K1       subkey for a complete last block
+ * \param K2       subkey for a padded last block
+ * \param p        remaining bytes of the message
+ * \param left     their number, 0 to 16 (0 only for an empty message)
+ * \param blk      16-byte output block
+ */
+void cmac_last( const unsigned char K1[16], const unsigned char K2[16],
+                const unsigned char *p, size_t left, unsigned char blk[16] );
+
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int cmac_self_test( int verbose );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* cmac.h */
@@ -0,0 +1,729 @@
+/*
+ *  AES-GCM on AES-NI and PCLMULQDQ
+ *
+ *  http://csrc.nist.gov/publications/nistpubs/800-38D/SP-800-38D.pdf
+ *
+ *  GHASH works on byte-reflected blocks using the carry-less multiply and
+ *  reduction from Intel's "Carry-Less Multiplication and Its Usage for
+ *  Computing the GCM Mode" white paper. Blocks are hashed 8 at a time
+ *  against precomputed H^8..H^1 and reduced once per group, and those
+ *  multiplies are spread over the AES rounds of the next 8 counter blocks
+ *  so the keystream and the MAC come out of the same pass over the data.
+ */
+
+#include "gcm.h"
+#include "xor.h"
+
+#define BSWAP_MASK  _mm_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
+
+/*
+ * Accumulate the unreduced 256-bit product a*b into lo/mid/hi
+ */
+static inline void gcm_mul_acc( __m128i a, __m128i b,
+                                __m128i *lo, __m128i *mid, __m128i *hi )
+{
+    *lo  = _mm_xor_si128( *lo,  _mm_clmulepi64_si128( a, b, 0x00 ) );
+    *hi  = _mm_xor_si128( *hi,  _mm_clmulepi64_si128( a, b, 0x11 ) );
+    *mid = _mm_xor_si128( *mid, _mm_clmulepi64_si128( a, b, 0x10 ) );
+    *mid = _mm_xor_si128( *mid, _mm_clmulepi64_si128( a, b, 0x01 ) );
+}
+
+/*
+ * Shift the reflected 256-bit product left by one and reduce it modulo
+ * x^128 + x^7 + x^2 + x + 1. Both steps are linear, so a sum of
+ * products can be reduced once.
+ */
+static inline __m128i gcm_reduce( __m128i lo, __m128i mid, __m128i hi )
+{
+    __m128i t2, t4, t5, t7, t8, t9;
+
+    lo = _mm_xor_si128( lo, _mm_slli_si128( mid, 8 ) );
+    hi = _mm_xor_si128( hi, _mm_srli_si128( mid, 8 ) );
+
+    t7 = _mm_srli_epi32( lo, 31 );
+    t8 = _mm_srli_epi32( hi, 31 );
+    lo = _mm_slli_epi32( lo, 1 );
+    hi = _mm_slli_epi32( hi, 1 );
+    t9 = _mm_srli_si128( t7, 12 );
+    t8 = _mm_slli_si128( t8, 4 );
+    t7 = _mm_slli_si128( t7, 4 );
+    lo = _mm_or_si128( lo, t7 );
+    hi = _mm_or_si128( hi, t8 );
+    hi = _mm_or_si128( hi, t9 );
+
+    t7 = _mm_slli_epi32( lo, 31 );
+    t8 = _mm_slli_epi32( lo, 30 );
+    t9 = _mm_slli_epi32( lo, 25 );
+    t7 = _mm_xor_si128( t7, t8 );
+    t7 = _mm_xor_si128( t7, t9 );
+    t8 = _mm_srli_si128( t7, 4 );
+    t7 = _mm_slli_si128( t7, 12 );
+    lo = _mm_xor_si128( lo, t7 );
+
+    t2 = _mm_srli_epi32( lo, 1 );
+    t4 = _mm_srli_epi32( lo, 2 );
+    t5 = _mm_srli_epi32( lo, 7 );
+    t2 = _mm_xor_si128( t2, t4 );
+    t2 = _mm_xor_si128( t2, t5 );
+    t2 = _mm_xor_si128( t2, t8 );
+    lo = _mm_xor_si128( lo, t2 );
+
+    return( _mm_xor_si128( hi, lo ) );
+}
+
+static __m128i gcm_mult( __m128i a, __m128i b )
+{
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+
+    gcm_mul_acc( a, b, &lo, &mid, &hi );
+
+    return( gcm_reduce( lo, mid, hi ) );
+}
+
+/*
+ * y = (y ^ x[0]) * H^n ^ x[1] * H^(n-1) ^ ... ^ x[n-1] * H, for 1 <= n <= 8
+ */
+static __m128i gcm_ghash_n( const gcm_context *ctx, __m128i y,
+                            const __m128i *x, int n )
+{
+    const __m128i *HL = (const __m128i *) ctx->HL;
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    int i;
+
+    gcm_mul_acc( _mm_xor_si128( y, x[0] ), HL[n - 1], &lo, &mid, &hi );
+
+    for( i = 1; i < n; i++ )
+        gcm_mul_acc( x[i], HL[n - 1 - i], &lo, &mid, &hi );
+
+    return( gcm_reduce( lo, mid, hi ) );
+}
+
+/*
+ * Fold a buffer into y, zero-padding the last partial block
+ */
+static __m128i gcm_ghash_buf( const gcm_context *ctx, __m128i y,
+                              const unsigned char *buf, size_t len )
+{
+    __m128i x[8];
+    unsigned char last[16];
+    int i, n;
+
+    while( len >= 128 )
+    {
+        for( i = 0; i < 8; i++ )
+            x[i] = _mm_shuffle_epi8( _mm_loadu_si128( (__m128i *) buf + i ), BSWAP_MASK );
+
+        y = gcm_ghash_n( ctx, y, x, 8 );
+        buf += 128;
+        len -= 128;
+    }
+
+    for( n = 0; len >= 16; n++, buf += 16, len -= 16 )
+        x[n] = _mm_shuffle_epi8( _mm_loadu_si128( (__m128i *) buf ), BSWAP_MASK );
+
+    if( len > 0 )
+    {
+        memset( last, 0, 16 );
+        memcpy( last, buf, len );
+        x[n++] = _mm_shuffle_epi8( _mm_loadu_si128( (__m128i *) last ), BSWAP_MASK );
+    }
+
+    if( n > 0 )
+        y = gcm_ghash_n( ctx, y, x, n );
+
+    return( y );
+}
+
+/*
+ * Encrypt the next 8 counter blocks into ks[] while folding the 8
+ * reflected blocks x[] into y. Counters are kept byte-reversed so the
+ * 32-bit increment is a single add_epi32.
+ */
+static inline __m128i gcm_ctr8_ghash8( const gcm_context *ctx, __m128i *ctr,
+                                       __m128i *ks, const __m128i *x, __m128i y )
+{
+    const __m128i *rk = (const __m128i *) ctx->aes.ni;
+    const __m128i *HL = (const __m128i *) ctx->HL;
+    const __m128i ONE = _mm_set_epi32( 0, 0, 0, 1 );
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    int j, k, nr = ctx->aes.nr;
+
+    for( k = 0; k < 8; k++ )
+    {
+        *ctr  = _mm_add_epi32( *ctr, ONE );
+        ks[k] = _mm_xor_si128( _mm_shuffle_epi8( *ctr, BSWAP_MASK ), rk[0] );
+    }
+
+    for( j = 1; j < nr; j++ )
+    {
+        for( k = 0; k < 8; k++ )
+            ks[k] = _mm_aesenc_si128( ks[k], rk[j] );
+
+        /* nr >= 10, so the 8 multiplies fit in the first 8 rounds */
+        if( j == 1 )
+            gcm_mul_acc( _mm_xor_si128( y, x[0] ), HL[7], &lo, &mid, &hi );
+        else if( j <= 8 )
+            gcm_mul_acc( x[j - 1], HL[8 - j], &lo, &mid, &hi );
+    }
+
+    for( k = 0; k < 8; k++ )
+        ks[k] = _mm_aesenclast_si128( ks[k], rk[j] );
+
+    return( gcm_reduce( lo, mid, hi ) );
+}
+
+/*
+ * Encrypt the next n <= 8 counter blocks into ks[]. n is rounded up to 4
+ * or 8 and ctr advances by that much, so this is only used for the first
+ * bulk step and the tail.
+ */
+static inline void gcm_ctr8( const gcm_context *ctx, __m128i *ctr, __m128i *ks, int n )
+{
+    const __m128i ONE = _mm_set_epi32( 0, 0, 0, 1 );
+    int k;
+
+    n = ( n > 4 ) ? 8 : 4;
+    for( k = 0; k < n; k++ )
+    {
+        *ctr  = _mm_add_epi32( *ctr, ONE );
+        ks[k] = _mm_shuffle_epi8( *ctr, BSWAP_MASK );
+    }
+
+    if( n > 4 )
+        AES_encrypt8( ks, (const __m128i *) ctx->aes.ni, ctx->aes.nr );
+    else
+        AES_encrypt4( ks, (const __m128i *) ctx->aes.ni, ctx->aes.nr );
+}
+
+int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    ALIGN16 unsigned char h[16];
+    __m128i *HL = (__m128i *) ctx->HL;
+    int i;
+
+    if( aes_setkey_enc( &ctx->aes, key, keysize ) != 0 )
+        return( POLARSSL_ERR_GCM_BAD_INPUT );
+
+    memset( h, 0, 16 );
+    AES_ECB_encrypt( h, h, 16, ctx->aes.ni, ctx->aes.nr );
+
+    HL[0] = _mm_shuffle_epi8( _mm_load_si128( (__m128i *) h ), BSWAP_MASK );
+    for( i = 1; i < 8; i++ )
+        HL[i] = gcm_mult( HL[i - 1], HL[0] );
+
+    return( 0 );
+}
+
+int gcm_crypt_and_tag( gcm_context *ctx,
+                       int mode,
+                       size_t length,
+                       const unsigned char *iv,
+                       size_t iv_len,
+                       const unsigned char *add,
+                       size_t add_len,
+                       const unsigned char *input,
+                       unsigned char *output,
+                       size_t tag_len,
+                       unsigned char *tag )
+{
+    ALIGN16 unsigned char buf[16];
+    ALIGN16 unsigned char last[8 * 16];
+    __m128i y, j0, ctr, lenblk, ks[8], x[8];
+    size_t i, rem;
+    int k, have_prev = 0;
+
+    if( tag_len < 4 || tag_len > 16 || iv_len == 0 ||
+        (unsigned long long) length > 0xFFFFFFFE0ULL )
+        return( POLARSSL_ERR_GCM_BAD_INPUT );
+
+    /*
+     * Pre-counter block J0
+     */
+    if( iv_len == 12 )
+    {
+        memcpy( buf, iv, 12 );
+        buf[12] = buf[13] = buf[14] = 0;
+        buf[15] = 1;
+        j0 = _mm_load_si128( (__m128i *) buf );
+    }
+    else
+    {
+        y = gcm_ghash_buf( ctx, _mm_setzero_si128(), iv, iv_len );
+        lenblk = _mm_set_epi64x( 0, (long long) iv_len * 8 );
+        y = gcm_ghash_n( ctx, y, &lenblk, 1 );
+        j0 = _mm_shuffle_epi8( y, BSWAP_MASK );
+    }
+    ctr = _mm_shuffle_epi8( j0, BSWAP_MASK );
+
+    y = gcm_ghash_buf( ctx, _mm_setzero_si128(), add, add_len );
+
+    /*
+     * Bulk: 8 blocks per step. Decryption hashes the ciphertext it is
+     * about to decrypt; encryption hashes the previous step's output,
+     * which is still in registers.
+     */
+    for( i = 0; length - i >= 128; i += 128 )
+    {
+        if( mode == GCM_DECRYPT )
+        {
+            for( k = 0; k < 8; k++ )
+                x[k] = _mm_shuffle_epi8( _mm_loadu_si128( (__m128i *)( input + i ) + k ), BSWAP_MASK );
+            y = gcm_ctr8_ghash8( ctx, &ctr, ks, x, y );
+        }
+        else if( have_prev )
+            y = gcm_ctr8_ghash8( ctx, &ctr, ks, x, y );
+        else
+            gcm_ctr8( ctx, &ctr, ks, 8 );
+
+        for( k = 0; k < 8; k++ )
+        {
+            ks[k] = _mm_xor_si128( ks[k], _mm_loadu_si128( (__m128i *)( input + i ) + k ) );
+            _mm_storeu_si128( (__m128i *)( output + i ) + k, ks[k] );
+
+            if( mode == GCM_ENCRYPT )
+                x[k] = _mm_shuffle_epi8( ks[k], BSWAP_MASK );
+        }
+        have_prev = ( mode == GCM_ENCRYPT );
+    }
+
+    if( have_prev )
+        y = gcm_ghash_n( ctx, y, x, 8 );
+
+    /*
+     * Up to 127 trailing bytes
+     */
+    rem = length - i;
+    if( rem > 0 )
+    {
+        if( mode == GCM_DECRYPT )
+            y = gcm_ghash_buf( ctx, y, input + i, rem );
+
+        gcm_ctr8( ctx, &ctr, ks, (int)( ( rem + 15 ) / 16 ) );
+        for( k = 0; k < (int)( ( rem + 15 ) / 16 ); k++ )
+            _mm_store_si128( (__m128i *) last + k, ks[k] );
+        xor_keystream( output + i, input + i, last, rem );
+
+        if( mode == GCM_ENCRYPT )
+            y = gcm_ghash_buf( ctx, y, output + i, rem );
+    }
+
+    lenblk = _mm_set_epi64x( (long long) add_len * 8, (long long) length * 8 );
+    y = gcm_ghash_n( ctx, y, &lenblk, 1 );
+
+    /*
+     * T = E(K, J0) ^ GHASH
+     */
+    _mm_store_si128( (__m128i *) buf, j0 );
+    AES_ECB_encrypt( buf, buf, 16, ctx->aes.ni, ctx->aes.nr );
+    y = _mm_xor_si128( _mm_shuffle_epi8( y, BSWAP_MASK ), _mm_load_si128( (__m128i *) buf ) );
+    _mm_store_si128( (__m128i *) buf, y );
+    memcpy( tag, buf, tag_len );
+
+    return( 0 );
+}
+
+int gcm_auth_decrypt( gcm_context *ctx,
+                      size_t length,
+                      const unsigned char *iv,
+                      size_t iv_len,
+                      const unsigned char *add,
+                      size_t add_len,
+                      const unsigned char *tag,
+                      size_t tag_len,
+                      const unsigned char *input,
+                      unsigned char *output )
+{
+    unsigned char check_tag[16];
+    size_t i;
+    int ret, diff;
+
+    if( ( ret = gcm_crypt_and_tag( ctx, GCM_DECRYPT, length, iv, iv_len,
+                                   add, add_len, input, output,
+                                   tag_len, check_tag ) ) != 0 )
+        return( ret );
+
+    /* Check tag in "constant-time" */
+    for( diff = 0, i = 0; i < tag_len; i++ )
+        diff |= tag[i] ^ check_tag[i];
+
+    if( diff != 0 )
+    {
+        memset( output, 0, length );
+        return( POLARSSL_ERR_GCM_AUTH_FAILED );
+    }
+
+    return( 0 );
+}
+
+#if defined(POLARSSL_SELF_TEST)
+
+#include <stdio.h>
+
+/*
+ * AES-GCM test vectors from:
+ *
+ * http://csrc.nist.gov/groups/ST/toolkit/BCM/documents/proposedmodes/gcm/gcm-revised-spec.pdf
+ *
+ * Test cases 1-6, 7-12 and 13-18 share plaintexts, IVs and additional
+ * data and differ in the key size (128, 192, 256 bits).
+ */
+#define MAX_TESTS   6
+
+static const int key_index[MAX_TESTS] =
+    { 0, 0, 1, 1, 1, 1 };
+
+static const unsigned char key[MAX_TESTS][32] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
+      0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
+      0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
+      0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08 },
+};
+
+static const size_t iv_len[MAX_TESTS] =
+    { 12, 12, 12, 12, 8, 60 };
+
+static const int iv_index[MAX_TESTS] =
+    { 0, 0, 1, 1, 1, 2 };
+
+static const unsigned char iv[MAX_TESTS][64] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00 },
+    { 0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad,
+      0xde, 0xca, 0xf8, 0x88 },
+    { 0x93, 0x13, 0x22, 0x5d, 0xf8, 0x84, 0x06, 0xe5,
+      0x55, 0x90, 0x9c, 0x5a, 0xff, 0x52, 0x69, 0xaa,
+      0x6a, 0x7a, 0x95, 0x38, 0x53, 0x4f, 0x7d, 0xa1,
+      0xe4, 0xc3, 0x03, 0xd2, 0xa3, 0x18, 0xa7, 0x28,
+      0xc3, 0xc0, 0xc9, 0x51, 0x56, 0x80, 0x95, 0x39,
+      0xfc, 0xf0, 0xe2, 0x42, 0x9a, 0x6b, 0x52, 0x54,
+      0x16, 0xae, 0xdb, 0xf5, 0xa0, 0xde, 0x6a, 0x57,
+      0xa6, 0x37, 0xb3, 0x9b },
+};
+
+static const size_t add_len[MAX_TESTS] =
+    { 0, 0, 0, 20, 20, 20 };
+
+static const unsigned char additional[20] =
+{
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xab, 0xad, 0xda, 0xd2
+};
+
+static const size_t pt_len[MAX_TESTS] =
+    { 0, 16, 64, 60, 60, 60 };
+
+static const int pt_index[MAX_TESTS] =
+    { 0, 0, 1, 1, 1, 1 };
+
+static const unsigned char pt[MAX_TESTS][64] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5,
+      0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+      0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda,
+      0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+      0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53,
+      0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+      0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57,
+      0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55 },
+};
+
+static const unsigned char ct[MAX_TESTS * 3][64] =
+{
+    { 0x00 },
+    { 0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92,
+      0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78 },
+    { 0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24,
+      0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+      0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0,
+      0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+      0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c,
+      0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+      0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97,
+      0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85 },
+    { 0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24,
+      0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+      0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0,
+      0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+      0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c,
+      0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+      0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97,
+      0x3d, 0x58, 0xe0, 0x91 },
+    { 0x61, 0x35, 0x3b, 0x4c, 0x28, 0x06, 0x93, 0x4a,
+      0x77, 0x7f, 0xf5, 0x1f, 0xa2, 0x2a, 0x47, 0x55,
+      0x69, 0x9b, 0x2a, 0x71, 0x4f, 0xcd, 0xc6, 0xf8,
+      0x37, 0x66, 0xe5, 0xf9, 0x7b, 0x6c, 0x74, 0x23,
+      0x73, 0x80, 0x69, 0x00, 0xe4, 0x9f, 0x24, 0xb2,
+      0x2b, 0x09, 0x75, 0x44, 0xd4, 0x89, 0x6b, 0x42,
+      0x49, 0x89, 0xb5, 0xe1, 0xeb, 0xac, 0x0f, 0x07,
+      0xc2, 0x3f, 0x45, 0x98 },
+    { 0x8c, 0xe2, 0x49, 0x98, 0x62, 0x56, 0x15, 0xb6,
+      0x03, 0xa0, 0x33, 0xac, 0xa1, 0x3f, 0xb8, 0x94,
+      0xbe, 0x91, 0x12, 0xa5, 0xc3, 0xa2, 0x11, 0xa8,
+      0xba, 0x26, 0x2a, 0x3c, 0xca, 0x7e, 0x2c, 0xa7,
+      0x01, 0xe4, 0xa9, 0xa4, 0xfb, 0xa4, 0x3c, 0x90,
+      0xcc, 0xdc, 0xb2, 0x81, 0xd4, 0x8c, 0x7c, 0x6f,
+      0xd6, 0x28, 0x75, 0xd2, 0xac, 0xa4, 0x17, 0x03,
+      0x4c, 0x34, 0xae, 0xe5 },
+    { 0x00 },
+    { 0x98, 0xe7, 0x24, 0x7c, 0x07, 0xf0, 0xfe, 0x41,
+      0x1c, 0x26, 0x7e, 0x43, 0x84, 0xb0, 0xf6, 0x00 },
+    { 0x39, 0x80, 0xca, 0x0b, 0x3c, 0x00, 0xe8, 0x41,
+      0xeb, 0x06, 0xfa, 0xc4, 0x87, 0x2a, 0x27, 0x57,
+      0x85, 0x9e, 0x1c, 0xea, 0xa6, 0xef, 0xd9, 0x84,
+      0x62, 0x85, 0x93, 0xb4, 0x0c, 0xa1, 0xe1, 0x9c,
+      0x7d, 0x77, 0x3d, 0x00, 0xc1, 0x44, 0xc5, 0x25,
+      0xac, 0x61, 0x9d, 0x18, 0xc8, 0x4a, 0x3f, 0x47,
+      0x18, 0xe2, 0x44, 0x8b, 0x2f, 0xe3, 0x24, 0xd9,
+      0xcc, 0xda, 0x27, 0x10, 0xac, 0xad, 0xe2, 0x56 },
+    { 0x39, 0x80, 0xca, 0x0b, 0x3c, 0x00, 0xe8, 0x41,
+      0xeb, 0x06, 0xfa, 0xc4, 0x87, 0x2a, 0x27, 0x57,
+      0x85, 0x9e, 0x1c, 0xea, 0xa6, 0xef, 0xd9, 0x84,
+      0x62, 0x85, 0x93, 0xb4, 0x0c, 0xa1, 0xe1, 0x9c,
+      0x7d, 0x77, 0x3d, 0x00, 0xc1, 0x44, 0xc5, 0x25,
+      0xac, 0x61, 0x9d, 0x18, 0xc8, 0x4a, 0x3f, 0x47,
+      0x18, 0xe2, 0x44, 0x8b, 0x2f, 0xe3, 0x24, 0xd9,
+      0xcc, 0xda, 0x27, 0x10 },
+    { 0x0f, 0x10, 0xf5, 0x99, 0xae, 0x14, 0xa1, 0x54,
+      0xed, 0x24, 0xb3, 0x6e, 0x25, 0x32, 0x4d, 0xb8,
+      0xc5, 0x66, 0x63, 0x2e, 0xf2, 0xbb, 0xb3, 0x4f,
+      0x83, 0x47, 0x28, 0x0f, 0xc4, 0x50, 0x70, 0x57,
+      0xfd, 0xdc, 0x29, 0xdf, 0x9a, 0x47, 0x1f, 0x75,
+      0xc6, 0x65, 0x41, 0xd4, 0xd4, 0xda, 0xd1, 0xc9,
+      0xe9, 0x3a, 0x19, 0xa5, 0x8e, 0x8b, 0x47, 0x3f,
+      0xa0, 0xf0, 0x62, 0xf7 },
+    { 0xd2, 0x7e, 0x88, 0x68, 0x1c, 0xe3, 0x24, 0x3c,
+      0x48, 0x30, 0x16, 0x5a, 0x8f, 0xdc, 0xf9, 0xff,
+      0x1d, 0xe9, 0xa1, 0xd8, 0xe6, 0xb4, 0x47, 0xef,
+      0x6e, 0xf7, 0xb7, 0x98, 0x28, 0x66, 0x6e, 0x45,
+      0x81, 0xe7, 0x90, 0x12, 0xaf, 0x34, 0xdd, 0xd9,
+      0xe2, 0xf0, 0x37, 0x58, 0x9b, 0x29, 0x2d, 0xb3,
+      0xe6, 0x7c, 0x03, 0x67, 0x45, 0xfa, 0x22, 0xe7,
+      0xe9, 0xb7, 0x37, 0x3b },
+    { 0x00 },
+    { 0xce, 0xa7, 0x40, 0x3d, 0x4d, 0x60, 0x6b, 0x6e,
+      0x07, 0x4e, 0xc5, 0xd3, 0xba, 0xf3, 0x9d, 0x18 },
+    { 0x52, 0x2d, 0xc1, 0xf0, 0x99, 0x56, 0x7d, 0x07,
+      0xf4, 0x7f, 0x37, 0xa3, 0x2a, 0x84, 0x42, 0x7d,
+      0x64, 0x3a, 0x8c, 0xdc, 0xbf, 0xe5, 0xc0, 0xc9,
+      0x75, 0x98, 0xa2, 0xbd, 0x25, 0x55, 0xd1, 0xaa,
+      0x8c, 0xb0, 0x8e, 0x48, 0x59, 0x0d, 0xbb, 0x3d,
+      0xa7, 0xb0, 0x8b, 0x10, 0x56, 0x82, 0x88, 0x38,
+      0xc5, 0xf6, 0x1e, 0x63, 0x93, 0xba, 0x7a, 0x0a,
+      0xbc, 0xc9, 0xf6, 0x62, 0x89, 0x80, 0x15, 0xad },
+    { 0x52, 0x2d, 0xc1, 0xf0, 0x99, 0x56, 0x7d, 0x07,
+      0xf4, 0x7f, 0x37, 0xa3, 0x2a, 0x84, 0x42, 0x7d,
+      0x64, 0x3a, 0x8c, 0xdc, 0xbf, 0xe5, 0xc0, 0xc9,
+      0x75, 0x98, 0xa2, 0xbd, 0x25, 0x55, 0xd1, 0xaa,
+      0x8c, 0xb0, 0x8e, 0x48, 0x59, 0x0d, 0xbb, 0x3d,
+      0xa7, 0xb0, 0x8b, 0x10, 0x56, 0x82, 0x88, 0x38,
+      0xc5, 0xf6, 0x1e, 0x63, 0x93, 0xba, 0x7a, 0x0a,
+      0xbc, 0xc9, 0xf6, 0x62 },
+    { 0xc3, 0x76, 0x2d, 0xf1, 0xca, 0x78, 0x7d, 0x32,
+      0xae, 0x47, 0xc1, 0x3b, 0xf1, 0x98, 0x44, 0xcb,
+      0xaf, 0x1a, 0xe1, 0x4d, 0x0b, 0x97, 0x6a, 0xfa,
+      0xc5, 0x2f, 0xf7, 0xd7, 0x9b, 0xba, 0x9d, 0xe0,
+      0xfe, 0xb5, 0x82, 0xd3, 0x39, 0x34, 0xa4, 0xf0,
+      0x95, 0x4c, 0xc2, 0x36, 0x3b, 0xc7, 0x3f, 0x78,
+      0x62, 0xac, 0x43, 0x0e, 0x64, 0xab, 0xe4, 0x99,
+      0xf4, 0x7c, 0x9b, 0x1f },
+    { 0x5a, 0x8d, 0xef, 0x2f, 0x0c, 0x9e, 0x53, 0xf1,
+      0xf7, 0x5d, 0x78, 0x53, 0x65, 0x9e, 0x2a, 0x20,
+      0xee, 0xb2, 0xb2, 0x2a, 0xaf, 0xde, 0x64, 0x19,
+      0xa0, 0x58, 0xab, 0x4f, 0x6f, 0x74, 0x6b, 0xf4,
+      0x0f, 0xc0, 0xc3, 0xb7, 0x80, 0xf2, 0x44, 0x45,
+      0x2d, 0xa3, 0xeb, 0xf1, 0xc5, 0xd8, 0x2c, 0xde,
+      0xa2, 0x41, 0x89, 0x97, 0x20, 0x0e, 0xf8, 0x2e,
+      0x44, 0xae, 0x7e, 0x3f }
+};
+
+static const unsigned char tag[MAX_TESTS * 3][16] =
+{
+    { 0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61,
+      0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a },
+    { 0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd,
+      0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf },
+    { 0x4d, 0x5c, 0x2a, 0xf3, 0x27, 0xcd, 0x64, 0xa6,
+      0x2c, 0xf3, 0x5a, 0xbd, 0x2b, 0xa6, 0xfa, 0xb4 },
+    { 0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb,
+      0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47 },
+    { 0x36, 0x12, 0xd2, 0xe7, 0x9e, 0x3b, 0x07, 0x85,
+      0x56, 0x1b, 0xe1, 0x4a, 0xac, 0xa2, 0xfc, 0xcb },
+    { 0x61, 0x9c, 0xc5, 0xae, 0xff, 0xfe, 0x0b, 0xfa,
+      0x46, 0x2a, 0xf4, 0x3c, 0x16, 0x99, 0xd0, 0x50 },
+    { 0xcd, 0x33, 0xb2, 0x8a, 0xc7, 0x73, 0xf7, 0x4b,
+      0xa0, 0x0e, 0xd1, 0xf3, 0x12, 0x57, 0x24, 0x35 },
+    { 0x2f, 0xf5, 0x8d, 0x80, 0x03, 0x39, 0x27, 0xab,
+      0x8e, 0xf4, 0xd4, 0x58, 0x75, 0x14, 0xf0, 0xfb },
+    { 0x99, 0x24, 0xa7, 0xc8, 0x58, 0x73, 0x36, 0xbf,
+      0xb1, 0x18, 0x02, 0x4d, 0xb8, 0x67, 0x4a, 0x14 },
+    { 0x25, 0x19, 0x49, 0x8e, 0x80, 0xf1, 0x47, 0x8f,
+      0x37, 0xba, 0x55, 0xbd, 0x6d, 0x27, 0x61, 0x8c },
+    { 0x65, 0xdc, 0xc5, 0x7f, 0xcf, 0x62, 0x3a, 0x24,
+      0x09, 0x4f, 0xcc, 0xa4, 0x0d, 0x35, 0x33, 0xf8 },
+    { 0xdc, 0xf5, 0x66, 0xff, 0x29, 0x1c, 0x25, 0xbb,
+      0xb8, 0x56, 0x8f, 0xc3, 0xd3, 0x76, 0xa6, 0xd9 },
+    { 0x53, 0x0f, 0x8a, 0xfb, 0xc7, 0x45, 0x36, 0xb9,
+      0xa9, 0x63, 0xb4, 0xf1, 0xc4, 0xcb, 0x73, 0x8b },
+    { 0xd0, 0xd1, 0xc8, 0xa7, 0x99, 0x99, 0x6b, 0xf0,
+      0x26, 0x5b, 0x98, 0xb5, 0xd4, 0x8a, 0xb9, 0x19 },
+    { 0xb0, 0x94, 0xda, 0xc5, 0xd9, 0x34, 0x71, 0xbd,
+      0xec, 0x1a, 0x50, 0x22, 0x70, 0xe3, 0xcc, 0x6c },
+    { 0x76, 0xfc, 0x6e, 0xce, 0x0f, 0x4e, 0x17, 0x68,
+      0xcd, 0xdf, 0x88, 0x53, 0xbb, 0x2d, 0x55, 0x1b },
+    { 0x3a, 0x33, 0x7d, 0xbf, 0x46, 0xa7, 0x92, 0xc4,
+      0x5e, 0x45, 0x49, 0x13, 0xfe, 0x2e, 0xa8, 0xf2 },
+    { 0xa4, 0x4a, 0x82, 0x66, 0xee, 0x1c, 0x8e, 0xb0,
+      0xc8, 0xb5, 0xd4, 0xcf, 0x5a, 0xe9, 0xf1, 0x9a }
+};
+
+/*
+ * The vectors above are at most four blocks long. A 300-byte message,
+ * byte i = 7 * i + 3, under the key, IV and additional data of test
+ * case 4 (128-bit) and 16 (256-bit) also runs the 8-block stitched loop
+ * and a partial last block. Tags computed with OpenSSL.
+ */
+#define LONG_LEN    300
+
+static const unsigned char long_tag[2][16] =
+{
+{ 0x73, 0xda, 0x24, 0xf4, 0xa5, 0xe9, 0xbb, 0x81,
+      0x0b, 0x84, 0xd5, 0x71, 0xe5, 0xe6, 0xa8, 0x8d },
+{ 0x0c, 0xf1, 0x05, 0xef, 0x85, 0xb0, 0x87, 0x56,
+      0x88, 0x4d, 0x34, 0x32, 0x73, 0xd8, 0x0b, 0xbe }
+};
+
+/*
+ * Checkup routine
+ */
+int gcm_self_test( int verbose )
+{
+    gcm_context ctx;
+    unsigned char buf[LONG_LEN];
+    unsigned char msg[LONG_LEN];
+    unsigned char tag_buf[16];
+    int i, j, k;
+
+    for( j = 0; j < 3; j++ )
+    {
+        int key_len = 128 + 64 * j;
+
+        for( i = 0; i < MAX_TESTS; i++ )
+        {
+            if( verbose != 0 )
+                printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "enc" );
+
+            gcm_init( &ctx, key[key_index[i]], key_len );
+
+            gcm_crypt_and_tag( &ctx, GCM_ENCRYPT,
+                               pt_len[i],
+                               iv[iv_index[i]], iv_len[i],
+                               additional, add_len[i],
+                               pt[pt_index[i]], buf, 16, tag_buf );
+
+            if( memcmp( buf, ct[j * 6 + i], pt_len[i] ) != 0 ||
+                memcmp( tag_buf, tag[j * 6 + i], 16 ) != 0 )
+            {
+                if( verbose != 0 )
+                    printf( "failed\n" );
+
+                return( 1 );
+            }
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+
+            if( verbose != 0 )
+                printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "dec" );
+
+            if( gcm_auth_decrypt( &ctx, pt_len[i],
+                                  iv[iv_index[i]], iv_len[i],
+                                  additional, add_len[i],
+                                  tag[j * 6 + i], 16,
+                                  ct[j * 6 + i], buf ) != 0 ||
+                memcmp( buf, pt[pt_index[i]], pt_len[i] ) != 0 )
+            {
+                if( verbose != 0 )
+                    printf( "failed\n" );
+
+                return( 1 );
+            }
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+    }
+
+    for( k = 0; k < LONG_LEN; k++ )
+        msg[k] = (unsigned char)( 7 * k + 3 );
+
+    for( j = 0; j < 2; j++ )
+    {
+        if( verbose != 0 )
+            printf( "  AES-GCM-%3d %d bytes: ", 128 + 128 * j, LONG_LEN );
+
+        gcm_init( &ctx, key[1], 128 + 128 * j );
+
+        gcm_crypt_and_tag( &ctx, GCM_ENCRYPT, LONG_LEN, iv[1], 12,
+                           additional, 20, msg, buf, 16, tag_buf );
+
+        if( memcmp( tag_buf, long_tag[j], 16 ) != 0 ||
+            gcm_auth_decrypt( &ctx, LONG_LEN, iv[1], 12, additional, 20,
+                              tag_buf, 16, buf, buf ) != 0 ||
+            memcmp( buf, msg, LONG_LEN ) != 0 )
+        {
+            if( verbose != 0 )
+                printf( "failed\n" );
+
+            return( 1 );
+        }
+
+        if( verbose != 0 )
+            printf( "passed\n" );
+    }
+
+    /*
+     * A tag with one bit flipped must be rejected and the output wiped
+     */
+    if( verbose != 0 )
+        printf( "  AES-GCM-128 bad tag: " );
+
+    gcm_init( &ctx, key[1], 128 );
+    memcpy( tag_buf, tag[3], 16 );
+    tag_buf[15] ^= 0x01;
+
+    if( gcm_auth_decrypt( &ctx, pt_len[3], iv[1], 12, additional, 20,
+                          tag_buf, 16, ct[3], buf ) != POLARSSL_ERR_GCM_AUTH_FAILED )
+    {
+        if( verbose != 0 )
+            printf( "failed\n" );
+
+        return( 1 );
+    }
+
+    for( k = 0; k < (int) pt_len[3]; k++ )
+    {
+        if( buf[k] != 0 )
+        {
+            if( verbose != 0 )
+                printf( "failed\n" );
+
+            return( 1 );
+        }
+    }
+
+    if( verbose != 0 )
+        printf( "passed\n\n" );
+
+    return( 0 );
+}
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * \file gcm.h
+ *
+ * \brief AES-GCM (NIST SP 800-38D) on AES-NI and PCLMULQDQ
+ *
+ * The CTR keystream and the GHASH of the ciphertext are computed in the
+ * same 8-block loop, so each block of data is read once.
+ */
+#ifndef POLARSSL_GCM_H
+#define POLARSSL_GCM_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+
+#define GCM_ENCRYPT     1
+#define GCM_DECRYPT     0
+
+#define POLARSSL_ERR_GCM_AUTH_FAILED                       -0x0012  /**< Authenticated decryption failed. */
+#define POLARSSL_ERR_GCM_BAD_INPUT                         -0x0014  /**< Bad input parameters to function. */
+
+/**
+ * \brief          GCM context structure
+ */
+typedef struct
+{
+    aes_context aes;                    /*!<  encryption schedule            */
+    ALIGN16 unsigned char HL[8][16];    /*!<  H^1..H^8, byte-reflected       */
+}
+gcm_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          GCM initialization (encryption)
+ *
+ * \param ctx      GCM context to be initialized
+ * \param key      encryption key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_GCM_BAD_INPUT
+ */
+int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          GCM buffer encryption/decryption using AES
+ *
+ * \param ctx      GCM context
+ * \param mode     GCM_ENCRYPT or GCM_DECRYPT
+ * \param length   length of the input data
+ * \param iv       initialization vector
+ * \param iv_len   length of IV (12 bytes is the fast path)
+ * \param add      additional data
+ * \param add_len  length of additional data
+ * \param input    buffer holding the input data
+ * \param output   buffer for holding the output data
+ * \param tag_len  length of the tag to generate (4 to 16 bytes)
+ * \param tag      buffer for holding the tag
+ *
+ * \return         0 if successful, or POLARSSL_ERR_GCM_BAD_INPUT
+ */
+int gcm_crypt_and_tag( gcm_context *ctx,
+                       int mode,
+                       size_t length,
+                       const unsigned char *iv,
+                       size_t iv_len,
+                       const unsigned char *add,
+                       size_t add_len,
+                       const unsigned char *input,
+                       unsigned char *output,
+                       size_t tag_len,
+                       unsigned char *tag );
+
+/**
+ * \brief          GCM buffer authenticated decryption using AES
+ *
+ * \param ctx      GCM context
+ * \param length   length of the input data
+ * \param iv       initialization vector
+ * \param iv_len   length of IV
+ * \param add      additional data
+ * \param add_len  length of additional data
+ * \param tag      buffer holding the tag
+ * \param tag_len  length of the tag
+ * \param input    buffer holding the input data
+ * \param output   buffer for holding the output data
+ *
+ * \return         0 if successful and authenticated,
+ *                 POLARSSL_ERR_GCM_AUTH_FAILED if tag does not match
+ *                 (output is then zeroed)
+ */
+int gcm_auth_decrypt( gcm_context *ctx,
+                      size_t length,
+                      const unsigned char *iv,
+                      size_t iv_len,
+                      const unsigned char *add,
+                      size_t add_len,
+                      const unsigned char *tag,
+                      size_t tag_len,
+                      const unsigned char *input,
+                      unsigned char *output );
+
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int gcm_self_test( int verbose );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* gcm.h */
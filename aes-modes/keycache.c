@@ -0,0 +1,197 @@
+/*
+ *  Bounded cache of expanded AES keys
+ *
+ *  Each set keeps KEYCACHE_WAYS entries under its own mutex. The hash
+ *  picks the set and filters the ways, then the key bytes are compared
+ *  in full. A miss runs
+ *  the key expansion without holding the lock and then takes it again
+ *  to insert; two threads missing on the same key both expand it, and
+ *  the second insert finds the entry and just refreshes it.
+ */
+
+#include <stdlib.h>
+
+#include "keycache.h"
+
+typedef struct
+{
+    aes_context enc;                    /*!<  encryption schedule       */
+    aes_context dec;                    /*!<  decryption schedule       */
+}
+keycache_entry;
+
+/*
+ * The lookup state of a set (hash tags, sizes, key bytes, LRU ticks)
+ * comes first and spans a few cache lines; a lookup only touches the
+ * schedule of the way that matches.
+ */
+struct keycache_set
+{
+    pthread_mutex_t lock;
+    unsigned long long tick;
+    unsigned long long tag[KEYCACHE_WAYS];      /*!<  full key hash     */
+    unsigned long long used[KEYCACHE_WAYS];     /*!<  0 for empty ways  */
+    unsigned int keysize[KEYCACHE_WAYS];
+    unsigned char has[KEYCACHE_WAYS];           /*!<  1 enc, 2 dec      */
+    unsigned char key[KEYCACHE_WAYS][32];
+    unsigned long long hits;
+    unsigned long long misses;
+    keycache_entry way[KEYCACHE_WAYS];
+};
+
+#define HAS_MODE( mode )    ( ( mode ) == AES_ENCRYPT ? 1 : 2 )
+
+/*
+ * FNV-1a over the key bytes and size
+ */
+static unsigned long long keycache_hash( const unsigned char *key,
+                                         unsigned int keysize )
+{
+    unsigned long long h = 0xCBF29CE484222325ULL;
+    unsigned int i;
+
+    for( i = 0; i < keysize / 8; i++ )
+        h = ( h ^ key[i] ) * 0x100000001B3ULL;
+    h = ( h ^ keysize ) * 0x100000001B3ULL;
+
+    return( h ^ ( h >> 32 ) );
+}
+
+static int keycache_find( keycache_set *set, unsigned long long tag,
+                          const unsigned char *key, unsigned int keysize )
+{
+    int i;
+
+    for( i = 0; i < KEYCACHE_WAYS; i++ )
+        if( set->tag[i] == tag && set->keysize[i] == keysize &&
+            memcmp( set->key[i], key, keysize / 8 ) == 0 )
+            return( i );
+
+    return( -1 );
+}
+
+/*
+ * Copies only the round keys in use
+ */
+static void keycache_copy( aes_context *dst, const aes_context *src )
+{
+    memcpy( dst->rk, src->rk, ( src->nr + 1 ) * 16 );
+    dst->nr = src->nr;
+    dst->compact = src->compact;
+}
+
+int aes_keycache_init( aes_keycache *cache, size_t entries )
+{
+    size_t i, nsets = 1;
+    void *p;
+
+    while( nsets * KEYCACHE_WAYS < entries )
+        nsets <<= 1;
+
+    if( posix_memalign( &p, 64, nsets * sizeof( keycache_set ) ) != 0 )
+        return( POLARSSL_ERR_KEYCACHE_ALLOC_FAILED );
+
+    memset( p, 0, nsets * sizeof( keycache_set ) );
+    cache->sets = (keycache_set *) p;
+    cache->nsets = nsets;
+
+    for( i = 0; i < nsets; i++ )
+        pthread_mutex_init( &cache->sets[i].lock, NULL );
+
+    return( 0 );
+}
+
+void aes_keycache_free( aes_keycache *cache )
+{
+    size_t i;
+
+    if( cache->sets == NULL )
+        return;
+
+    for( i = 0; i < cache->nsets; i++ )
+        pthread_mutex_destroy( &cache->sets[i].lock );
+
+    memset( cache->sets, 0, cache->nsets * sizeof( keycache_set ) );
+    free( cache->sets );
+    cache->sets = NULL;
+    cache->nsets = 0;
+}
+
+int aes_keycache_get( aes_keycache *cache,
+                      int mode,
+                      const unsigned char *key,
+                      unsigned int keysize,
+                      aes_context *ctx )
+{
+    keycache_set *set;
+    keycache_entry *e;
+    unsigned long long tag;
+    int i, w, ret;
+
+    if( keysize != 128 && keysize != 192 && keysize != 256 )
+        return( POLARSSL_ERR_AES_INVALID_KEY_LENGTH );
+
+    tag = keycache_hash( key, keysize );
+    set = &cache->sets[tag & ( cache->nsets - 1 )];
+
+    pthread_mutex_lock( &set->lock );
+    w = keycache_find( set, tag, key, keysize );
+    if( w >= 0 && ( set->has[w] & HAS_MODE( mode ) ) )
+    {
+        e = &set->way[w];
+        set->used[w] = ++set->tick;
+        set->hits++;
+        keycache_copy( ctx, ( mode == AES_ENCRYPT ) ? &e->enc : &e->dec );
+        pthread_mutex_unlock( &set->lock );
+        return( 0 );
+    }
+    set->misses++;
+    pthread_mutex_unlock( &set->lock );
+
+    if( mode == AES_ENCRYPT )
+        ret = aes_setkey_enc( ctx, key, keysize );
+    else
+        ret = aes_setkey_dec( ctx, key, keysize );
+    if( ret != 0 )
+        return( ret );
+
+    pthread_mutex_lock( &set->lock );
+    if( ( w = keycache_find( set, tag, key, keysize ) ) < 0 )
+    {
+        /*
+         * Evict the least recently used way; empty ways have used == 0
+         */
+        for( w = 0, i = 1; i < KEYCACHE_WAYS; i++ )
+            if( set->used[i] < set->used[w] )
+                w = i;
+
+        memcpy( set->key[w], key, keysize / 8 );
+        set->tag[w] = tag;
+        set->keysize[w] = keysize;
+        set->has[w] = 0;
+    }
+
+    e = &set->way[w];
+    keycache_copy( ( mode == AES_ENCRYPT ) ? &e->enc : &e->dec, ctx );
+    set->has[w] |= HAS_MODE( mode );
+    set->used[w] = ++set->tick;
+    pthread_mutex_unlock( &set->lock );
+
+    return( 0 );
+}
+
+void aes_keycache_stats( aes_keycache *cache,
+                         unsigned long long *hits,
+                         unsigned long long *misses )
+{
+    size_t i;
+
+    *hits = *misses = 0;
+    for( i = 0; i < cache->nsets; i++ )
+    {
+        pthread_mutex_lock( &cache->sets[i].lock );
+        *hits += cache->sets[i].hits;
+        *misses += cache->sets[i].misses;
+        pthread_mutex_unlock( &cache->sets[i].lock );
+    }
+}
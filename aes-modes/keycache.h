@@ -0,0 +1,91 @@
+/**
+ * \file keycache.h
+ *
+ * \brief Bounded cache of expanded AES keys
+ *
+ * Workloads that see the same keys over and over can look the expanded
+ * schedule up instead of re-running the key expansion per message. The
+ * cache is set associative: a key hashes to one set of KEYCACHE_WAYS
+ * entries with its own lock, so threads only contend when their keys land
+ * in the same set, and the least recently used entry of the set is evicted
+ * on a miss. Entries hold aes_context schedules, which serve both the
+ * table and the AES-NI backends.
+ */
+#ifndef POLARSSL_KEYCACHE_H
+#define POLARSSL_KEYCACHE_H
+
+#include <string.h>
+#include <pthread.h>
+
+#include "aes.h"
+
+#define KEYCACHE_WAYS   4       /**< entries per set, LRU within the set */
+
+#define POLARSSL_ERR_KEYCACHE_ALLOC_FAILED                 -0x0026  /**< Cache memory allocation failed. */
+
+typedef struct keycache_set keycache_set;
+
+/**
+ * \brief          Key cache structure
+ */
+typedef struct
+{
+    keycache_set *sets;                 /*!<  nsets sets of KEYCACHE_WAYS */
+    size_t nsets;                       /*!<  a power of two              */
+}
+aes_keycache;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Allocate an empty cache
+ *
+ * \param cache    cache to be initialized
+ * \param entries  capacity in keys, rounded up to a power-of-two number
+ *                 of sets of KEYCACHE_WAYS entries
+ *
+ * \return         0 if successful, or POLARSSL_ERR_KEYCACHE_ALLOC_FAILED
+ */
+int aes_keycache_init( aes_keycache *cache, size_t entries );
+
+/**
+ * \brief          Release the cache memory
+ */
+void aes_keycache_free( aes_keycache *cache );
+
+/**
+ * \brief          Expanded schedule for a key, from the cache if present
+ *
+ * On a miss the key is expanded (outside the set lock), stored and its
+ * set's least recently used entry evicted. The schedule is copied out, so
+ * ctx stays valid whatever later calls evict. Safe to call concurrently.
+ *
+ * \param cache    key cache
+ * \param mode     AES_ENCRYPT or AES_DECRYPT schedule
+ * \param key      key bytes
+ * \param keysize  must be 128, 192 or 256
+ * \param ctx      receives the schedule (for aes_crypt_* and, via
+ *                 ctx->ni, the aesni.h functions)
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int aes_keycache_get( aes_keycache *cache,
+                      int mode,
+                      const unsigned char *key,
+                      unsigned int keysize,
+                      aes_context *ctx );
+
+/**
+ * \brief          Lookup counters since aes_keycache_init
+ */
+void aes_keycache_stats( aes_keycache *cache,
+                         unsigned long long *hits,
+                         unsigned long long *misses );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* keycache.h */
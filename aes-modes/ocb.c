@@ -0,0 +1,566 @@
+/*
+ *  AES-OCB3
+ *
+ *  http://tools.ietf.org/html/rfc7253
+ *
+ *  Block i is encrypted as C_i = Offset_i ^ E(P_i ^ Offset_i) with
+ *  Offset_i = Offset_{i-1} ^ L_{ntz(i)}, so the offsets of a group of 8
+ *  blocks cost 8 XORs against the precomputed L table and the 8 cipher
+ *  calls are independent. The associated data is hashed the same way
+ *  with the encryption kernel only. Without AES-NI the same groups go
+ *  through aes_crypt_ecb_blocks.
+ */
+
+#include "ocb.h"
+#include "cmac.h"
+
+#define OCB_MAX_BLOCKS  ( ( (unsigned long long) 1 << OCB_L_MAX ) - 1 )
+
+static inline __m128i ocb_encrypt1( ocb_context *ctx, __m128i x )
+{
+    const __m128i *k = (const __m128i *) ctx->enc.ni;
+    ALIGN16 unsigned char buf[16];
+    int j;
+
+    if( !ctx->aesni )
+    {
+        _mm_store_si128( (__m128i *) buf, x );
+        aes_crypt_ecb( &ctx->enc, AES_ENCRYPT, buf, buf );
+        return( _mm_load_si128( (const __m128i *) buf ) );
+    }
+
+    x = _mm_xor_si128( x, k[0] );
+    for( j = 1; j < ctx->enc.nr; j++ )
+        x = _mm_aesenc_si128( x, k[j] );
+
+    return( _mm_aesenclast_si128( x, k[j] ) );
+}
+
+/*
+ * n <= 8 blocks through the 4- or 8-block kernel; unused slots are junk
+ */
+static inline void ocb_kernel( ocb_context *ctx, int mode, __m128i *b, int n )
+{
+    aes_context *key = ( mode == OCB_DECRYPT ) ? &ctx->dec : &ctx->enc;
+    const __m128i *k = (const __m128i *) key->ni;
+
+    if( !ctx->aesni )
+        aes_crypt_ecb_blocks( key, ( mode == OCB_DECRYPT ) ? AES_DECRYPT : AES_ENCRYPT,
+                              16 * n, (unsigned char *) b, (unsigned char *) b );
+    else if( mode == OCB_DECRYPT && n > 4 )
+        AES_decrypt8( b, k, key->nr );
+    else if( mode == OCB_DECRYPT )
+        AES_decrypt4( b, k, key->nr );
+    else if( n > 4 )
+        AES_encrypt8( b, k, key->nr );
+    else
+        AES_encrypt4( b, k, key->nr );
+}
+
+/*
+ * HASH(K, A)
+ */
+static __m128i ocb_hash( ocb_context *ctx, const unsigned char *add, size_t add_len )
+{
+    const __m128i *L = (const __m128i *) ctx->L;
+    ALIGN16 unsigned char buf[16];
+    __m128i off = _mm_setzero_si128(), sum = _mm_setzero_si128(), b[8];
+    unsigned long long i;
+    int j, n;
+
+    for( i = 1; add_len >= 16; i += n )
+    {
+        n = ( add_len >= 128 ) ? 8 : (int)( add_len / 16 );
+
+        for( j = 0; j < 8; j++ )
+        {
+            if( j < n )
+            {
+                off = _mm_xor_si128( off, L[__builtin_ctzll( i + j )] );
+                b[j] = _mm_xor_si128( _mm_loadu_si128( (const __m128i *) add + j ), off );
+            }
+            else
+                b[j] = _mm_setzero_si128();
+        }
+
+        ocb_kernel( ctx, OCB_ENCRYPT, b, n );
+
+        for( j = 0; j < n; j++ )
+            sum = _mm_xor_si128( sum, b[j] );
+
+        add += 16 * n;
+        add_len -= 16 * n;
+    }
+
+    if( add_len > 0 )
+    {
+        memset( buf, 0, 16 );
+        memcpy( buf, add, add_len );
+        buf[add_len] = 0x80;
+
+        off = _mm_xor_si128( off, _mm_load_si128( (const __m128i *) ctx->L_star ) );
+        sum = _mm_xor_si128( sum, ocb_encrypt1( ctx,
+                                 _mm_xor_si128( _mm_load_si128( (__m128i *) buf ), off ) ) );
+    }
+
+    return( sum );
+}
+
+int ocb_init( ocb_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    int i;
+
+    if( aes_setkey_enc( &ctx->enc, key, keysize ) != 0 ||
+        aes_setkey_dec( &ctx->dec, key, keysize ) != 0 )
+        return( POLARSSL_ERR_OCB_BAD_INPUT );
+
+    ctx->aesni = CheckAESSupport() != 0;
+
+    _mm_store_si128( (__m128i *) ctx->L_star, ocb_encrypt1( ctx, _mm_setzero_si128() ) );
+
+    cmac_dbl( ctx->L_dollar, ctx->L_star );
+    cmac_dbl( ctx->L[0], ctx->L_dollar );
+    for( i = 1; i < OCB_L_MAX; i++ )
+        cmac_dbl( ctx->L[i], ctx->L[i - 1] );
+
+    return( 0 );
+}
+
+int ocb_crypt_and_tag( ocb_context *ctx,
+                       int mode,
+                       size_t length,
+                       const unsigned char *iv,
+                       size_t iv_len,
+                       const unsigned char *add,
+                       size_t add_len,
+                       const unsigned char *input,
+                       unsigned char *output,
+                       size_t tag_len,
+                       unsigned char *tag )
+{
+    const __m128i *L = (const __m128i *) ctx->L;
+    ALIGN16 unsigned char nonce[16], stretch[24], buf[16];
+    __m128i off, sum, b[8], o[8];
+    unsigned long long i;
+    size_t rem;
+    int j, n, bottom, shift;
+
+    if( iv_len < 1 || iv_len > 15 || tag_len < 1 || tag_len > 16 ||
+        (unsigned long long) length / 16 > OCB_MAX_BLOCKS ||
+        (unsigned long long) add_len / 16 > OCB_MAX_BLOCKS )
+        return( POLARSSL_ERR_OCB_BAD_INPUT );
+
+    /*
+     * Nonce = num2str(TAGLEN mod 128, 7) || zeros || 1 || N, then
+     * Offset_0 = Stretch[1 + bottom .. 128 + bottom]
+     */
+    memset( nonce, 0, 16 );
+    nonce[0] = (unsigned char)( ( ( tag_len * 8 ) % 128 ) << 1 );
+    nonce[15 - iv_len] |= 1;
+    memcpy( nonce + 16 - iv_len, iv, iv_len );
+
+    bottom = nonce[15] & 0x3F;
+    nonce[15] &= 0xC0;
+
+    _mm_store_si128( (__m128i *) stretch,
+                     ocb_encrypt1( ctx, _mm_load_si128( (const __m128i *) nonce ) ) );
+    for( j = 0; j < 8; j++ )
+        stretch[16 + j] = stretch[j] ^ stretch[j + 1];
+
+    shift = bottom % 8;
+    for( j = 0; j < 16; j++ )
+    {
+        buf[j] = stretch[j + bottom / 8];
+        if( shift != 0 )
+            buf[j] = (unsigned char)( ( buf[j] << shift ) |
+                                      ( stretch[j + bottom / 8 + 1] >> ( 8 - shift ) ) );
+    }
+
+    off = _mm_load_si128( (__m128i *) buf );
+    sum = _mm_setzero_si128();
+
+    /*
+     * Full blocks, 8 at a time: offsets first, then one kernel call
+     */
+    for( i = 1; length >= 16; i += n )
+    {
+        n = ( length >= 128 ) ? 8 : (int)( length / 16 );
+
+        for( j = 0; j < 8; j++ )
+        {
+            if( j < n )
+            {
+                off = _mm_xor_si128( off, L[__builtin_ctzll( i + j )] );
+                o[j] = off;
+                b[j] = _mm_loadu_si128( (const __m128i *) input + j );
+                if( mode == OCB_ENCRYPT )
+                    sum = _mm_xor_si128( sum, b[j] );
+                b[j] = _mm_xor_si128( b[j], off );
+            }
+            else
+                b[j] = _mm_setzero_si128();
+        }
+
+        ocb_kernel( ctx, mode, b, n );
+
+        for( j = 0; j < n; j++ )
+        {
+            b[j] = _mm_xor_si128( b[j], o[j] );
+            if( mode == OCB_DECRYPT )
+                sum = _mm_xor_si128( sum, b[j] );
+            _mm_storeu_si128( (__m128i *) output + j, b[j] );
+        }
+
+        input += 16 * n;
+        output += 16 * n;
+        length -= 16 * n;
+    }
+
+    /*
+     * Partial last block: XOR with E(Offset_*), checksum the padded plaintext
+     */
+    rem = length;
+    if( rem > 0 )
+    {
+        ALIGN16 unsigned char pad[16];
+
+        off = _mm_xor_si128( off, _mm_load_si128( (const __m128i *) ctx->L_star ) );
+        _mm_store_si128( (__m128i *) pad, ocb_encrypt1( ctx, off ) );
+
+        memset( buf, 0, 16 );
+        if( mode == OCB_ENCRYPT )
+            memcpy( buf, input, rem );
+        for( j = 0; j < (int) rem; j++ )
+            output[j] = input[j] ^ pad[j];
+        if( mode == OCB_DECRYPT )
+            memcpy( buf, output, rem );
+        buf[rem] = 0x80;
+
+        sum = _mm_xor_si128( sum, _mm_load_si128( (__m128i *) buf ) );
+    }
+
+    /*
+     * Tag = E(Checksum ^ Offset ^ L_$) ^ HASH(K, A)
+     */
+    sum = _mm_xor_si128( sum, off );
+    sum = _mm_xor_si128( sum, _mm_load_si128( (const __m128i *) ctx->L_dollar ) );
+    sum = _mm_xor_si128( ocb_encrypt1( ctx, sum ), ocb_hash( ctx, add, add_len ) );
+
+    _mm_store_si128( (__m128i *) buf, sum );
+    memcpy( tag, buf, tag_len );
+
+    return( 0 );
+}
+
+int ocb_auth_decrypt( ocb_context *ctx,
+                      size_t length,
+                      const unsigned char *iv,
+                      size_t iv_len,
+                      const unsigned char *add,
+                      size_t add_len,
+                      const unsigned char *tag,
+                      size_t tag_len,
+                      const unsigned char *input,
+                      unsigned char *output )
+{
+    unsigned char check_tag[16];
+    size_t i;
+    int ret, diff;
+
+    if( ( ret = ocb_crypt_and_tag( ctx, OCB_DECRYPT, length, iv, iv_len,
+                                   add, add_len, input, output,
+                                   tag_len, check_tag ) ) != 0 )
+        return( ret );
+
+    /* Check tag in "constant-time" */
+    for( diff = 0, i = 0; i < tag_len; i++ )
+        diff |= tag[i] ^ check_tag[i];
+
+    if( diff != 0 )
+    {
+        memset( output, 0, length );
+        return( POLARSSL_ERR_OCB_AUTH_FAILED );
+    }
+
+    return( 0 );
+}
+
+#if defined(POLARSSL_SELF_TEST)
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * AES-OCB test vectors from:
+ *
+ * http://tools.ietf.org/html/rfc7253#appendix-A
+ *
+ * The sample results use K = 000102...0F, N = BBAA99887766554433221100
+ * with the last byte counting up, and A and P taken from the start of
+ * 000102...27.
+ */
+#define OCB_SAMPLES     16
+
+static const size_t ocb_test_add_len[OCB_SAMPLES] =
+    { 0, 8, 8, 0, 16, 16, 0, 24, 24, 0, 32, 32, 0, 40, 40, 0 };
+
+static const size_t ocb_test_pt_len[OCB_SAMPLES] =
+    { 0, 8, 0, 8, 16, 0, 16, 24, 0, 24, 32, 0, 32, 40, 0, 40 };
+
+static const unsigned char ocb_test_nonce[12] =
+{
+    0xbb, 0xaa, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44,
+    0x33, 0x22, 0x11, 0x00
+};
+
+static const unsigned char ocb_test_ct[OCB_SAMPLES][56] =
+{
+    { 0x78, 0x54, 0x07, 0xbf, 0xff, 0xc8, 0xad, 0x9e,
+      0xdc, 0xc5, 0x52, 0x0a, 0xc9, 0x11, 0x1e, 0xe6 },
+    { 0x68, 0x20, 0xb3, 0x65, 0x7b, 0x6f, 0x61, 0x5a,
+      0x57, 0x25, 0xbd, 0xa0, 0xd3, 0xb4, 0xeb, 0x3a,
+      0x25, 0x7c, 0x9a, 0xf1, 0xf8, 0xf0, 0x30, 0x09 },
+    { 0x81, 0x01, 0x7f, 0x82, 0x03, 0xf0, 0x81, 0x27,
+      0x71, 0x52, 0xfa, 0xde, 0x69, 0x4a, 0x0a, 0x00 },
+    { 0x45, 0xdd, 0x69, 0xf8, 0xf5, 0xaa, 0xe7, 0x24,
+      0x14, 0x05, 0x4c, 0xd1, 0xf3, 0x5d, 0x82, 0x76,
+      0x0b, 0x2c, 0xd0, 0x0d, 0x2f, 0x99, 0xbf, 0xa9 },
+    { 0x57, 0x1d, 0x53, 0x5b, 0x60, 0xb2, 0x77, 0x18,
+      0x8b, 0xe5, 0x14, 0x71, 0x70, 0xa9, 0xa2, 0x2c,
+      0x3a, 0xd7, 0xa4, 0xff, 0x38, 0x35, 0xb8, 0xc5,
+      0x70, 0x1c, 0x1c, 0xce, 0xc8, 0xfc, 0x33, 0x58 },
+    { 0x8c, 0xf7, 0x61, 0xb6, 0x90, 0x2e, 0xf7, 0x64,
+      0x46, 0x2a, 0xd8, 0x64, 0x98, 0xca, 0x6b, 0x97 },
+    { 0x5c, 0xe8, 0x8e, 0xc2, 0xe0, 0x69, 0x27, 0x06,
+      0xa9, 0x15, 0xc0, 0x0a, 0xeb, 0x8b, 0x23, 0x96,
+      0xf4, 0x0e, 0x1c, 0x74, 0x3f, 0x52, 0x43, 0x6b,
+      0xdf, 0x06, 0xd8, 0xfa, 0x1e, 0xca, 0x34, 0x3d },
+    { 0x1c, 0xa2, 0x20, 0x73, 0x08, 0xc8, 0x7c, 0x01,
+      0x07, 0x56, 0x10, 0x4d, 0x88, 0x40, 0xce, 0x19,
+      0x52, 0xf0, 0x96, 0x73, 0xa4, 0x48, 0xa1, 0x22,
+      0xc9, 0x2c, 0x62, 0x24, 0x10, 0x51, 0xf5, 0x73,
+      0x56, 0xd7, 0xf3, 0xc9, 0x0b, 0xb0, 0xe0, 0x7f },
+    { 0x6d, 0xc2, 0x25, 0xa0, 0x71, 0xfc, 0x1b, 0x9f,
+      0x7c, 0x69, 0xf9, 0x3b, 0x0f, 0x1e, 0x10, 0xde },
+    { 0x22, 0x1b, 0xd0, 0xde, 0x7f, 0xa6, 0xfe, 0x99,
+      0x3e, 0xcc, 0xd7, 0x69, 0x46, 0x0a, 0x0a, 0xf2,
+      0xd6, 0xcd, 0xed, 0x0c, 0x39, 0x5b, 0x1c, 0x3c,
+      0xe7, 0x25, 0xf3, 0x24, 0x94, 0xb9, 0xf9, 0x14,
+      0xd8, 0x5c, 0x0b, 0x1e, 0xb3, 0x83, 0x57, 0xff },
+    { 0xbd, 0x6f, 0x6c, 0x49, 0x62, 0x01, 0xc6, 0x92,
+      0x96, 0xc1, 0x1e, 0xfd, 0x13, 0x8a, 0x46, 0x7a,
+      0xbd, 0x3c, 0x70, 0x79, 0x24, 0xb9, 0x64, 0xde,
+      0xaf, 0xfc, 0x40, 0x31, 0x9a, 0xf5, 0xa4, 0x85,
+      0x40, 0xfb, 0xba, 0x18, 0x6c, 0x55, 0x53, 0xc6,
+      0x8a, 0xd9, 0xf5, 0x92, 0xa7, 0x9a, 0x42, 0x40 },
+    { 0xfe, 0x80, 0x69, 0x0b, 0xee, 0x8a, 0x48, 0x5d,
+      0x11, 0xf3, 0x29, 0x65, 0xbc, 0x9d, 0x2a, 0x32 },
+    { 0x29, 0x42, 0xbf, 0xc7, 0x73, 0xbd, 0xa2, 0x3c,
+      0xab, 0xc6, 0xac, 0xfd, 0x9b, 0xfd, 0x58, 0x35,
+      0xbd, 0x30, 0x0f, 0x09, 0x73, 0x79, 0x2e, 0xf4,
+      0x60, 0x40, 0xc5, 0x3f, 0x14, 0x32, 0xbc, 0xdf,
+      0xb5, 0xe1, 0xdd, 0xe3, 0xbc, 0x18, 0xa5, 0xf8,
+      0x40, 0xb5, 0x2e, 0x65, 0x34, 0x44, 0xd5, 0xdf },
+    { 0xd5, 0xca, 0x91, 0x74, 0x84, 0x10, 0xc1, 0x75,
+      0x1f, 0xf8, 0xa2, 0xf6, 0x18, 0x25, 0x5b, 0x68,
+      0xa0, 0xa1, 0x2e, 0x09, 0x3f, 0xf4, 0x54, 0x60,
+      0x6e, 0x59, 0xf9, 0xc1, 0xd0, 0xdd, 0xc5, 0x4b,
+      0x65, 0xe8, 0x62, 0x8e, 0x56, 0x8b, 0xad, 0x7a,
+      0xed, 0x07, 0xba, 0x06, 0xa4, 0xa6, 0x94, 0x83,
+      0xa7, 0x03, 0x54, 0x90, 0xc5, 0x76, 0x9e, 0x60 },
+    { 0xc5, 0xcd, 0x9d, 0x18, 0x50, 0xc1, 0x41, 0xe3,
+      0x58, 0x64, 0x99, 0x94, 0xee, 0x70, 0x1b, 0x68 },
+    { 0x44, 0x12, 0x92, 0x34, 0x93, 0xc5, 0x7d, 0x5d,
+      0xe0, 0xd7, 0x00, 0xf7, 0x53, 0xcc, 0xe0, 0xd1,
+      0xd2, 0xd9, 0x50, 0x60, 0x12, 0x2e, 0x9f, 0x15,
+      0xa5, 0xdd, 0xbf, 0xc5, 0x78, 0x7e, 0x50, 0xb5,
+      0xcc, 0x55, 0xee, 0x50, 0x7b, 0xcb, 0x08, 0x4e,
+      0x47, 0x9a, 0xd3, 0x63, 0xac, 0x36, 0x6b, 0x95,
+      0xa9, 0x8c, 0xa5, 0xf3, 0x00, 0x0b, 0x14, 0x79 }
+};
+
+/*
+ * The sample with a 96-bit tag: K = 0F0E0D...00, N = ...0D, 40 bytes
+ * of A and P
+ */
+static const unsigned char ocb_test_key96[16] =
+{
+    0x0f, 0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x09, 0x08,
+    0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00
+};
+
+static const unsigned char ocb_test_ct96[52] =
+{
+    0x17, 0x92, 0xa4, 0xe3, 0x1e, 0x07, 0x55, 0xfb,
+    0x03, 0xe3, 0x1b, 0x22, 0x11, 0x6e, 0x6c, 0x2d,
+    0xdf, 0x9e, 0xfd, 0x6e, 0x33, 0xd5, 0x36, 0xf1,
+    0xa0, 0x12, 0x4b, 0x0a, 0x55, 0xba, 0xe8, 0x84,
+    0xed, 0x93, 0x48, 0x15, 0x29, 0xc7, 0x6b, 0x6a,
+    0xd0, 0xc5, 0x15, 0xf4, 0xd1, 0xcd, 0xd4, 0xfd,
+    0xac, 0x4f, 0x02, 0xaa
+};
+
+/*
+ * The iterative test of Appendix A: 384 encryptions of 0 to 127 zero
+ * bytes, one more over their concatenation as associated data. Results
+ * for 128-, 192- and 256-bit keys and 128-, 96- and 64-bit tags.
+ */
+#define OCB_ITER_LEN    22400
+
+static const unsigned char ocb_test_iter_tag[9][16] =
+{
+    { 0x67, 0xe9, 0x44, 0xd2, 0x32, 0x56, 0xc5, 0xe0,
+      0xb6, 0xc6, 0x1f, 0xa2, 0x2f, 0xdf, 0x1e, 0xa2 },
+    { 0xf6, 0x73, 0xf2, 0xc3, 0xe7, 0x17, 0x4a, 0xae,
+      0x7b, 0xae, 0x98, 0x6c, 0xa9, 0xf2, 0x9e, 0x17 },
+    { 0xd9, 0x0e, 0xb8, 0xe9, 0xc9, 0x77, 0xc8, 0x8b,
+      0x79, 0xdd, 0x79, 0x3d, 0x7f, 0xfa, 0x16, 0x1c },
+    { 0x77, 0xa3, 0xd8, 0xe7, 0x35, 0x89, 0x15, 0x8d,
+      0x25, 0xd0, 0x12, 0x09 },
+    { 0x05, 0xd5, 0x6e, 0xad, 0x27, 0x52, 0xc8, 0x6b,
+      0xe6, 0x93, 0x2c, 0x5e },
+    { 0x54, 0x58, 0x35, 0x9a, 0xc2, 0x3b, 0x0c, 0xba,
+      0x9e, 0x63, 0x30, 0xdd },
+    { 0x19, 0x2c, 0x9b, 0x7b, 0xd9, 0x0b, 0xa0, 0x6a },
+    { 0x00, 0x66, 0xbc, 0x6e, 0x0e, 0xf3, 0x4e, 0x24 },
+    { 0x7d, 0x4e, 0xa5, 0xd4, 0x45, 0x50, 0x1c, 0xbe }
+};
+
+/*
+ * Checkup routine
+ */
+int ocb_self_test( int verbose )
+{
+    ocb_context ctx;
+    unsigned char key[32];
+    unsigned char nonce[12];
+    unsigned char data[40];
+    unsigned char zero[128];
+    unsigned char buf[56];
+    unsigned char *c;
+    size_t c_len;
+    int i, j, n, tag_len, key_len, path, ret = 0;
+
+    if( ( c = malloc( OCB_ITER_LEN ) ) == NULL )
+        return( 1 );
+
+    for( i = 0; i < 40; i++ )
+        data[i] = (unsigned char) i;
+
+    memset( zero, 0, sizeof( zero ) );
+
+    /*
+     * The AES-NI path (when available) and the aes_crypt_ecb path
+     */
+    for( path = CheckAESSupport() ? 1 : 0; path >= 0; path-- )
+    {
+        memcpy( key, data, 16 );
+        ocb_init( &ctx, key, 128 );
+        ctx.aesni = path;
+
+        for( i = 0; i < OCB_SAMPLES; i++ )
+        {
+            size_t len = ocb_test_pt_len[i];
+
+            if( verbose != 0 )
+                printf( "  AES-OCB-128 #%d (%s): ", i + 1, path ? "aesni" : "table" );
+
+            memcpy( nonce, ocb_test_nonce, 12 );
+            nonce[11] = (unsigned char) i;
+
+            ocb_crypt_and_tag( &ctx, OCB_ENCRYPT, len, nonce, 12,
+                               data, ocb_test_add_len[i], data, buf, 16, buf + len );
+
+            if( memcmp( buf, ocb_test_ct[i], len + 16 ) != 0 ||
+                ocb_auth_decrypt( &ctx, len, nonce, 12, data, ocb_test_add_len[i],
+                                  ocb_test_ct[i] + len, 16, ocb_test_ct[i], buf ) != 0 ||
+                memcmp( buf, data, len ) != 0 )
+                goto fail;
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+
+        if( verbose != 0 )
+            printf( "  AES-OCB-128 96-bit tag (%s): ", path ? "aesni" : "table" );
+
+        ocb_init( &ctx, ocb_test_key96, 128 );
+        ctx.aesni = path;
+        memcpy( nonce, ocb_test_nonce, 12 );
+        nonce[11] = 0x0d;
+
+        ocb_crypt_and_tag( &ctx, OCB_ENCRYPT, 40, nonce, 12, data, 40, data, buf, 12, buf + 40 );
+
+        if( memcmp( buf, ocb_test_ct96, 52 ) != 0 )
+            goto fail;
+
+        if( verbose != 0 )
+            printf( "passed\n" );
+
+        memset( nonce, 0, sizeof( nonce ) );
+
+        for( j = 0; j < 9; j++ )
+        {
+            tag_len = 16 - 4 * ( j / 3 );
+            key_len = 128 + 64 * ( j % 3 );
+
+            if( verbose != 0 )
+                printf( "  AES-OCB-%3d iterative, %d-bit tag (%s): ", key_len, tag_len * 8,
+                        path ? "aesni" : "table" );
+
+            memset( key, 0, sizeof( key ) );
+            key[key_len / 8 - 1] = (unsigned char)( tag_len * 8 );
+            ocb_init( &ctx, key, key_len );
+            ctx.aesni = path;
+
+            for( c_len = 0, i = 0; i < 128; i++ )
+            {
+                n = 3 * i + 1;
+                nonce[10] = (unsigned char)( n >> 8 ); nonce[11] = (unsigned char) n;
+                ocb_crypt_and_tag( &ctx, OCB_ENCRYPT, i, nonce, 12, zero, i, zero,
+                                   c + c_len, tag_len, c + c_len + i );
+                c_len += i + tag_len;
+
+                n = 3 * i + 2;
+                nonce[10] = (unsigned char)( n >> 8 ); nonce[11] = (unsigned char) n;
+                ocb_crypt_and_tag( &ctx, OCB_ENCRYPT, i, nonce, 12, NULL, 0, zero,
+                                   c + c_len, tag_len, c + c_len + i );
+                c_len += i + tag_len;
+
+                n = 3 * i + 3;
+                nonce[10] = (unsigned char)( n >> 8 ); nonce[11] = (unsigned char) n;
+                ocb_crypt_and_tag( &ctx, OCB_ENCRYPT, 0, nonce, 12, zero, i, NULL,
+                                   c + c_len, tag_len, c + c_len );
+                c_len += tag_len;
+            }
+
+            nonce[10] = (unsigned char)( 385 >> 8 ); nonce[11] = (unsigned char) 385;
+            ocb_crypt_and_tag( &ctx, OCB_ENCRYPT, 0, nonce, 12, c, c_len, NULL,
+                               NULL, tag_len, buf );
+
+            if( memcmp( buf, ocb_test_iter_tag[j], tag_len ) != 0 )
+                goto fail;
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+    }
+
+    goto exit;
+
+fail:
+    if( verbose != 0 )
+        printf( "failed\n" );
+
+    ret = 1;
+
+exit:
+    free( c );
+
+    if( verbose != 0 )
+        printf( "\n" );
+
+    return( ret );
+}
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * \file ocb.h
+ *
+ * \brief AES-OCB3 (RFC 7253)
+ *
+ * Every block is encrypted under its own offset, and the offsets are
+ * XORs of a precomputed table, so both encryption and authentication run
+ * 8 blocks at a time through the interleaved kernels. The checksum is a
+ * plain XOR of the plaintext. Without AES-NI the table implementation
+ * (aes_crypt_ecb) is used.
+ */
+#ifndef POLARSSL_OCB_H
+#define POLARSSL_OCB_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+
+#define OCB_ENCRYPT     1
+#define OCB_DECRYPT     0
+
+#define OCB_L_MAX       48      /**< L_0..L_47: up to 2^48 - 1 blocks per input */
+
+#define POLARSSL_ERR_OCB_AUTH_FAILED                       -0x0016  /**< Authenticated decryption failed. */
+#define POLARSSL_ERR_OCB_BAD_INPUT                         -0x0018  /**< Bad input parameters to function. */
+
+/**
+ * \brief          OCB context structure
+ *
+ *                 ocb_init turns `aesni` on when the CPU supports it;
+ *                 clearing it afterwards forces the table path.
+ */
+typedef struct
+{
+    int aesni;                                  /*!<  nonzero: AES-NI path   */
+    aes_context enc;                            /*!<  encryption schedule    */
+    aes_context dec;                            /*!<  decryption schedule    */
+    ALIGN16 unsigned char L_star[16];           /*!<  E(0)                   */
+    ALIGN16 unsigned char L_dollar[16];         /*!<  double(L_*)            */
+    ALIGN16 unsigned char L[OCB_L_MAX][16];     /*!<  L_i = double^i(L_$)    */
+}
+ocb_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          OCB initialization: key schedules and L table
+ *
+ * \param ctx      OCB context to be initialized
+ * \param key      encryption key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_OCB_BAD_INPUT
+ */
+int ocb_init( ocb_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          OCB buffer encryption/decryption using AES
+ *
+ * \param ctx      OCB context
+ * \param mode     OCB_ENCRYPT or OCB_DECRYPT
+ * \param length   length of the input data
+ * \param iv       nonce
+ * \param iv_len   length of the nonce (1 to 15 bytes)
+ * \param add      additional data
+ * \param add_len  length of additional data
+ * \param input    buffer holding the input data
+ * \param output   buffer for holding the output data
+ * \param tag_len  length of the tag to generate (1 to 16 bytes)
+ * \param tag      buffer for holding the tag
+ *
+ * \return         0 if successful, or POLARSSL_ERR_OCB_BAD_INPUT
+ */
+int ocb_crypt_and_tag( ocb_context *ctx,
+                       int mode,
+                       size_t length,
+                       const unsigned char *iv,
+                       size_t iv_len,
+                       const unsigned char *add,
+                       size_t add_len,
+                       const unsigned char *input,
+                       unsigned char *output,
+                       size_t tag_len,
+                       unsigned char *tag );
+
+/**
+ * \brief          OCB buffer authenticated decryption using AES
+ *
+ * \param ctx      OCB context
+ * \param length   length of the input data
+ * \param iv       nonce
+ * \param iv_len   length of the nonce
+ * \param add      additional data
+ * \param add_len  length of additional data
+ * \param tag      buffer holding the tag
+ * \param tag_len  length of the tag
+ * \param input    buffer holding the input data
+ * \param output   buffer for holding the output data
+ *
+ * \return         0 if successful and authenticated,
+ *                 POLARSSL_ERR_OCB_AUTH_FAILED if tag does not match
+ *                 (output is then zeroed)
+ */
+int ocb_auth_decrypt( ocb_context *ctx,
+                      size_t length,
+                      const unsigned char *iv,
+                      size_t iv_len,
+                      const unsigned char *add,
+                      size_t add_len,
+                      const unsigned char *tag,
+                      size_t tag_len,
+                      const unsigned char *input,
+                      unsigned char *output );
+
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int ocb_self_test( int verbose );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocb.h */
@@ -1,11 +1,28 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
 #include "aes.h"
 #include "aesni.h"
+#include "vaes.h"
+#include "gcm.h"
+#include "ocb.h"
+#include "ccm.h"
+#include "xts.h"
+#include "aesx.h"
+#include "aesbs.h"
+#include "vpaes.h"
+#include "cmac.h"
+#include "keycache.h"
+#include "aesmb.h"
 
 #define ITERATIONS 10
 #define AES_BLOCK_SIZE 16
@@ -24,27 +41,23 @@ typedef struct AESInfo {
 
 size_t MESSAGE_LENGTH = 0;
 
-/* ------------------ ELECTRONIC CODE-BOOK ------------------ */
-void* ecb_test_thread(void* a) {
+/* If set (first command line argument), only tests whose name contains it run */
+const char *test_filter = NULL;
 
-	AESInfo* info = (AESInfo *)a;
-	//unsigned char output[AES_BLOCK_SIZE];
-	
-	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
-	unsigned char* currpos = msg + encrypt_length * info->thread_id;
-	unsigned char* output = out + encrypt_length * info->thread_id;
-	
-	for(int i = 0; i < encrypt_length / AES_BLOCK_SIZE; i++) {
-		aes_crypt_ecb(&aes_ctx, AES_ENCRYPT, currpos, output);
-		currpos += AES_BLOCK_SIZE;
-		output += AES_BLOCK_SIZE;
-	}
-	
-	return NULL;
-}
+/* ------------------ TEST DRIVER ------------------ */
 
-void ecb_test(int msg_length, int num_thread) {
-	printf("Plain ECB, %d, %d, ", msg_length, num_thread);
+/*
+ * Encrypts a random `msg_length`-byte message ITERATIONS times, split
+ * evenly across `num_thread` threads running `thread_fn`, and prints the
+ * wall time of each run in microseconds. `setkey` is called with a fresh
+ * random `key` before every run and is not timed.
+ */
+void run_test(const char *name, void (*setkey)(void), void* (*thread_fn)(void*),
+			  int msg_length, int num_thread) {
+	if(test_filter && !strstr(name, test_filter))
+		return;
+
+	printf("%s, %d, %d, ", name, msg_length, num_thread);
 
 	MESSAGE_LENGTH = msg_length;
 
@@ -61,7 +74,7 @@ void ecb_test(int msg_length, int num_thread) {
 			key[i] = rand() % 255;
 		}	
 			
-		aes_setkey_enc(&aes_ctx, key, KEY_LENGTH_BITS);
+		setkey();
 	
 		pthread_t threads[num_thread];
 		pthread_attr_t pthread_custom_attr;
@@ -77,7 +90,7 @@ void ecb_test(int msg_length, int num_thread) {
 			infos[tid].thread_id = tid;
 			infos[tid].total_threads = num_thread;
 			
-			pthread_create(&threads[tid], &pthread_custom_attr, ecb_test_thread, &infos[tid]);
+			pthread_create(&threads[tid], &pthread_custom_attr, thread_fn, &infos[tid]);
 		}
 		
 		
@@ -95,265 +108,1488 @@ void ecb_test(int msg_length, int num_thread) {
    		printf("%lld, ", seconds);
 	}
 	
-	MESSAGE_LENGTH = 0;
+	MESSAGE_LENGTH = 0;
+	
+	free(msg);
+	free(out);
+	
+	printf("\n");
+}
+
+/* Runs `test` over the usual grid of message sizes and thread counts. */
+void run_sizes(void (*test)(int, int)) {
+	static const int sizes[] = { 1048576, 10485760, 104857600, 1048576000 };
+	
+	for(int s = 0; s < 4; s++) {
+		for(int num_thread = 1; num_thread <= 8; num_thread *= 2) {
+			test(sizes[s], num_thread);
+		}
+	}
+}
+
+/* ------------------ ELECTRONIC CODE-BOOK ------------------ */
+void* ecb_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	//unsigned char output[AES_BLOCK_SIZE];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	aes_crypt_ecb_blocks(&aes_ctx, AES_ENCRYPT, encrypt_length, currpos, output);
+	
+	return NULL;
+}
+
+void table_setkey(void) {
+	aes_setkey_enc(&aes_ctx, key, KEY_LENGTH_BITS);
+}
+
+void ecb_test(int msg_length, int num_thread) {
+	run_test("Plain ECB", table_setkey, ecb_test_thread, msg_length, num_thread);
+}
+
+/* ------------------ TABLE LAYOUT (FOUR TABLES VS ONE) ------------------ */
+void compact_setkey(void) {
+	table_setkey();
+	aes_set_compact_tables(&aes_ctx, 1);
+}
+
+void ecb_compact_test(int msg_length, int num_thread) {
+	run_test("Plain ECB compact", compact_setkey, ecb_test_thread, msg_length, num_thread);
+}
+
+/*
+ * Counts L1 data cache read misses of the calling thread. Returns -1 when
+ * perf events are unavailable (not Linux, no permission, no PMU in the VM);
+ * the report then shows throughput only.
+ */
+int l1d_miss_counter_open(void) {
+#ifdef __linux__
+	struct perf_event_attr attr;
+	
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+void l1d_miss_counter_enable(int fd, int on) {
+#ifdef __linux__
+	if(fd < 0)
+		return;
+	if(on)
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#endif
+}
+
+long long l1d_miss_counter_read(int fd) {
+	long long count = 0;
+	
+	if(fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+		return -1;
+	return count;
+}
+
+#define LAYOUT_APP_BYTES (24 * 1024)
+#define LAYOUT_CHUNK 1024
+#define LAYOUT_ROUNDS 20000
+
+/*
+ * Runs each table layout two ways: a 16 MiB ECB pass for raw throughput,
+ * then LAYOUT_ROUNDS of one LAYOUT_CHUNK encryption followed by a sweep of
+ * a LAYOUT_APP_BYTES "application" buffer. The L1D misses of the second run
+ * show how much of the application's data the tables push out.
+ */
+void table_layout_test(void) {
+	static const char *names[] = { "four tables", "compact" };
+	const size_t bulk = 16 * 1048576;
+	unsigned char *buf, *app, chunk[LAYOUT_CHUNK];
+	volatile unsigned long sink = 0;
+	struct timeval start, end;
+	int fd;
+	
+	if(test_filter && !strstr("Table layout", test_filter))
+		return;
+	
+	buf = malloc(bulk);
+	app = malloc(LAYOUT_APP_BYTES);
+	memset(buf, 0x3C, bulk);
+	memset(app, 0x5A, LAYOUT_APP_BYTES);
+	memset(chunk, 0xA5, sizeof(chunk));
+	fd = l1d_miss_counter_open();
+	if(fd < 0)
+		printf("## perf events unavailable, reporting throughput only\n");
+	
+	for(int layout = 0; layout < 2; layout++) {
+		long long misses_bulk, misses_mixed;
+		double mbps, ns;
+		
+		table_setkey();
+		if(aes_set_compact_tables(&aes_ctx, layout) != 0) {
+			printf("Table layout, %s, unavailable in this build\n", names[layout]);
+			continue;
+		}
+		
+		l1d_miss_counter_enable(fd, 1);
+		gettimeofday(&start, NULL);
+		aes_crypt_ecb_blocks(&aes_ctx, AES_ENCRYPT, bulk, buf, buf);
+		gettimeofday(&end, NULL);
+		l1d_miss_counter_enable(fd, 0);
+		misses_bulk = l1d_miss_counter_read(fd);
+		mbps = bulk / (double)(1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec));
+		
+		l1d_miss_counter_enable(fd, 1);
+		gettimeofday(&start, NULL);
+		for(int r = 0; r < LAYOUT_ROUNDS; r++) {
+			aes_crypt_ecb_blocks(&aes_ctx, AES_ENCRYPT, LAYOUT_CHUNK, chunk, chunk);
+			for(int i = 0; i < LAYOUT_APP_BYTES; i += 64)
+				sink += app[i];
+		}
+		gettimeofday(&end, NULL);
+		l1d_miss_counter_enable(fd, 0);
+		misses_mixed = l1d_miss_counter_read(fd);
+		ns = 1000.0 * (1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)) / LAYOUT_ROUNDS;
+		
+		printf("Table layout, %s, %.0f MB/s, mixed %.0f ns/round", names[layout], mbps, ns);
+		if(misses_bulk >= 0 && misses_mixed >= 0)
+			printf(", L1D misses %.2f/KB bulk, %.1f/round mixed",
+				   misses_bulk * 1024.0 / bulk, (double)misses_mixed / LAYOUT_ROUNDS);
+		printf("\n");
+	}
+	
+	if(fd >= 0)
+		close(fd);
+	free(buf);
+	free(app);
+}
+
+/* ------------------ COUNTER MODE ------------------ */
+unsigned char nonce_counter[16];
+
+//Each thread encrypts its own slice at its block offset, so the output matches a serial run
+void* ctr_test_thread(void* a) {
+	AESInfo* info = (AESInfo *)a;
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	aes_crypt_ctr_at(&aes_ctx, encrypt_length, nonce_counter,
+					 (unsigned long long)(encrypt_length / AES_BLOCK_SIZE) * info->thread_id,
+					 currpos, output);
+	
+	return NULL;
+}
+
+void ctr_nonce_init(void) {
+	memset(nonce_counter, 0, sizeof(nonce_counter));
+	memcpy(nonce_counter, "315AHloEelAS", 12);
+	nonce_counter[15] = 1;
+}
+
+void ctr_setkey(void) {
+	ctr_nonce_init();
+	table_setkey();
+}
+
+void ctr_test(int msg_length, int num_thread) {
+	run_test("Plain CTR", ctr_setkey, ctr_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ AESNI BASED ELECTRONIC CODE-BOOK ------------------ */
+aes_context AESNI_CTX;
+
+
+void* aes_ecb_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	//unsigned char output[AES_BLOCK_SIZE];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	AES_ECB_encrypt(currpos, output, encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
+	
+	return NULL;
+}
+
+void aesni_setkey(void) {
+	aes_setkey_enc(&AESNI_CTX, key, KEY_LENGTH_BITS);
+}
+
+void aes_ecb_test(int msg_length, int num_thread) {
+	run_test("AESNI ECB", aesni_setkey, aes_ecb_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ AESNI BASED COUNTER MODE ------------------ */
+	unsigned char ivec[8];
+	unsigned char nonce[4];
+
+void* aes_ctr_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	//unsigned char output[AES_BLOCK_SIZE];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	AES_CTR128_encrypt(currpos, output, nonce_counter,
+					   (unsigned long long)(encrypt_length / AES_BLOCK_SIZE) * info->thread_id,
+					   encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
+	
+	return NULL;
+}
+
+void aesni_ctr_setkey(void) {
+	ivec[0] = 'H'; ivec[1] = 'l'; ivec[2] = 'o'; ivec[3] = 'E';
+	ivec[4] = 'e'; ivec[5] = 'l'; ivec[6] = 'A'; ivec[7] = 'S';
+	
+	nonce[0] = '3'; nonce[1] = '1'; nonce[2] = '5'; nonce[3] = 'A';
+	
+	//same counter blocks AES_CTR_encrypt builds from ivec and nonce
+	memcpy(nonce_counter, nonce, 4);
+	memcpy(nonce_counter + 4, ivec, 8);
+	nonce_counter[12] = nonce_counter[13] = nonce_counter[14] = 0;
+	nonce_counter[15] = 1;
+	
+	aesni_setkey();
+}
+
+/*
+ * Encrypts one buffer serially and again as CTR_CHECK_SLICES slices at
+ * their block offsets, in reverse order, from a counter about to carry out
+ * of its low 64 bits. The table, AES-NI and (where available) VAES paths
+ * must agree with each other and with themselves. Returns 0 on success.
+ */
+#define CTR_CHECK_SLICES 8
+#define CTR_CHECK_LENGTH (CTR_CHECK_SLICES * 1024 + 5)
+
+int ctr_split_check(void) {
+	unsigned char counter[16], *in, *serial, *split, *ni;
+	int slice = (CTR_CHECK_LENGTH / CTR_CHECK_SLICES) & ~(AES_BLOCK_SIZE - 1);
+	int ret = 0;
+	
+	in = malloc(CTR_CHECK_LENGTH);
+	serial = malloc(CTR_CHECK_LENGTH);
+	split = malloc(CTR_CHECK_LENGTH);
+	ni = malloc(CTR_CHECK_LENGTH);
+	
+	for(int i = 0; i < CTR_CHECK_LENGTH; i++)
+		in[i] = rand() % 255;
+	for(int i = 0; i < KEY_LENGTH_BYTES; i++)
+		key[i] = rand() % 255;
+	memset(counter, 0xff, sizeof(counter));
+	counter[0] = 0x12;
+	counter[15] = 0xf0;
+	
+	table_setkey();
+	aes_crypt_ctr_at(&aes_ctx, CTR_CHECK_LENGTH, counter, 0, in, serial);
+	
+	for(int s = CTR_CHECK_SLICES - 1; s >= 0; s--) {
+		int len = (s == CTR_CHECK_SLICES - 1) ? CTR_CHECK_LENGTH - slice * s : slice;
+		aes_crypt_ctr_at(&aes_ctx, len, counter, slice / AES_BLOCK_SIZE * s, in + slice * s, split + slice * s);
+	}
+	ret |= memcmp(serial, split, CTR_CHECK_LENGTH);
+	
+	if(CheckAESSupport()) {
+		aesni_setkey();
+		for(int s = CTR_CHECK_SLICES - 1; s >= 0; s--) {
+			int len = (s == CTR_CHECK_SLICES - 1) ? CTR_CHECK_LENGTH - slice * s : slice;
+			AES_CTR128_encrypt(in + slice * s, ni + slice * s, counter, slice / AES_BLOCK_SIZE * s,
+							   len, AESNI_CTX.ni, AESNI_CTX.nr);
+		}
+		ret |= memcmp(serial, ni, CTR_CHECK_LENGTH);
+		
+		if(CheckVAESSupport()) {
+			memset(ni, 0, CTR_CHECK_LENGTH);
+			for(int s = CTR_CHECK_SLICES - 1; s >= 0; s--) {
+				int len = (s == CTR_CHECK_SLICES - 1) ? CTR_CHECK_LENGTH - slice * s : slice;
+				AES_CTR128_encrypt_vaes(in + slice * s, ni + slice * s, counter, slice / AES_BLOCK_SIZE * s,
+										len, AESNI_CTX.ni, AESNI_CTX.nr);
+			}
+			ret |= memcmp(serial, ni, CTR_CHECK_LENGTH);
+		}
+	}
+	
+	free(in);
+	free(serial);
+	free(split);
+	free(ni);
+	
+	return ret;
+}
+
+/*
+ * AES_set_encrypt_key/AES_set_decrypt_key (aeskeygenassist, aesimc)
+ * against the table expansion of aes_setkey_enc/aes_setkey_dec, and
+ * aes_setkey_enc/aes_setkey_dec on their AES-NI path against both, for
+ * 128-, 192- and 256-bit keys. Skipped without AES-NI. Returns 0 on
+ * success.
+ */
+#define KEYSCHEDULE_CHECK_KEYS 16
+
+int keyschedule_check(void) {
+	aes_context table, ni;
+	AES_KEY ref;
+	unsigned char k[32];
+	int ret = 0;
+	
+	if(!CheckAESSupport())
+		return 0;
+	
+	for(int n = 0; n < KEYSCHEDULE_CHECK_KEYS; n++) {
+		for(int bits = 128; bits <= 256; bits += 64) {
+			for(int i = 0; i < 32; i++)
+				k[i] = rand() % 255;
+			
+			AES_set_encrypt_key(k, bits, &ref);
+			aes_setkey_aesni(0);
+			aes_setkey_enc(&table, k, bits);
+			aes_setkey_aesni(1);
+			aes_setkey_enc(&ni, k, bits);
+			ret |= table.nr != (int) ref.nr || ni.nr != (int) ref.nr;
+			ret |= memcmp(table.ni, ref.KEY, 16 * (ref.nr + 1)) != 0;
+			ret |= memcmp(ni.ni, ref.KEY, 16 * (ref.nr + 1)) != 0;
+			
+			AES_set_decrypt_key(k, bits, &ref);
+			aes_setkey_aesni(0);
+			aes_setkey_dec(&table, k, bits);
+			aes_setkey_aesni(1);
+			aes_setkey_dec(&ni, k, bits);
+			ret |= table.nr != (int) ref.nr || ni.nr != (int) ref.nr;
+			ret |= memcmp(table.ni, ref.KEY, 16 * (ref.nr + 1)) != 0;
+			ret |= memcmp(ni.ni, ref.KEY, 16 * (ref.nr + 1)) != 0;
+		}
+	}
+	
+	return ret;
+}
+
+/*
+ * AES_CBC_encrypt, AES_CBC_decrypt (also in place) and
+ * AES_CBC_encrypt_multi against aes_crypt_cbc for 128-, 192- and 256-bit
+ * keys: output and updated IV. CBC_CHECK_BLOCKS covers full 8-block
+ * groups and a remainder; CBC_CHECK_STREAMS is not a multiple of 8, so
+ * the multi-stream call ends with a partial group. Skipped without AES-NI.
+ * Returns 0 on success.
+ */
+#define CBC_CHECK_BLOCKS 27
+#define CBC_CHECK_LENGTH (CBC_CHECK_BLOCKS * AES_BLOCK_SIZE)
+#define CBC_CHECK_STREAMS 13
+#define CBC_CHECK_STREAM 32
+
+int cbc_check(void) {
+	aes_context enc, dec;
+	unsigned char k[32], iv[16], ref_iv[16], *in, *ref, *out;
+	unsigned char ivs[CBC_CHECK_STREAMS][16], start_ivs[CBC_CHECK_STREAMS][16];
+	const unsigned char *ins[CBC_CHECK_STREAMS];
+	unsigned char *outs[CBC_CHECK_STREAMS], *ivps[CBC_CHECK_STREAMS];
+	int ret = 0;
+	
+	if(!CheckAESSupport())
+		return 0;
+	
+	in = malloc(CBC_CHECK_LENGTH);
+	ref = malloc(CBC_CHECK_LENGTH);
+	out = malloc(CBC_CHECK_LENGTH);
+	
+	for(int i = 0; i < CBC_CHECK_LENGTH; i++)
+		in[i] = rand() % 255;
+	
+	for(int bits = 128; bits <= 256; bits += 64) {
+		for(int i = 0; i < 32; i++)
+			k[i] = rand() % 255;
+		for(int i = 0; i < 16; i++)
+			iv[i] = rand() % 255;
+		aes_setkey_enc(&enc, k, bits);
+		aes_setkey_dec(&dec, k, bits);
+		
+		//encryption
+		memcpy(ref_iv, iv, 16);
+		aes_crypt_cbc(&enc, AES_ENCRYPT, CBC_CHECK_LENGTH, ref_iv, in, ref);
+		memcpy(ivs[0], iv, 16);
+		AES_CBC_encrypt(in, out, ivs[0], CBC_CHECK_LENGTH, enc.ni, enc.nr);
+		ret |= memcmp(ref, out, CBC_CHECK_LENGTH) != 0 || memcmp(ref_iv, ivs[0], 16) != 0;
+		
+		//decryption, then in place
+		memcpy(ref_iv, iv, 16);
+		aes_crypt_cbc(&dec, AES_DECRYPT, CBC_CHECK_LENGTH, ref_iv, in, ref);
+		memcpy(ivs[0], iv, 16);
+		AES_CBC_decrypt(in, out, ivs[0], CBC_CHECK_LENGTH, dec.ni, dec.nr);
+		ret |= memcmp(ref, out, CBC_CHECK_LENGTH) != 0 || memcmp(ref_iv, ivs[0], 16) != 0;
+		
+		memcpy(out, in, CBC_CHECK_LENGTH);
+		memcpy(ivs[0], iv, 16);
+		AES_CBC_decrypt(out, out, ivs[0], CBC_CHECK_LENGTH, dec.ni, dec.nr);
+		ret |= memcmp(ref, out, CBC_CHECK_LENGTH) != 0 || memcmp(ref_iv, ivs[0], 16) != 0;
+		
+		//independent streams, each with its own IV
+		for(int s = 0; s < CBC_CHECK_STREAMS; s++) {
+			for(int i = 0; i < 16; i++)
+				ivs[s][i] = rand() % 255;
+			ins[s] = in + s * CBC_CHECK_STREAM;
+			outs[s] = out + s * CBC_CHECK_STREAM;
+			ivps[s] = ivs[s];
+			memcpy(start_ivs[s], ivs[s], 16);
+		}
+		AES_CBC_encrypt_multi(ins, outs, ivps, CBC_CHECK_STREAM, CBC_CHECK_STREAMS, enc.ni, enc.nr);
+		
+		for(int s = 0; s < CBC_CHECK_STREAMS; s++) {
+			aes_crypt_cbc(&enc, AES_ENCRYPT, CBC_CHECK_STREAM, start_ivs[s], ins[s], ref);
+			ret |= memcmp(ref, outs[s], CBC_CHECK_STREAM) != 0 || memcmp(start_ivs[s], ivs[s], 16) != 0;
+		}
+	}
+	
+	free(in);
+	free(ref);
+	free(out);
+	
+	return ret;
+}
+
+/*
+ * AES_CFB128_encrypt/AES_CFB128_decrypt, and aes_crypt_cfb128 itself,
+ * with the message split mid-block across two calls, against one
+ * aes_crypt_cfb128 call for 128-, 192- and 256-bit keys: output, IV and
+ * byte offset, so resuming from a nonzero num/iv_off is covered. The
+ * AES-NI half is skipped without AES-NI. Returns 0 on success.
+ */
+#define CFB_CHECK_LENGTH (27 * AES_BLOCK_SIZE + 5)
+#define CFB_CHECK_SPLIT (7 * AES_BLOCK_SIZE + 9)
+
+int cfb_check(void) {
+	static const int modes[] = { AES_ENCRYPT, AES_DECRYPT };
+	aes_context enc;
+	unsigned char k[32], iv[16], ref_iv[16], split_iv[16], *in, *ref, *out;
+	int ref_off, off, ni = CheckAESSupport();
+	int ret = 0;
+	
+	in = malloc(CFB_CHECK_LENGTH);
+	ref = malloc(CFB_CHECK_LENGTH);
+	out = malloc(CFB_CHECK_LENGTH);
+	
+	for(int i = 0; i < CFB_CHECK_LENGTH; i++)
+		in[i] = rand() % 255;
+	
+	for(int bits = 128; bits <= 256; bits += 64) {
+		for(int i = 0; i < 32; i++)
+			k[i] = rand() % 255;
+		for(int i = 0; i < 16; i++)
+			iv[i] = rand() % 255;
+		aes_setkey_enc(&enc, k, bits);
+		
+		for(int m = 0; m < 2; m++) {
+			int mode = modes[m];
+			
+			ref_off = 0;
+			memcpy(ref_iv, iv, 16);
+			aes_crypt_cfb128(&enc, mode, CFB_CHECK_LENGTH, &ref_off, ref_iv, in, ref);
+			
+			off = 0;
+			memcpy(split_iv, iv, 16);
+			aes_crypt_cfb128(&enc, mode, CFB_CHECK_SPLIT, &off, split_iv, in, out);
+			aes_crypt_cfb128(&enc, mode, CFB_CHECK_LENGTH - CFB_CHECK_SPLIT, &off, split_iv,
+							 in + CFB_CHECK_SPLIT, out + CFB_CHECK_SPLIT);
+			ret |= memcmp(ref, out, CFB_CHECK_LENGTH) != 0 || memcmp(ref_iv, split_iv, 16) != 0 || off != ref_off;
+			
+			if(!ni)
+				continue;
+			
+			off = 0;
+			memcpy(split_iv, iv, 16);
+			memset(out, 0, CFB_CHECK_LENGTH);
+			if(mode == AES_ENCRYPT) {
+				AES_CFB128_encrypt(in, out, split_iv, &off, CFB_CHECK_SPLIT, enc.ni, enc.nr);
+				AES_CFB128_encrypt(in + CFB_CHECK_SPLIT, out + CFB_CHECK_SPLIT, split_iv, &off,
+								   CFB_CHECK_LENGTH - CFB_CHECK_SPLIT, enc.ni, enc.nr);
+			}
+			else {
+				AES_CFB128_decrypt(in, out, split_iv, &off, CFB_CHECK_SPLIT, enc.ni, enc.nr);
+				AES_CFB128_decrypt(in + CFB_CHECK_SPLIT, out + CFB_CHECK_SPLIT, split_iv, &off,
+								   CFB_CHECK_LENGTH - CFB_CHECK_SPLIT, enc.ni, enc.nr);
+			}
+			ret |= memcmp(ref, out, CFB_CHECK_LENGTH) != 0 || memcmp(ref_iv, split_iv, 16) != 0 || off != ref_off;
+		}
+	}
+	
+	free(in);
+	free(ref);
+	free(out);
+	
+	return ret;
+}
+
+/*
+ * The bitsliced and vpaes backends against aes_crypt_ecb/aes_crypt_cbc/
+ * aes_crypt_ctr_at for 128-, 192- and 256-bit keys: ECB both ways, CBC
+ * decryption (output and updated IV), and CTR at an odd block offset from
+ * a counter about to carry out of its low 64 bits, ending in a partial
+ * block. BACKEND_CHECK_BLOCKS covers full 8-block groups and a remainder.
+ * vpaes is skipped without SSSE3. Returns 0 on success.
+ */
+#define BACKEND_CHECK_BLOCKS 27
+#define BACKEND_CHECK_LENGTH (BACKEND_CHECK_BLOCKS * AES_BLOCK_SIZE)
+
+int backend_check(void) {
+	aes_context enc, dec;
+	aesbs_context bs;
+	vpaes_context vp_enc, vp_dec;
+	unsigned char k[32], iv[16], ref_iv[16], counter[16], *in, *ref, *out;
+	static const int modes[] = { AES_ENCRYPT, AES_DECRYPT };
+	int vp = CheckSSSE3Support();
+	int ret = 0;
+	
+	in = malloc(BACKEND_CHECK_LENGTH);
+	ref = malloc(BACKEND_CHECK_LENGTH);
+	out = malloc(BACKEND_CHECK_LENGTH);
+	
+	for(int i = 0; i < BACKEND_CHECK_LENGTH; i++)
+		in[i] = rand() % 255;
+	memset(counter, 0xff, sizeof(counter));
+	counter[0] = 0x34;
+	counter[15] = 0xf9;
+	
+	for(int bits = 128; bits <= 256; bits += 64) {
+		for(int i = 0; i < 32; i++)
+			k[i] = rand() % 255;
+		aes_setkey_enc(&enc, k, bits);
+		aes_setkey_dec(&dec, k, bits);
+		aesbs_setkey(&bs, k, bits);
+		if(vp) {
+			vpaes_setkey_enc(&vp_enc, k, bits);
+			vpaes_setkey_dec(&vp_dec, k, bits);
+		}
+		
+		//ECB encryption and decryption
+		for(int m = 0; m < 2; m++) {
+			int mode = modes[m];
+			
+			for(int i = 0; i < BACKEND_CHECK_LENGTH; i += AES_BLOCK_SIZE)
+				aes_crypt_ecb(mode == AES_ENCRYPT ? &enc : &dec, mode, in + i, ref + i);
+			
+			aesbs_crypt_ecb(&bs, mode, BACKEND_CHECK_LENGTH, in, out);
+			ret |= memcmp(ref, out, BACKEND_CHECK_LENGTH) != 0;
+			
+			if(vp) {
+				for(int i = 0; i < BACKEND_CHECK_LENGTH; i += AES_BLOCK_SIZE)
+					vpaes_crypt_ecb(mode == AES_ENCRYPT ? &vp_enc : &vp_dec, mode, in + i, out + i);
+				ret |= memcmp(ref, out, BACKEND_CHECK_LENGTH) != 0;
+			}
+		}
+		
+		//CBC decryption
+		memcpy(ref_iv, counter, 16);
+		aes_crypt_cbc(&dec, AES_DECRYPT, BACKEND_CHECK_LENGTH, ref_iv, in, ref);
+		
+		memcpy(iv, counter, 16);
+		aesbs_crypt_cbc(&bs, AES_DECRYPT, BACKEND_CHECK_LENGTH, iv, in, out);
+		ret |= memcmp(ref, out, BACKEND_CHECK_LENGTH) != 0 || memcmp(ref_iv, iv, 16) != 0;
+		
+		if(vp) {
+			memcpy(iv, counter, 16);
+			vpaes_crypt_cbc(&vp_dec, AES_DECRYPT, BACKEND_CHECK_LENGTH, iv, in, out);
+			ret |= memcmp(ref, out, BACKEND_CHECK_LENGTH) != 0 || memcmp(ref_iv, iv, 16) != 0;
+		}
+		
+		//CTR from block 3, partial last block
+		aes_crypt_ctr_at(&enc, BACKEND_CHECK_LENGTH - 5, counter, 3, in, ref);
+		
+		aesbs_crypt_ctr(&bs, BACKEND_CHECK_LENGTH - 5, counter, 3, in, out);
+		ret |= memcmp(ref, out, BACKEND_CHECK_LENGTH - 5) != 0;
+		
+		if(vp) {
+			vpaes_crypt_ctr_at(&vp_enc, BACKEND_CHECK_LENGTH - 5, counter, 3, in, out);
+			ret |= memcmp(ref, out, BACKEND_CHECK_LENGTH - 5) != 0;
+		}
+	}
+	
+	free(in);
+	free(ref);
+	free(out);
+	
+	return ret;
+}
+
+void aes_ctr_test(int msg_length, int num_thread) {
+	run_test("AESNI CTR", aesni_ctr_setkey, aes_ctr_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ AESNI BASED CIPHER BLOCK CHAINING ------------------ */
+aes_context AESNI_DCTX;
+
+#define CBC_STREAMS 8
+
+void aesni_cbc_setkey(void) {
+	aesni_setkey();
+	aes_setkey_dec(&AESNI_DCTX, key, KEY_LENGTH_BITS);
+}
+
+void* aes_cbc_enc_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	AES_CBC_encrypt(currpos, output, iv, encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
+	
+	return NULL;
+}
+
+void aes_cbc_enc_test(int msg_length, int num_thread) {
+	run_test("AESNI CBC enc", aesni_cbc_setkey, aes_cbc_enc_test_thread, msg_length, num_thread);
+}
+
+void* aes_cbc_dec_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	AES_CBC_decrypt(currpos, output, iv, encrypt_length, AESNI_DCTX.ni, AESNI_DCTX.nr);
+	
+	return NULL;
+}
+
+void aes_cbc_dec_test(int msg_length, int num_thread) {
+	run_test("AESNI CBC dec", aesni_cbc_setkey, aes_cbc_dec_test_thread, msg_length, num_thread);
+}
+
+//Each thread encrypts its slice as CBC_STREAMS independent CBC streams
+void* aes_cbc_multi_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char ivs[CBC_STREAMS][AES_BLOCK_SIZE];
+	const unsigned char* ins[CBC_STREAMS];
+	unsigned char* outs[CBC_STREAMS];
+	unsigned char* ivps[CBC_STREAMS];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	int stream_length = encrypt_length / CBC_STREAMS;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	for(int s = 0; s < CBC_STREAMS; s++) {
+		memset(ivs[s], s, AES_BLOCK_SIZE);
+		ins[s] = currpos + stream_length * s;
+		outs[s] = output + stream_length * s;
+		ivps[s] = ivs[s];
+	}
+	
+	AES_CBC_encrypt_multi(ins, outs, ivps, stream_length, CBC_STREAMS, AESNI_CTX.ni, AESNI_CTX.nr);
+	
+	return NULL;
+}
+
+void aes_cbc_multi_test(int msg_length, int num_thread) {
+	run_test("AESNI CBC enc x8", aesni_cbc_setkey, aes_cbc_multi_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ CIPHER FEEDBACK (CFB128) ------------------ */
+
+//Each thread runs its slice as its own CFB stream; decryption is the parallel direction
+void* cfb_enc_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+	int iv_off = 0;
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	aes_crypt_cfb128(&aes_ctx, AES_ENCRYPT, encrypt_length, &iv_off, iv, currpos, output);
+	
+	return NULL;
+}
+
+void* cfb_dec_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+	int iv_off = 0;
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	aes_crypt_cfb128(&aes_ctx, AES_DECRYPT, encrypt_length, &iv_off, iv, currpos, output);
+	
+	return NULL;
+}
+
+void cfb_enc_test(int msg_length, int num_thread) {
+	run_test("Plain CFB enc", table_setkey, cfb_enc_test_thread, msg_length, num_thread);
+}
+
+void cfb_dec_test(int msg_length, int num_thread) {
+	run_test("Plain CFB dec", table_setkey, cfb_dec_test_thread, msg_length, num_thread);
+}
+
+void* aes_cfb_enc_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+	int num = 0;
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	AES_CFB128_encrypt(currpos, output, iv, &num, encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
+	
+	return NULL;
+}
+
+void* aes_cfb_dec_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+	int num = 0;
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	AES_CFB128_decrypt(currpos, output, iv, &num, encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
+	
+	return NULL;
+}
+
+void aes_cfb_enc_test(int msg_length, int num_thread) {
+	run_test("AESNI CFB enc", aesni_setkey, aes_cfb_enc_test_thread, msg_length, num_thread);
+}
+
+void aes_cfb_dec_test(int msg_length, int num_thread) {
+	run_test("AESNI CFB dec", aesni_setkey, aes_cfb_dec_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ AESNI + PCLMULQDQ GALOIS/COUNTER MODE ------------------ */
+gcm_context GCM_CTX;
+
+void gcm_setkey(void) {
+	gcm_init(&GCM_CTX, key, KEY_LENGTH_BITS);
+}
+
+//Each thread seals its slice as a separate GCM message with its own IV and tag
+void* gcm_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[12];
+	unsigned char tag[16];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	memset(iv, info->thread_id, sizeof(iv));
+	
+	gcm_crypt_and_tag(&GCM_CTX, GCM_ENCRYPT, encrypt_length, iv, sizeof(iv),
+					  NULL, 0, currpos, output, sizeof(tag), tag);
+	
+	return NULL;
+}
+
+void gcm_test(int msg_length, int num_thread) {
+	run_test("AESNI GCM", gcm_setkey, gcm_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ AESNI OFFSET CODEBOOK (OCB3) ------------------ */
+ocb_context OCB_CTX;
+
+void ocb_setkey(void) {
+	ocb_init(&OCB_CTX, key, KEY_LENGTH_BITS);
+}
+
+//Same split as the GCM test: one message, nonce and tag per thread
+void* ocb_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[12];
+	unsigned char tag[16];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	memset(iv, info->thread_id, sizeof(iv));
+	
+	ocb_crypt_and_tag(&OCB_CTX, OCB_ENCRYPT, encrypt_length, iv, sizeof(iv),
+					  NULL, 0, currpos, output, sizeof(tag), tag);
+	
+	return NULL;
+}
+
+void ocb_test(int msg_length, int num_thread) {
+	run_test("AESNI OCB", ocb_setkey, ocb_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ COUNTER WITH CBC-MAC (CCM) ------------------ */
+ccm_context CCM_CTX;
+
+void ccm_setkey(void) {
+	ccm_init(&CCM_CTX, key, KEY_LENGTH_BITS);
+}
+
+void ccm_table_setkey(void) {
+	ccm_setkey();
+	CCM_CTX.aesni = 0;
+}
+
+//8-byte nonces leave 7 length bytes, enough for the largest test size
+void* ccm_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	unsigned char iv[8];
+	unsigned char tag[16];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	memset(iv, info->thread_id, sizeof(iv));
+	
+	ccm_crypt_and_tag(&CCM_CTX, CCM_ENCRYPT, encrypt_length, iv, sizeof(iv),
+					  NULL, 0, currpos, output, sizeof(tag), tag);
+	
+	return NULL;
+}
+
+void ccm_table_test(int msg_length, int num_thread) {
+	run_test("Plain CCM", ccm_table_setkey, ccm_test_thread, msg_length, num_thread);
+}
+
+void ccm_test(int msg_length, int num_thread) {
+	run_test("AESNI CCM", ccm_setkey, ccm_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ CMAC (MANY SMALL RECORDS) ------------------ */
+#define CMAC_RECORD 256
+#define CMAC_BATCH 64
+
+cmac_context CMAC_CTX;
+
+void cmac_setkey_test(void) {
+	cmac_setkey(&CMAC_CTX, key, KEY_LENGTH_BITS);
+}
+
+//Each thread tags the CMAC_RECORD-byte records of its slice one after the other
+void* cmac_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	
+	for(int i = 0; i < encrypt_length / CMAC_RECORD; i++)
+		cmac(&CMAC_CTX, currpos + i * CMAC_RECORD, CMAC_RECORD, output + i * 16);
+	
+	return NULL;
+}
+
+//Same records, handed to cmac_batch CMAC_BATCH at a time
+void* cmac_batch_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
+	const unsigned char *in[CMAC_BATCH];
+	unsigned char *tags[CMAC_BATCH];
+	size_t lens[CMAC_BATCH];
+	
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
+	int records = encrypt_length / CMAC_RECORD;
+	
+	for(int i = 0; i < records; i += CMAC_BATCH) {
+		int n = (records - i < CMAC_BATCH) ? records - i : CMAC_BATCH;
+		
+		for(int j = 0; j < n; j++) {
+			in[j] = currpos + (i + j) * CMAC_RECORD;
+			tags[j] = output + (i + j) * 16;
+			lens[j] = CMAC_RECORD;
+		}
+		cmac_batch(&CMAC_CTX, n, in, lens, tags);
+	}
+	
+	return NULL;
+}
+
+void cmac_test(int msg_length, int num_thread) {
+	run_test("CMAC", cmac_setkey_test, cmac_test_thread, msg_length, num_thread);
+}
+
+void cmac_batch_test(int msg_length, int num_thread) {
+	run_test("CMAC batch", cmac_setkey_test, cmac_batch_test_thread, msg_length, num_thread);
+}
+
+/*
+ * Latency of one cmac call per message length, in nanoseconds: the
+ * serial chain cmac_batch is meant to hide
+ */
+void cmac_latency_test(void) {
+	static const int lengths[] = { 16, 64, 256, 1024, 4096 };
+	const int calls = 100000;
+	unsigned char buf[4096], tag[16];
+	struct timeval start, end;
+	
+	if(test_filter && !strstr("CMAC latency", test_filter))
+		return;
+	
+	memset(buf, 0x5A, sizeof(buf));
+	cmac_setkey_test();
+	
+	for(int l = 0; l < 5; l++) {
+		gettimeofday(&start, NULL);
+		for(int i = 0; i < calls; i++)
+			cmac(&CMAC_CTX, buf, lengths[l], tag);
+		gettimeofday(&end, NULL);
+		
+		long long useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+		printf("CMAC latency, %d, %.1f ns\n", lengths[l], useconds * 1000.0 / calls);
+	}
+}
+
+
+/* ------------------ MULTI-BUFFER JOB MANAGER (MANY SMALL STREAMS) ------------------ */
+#define MB_STREAMS 1024
+#define MB_BYTES (16 * 1048576)
+
+#define MB_CHECK_JOBS 300
+
+/*
+ * MB_CHECK_JOBS jobs of mixed modes, keys and lengths (CBC of 0 to 18
+ * blocks, CTR and CMAC of any length, so partial last blocks and the
+ * empty CMAC message come up) go through a manager with `lanes` lanes.
+ * Each output must match AES_CBC_encrypt, AES_CTR128_encrypt or cmac on
+ * that stream alone, the returned CBC/CTR iv must continue the stream,
+ * and every job must come back exactly once. Returns 0 on success.
+ */
+int aesmb_check(cmac_context *cm, aesmb_job *jobs, const unsigned char *buf, unsigned char *res, int lanes) {
+	static const unsigned char zero[16];
+	unsigned char (*iv)[16] = malloc(MB_CHECK_JOBS * 16);
+	int *seen = calloc(MB_CHECK_JOBS, sizeof(int));
+	unsigned char ref[304], a[16], b[16];
+	aesmb_manager mgr;
+	aesmb_job *done;
+	int ret = 0;
+	
+	aesmb_init(&mgr, lanes, KEY_LENGTH_BITS);
+	for(int s = 0; s < MB_CHECK_JOBS; s++) {
+		aesmb_job *j = &jobs[s];
+		
+		memset(j, 0, sizeof(aesmb_job));
+		j->key = &cm[s].ctx;
+		j->mode = s % 3;
+		for(int i = 0; i < 16; i++)
+			j->iv[i] = rand() % 255;
+		//counter about to carry out of its low 64 bits
+		if(s % 7 == 0)
+			memset(j->iv + 8, 0xff, 8);
+		memcpy(iv[s], j->iv, 16);
+		j->in = buf + s * 1024;
+		j->out = res + s * 1024;
+		j->length = (s * 37) % 300;
+		if(j->mode == AESMB_CBC_ENCRYPT)
+			j->length &= ~15;
+		j->user = &seen[s];
+	}
+	
+	for(int s = 0; s < MB_CHECK_JOBS; s++) {
+		aesmb_submit(&mgr, &jobs[s], &done);
+		if(done != NULL)
+			(*(int *)done->user)++;
+	}
+	while((done = aesmb_flush(&mgr)) != NULL)
+		(*(int *)done->user)++;
+	
+	for(int s = 0; s < MB_CHECK_JOBS; s++) {
+		aesmb_job *j = &jobs[s];
+		
+		if(seen[s] != 1 || j->status != AESMB_STATUS_COMPLETED) {
+			ret = 1;
+			continue;
+		}
+		
+		if(j->mode == AESMB_CBC_ENCRYPT) {
+			AES_CBC_encrypt(j->in, ref, iv[s], j->length, j->key->ni, j->key->nr);
+			ret |= memcmp(ref, j->out, j->length) != 0 || memcmp(iv[s], j->iv, 16) != 0;
+		}
+		else if(j->mode == AESMB_CTR) {
+			AES_CTR128_encrypt(j->in, ref, iv[s], 0, j->length, j->key->ni, j->key->nr);
+			AES_CTR128_encrypt(zero, a, iv[s], (j->length + 15) / 16, 16, j->key->ni, j->key->nr);
+			AES_CTR128_encrypt(zero, b, j->iv, 0, 16, j->key->ni, j->key->nr);
+			ret |= memcmp(ref, j->out, j->length) != 0 || memcmp(a, b, 16) != 0;
+		}
+		else {
+			cmac(&cm[s], j->in, j->length, ref);
+			ret |= memcmp(ref, j->out, 16) != 0;
+		}
+	}
+	
+	free(iv);
+	free(seen);
+	
+	return ret;
+}
+
+/*
+ * MB_STREAMS streams, each with its own key and IV, are encrypted (or
+ * MACed) repeatedly until MB_BYTES have gone through: one call per stream
+ * ("1 lane"), or every stream submitted to a job manager with 4 or 8
+ * lanes. Setup is not timed; the manager is checked by aesmb_check first.
+ */
+void aesmb_test(void) {
+	static const char *modes[] = { "CBC-enc", "CTR", "CMAC" };
+	static const int lengths[] = { 64, 256, 1024 };
+	static const int lanes[] = { 1, 4, 8 };
+	cmac_context *cm = malloc(MB_STREAMS * sizeof(cmac_context));
+	aesmb_job *jobs = malloc(MB_STREAMS * sizeof(aesmb_job));
+	unsigned char *buf = malloc(MB_STREAMS * 1024);
+	unsigned char *res = malloc(MB_STREAMS * 1024);
+	struct timeval start, end;
+	aesmb_manager mgr;
+	aesmb_job *done;
+	
+	if(test_filter && !strstr("Multi-buffer", test_filter))
+		goto exit;
+	
+	for(int s = 0; s < MB_STREAMS; s++) {
+		for(int i = 0; i < KEY_LENGTH_BYTES; i++)
+			key[i] = rand() % 255;
+		cmac_setkey(&cm[s], key, KEY_LENGTH_BITS);
+	}
+	for(int i = 0; i < MB_STREAMS * 1024; i++)
+		buf[i] = rand() % 255;
+	
+	for(int n = 4; n <= AESMB_LANES; n *= 2)
+		printf("Multi-buffer check, %d lanes: %s\n", n, aesmb_check(cm, jobs, buf, res, n) ? "FAILED" : "OK");
+	
+	for(int m = 0; m < 3; m++) {
+		for(int l = 0; l < 3; l++) {
+			int rounds = MB_BYTES / (MB_STREAMS * lengths[l]);
+			
+			for(int n = 0; n < 3; n++) {
+				for(int s = 0; s < MB_STREAMS; s++) {
+					memset(&jobs[s], 0, sizeof(aesmb_job));
+					jobs[s].key = &cm[s].ctx;
+					jobs[s].mode = m;
+					jobs[s].iv[0] = (unsigned char) s;
+					jobs[s].in = buf + s * 1024;
+					jobs[s].out = res + s * 1024;
+					jobs[s].length = lengths[l];
+				}
+				if(lanes[n] > 1)
+					aesmb_init(&mgr, lanes[n], KEY_LENGTH_BITS);
+				
+				gettimeofday(&start, NULL);
+				for(int r = 0; r < rounds; r++) {
+					for(int s = 0; s < MB_STREAMS; s++) {
+						aesmb_job *j = &jobs[s];
+						
+						if(lanes[n] > 1)
+							aesmb_submit(&mgr, j, &done);
+						else if(m == AESMB_CBC_ENCRYPT)
+							AES_CBC_encrypt(j->in, j->out, j->iv, j->length, j->key->ni, j->key->nr);
+						else if(m == AESMB_CTR)
+							AES_CTR128_encrypt(j->in, j->out, j->iv, 0, j->length, j->key->ni, j->key->nr);
+						else
+							cmac(&cm[s], j->in, j->length, j->out);
+					}
+					if(lanes[n] > 1)
+						while(aesmb_flush(&mgr) != NULL)
+							;
+				}
+				gettimeofday(&end, NULL);
+				
+				long long useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+				printf("Multi-buffer, %s, %d, %d lane%s, %.1f MB/s\n", modes[m], lengths[l], lanes[n],
+					   lanes[n] > 1 ? "s" : "", (double)rounds * MB_STREAMS * lengths[l] / useconds);
+			}
+		}
+	}
+	
+exit:
+	free(cm);
+	free(jobs);
+	free(buf);
+	free(res);
+}
+
+
+/* ------------------ EXPANDED-KEY CACHE ------------------ */
+#define KEYCACHE_POOL 1024
+#define KEYCACHE_MESSAGES 65536
+
+unsigned char keycache_keys[KEYCACHE_POOL][KEY_LENGTH_BYTES];
+aes_keycache KEYCACHE;
+int keycache_capacity;
+int keycache_msg_length;
+
+/*
+ * Each thread encrypts KEYCACHE_MESSAGES keycache_msg_length-byte messages,
+ * each under a key drawn uniformly from the pool. With no cache every
+ * message pays the key expansion; otherwise it is looked up.
+ */
+void* keycache_test_thread(void* a) {
+	AESInfo* info = (AESInfo *)a;
+	unsigned int seed = 7 + info->thread_id;
+	unsigned char counter[16] = { 0 };
+	unsigned char *buf = malloc(keycache_msg_length);
+	aes_context ctx;
+	int aesni = CheckAESSupport();
+	
+	memset(buf, 0x3C, keycache_msg_length);
+	
+	for(int m = 0; m < KEYCACHE_MESSAGES; m++) {
+		const unsigned char *k = keycache_keys[rand_r(&seed) % KEYCACHE_POOL];
+		
+		if(keycache_capacity == 0)
+			aes_setkey_enc(&ctx, k, KEY_LENGTH_BITS);
+		else
+			aes_keycache_get(&KEYCACHE, AES_ENCRYPT, k, KEY_LENGTH_BITS, &ctx);
+		
+		if(aesni)
+			AES_CTR128_encrypt(buf, buf, counter, 0, keycache_msg_length, ctx.ni, ctx.nr);
+		else
+			aes_crypt_ctr_at(&ctx, keycache_msg_length, counter, 0, buf, buf);
+	}
+	
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Hit rate against throughput for short messages, where the key setup is
+ * a large share of the work: capacity 0 expands every key, larger caches
+ * hold more of the KEYCACHE_POOL keys.
+ */
+void keycache_test(void) {
+	static const int capacities[] = { 0, 256, 512, 1024, 2048 };
+	static const int lengths[] = { 64, 256, 1024, 4096 };
+	unsigned long long hits, misses;
+	struct timeval start, end;
+	
+	if(test_filter && !strstr("Key cache", test_filter))
+		return;
 	
-	free(msg);
-	free(out);
+	for(int i = 0; i < KEYCACHE_POOL; i++)
+		for(int j = 0; j < KEY_LENGTH_BYTES; j++)
+			keycache_keys[i][j] = rand() % 255;
 	
-	printf("\n");
+	for(int l = 0; l < 4; l++) {
+		for(int c = 0; c < 5; c++) {
+			for(int num_thread = 1; num_thread <= 4; num_thread *= 4) {
+				pthread_t threads[num_thread];
+				AESInfo infos[num_thread];
+				
+				keycache_msg_length = lengths[l];
+				keycache_capacity = capacities[c];
+				if(keycache_capacity != 0 && aes_keycache_init(&KEYCACHE, keycache_capacity) != 0) {
+					printf("## key cache allocation failed\n");
+					return;
+				}
+				
+				gettimeofday(&start, NULL);
+				for(int tid = 0; tid < num_thread; tid++) {
+					infos[tid].thread_id = tid;
+					infos[tid].total_threads = num_thread;
+					pthread_create(&threads[tid], NULL, keycache_test_thread, &infos[tid]);
+				}
+				for(int tid = 0; tid < num_thread; tid++)
+					pthread_join(threads[tid], NULL);
+				gettimeofday(&end, NULL);
+				
+				hits = 0;
+				misses = 1;
+				if(keycache_capacity != 0) {
+					aes_keycache_stats(&KEYCACHE, &hits, &misses);
+					aes_keycache_free(&KEYCACHE);
+				}
+				
+				long long useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+				printf("Key cache, %d, %d, %d, hit %.1f%%, %.1f MB/s\n",
+					   lengths[l], keycache_capacity, num_thread,
+					   100.0 * hits / (hits + misses),
+					   (double)KEYCACHE_MESSAGES * keycache_msg_length * num_thread / useconds);
+			}
+		}
+	}
 }
 
-/* ------------------ COUNTER MODE ------------------ */
-void* ctr_test_thread(void* a) {
+
+/* ------------------ XTS (4 KIB SECTORS) ------------------ */
+#define XTS_SECTOR_SIZE 4096
+
+xts_context XTS_CTX;
+
+void xts_setkey(void) {
+	xts_setkey_enc(&XTS_CTX, key, KEY_LENGTH_BITS);
+}
+
+void xts_table_setkey(void) {
+	xts_setkey();
+	XTS_CTX.aesni = 0;
+}
+
+//Each thread encrypts its slice as the sectors it would occupy on disk
+void* xts_test_thread(void* a) {
+
 	AESInfo* info = (AESInfo *)a;
-	//unsigned char output[AES_BLOCK_SIZE];
 	
-	int offset = 0;
 	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
-	//unsigned char* currpos = msg + encrypt_length * info->thread_id;
-	//unsigned char* output = out + encrypt_length * info->thread_id;
-	
-	unsigned char nonce[16];
-	unsigned char block[16];
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-	//for(int i = 0; i < encrypt_length / AES_BLOCK_SIZE; i++) {
-	aes_crypt_ctr(&aes_ctx, encrypt_length, &offset, nonce, block, msg, out);
-	//	currpos += AES_BLOCK_SIZE;
-	//	output += AES_BLOCK_SIZE;
-	//}
+	xts_crypt_sectors(&XTS_CTX, AES_ENCRYPT, XTS_SECTOR_SIZE, encrypt_length / XTS_SECTOR_SIZE,
+					  (unsigned long long)(encrypt_length / XTS_SECTOR_SIZE) * info->thread_id,
+					  currpos, output);
 	
 	return NULL;
 }
 
-void ctr_test(int msg_length, int num_thread) {
-	printf("Plain CTR, %d, %d, ", msg_length, num_thread);
+void xts_test(int msg_length, int num_thread) {
+	run_test("Plain XTS", xts_table_setkey, xts_test_thread, msg_length, num_thread);
+}
 
-	MESSAGE_LENGTH = msg_length;
+void aes_xts_test(int msg_length, int num_thread) {
+	run_test("AESNI XTS", xts_setkey, xts_test_thread, msg_length, num_thread);
+}
 
-	msg = malloc(MESSAGE_LENGTH);
-	out = malloc(MESSAGE_LENGTH);
-	
-	for(int i = 0; i < MESSAGE_LENGTH; i++) {
-		msg[i] = rand() % 255;
-	}
 
-	for(int iter = 0; iter < ITERATIONS; iter++) {
-		
-		for(int i = 0; i < KEY_LENGTH_BYTES; i++) {
-			key[i] = rand() % 255;
-		}	
-			
-		aes_setkey_enc(&aes_ctx, key, KEY_LENGTH_BITS);
-	
-		pthread_t threads[num_thread];
-		pthread_attr_t pthread_custom_attr;
-		AESInfo infos[num_thread];
-		
-		pthread_attr_init(&pthread_custom_attr);
+/* ------------------ BITSLICED (CONSTANT-TIME, SSE2) ------------------ */
+aesbs_context BS_CTX;
+
+void bs_setkey(void) {
+	aesbs_setkey(&BS_CTX, key, KEY_LENGTH_BITS);
+}
+
+void bs_ctr_setkey(void) {
+	ctr_nonce_init();
+	bs_setkey();
+}
+
+void* bs_ecb_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
 	
-		struct timeval start, end;
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-		gettimeofday(&start, NULL);
-		
-		for(int tid = 0; tid < num_thread; tid++) {
-			infos[tid].thread_id = tid;
-			infos[tid].total_threads = num_thread;
-			
-			pthread_create(&threads[tid], &pthread_custom_attr, ecb_test_thread, &infos[tid]);
-		}
-		
-		
-		for(int tid = 0; tid < num_thread; tid++) {
-			pthread_join(threads[tid], NULL);
-		}
-		
-		gettimeofday(&end, NULL);
-		
-		long long seconds  = end.tv_sec  - start.tv_sec;
-   		long long useconds = end.tv_usec - start.tv_usec;	
-   		
-   		seconds = 1000000 * seconds + useconds;
-   		
-   		printf("%lld, ", seconds);
+	aesbs_crypt_ecb(&BS_CTX, AES_ENCRYPT, encrypt_length, currpos, output);
 	
-	}
+	return NULL;
+}
+
+void* bs_ctr_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
 	
-	MESSAGE_LENGTH = 0;
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-	free(msg);
-	free(out);
+	aesbs_crypt_ctr(&BS_CTX, encrypt_length, nonce_counter,
+					(unsigned long long)(encrypt_length / AES_BLOCK_SIZE) * info->thread_id,
+					currpos, output);
 	
-	printf("\n");
+	return NULL;
 }
 
+void bs_ecb_test(int msg_length, int num_thread) {
+	run_test("Bitsliced ECB", bs_setkey, bs_ecb_test_thread, msg_length, num_thread);
+}
 
-/* ------------------ AESNI BASED ELECTRONIC CODE-BOOK ------------------ */
-ALIGN16 unsigned char AESNI_KEY[16*15];
+void bs_ctr_test(int msg_length, int num_thread) {
+	run_test("Bitsliced CTR", bs_ctr_setkey, bs_ctr_test_thread, msg_length, num_thread);
+}
 
 
-void* aes_ecb_test_thread(void* a) {
+/* ------------------ VECTOR PERMUTE (CONSTANT-TIME, SSSE3) ------------------ */
+vpaes_context VP_CTX;
+
+void vpaes_setkey(void) {
+	vpaes_setkey_enc(&VP_CTX, key, KEY_LENGTH_BITS);
+}
+
+void vpaes_ctr_setkey(void) {
+	ctr_nonce_init();
+	vpaes_setkey();
+}
+
+void* vpaes_ecb_test_thread(void* a) {
 
 	AESInfo* info = (AESInfo *)a;
-	//unsigned char output[AES_BLOCK_SIZE];
+	int i;
 	
 	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
 	unsigned char* currpos = msg + encrypt_length * info->thread_id;
 	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-	AES_ECB_encrypt(currpos, output, encrypt_length, AESNI_KEY, 14);
+	for(i = 0; i < encrypt_length; i += AES_BLOCK_SIZE)
+		vpaes_crypt_ecb(&VP_CTX, AES_ENCRYPT, currpos + i, output + i);
 	
 	return NULL;
 }
 
-void aes_ecb_test(int msg_length, int num_thread) {
-	printf("AESNI ECB, %d, %d, ", msg_length, num_thread);
-
-	MESSAGE_LENGTH = msg_length;
+void* vpaes_ctr_test_thread(void* a) {
 
-	msg = malloc(MESSAGE_LENGTH);
-	out = malloc(MESSAGE_LENGTH);
+	AESInfo* info = (AESInfo *)a;
 	
-	for(int i = 0; i < MESSAGE_LENGTH; i++) {
-		msg[i] = rand() % 255;
-	}
-
-	for(int iter = 0; iter < ITERATIONS; iter++) {
-		
-		for(int i = 0; i < KEY_LENGTH_BYTES; i++) {
-			key[i] = rand() % 255;
-		}	
-			
-		AES_256_Key_Expansion(key, AESNI_KEY);
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-		pthread_t threads[num_thread];
-		pthread_attr_t pthread_custom_attr;
-		AESInfo infos[num_thread];
-		
-		pthread_attr_init(&pthread_custom_attr);
-
-		struct timeval start, end;
+	vpaes_crypt_ctr_at(&VP_CTX, encrypt_length, nonce_counter,
+					   (unsigned long long)(encrypt_length / AES_BLOCK_SIZE) * info->thread_id,
+					   currpos, output);
 	
-		gettimeofday(&start, NULL);
-		
-		for(int tid = 0; tid < num_thread; tid++) {
-			infos[tid].thread_id = tid;
-			infos[tid].total_threads = num_thread;
-			
-			pthread_create(&threads[tid], &pthread_custom_attr, aes_ecb_test_thread, &infos[tid]);
-		}
-		
-		
-		for(int tid = 0; tid < num_thread; tid++) {
-			pthread_join(threads[tid], NULL);
-		}
-		
-		gettimeofday(&end, NULL);
-		
-		long long seconds  = end.tv_sec  - start.tv_sec;
-   		long long useconds = end.tv_usec - start.tv_usec;	
-   		
-   		seconds = 1000000 * seconds + useconds;
-   		
-   		printf("%lld, ", seconds);
-	}
+	return NULL;
+}
+
+void vpaes_ecb_test(int msg_length, int num_thread) {
+	run_test("VPAES ECB", vpaes_setkey, vpaes_ecb_test_thread, msg_length, num_thread);
+}
+
+void vpaes_ctr_test(int msg_length, int num_thread) {
+	run_test("VPAES CTR", vpaes_ctr_setkey, vpaes_ctr_test_thread, msg_length, num_thread);
+}
+
+
+/* ------------------ FRONT-END (ONE-TIME CPU DISPATCH) ------------------ */
+aesx_context AESX_CTX;
+char aesx_test_name[32];
+
+void aesx_ctr_setkey(void) {
+	ctr_nonce_init();
+	aesx_setkey(&AESX_CTX, key, KEY_LENGTH_BITS);
+}
+
+void* aesx_ctr_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
 	
-	MESSAGE_LENGTH = 0;
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-	free(msg);
-	free(out);
+	aesx_crypt_ctr(&AESX_CTX, encrypt_length, nonce_counter,
+				   (unsigned long long)(encrypt_length / AES_BLOCK_SIZE) * info->thread_id,
+				   currpos, output);
 	
-	printf("\n");
+	return NULL;
 }
 
+void aesx_ctr_test(int msg_length, int num_thread) {
+	snprintf(aesx_test_name, sizeof(aesx_test_name), "AESX %s CTR", aesx_backend_name());
+	run_test(aesx_test_name, aesx_ctr_setkey, aesx_ctr_test_thread, msg_length, num_thread);
+}
 
-/* ------------------ AESNI BASED COUNTER MODE ------------------ */
-	unsigned char ivec[8];
-	unsigned char nonce[4];
 
-void* aes_ctr_test_thread(void* a) {
+/* ------------------ VAES (256/512-BIT AES-NI) ------------------ */
+void* vaes_ecb_test_thread(void* a) {
 
 	AESInfo* info = (AESInfo *)a;
-	//unsigned char output[AES_BLOCK_SIZE];
 	
 	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
 	unsigned char* currpos = msg + encrypt_length * info->thread_id;
 	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-	AES_CTR_encrypt(currpos, output, ivec, nonce, encrypt_length, AESNI_KEY, 14);
+	AES_ECB_encrypt_vaes(currpos, output, encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
 	
 	return NULL;
 }
 
-void aes_ctr_test(int msg_length, int num_thread) {
-	printf("AESNI CTR, %d, %d, ", msg_length, num_thread);
+void vaes_ecb_test(int msg_length, int num_thread) {
+	run_test("VAES ECB", aesni_setkey, vaes_ecb_test_thread, msg_length, num_thread);
+}
 
-	MESSAGE_LENGTH = msg_length;
+void* vaes_ecb_dec_test_thread(void* a) {
 
-	msg = malloc(MESSAGE_LENGTH);
-	out = malloc(MESSAGE_LENGTH);
+	AESInfo* info = (AESInfo *)a;
 	
-	for(int i = 0; i < MESSAGE_LENGTH; i++) {
-		msg[i] = rand() % 255;
-	}
-
-	for(int iter = 0; iter < ITERATIONS; iter++) {
-		
-		for(int i = 0; i < KEY_LENGTH_BYTES; i++) {
-			key[i] = rand() % 255;
-		}	
-		
-		ivec[0] = 'H'; ivec[1] = 'l'; ivec[2] = 'o'; ivec[3] = 'E';
-		ivec[4] = 'e'; ivec[5] = 'l'; ivec[6] = 'A'; ivec[7] = 'S';
-		
-		nonce[0] = '3'; nonce[1] = '1'; nonce[2] = '5'; nonce[3] = 'A';
-			
-		AES_256_Key_Expansion(key, AESNI_KEY);
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-		pthread_t threads[num_thread];
-		pthread_attr_t pthread_custom_attr;
-		AESInfo infos[num_thread];
-		
-		pthread_attr_init(&pthread_custom_attr);
-
-		struct timeval start, end;
+	AES_ECB_decrypt_vaes(currpos, output, encrypt_length, (const char*)AESNI_DCTX.ni, AESNI_DCTX.nr);
 	
-		gettimeofday(&start, NULL);
-		
-		for(int tid = 0; tid < num_thread; tid++) {
-			infos[tid].thread_id = tid;
-			infos[tid].total_threads = num_thread;
-			
-			pthread_create(&threads[tid], &pthread_custom_attr, aes_ctr_test_thread, &infos[tid]);
-		}
-		
-		
-		for(int tid = 0; tid < num_thread; tid++) {
-			pthread_join(threads[tid], NULL);
-		}
-		
-		gettimeofday(&end, NULL);
-		
-		long long seconds  = end.tv_sec  - start.tv_sec;
-   		long long useconds = end.tv_usec - start.tv_usec;	
-   		
-   		seconds = 1000000 * seconds + useconds;
-   		
-   		printf("%lld, ", seconds);
-	}
+	return NULL;
+}
+
+void vaes_ecb_dec_test(int msg_length, int num_thread) {
+	run_test("VAES ECB decrypt", aesni_cbc_setkey, vaes_ecb_dec_test_thread, msg_length, num_thread);
+}
+
+void* vaes_ctr_test_thread(void* a) {
+
+	AESInfo* info = (AESInfo *)a;
 	
-	MESSAGE_LENGTH = 0;
+	int encrypt_length = MESSAGE_LENGTH / info->total_threads;
+	unsigned char* currpos = msg + encrypt_length * info->thread_id;
+	unsigned char* output = out + encrypt_length * info->thread_id;
 	
-	free(msg);
-	free(out);
+	AES_CTR128_encrypt_vaes(currpos, output, nonce_counter,
+							(unsigned long long)(encrypt_length / AES_BLOCK_SIZE) * info->thread_id,
+							encrypt_length, AESNI_CTX.ni, AESNI_CTX.nr);
 	
-	printf("\n");
+	return NULL;
+}
+
+void vaes_ctr_test(int msg_length, int num_thread) {
+	run_test("VAES CTR", aesni_ctr_setkey, vaes_ctr_test_thread, msg_length, num_thread);
 }
 
 
-int main() {
+int main(int argc, char* argv[]) {
 	srand(1337);
 	setbuf(stdout, NULL);
 	
+	//usage: test [filter [backend]]; an empty filter runs everything
+	if(argc > 1)
+		test_filter = argv[1];
+	
+	if(argc > 2 && aesx_backend_select(argv[2]) != 0) {
+		printf("## AES backend %s is not available on this CPU\n", argv[2]);
+		return 1;
+	}
+	printf("## AES backend: %s\n", aesx_backend_name());
+	
+	printf("## AES self test: %s\n", aes_self_test(0) ? "FAILED" : "OK");
+	printf("## CTR split check: %s\n", ctr_split_check() ? "FAILED" : "OK");
+	printf("## Bitsliced/vpaes check: %s\n", backend_check() ? "FAILED" : "OK");
+	printf("## Key schedule check: %s\n", keyschedule_check() ? "FAILED" : "OK");
+	printf("## CBC check: %s\n", cbc_check() ? "FAILED" : "OK");
+	printf("## CFB check: %s\n", cfb_check() ? "FAILED" : "OK");
+	
 	/*
 	ecb_test(1048576, 1);
 	ecb_test(1048576, 2);
@@ -397,6 +1633,33 @@ int main() {
 	ctr_test(1048576000, 8);
 	*/
 	
+	//table vs bitsliced vs vector permute: the paths without AES-NI
+	run_sizes(ecb_test);
+	run_sizes(ecb_compact_test);
+	table_layout_test();
+	run_sizes(bs_ecb_test);
+	run_sizes(bs_ctr_test);
+	run_sizes(cfb_enc_test);
+	run_sizes(cfb_dec_test);
+	if(CheckSSSE3Support()) {
+		run_sizes(vpaes_ecb_test);
+		run_sizes(vpaes_ctr_test);
+	}
+	printf("## XTS self test: %s\n", xts_self_test(0) ? "FAILED" : "OK");
+	run_sizes(xts_test);
+	printf("## CCM self test: %s\n", ccm_self_test(0) ? "FAILED" : "OK");
+	run_sizes(ccm_table_test);
+	run_sizes(aesx_ctr_test);
+	
+	printf("## CMAC self test: %s\n", cmac_self_test(0) ? "FAILED" : "OK");
+	//one CMAC chain at a time vs independent chains interleaved
+	cmac_latency_test();
+	run_sizes(cmac_test);
+	run_sizes(cmac_batch_test);
+	
+	//per-message key setup with and without the expanded-key cache
+	keycache_test();
+	
 	if(CheckAESSupport()) {
 		printf("## CPU Supports AES-NI instructions. Continuing...\n");
 		/*aes_ecb_test(1048576, 1);
@@ -438,6 +1701,36 @@ int main() {
 		aes_ctr_test(1048576000, 2);
 		aes_ctr_test(1048576000, 4);
 		aes_ctr_test(1048576000, 8);			
+		
+		run_sizes(aes_cbc_enc_test);
+		run_sizes(aes_cbc_dec_test);
+		run_sizes(aes_cbc_multi_test);
+		run_sizes(aes_cfb_enc_test);
+		run_sizes(aes_cfb_dec_test);
+		run_sizes(aes_xts_test);
+		
+		//one call per short stream vs independent streams in job manager lanes
+		aesmb_test();
+		
+		//the two AEADs side by side: OCB needs no carry-less multiply
+		if(CheckPCLMULSupport()) {
+			printf("## GCM self test: %s\n", gcm_self_test(0) ? "FAILED" : "OK");
+			run_sizes(gcm_test);
+		} else {
+			printf("## CPU Does Not Support PCLMULQDQ instructions. Skipping GCM...\n");
+		}
+		printf("## OCB self test: %s\n", ocb_self_test(0) ? "FAILED" : "OK");
+		run_sizes(ocb_test);
+		run_sizes(ccm_test);
+		
+		if(CheckVAESSupport()) {
+			printf("## CPU Supports %d-bit VAES instructions. Continuing...\n", CheckVAESSupport());
+			run_sizes(vaes_ecb_test);
+			run_sizes(vaes_ecb_dec_test);
+			run_sizes(vaes_ctr_test);
+		} else {
+			printf("## CPU Does Not Support VAES instructions. Skipping...\n");
+		}
 	} else {
 		printf("## CPU Does Not Support AES-NI instructions. Skipping...\n");
 	}
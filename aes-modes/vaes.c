@@ -0,0 +1,462 @@
+#include <immintrin.h>
+#include "vaes.h"
+#include "xor.h"
+
+/*
+ * The kernels below are compiled for VAES/AVX-512 or VAES/AVX2 through
+ * target attributes rather than global -m flags, so the rest of this
+ * file (and the fallbacks it calls) still runs on plain AES-NI hosts.
+ */
+#define VAES512 __attribute__ ((target ("avx512f,avx512bw,vaes")))
+#define VAES256 __attribute__ ((target ("avx2,vaes")))
+
+#define cpuid_count(func,sub,ax,bx,cx,dx)\
+		__asm__ __volatile__ ("cpuid":\
+		"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func), "c" (sub))
+
+static int vaes_width = 0;
+
+//runs ahead of default-priority constructors, which may already ask for the width
+static void vaes_probe(void) __attribute__ ((constructor (101)));
+
+static void vaes_probe(void) {
+	unsigned int a,b,c,d,xcr0,xcr0_hi;
+
+	cpuid_count(0,0,a,b,c,d);
+	if(a < 7)
+		return;
+
+	//AES-NI and OSXSAVE, then ask the OS which register state it saves
+	cpuid_count(1,0,a,b,c,d);
+	if(!(c & 0x2000000) || !(c & 0x8000000))
+		return;
+	__asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+	if((xcr0 & 0x6) != 0x6)
+		return;
+
+	cpuid_count(7,0,a,b,c,d);
+	if(!(c & 0x200))
+		return;
+	if((b & 0x10000) && (b & 0x40000000) && (xcr0 & 0xe6) == 0xe6)
+		vaes_width = 512;
+	else if(b & 0x20)
+		vaes_width = 256;
+}
+
+int CheckVAESSupport() {
+	return vaes_width;
+}
+
+/* ------------------ 512-BIT KERNELS (4 BLOCKS PER REGISTER) ------------------ */
+
+VAES512 static unsigned long vaes512_ecb_encrypt(const unsigned char *in,
+												 unsigned char *out,
+												 unsigned long blocks,
+												 const __m128i *key,
+												 int number_of_rounds)
+{
+	__m512i rk[15], b0, b1, b2, b3;
+	unsigned long i;
+	int j;
+
+	for(j=0; j <= number_of_rounds; j++)
+		rk[j] = _mm512_broadcast_i32x4(key[j]);
+
+	for(i=0; i+16 <= blocks; i+=16) {
+		b0 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i), rk[0]);
+		b1 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i+64), rk[0]);
+		b2 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i+128), rk[0]);
+		b3 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i+192), rk[0]);
+		for(j=1; j < number_of_rounds; j++) {
+			b0 = _mm512_aesenc_epi128(b0, rk[j]);
+			b1 = _mm512_aesenc_epi128(b1, rk[j]);
+			b2 = _mm512_aesenc_epi128(b2, rk[j]);
+			b3 = _mm512_aesenc_epi128(b3, rk[j]);
+		}
+		_mm512_storeu_si512(out+16*i, _mm512_aesenclast_epi128(b0, rk[j]));
+		_mm512_storeu_si512(out+16*i+64, _mm512_aesenclast_epi128(b1, rk[j]));
+		_mm512_storeu_si512(out+16*i+128, _mm512_aesenclast_epi128(b2, rk[j]));
+		_mm512_storeu_si512(out+16*i+192, _mm512_aesenclast_epi128(b3, rk[j]));
+	}
+	for(; i+4 <= blocks; i+=4) {
+		b0 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i), rk[0]);
+		for(j=1; j < number_of_rounds; j++)
+			b0 = _mm512_aesenc_epi128(b0, rk[j]);
+		_mm512_storeu_si512(out+16*i, _mm512_aesenclast_epi128(b0, rk[j]));
+	}
+	return i;
+}
+
+VAES512 static unsigned long vaes512_ecb_decrypt(const unsigned char *in,
+												 unsigned char *out,
+												 unsigned long blocks,
+												 const __m128i *key,
+												 int number_of_rounds)
+{
+	__m512i rk[15], b0, b1, b2, b3;
+	unsigned long i;
+	int j;
+
+	for(j=0; j <= number_of_rounds; j++)
+		rk[j] = _mm512_broadcast_i32x4(key[j]);
+
+	for(i=0; i+16 <= blocks; i+=16) {
+		b0 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i), rk[0]);
+		b1 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i+64), rk[0]);
+		b2 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i+128), rk[0]);
+		b3 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i+192), rk[0]);
+		for(j=1; j < number_of_rounds; j++) {
+			b0 = _mm512_aesdec_epi128(b0, rk[j]);
+			b1 = _mm512_aesdec_epi128(b1, rk[j]);
+			b2 = _mm512_aesdec_epi128(b2, rk[j]);
+			b3 = _mm512_aesdec_epi128(b3, rk[j]);
+		}
+		_mm512_storeu_si512(out+16*i, _mm512_aesdeclast_epi128(b0, rk[j]));
+		_mm512_storeu_si512(out+16*i+64, _mm512_aesdeclast_epi128(b1, rk[j]));
+		_mm512_storeu_si512(out+16*i+128, _mm512_aesdeclast_epi128(b2, rk[j]));
+		_mm512_storeu_si512(out+16*i+192, _mm512_aesdeclast_epi128(b3, rk[j]));
+	}
+	for(; i+4 <= blocks; i+=4) {
+		b0 = _mm512_xor_si512(_mm512_loadu_si512(in+16*i), rk[0]);
+		for(j=1; j < number_of_rounds; j++)
+			b0 = _mm512_aesdec_epi128(b0, rk[j]);
+		_mm512_storeu_si512(out+16*i, _mm512_aesdeclast_epi128(b0, rk[j]));
+	}
+	return i;
+}
+
+/*
+ * Counters are kept byte-swapped per 64-bit half, as in AES_CTR_encrypt,
+ * so a lane-wise add_epi64 steps them. `ctr` is updated to the next
+ * unused counter.
+ */
+VAES512 static unsigned long vaes512_ctr_encrypt(const unsigned char *in,
+												 unsigned char *out,
+												 unsigned long blocks,
+												 __m128i *ctr,
+												 const __m128i *key,
+												 int number_of_rounds)
+{
+	__m512i rk[15], b0, b1, b2, b3, c0, c1, c2, c3, BSWAP_EPI64, FOUR, SIXTEEN;
+	unsigned long i;
+	int j;
+
+	for(j=0; j <= number_of_rounds; j++)
+		rk[j] = _mm512_broadcast_i32x4(key[j]);
+
+	BSWAP_EPI64 = _mm512_broadcast_i32x4(_mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8));
+	FOUR = _mm512_set_epi64(4,0,4,0,4,0,4,0);
+	SIXTEEN = _mm512_set_epi64(16,0,16,0,16,0,16,0);
+
+	c0 = _mm512_add_epi64(_mm512_broadcast_i32x4(*ctr), _mm512_set_epi64(3,0,2,0,1,0,0,0));
+	c1 = _mm512_add_epi64(c0, FOUR);
+	c2 = _mm512_add_epi64(c1, FOUR);
+	c3 = _mm512_add_epi64(c2, FOUR);
+
+	for(i=0; i+16 <= blocks; i+=16) {
+		b0 = _mm512_xor_si512(_mm512_shuffle_epi8(c0, BSWAP_EPI64), rk[0]);
+		b1 = _mm512_xor_si512(_mm512_shuffle_epi8(c1, BSWAP_EPI64), rk[0]);
+		b2 = _mm512_xor_si512(_mm512_shuffle_epi8(c2, BSWAP_EPI64), rk[0]);
+		b3 = _mm512_xor_si512(_mm512_shuffle_epi8(c3, BSWAP_EPI64), rk[0]);
+		c0 = _mm512_add_epi64(c0, SIXTEEN);
+		c1 = _mm512_add_epi64(c1, SIXTEEN);
+		c2 = _mm512_add_epi64(c2, SIXTEEN);
+		c3 = _mm512_add_epi64(c3, SIXTEEN);
+		for(j=1; j < number_of_rounds; j++) {
+			b0 = _mm512_aesenc_epi128(b0, rk[j]);
+			b1 = _mm512_aesenc_epi128(b1, rk[j]);
+			b2 = _mm512_aesenc_epi128(b2, rk[j]);
+			b3 = _mm512_aesenc_epi128(b3, rk[j]);
+		}
+		b0 = _mm512_aesenclast_epi128(b0, rk[j]);
+		b1 = _mm512_aesenclast_epi128(b1, rk[j]);
+		b2 = _mm512_aesenclast_epi128(b2, rk[j]);
+		b3 = _mm512_aesenclast_epi128(b3, rk[j]);
+		_mm512_storeu_si512(out+16*i, _mm512_xor_si512(b0, _mm512_loadu_si512(in+16*i)));
+		_mm512_storeu_si512(out+16*i+64, _mm512_xor_si512(b1, _mm512_loadu_si512(in+16*i+64)));
+		_mm512_storeu_si512(out+16*i+128, _mm512_xor_si512(b2, _mm512_loadu_si512(in+16*i+128)));
+		_mm512_storeu_si512(out+16*i+192, _mm512_xor_si512(b3, _mm512_loadu_si512(in+16*i+192)));
+	}
+	for(; i+4 <= blocks; i+=4) {
+		b0 = _mm512_xor_si512(_mm512_shuffle_epi8(c0, BSWAP_EPI64), rk[0]);
+		c0 = _mm512_add_epi64(c0, FOUR);
+		for(j=1; j < number_of_rounds; j++)
+			b0 = _mm512_aesenc_epi128(b0, rk[j]);
+		b0 = _mm512_aesenclast_epi128(b0, rk[j]);
+		_mm512_storeu_si512(out+16*i, _mm512_xor_si512(b0, _mm512_loadu_si512(in+16*i)));
+	}
+	*ctr = _mm512_castsi512_si128(c0);
+	return i;
+}
+
+/* ------------------ 256-BIT KERNELS (2 BLOCKS PER REGISTER) ------------------ */
+
+VAES256 static unsigned long vaes256_ecb_encrypt(const unsigned char *in,
+												 unsigned char *out,
+												 unsigned long blocks,
+												 const __m128i *key,
+												 int number_of_rounds)
+{
+	__m256i rk[15], b0, b1, b2, b3;
+	unsigned long i;
+	int j;
+
+	for(j=0; j <= number_of_rounds; j++)
+		rk[j] = _mm256_broadcastsi128_si256(key[j]);
+
+	for(i=0; i+8 <= blocks; i+=8) {
+		b0 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i)), rk[0]);
+		b1 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i+32)), rk[0]);
+		b2 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i+64)), rk[0]);
+		b3 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i+96)), rk[0]);
+		for(j=1; j < number_of_rounds; j++) {
+			b0 = _mm256_aesenc_epi128(b0, rk[j]);
+			b1 = _mm256_aesenc_epi128(b1, rk[j]);
+			b2 = _mm256_aesenc_epi128(b2, rk[j]);
+			b3 = _mm256_aesenc_epi128(b3, rk[j]);
+		}
+		_mm256_storeu_si256((__m256i*)(out+16*i), _mm256_aesenclast_epi128(b0, rk[j]));
+		_mm256_storeu_si256((__m256i*)(out+16*i+32), _mm256_aesenclast_epi128(b1, rk[j]));
+		_mm256_storeu_si256((__m256i*)(out+16*i+64), _mm256_aesenclast_epi128(b2, rk[j]));
+		_mm256_storeu_si256((__m256i*)(out+16*i+96), _mm256_aesenclast_epi128(b3, rk[j]));
+	}
+	for(; i+2 <= blocks; i+=2) {
+		b0 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i)), rk[0]);
+		for(j=1; j < number_of_rounds; j++)
+			b0 = _mm256_aesenc_epi128(b0, rk[j]);
+		_mm256_storeu_si256((__m256i*)(out+16*i), _mm256_aesenclast_epi128(b0, rk[j]));
+	}
+	return i;
+}
+
+VAES256 static unsigned long vaes256_ecb_decrypt(const unsigned char *in,
+												 unsigned char *out,
+												 unsigned long blocks,
+												 const __m128i *key,
+												 int number_of_rounds)
+{
+	__m256i rk[15], b0, b1, b2, b3;
+	unsigned long i;
+	int j;
+
+	for(j=0; j <= number_of_rounds; j++)
+		rk[j] = _mm256_broadcastsi128_si256(key[j]);
+
+	for(i=0; i+8 <= blocks; i+=8) {
+		b0 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i)), rk[0]);
+		b1 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i+32)), rk[0]);
+		b2 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i+64)), rk[0]);
+		b3 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i+96)), rk[0]);
+		for(j=1; j < number_of_rounds; j++) {
+			b0 = _mm256_aesdec_epi128(b0, rk[j]);
+			b1 = _mm256_aesdec_epi128(b1, rk[j]);
+			b2 = _mm256_aesdec_epi128(b2, rk[j]);
+			b3 = _mm256_aesdec_epi128(b3, rk[j]);
+		}
+		_mm256_storeu_si256((__m256i*)(out+16*i), _mm256_aesdeclast_epi128(b0, rk[j]));
+		_mm256_storeu_si256((__m256i*)(out+16*i+32), _mm256_aesdeclast_epi128(b1, rk[j]));
+		_mm256_storeu_si256((__m256i*)(out+16*i+64), _mm256_aesdeclast_epi128(b2, rk[j]));
+		_mm256_storeu_si256((__m256i*)(out+16*i+96), _mm256_aesdeclast_epi128(b3, rk[j]));
+	}
+	for(; i+2 <= blocks; i+=2) {
+		b0 = _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(in+16*i)), rk[0]);
+		for(j=1; j < number_of_rounds; j++)
+			b0 = _mm256_aesdec_epi128(b0, rk[j]);
+		_mm256_storeu_si256((__m256i*)(out+16*i), _mm256_aesdeclast_epi128(b0, rk[j]));
+	}
+	return i;
+}
+
+VAES256 static unsigned long vaes256_ctr_encrypt(const unsigned char *in,
+												 unsigned char *out,
+												 unsigned long blocks,
+												 __m128i *ctr,
+												 const __m128i *key,
+												 int number_of_rounds)
+{
+	__m256i rk[15], b0, b1, b2, b3, c0, c1, c2, c3, BSWAP_EPI64, TWO, EIGHT;
+	unsigned long i;
+	int j;
+
+	for(j=0; j <= number_of_rounds; j++)
+		rk[j] = _mm256_broadcastsi128_si256(key[j]);
+
+	BSWAP_EPI64 = _mm256_broadcastsi128_si256(_mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8));
+	TWO = _mm256_set_epi64x(2,0,2,0);
+	EIGHT = _mm256_set_epi64x(8,0,8,0);
+
+	c0 = _mm256_add_epi64(_mm256_broadcastsi128_si256(*ctr), _mm256_set_epi64x(1,0,0,0));
+	c1 = _mm256_add_epi64(c0, TWO);
+	c2 = _mm256_add_epi64(c1, TWO);
+	c3 = _mm256_add_epi64(c2, TWO);
+
+	for(i=0; i+8 <= blocks; i+=8) {
+		b0 = _mm256_xor_si256(_mm256_shuffle_epi8(c0, BSWAP_EPI64), rk[0]);
+		b1 = _mm256_xor_si256(_mm256_shuffle_epi8(c1, BSWAP_EPI64), rk[0]);
+		b2 = _mm256_xor_si256(_mm256_shuffle_epi8(c2, BSWAP_EPI64), rk[0]);
+		b3 = _mm256_xor_si256(_mm256_shuffle_epi8(c3, BSWAP_EPI64), rk[0]);
+		c0 = _mm256_add_epi64(c0, EIGHT);
+		c1 = _mm256_add_epi64(c1, EIGHT);
+		c2 = _mm256_add_epi64(c2, EIGHT);
+		c3 = _mm256_add_epi64(c3, EIGHT);
+		for(j=1; j < number_of_rounds; j++) {
+			b0 = _mm256_aesenc_epi128(b0, rk[j]);
+			b1 = _mm256_aesenc_epi128(b1, rk[j]);
+			b2 = _mm256_aesenc_epi128(b2, rk[j]);
+			b3 = _mm256_aesenc_epi128(b3, rk[j]);
+		}
+		b0 = _mm256_aesenclast_epi128(b0, rk[j]);
+		b1 = _mm256_aesenclast_epi128(b1, rk[j]);
+		b2 = _mm256_aesenclast_epi128(b2, rk[j]);
+		b3 = _mm256_aesenclast_epi128(b3, rk[j]);
+		_mm256_storeu_si256((__m256i*)(out+16*i), _mm256_xor_si256(b0, _mm256_loadu_si256((__m256i*)(in+16*i))));
+		_mm256_storeu_si256((__m256i*)(out+16*i+32), _mm256_xor_si256(b1, _mm256_loadu_si256((__m256i*)(in+16*i+32))));
+		_mm256_storeu_si256((__m256i*)(out+16*i+64), _mm256_xor_si256(b2, _mm256_loadu_si256((__m256i*)(in+16*i+64))));
+		_mm256_storeu_si256((__m256i*)(out+16*i+96), _mm256_xor_si256(b3, _mm256_loadu_si256((__m256i*)(in+16*i+96))));
+	}
+	for(; i+2 <= blocks; i+=2) {
+		b0 = _mm256_xor_si256(_mm256_shuffle_epi8(c0, BSWAP_EPI64), rk[0]);
+		c0 = _mm256_add_epi64(c0, TWO);
+		for(j=1; j < number_of_rounds; j++)
+			b0 = _mm256_aesenc_epi128(b0, rk[j]);
+		b0 = _mm256_aesenclast_epi128(b0, rk[j]);
+		_mm256_storeu_si256((__m256i*)(out+16*i), _mm256_xor_si256(b0, _mm256_loadu_si256((__m256i*)(in+16*i))));
+	}
+	*ctr = _mm256_castsi256_si128(c0);
+	return i;
+}
+
+/* ------------------ ENTRY POINTS ------------------ */
+
+void AES_ECB_encrypt_vaes(const unsigned char *in,
+						  unsigned char *out,
+						  unsigned long length,
+						  const unsigned char *key,
+						  int number_of_rounds)
+{
+	unsigned long done = 0;
+
+	if(vaes_width == 512)
+		done = vaes512_ecb_encrypt(in, out, length/16, (const __m128i*)key, number_of_rounds);
+	else if(vaes_width == 256)
+		done = vaes256_ecb_encrypt(in, out, length/16, (const __m128i*)key, number_of_rounds);
+
+	//the last few blocks (and any partial block) go through the 128-bit path
+	if(16*done < length)
+		AES_ECB_encrypt(in+16*done, out+16*done, length-16*done, key, number_of_rounds);
+}
+
+void AES_ECB_decrypt_vaes(const unsigned char *in,
+						  unsigned char *out,
+						  unsigned long length,
+						  const char *key,
+						  int number_of_rounds)
+{
+	unsigned long done = 0;
+
+	if(vaes_width == 512)
+		done = vaes512_ecb_decrypt(in, out, length/16, (const __m128i*)key, number_of_rounds);
+	else if(vaes_width == 256)
+		done = vaes256_ecb_decrypt(in, out, length/16, (const __m128i*)key, number_of_rounds);
+
+	if(16*done < length)
+		AES_ECB_decrypt(in+16*done, out+16*done, length-16*done, key, number_of_rounds);
+}
+
+void AES_CTR_encrypt_vaes(const unsigned char *in,
+						  unsigned char *out,
+						  const unsigned char ivec[8],
+						  const unsigned char nonce[4],
+						  unsigned long length,
+						  const unsigned char *key,
+						  int number_of_rounds)
+{
+	__m128i ctr_block, tmp, ONE, BSWAP_EPI64;
+	ALIGN16 unsigned char last[16];
+	unsigned long i, blocks = length/16;
+	int j;
+
+	if(vaes_width == 0) {
+		AES_CTR_encrypt(in, out, ivec, nonce, length, key, number_of_rounds);
+		return;
+	}
+
+	ONE = _mm_set_epi32(0,1,0,0);
+	BSWAP_EPI64 = _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+
+	ctr_block = _mm_setzero_si128();
+	ctr_block = _mm_insert_epi64(ctr_block, *(long long*)ivec, 1);
+	ctr_block = _mm_insert_epi32(ctr_block, *(int*)nonce, 1);
+	ctr_block = _mm_srli_si128(ctr_block, 4);
+	ctr_block = _mm_shuffle_epi8(ctr_block, BSWAP_EPI64);
+	ctr_block = _mm_add_epi64(ctr_block, ONE);
+
+	if(vaes_width == 512)
+		i = vaes512_ctr_encrypt(in, out, blocks, &ctr_block, (const __m128i*)key, number_of_rounds);
+	else
+		i = vaes256_ctr_encrypt(in, out, blocks, &ctr_block, (const __m128i*)key, number_of_rounds);
+
+	//finish the remaining whole blocks and a trailing partial block
+	for(; 16*i < length; i++) {
+		tmp = _mm_shuffle_epi8(ctr_block, BSWAP_EPI64);
+		ctr_block = _mm_add_epi64(ctr_block, ONE);
+		tmp = _mm_xor_si128(tmp, ((__m128i*)key)[0]);
+		for(j=1; j < number_of_rounds; j++)
+			tmp = _mm_aesenc_si128(tmp, ((__m128i*)key)[j]);
+		tmp = _mm_aesenclast_si128(tmp, ((__m128i*)key)[j]);
+		if(16*i+16 <= length) {
+			tmp = _mm_xor_si128(tmp, _mm_loadu_si128(&((__m128i*)in)[i]));
+			_mm_storeu_si128(&((__m128i*)out)[i], tmp);
+		} else {
+			_mm_store_si128((__m128i*)last, tmp);
+			xor_keystream(out + 16*i, in + 16*i, last, length - 16*i);
+		}
+	}
+}
+
+void AES_CTR128_encrypt_vaes(const unsigned char *in,
+							 unsigned char *out,
+							 const unsigned char counter[16],
+							 unsigned long long block_offset,
+							 unsigned long length,
+							 const unsigned char *key,
+							 int number_of_rounds)
+{
+	ALIGN16 unsigned char next[16];
+	__m128i ctr_block;
+	unsigned long long hi = 0, lo = 0;
+	unsigned long i = 0, blocks = length/16;
+	int j;
+
+	if(vaes_width != 0) {
+		for(j=0; j < 8; j++) {
+			hi = (hi << 8) | counter[j];
+			lo = (lo << 8) | counter[j+8];
+		}
+		lo += block_offset;
+		if(lo < block_offset)
+			hi++;
+
+		//the wide kernels only step the low 64 bits, so stop before they wrap
+		if(lo + blocks < lo)
+			blocks = 0 - lo;
+
+		ctr_block = _mm_set_epi64x((long long)lo, (long long)hi);
+		if(vaes_width == 512)
+			i = vaes512_ctr_encrypt(in, out, blocks, &ctr_block, (const __m128i*)key, number_of_rounds);
+		else
+			i = vaes256_ctr_encrypt(in, out, blocks, &ctr_block, (const __m128i*)key, number_of_rounds);
+
+		lo += i;
+		if(lo < i)
+			hi++;
+		for(j=7; j >= 0; j--) {
+			next[j] = (unsigned char)hi; hi >>= 8;
+			next[j+8] = (unsigned char)lo; lo >>= 8;
+		}
+		counter = next;
+		block_offset = 0;
+	}
+
+	AES_CTR128_encrypt(in+16*i, out+16*i, counter, block_offset, length-16*i, key, number_of_rounds);
+}
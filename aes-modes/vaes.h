@@ -0,0 +1,50 @@
+#ifndef VAES_H
+#define VAES_H
+
+#include "aesni.h"
+
+/*
+ * VAES kernels: the same rounds as aesni.c but on 256-bit (2 blocks) or
+ * 512-bit (4 blocks) registers. Every entry point takes the same
+ * arguments and key schedule as its AES_* counterpart in aesni.h and
+ * falls back to it when the CPU or OS does not support VAES.
+ */
+
+/*
+ * Widest usable VAES register width in bits: 512 (VAES + AVX-512F/BW),
+ * 256 (VAES + AVX2) or 0. The CPU is probed once at startup.
+ */
+int CheckVAESSupport();
+
+void AES_ECB_encrypt_vaes(const unsigned char *in,
+						  unsigned char *out,
+						  unsigned long length,
+						  const unsigned char *key,
+						  int number_of_rounds);
+
+void AES_ECB_decrypt_vaes(const unsigned char *in,
+						  unsigned char *out,
+						  unsigned long length,
+						  const char *key,
+						  int number_of_rounds);
+
+void AES_CTR_encrypt_vaes(const unsigned char *in,
+						  unsigned char *out,
+						  const unsigned char ivec[8],
+						  const unsigned char nonce[4],
+						  unsigned long length,
+						  const unsigned char *key,
+						  int number_of_rounds);
+
+/*
+ * Seekable 128-bit CTR, same semantics as AES_CTR128_encrypt.
+ */
+void AES_CTR128_encrypt_vaes(const unsigned char *in,
+							 unsigned char *out,
+							 const unsigned char counter[16],
+							 unsigned long long block_offset,
+							 unsigned long length,
+							 const unsigned char *key,
+							 int number_of_rounds);
+
+#endif
@@ -0,0 +1,451 @@
+/*
+ *  Constant-time AES on SSSE3 byte shuffles
+ *
+ *  After Hamburg, "Accelerating AES with Vector Permute Instructions"
+ *  (CHES 2009). GF(2^8) is taken as a 2-dimensional space over its
+ *  subfield GF(2^4): x = i + k w with w = 0x12 and i, k in GF(2^4).
+ *  With j = i + k and a = 0xE1 the inverse of x is a sum of one function
+ *  of io = j + 1/(1/i + a/k) and one of jo = i + 1/(1/j + a/k), where
+ *  every division is a 16-entry table indexed by a nibble, i.e. a
+ *  pshufb. The affine part of the S-box, MixColumns and the change of
+ *  basis are folded into the output tables, so the state stays in the
+ *  (i, k) basis between rounds and the round keys are stored in it; the
+ *  constant 0x63 is folded into the round keys too. Decryption is the
+ *  equivalent inverse cipher on the schedule of aes_setkey_dec.
+ *
+ *  All lookups are register shuffles: no memory access depends on the
+ *  key or the data.
+ */
+
+#include "vpaes.h"
+#include "xor.h"
+
+#define LD(t)       _mm_loadu_si128( (const __m128i *)(t) )
+#define XOR(a,b)    _mm_xor_si128( (a), (b) )
+#define SHUF(t,x)   _mm_shuffle_epi8( (t), (x) )
+
+/* 1/x and a/x on nibbles; x = 0 maps to 0x80 ("infinity"), which pshufb turns into 0 */
+static const unsigned char k_inv[16] =
+{ 0x80, 0x01, 0x08, 0x0D, 0x0F, 0x06, 0x05, 0x0E,
+  0x02, 0x0C, 0x0B, 0x0A, 0x09, 0x03, 0x07, 0x04 };
+
+static const unsigned char k_ak[16] =
+{ 0x80, 0x0D, 0x05, 0x06, 0x0A, 0x02, 0x03, 0x07,
+  0x0C, 0x0B, 0x04, 0x09, 0x08, 0x01, 0x0F, 0x0E };
+
+/* Byte to (i, k), from the standard basis and from A^-1 of it */
+static const unsigned char k_ipt[2][16] =
+{
+    { 0x00, 0x10, 0x36, 0x26, 0x7C, 0x6C, 0x4A, 0x5A,
+      0x5C, 0x4C, 0x6A, 0x7A, 0x20, 0x30, 0x16, 0x06 },
+    { 0x00, 0x37, 0xA9, 0x9E, 0x77, 0x40, 0xDE, 0xE9,
+      0x1E, 0x29, 0xB7, 0x80, 0x69, 0x5E, 0xC0, 0xF7 }
+};
+
+static const unsigned char k_dipt[2][16] =
+{
+    { 0x00, 0x1D, 0x55, 0x48, 0xE5, 0xF8, 0xB0, 0xAD,
+      0x76, 0x6B, 0x23, 0x3E, 0x93, 0x8E, 0xC6, 0xDB },
+    { 0x00, 0xCB, 0x3B, 0xF0, 0x1F, 0xD4, 0x24, 0xEF,
+      0xC5, 0x0E, 0xFE, 0x35, 0xDA, 0x11, 0xE1, 0x2A }
+};
+
+/* Encryption outputs, (io, jo) to S(x) ^ 0x63 and twice that, in the (i, k) basis */
+static const unsigned char k_sb1[2][16] =
+{
+    { 0x00, 0x3C, 0xDA, 0x10, 0xC1, 0x27, 0xCA, 0xFD,
+      0xD1, 0x2C, 0x37, 0x0B, 0xE6, 0xED, 0x1B, 0xF6 },
+    { 0x00, 0x0D, 0xC3, 0xEC, 0x5F, 0x91, 0x2F, 0x52,
+      0xB3, 0xE1, 0x7D, 0x70, 0xCE, 0xBE, 0x9C, 0x22 }
+};
+
+static const unsigned char k_sb2[2][16] =
+{
+    { 0x00, 0xEB, 0x85, 0x36, 0xF1, 0x9F, 0xB3, 0x1A,
+      0xC7, 0xDD, 0xA9, 0x42, 0x6E, 0x2C, 0x74, 0x58 },
+    { 0x00, 0x63, 0x3C, 0xF9, 0x2F, 0x70, 0xC5, 0x4C,
+      0xD6, 0x9A, 0x89, 0xEA, 0x5F, 0xB5, 0x13, 0xA6 }
+};
+
+/* Last round: S(x) ^ 0x63 in the standard basis */
+static const unsigned char k_sbo[2][16] =
+{
+    { 0x00, 0x54, 0xB7, 0x01, 0xF2, 0x11, 0xB6, 0xA6,
+      0xF3, 0x55, 0x10, 0x44, 0xE3, 0xA7, 0x45, 0xE2 },
+    { 0x00, 0x4B, 0x2A, 0xB5, 0xC2, 0xA3, 0x9F, 0x89,
+      0x77, 0xFE, 0x16, 0x5D, 0x61, 0x3C, 0xE8, 0xD4 }
+};
+
+/* Decryption outputs, 14, 11, 13 and 9 times InvS(x), in the (i, k) basis of A^-1 */
+static const unsigned char k_dsb[4][2][16] =
+{
+    {
+        { 0x00, 0x16, 0x39, 0xC7, 0x43, 0x6C, 0xFE, 0x55,
+          0x84, 0xD1, 0xAB, 0xBD, 0x2F, 0x92, 0x7A, 0xE8 },
+        { 0x00, 0xD0, 0xF5, 0x5C, 0xB1, 0x94, 0xA9, 0x61,
+          0xED, 0x8C, 0xC8, 0x18, 0x25, 0x3D, 0x44, 0x79 }
+    },
+    {
+        { 0x00, 0x7A, 0xAB, 0x43, 0x6C, 0xBD, 0xE8, 0x16,
+          0x2F, 0x39, 0xFE, 0x84, 0xD1, 0x55, 0xC7, 0x92 },
+        { 0x00, 0x44, 0xC8, 0xB1, 0x94, 0x18, 0x79, 0xD0,
+          0x25, 0xF5, 0xA9, 0xED, 0x8C, 0x61, 0x5C, 0x3D }
+    },
+    {
+        { 0x00, 0x30, 0x3B, 0x10, 0x37, 0x3C, 0x2B, 0x07,
+          0x27, 0x20, 0x2C, 0x1C, 0x0B, 0x17, 0x0C, 0x1B },
+        { 0x00, 0xBE, 0x13, 0x0D, 0x6D, 0xC0, 0x1E, 0xD3,
+          0x60, 0xB3, 0xCD, 0x73, 0xAD, 0xDE, 0x7E, 0xA0 }
+    },
+    {
+        { 0x00, 0x4C, 0x82, 0xA8, 0x04, 0xCA, 0x2A, 0x48,
+          0xAC, 0xE4, 0x62, 0x2E, 0xCE, 0xE0, 0x86, 0x66 },
+        { 0x00, 0x27, 0x30, 0x20, 0x3B, 0x2C, 0x10, 0x1C,
+          0x1B, 0x07, 0x0C, 0x2B, 0x17, 0x3C, 0x0B, 0x37 }
+    }
+};
+
+/* Last round: InvS(x) in the standard basis */
+static const unsigned char k_dsbo[2][16] =
+{
+    { 0x00, 0x1F, 0x3F, 0x4A, 0xCE, 0xEE, 0x75, 0xD1,
+      0x84, 0x55, 0xA4, 0xBB, 0x20, 0x9B, 0xF1, 0x6A },
+    { 0x00, 0x1E, 0x8F, 0xAB, 0x23, 0xB2, 0x24, 0x3D,
+      0x88, 0xB5, 0x19, 0x07, 0x91, 0x96, 0xAC, 0x3A }
+};
+
+/*
+ * ShiftRows followed by a rotation of each column by r rows (InvShiftRows
+ * for decryption), one pshufb mask per MixColumns term
+ */
+static const unsigned char k_sr[4][16] =
+{
+    {  0,  5, 10, 15,  4,  9, 14,  3,  8, 13,  2,  7, 12,  1,  6, 11 },
+    {  5, 10, 15,  0,  9, 14,  3,  4, 13,  2,  7,  8,  1,  6, 11, 12 },
+    { 10, 15,  0,  5, 14,  3,  4,  9,  2,  7,  8, 13,  6, 11, 12,  1 },
+    { 15,  0,  5, 10,  3,  4,  9, 14,  7,  8, 13,  2, 11, 12,  1,  6 }
+};
+
+static const unsigned char k_isr[4][16] =
+{
+    {  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+    { 13, 10,  7,  0,  1, 14, 11,  4,  5,  2, 15,  8,  9,  6,  3, 12 },
+    { 10,  7,  0, 13, 14, 11,  4,  1,  2, 15,  8,  5,  6,  3, 12,  9 },
+    {  7,  0, 13, 10, 11,  4,  1, 14, 15,  8,  5,  2,  3, 12,  9,  6 }
+};
+
+/*
+ * High and low nibble of every byte
+ */
+static inline void vpaes_split( __m128i x, __m128i *hi, __m128i *lo )
+{
+    const __m128i m = _mm_set1_epi8( 0x0F );
+
+    *lo = _mm_and_si128( x, m );
+    *hi = _mm_and_si128( _mm_srli_epi16( x, 4 ), m );
+}
+
+/*
+ * Byte-wise GF(2)-linear map given by its values on the two nibbles
+ */
+static inline __m128i vpaes_transform( __m128i x, const unsigned char t[2][16] )
+{
+    __m128i hi, lo;
+
+    vpaes_split( x, &hi, &lo );
+
+    return( XOR( SHUF( LD( t[0] ), lo ), SHUF( LD( t[1] ), hi ) ) );
+}
+
+/*
+ * GF(2^8) inversion in the (i, k) basis: returns (io, jo), to be fed to
+ * a pair of output tables
+ */
+static inline void vpaes_inverse( __m128i x, __m128i *io, __m128i *jo )
+{
+    const __m128i inv = LD( k_inv );
+    __m128i i, j, k, ak, iak, jak;
+
+    vpaes_split( x, &i, &k );
+    j   = XOR( i, k );
+    ak  = SHUF( LD( k_ak ), k );
+    iak = XOR( SHUF( inv, i ), ak );
+    jak = XOR( SHUF( inv, j ), ak );
+    *io = XOR( SHUF( inv, iak ), j );
+    *jo = XOR( SHUF( inv, jak ), i );
+}
+
+static inline __m128i vpaes_out( const unsigned char t[2][16], __m128i io, __m128i jo )
+{
+    return( XOR( SHUF( LD( t[0] ), io ), SHUF( LD( t[1] ), jo ) ) );
+}
+
+/*
+ * Encrypt n blocks in place. Each round is SubBytes, then
+ * out = 2s + 3 rot1(s) + rot2(s) + rot3(s) as D + rot1(D + s) + rot2(s) + rot3(s)
+ * with ShiftRows folded into the rotations.
+ */
+static void vpaes_encrypt( const vpaes_context *ctx, __m128i *b, int n )
+{
+    const __m128i *rk = ctx->rk;
+    __m128i io, jo, s, d;
+    int r, i;
+
+    for( i = 0; i < n; i++ )
+        b[i] = XOR( vpaes_transform( b[i], k_ipt ), rk[0] );
+
+    for( r = 1; r < ctx->nr; r++ )
+    {
+        for( i = 0; i < n; i++ )
+        {
+            vpaes_inverse( b[i], &io, &jo );
+            s = vpaes_out( k_sb1, io, jo );
+            d = vpaes_out( k_sb2, io, jo );
+
+            b[i] = XOR( XOR( SHUF( d, LD( k_sr[0] ) ), SHUF( XOR( d, s ), LD( k_sr[1] ) ) ),
+                        XOR( SHUF( s, LD( k_sr[2] ) ), SHUF( s, LD( k_sr[3] ) ) ) );
+            b[i] = XOR( b[i], rk[r] );
+        }
+    }
+
+    for( i = 0; i < n; i++ )
+    {
+        vpaes_inverse( b[i], &io, &jo );
+        b[i] = XOR( SHUF( vpaes_out( k_sbo, io, jo ), LD( k_sr[0] ) ), rk[r] );
+    }
+}
+
+/*
+ * Decrypt n blocks in place: InvShiftRows, InvSubBytes and
+ * InvMixColumns (14, 11, 13, 9), then the transformed round key
+ */
+static void vpaes_decrypt( const vpaes_context *ctx, __m128i *b, int n )
+{
+    const __m128i *rk = ctx->rk;
+    __m128i io, jo, x;
+    int r, i, t;
+
+    for( i = 0; i < n; i++ )
+        b[i] = XOR( vpaes_transform( b[i], k_dipt ), rk[0] );
+
+    for( r = 1; r < ctx->nr; r++ )
+    {
+        for( i = 0; i < n; i++ )
+        {
+            vpaes_inverse( b[i], &io, &jo );
+
+            x = rk[r];
+            for( t = 0; t < 4; t++ )
+                x = XOR( x, SHUF( vpaes_out( k_dsb[t], io, jo ), LD( k_isr[t] ) ) );
+            b[i] = x;
+        }
+    }
+
+    for( i = 0; i < n; i++ )
+    {
+        vpaes_inverse( b[i], &io, &jo );
+        b[i] = XOR( SHUF( vpaes_out( k_dsbo, io, jo ), LD( k_isr[0] ) ), rk[r] );
+    }
+}
+
+int CheckSSSE3Support( void )
+{
+    unsigned int a, b, c, d;
+
+    __asm__ __volatile__ ( "cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1), "c" (0) );
+
+    return( ( c & 0x200 ) != 0 );
+}
+
+/*
+ * Round keys of the regular schedule, moved into the basis the state is
+ * kept in. Every round key that follows an S-box absorbs its 0x63 (for
+ * decryption the 0x63 in front of the inverse S-box is absorbed by the
+ * key before it).
+ */
+static int vpaes_setkey( vpaes_context *ctx, int mode, const unsigned char *key, unsigned int keysize )
+{
+    const __m128i c63 = _mm_set1_epi8( 0x63 );
+    aes_context tmp;
+    __m128i rk;
+    int r, ret;
+
+    if( mode == AES_DECRYPT )
+        ret = aes_setkey_dec( &tmp, key, keysize );
+    else
+        ret = aes_setkey_enc( &tmp, key, keysize );
+
+    if( ret != 0 )
+        return( ret );
+
+    ctx->nr = tmp.nr;
+    for( r = 0; r <= ctx->nr; r++ )
+    {
+        rk = _mm_set_epi32( (int) tmp.rk[4 * r + 3], (int) tmp.rk[4 * r + 2],
+                            (int) tmp.rk[4 * r + 1], (int) tmp.rk[4 * r] );
+
+        if( mode == AES_DECRYPT )
+        {
+            if( r < ctx->nr )
+                rk = vpaes_transform( XOR( rk, c63 ), k_dipt );
+        }
+        else
+        {
+            if( r > 0 )
+                rk = XOR( rk, c63 );
+            if( r < ctx->nr )
+                rk = vpaes_transform( rk, k_ipt );
+        }
+
+        ctx->rk[r] = rk;
+    }
+
+    memset( &tmp, 0, sizeof( tmp ) );
+
+    return( 0 );
+}
+
+/*
+ * AES key schedule (encryption)
+ */
+int vpaes_setkey_enc( vpaes_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    return( vpaes_setkey( ctx, AES_ENCRYPT, key, keysize ) );
+}
+
+/*
+ * AES key schedule (decryption)
+ */
+int vpaes_setkey_dec( vpaes_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    return( vpaes_setkey( ctx, AES_DECRYPT, key, keysize ) );
+}
+
+/*
+ * AES-ECB block encryption/decryption
+ */
+int vpaes_crypt_ecb( vpaes_context *ctx,
+                     int mode,
+                     const unsigned char input[16],
+                     unsigned char output[16] )
+{
+    __m128i b = _mm_loadu_si128( (const __m128i *) input );
+
+    if( mode == AES_DECRYPT )
+        vpaes_decrypt( ctx, &b, 1 );
+    else
+        vpaes_encrypt( ctx, &b, 1 );
+
+    _mm_storeu_si128( (__m128i *) output, b );
+
+    return( 0 );
+}
+
+/*
+ * AES-CBC buffer encryption/decryption; decryption runs 4 blocks at a time
+ */
+int vpaes_crypt_cbc( vpaes_context *ctx,
+                     int mode,
+                     size_t length,
+                     unsigned char iv[16],
+                     const unsigned char *input,
+                     unsigned char *output )
+{
+    __m128i v, c[4], b[4];
+    int i, n;
+
+    if( length % 16 )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    v = _mm_loadu_si128( (const __m128i *) iv );
+
+    if( mode == AES_ENCRYPT )
+    {
+        for( ; length > 0; length -= 16, input += 16, output += 16 )
+        {
+            v = XOR( v, _mm_loadu_si128( (const __m128i *) input ) );
+            vpaes_encrypt( ctx, &v, 1 );
+            _mm_storeu_si128( (__m128i *) output, v );
+        }
+    }
+    else
+    {
+        while( length > 0 )
+        {
+            n = ( length < 64 ) ? (int)( length / 16 ) : 4;
+
+            /* input may alias output: keep the ciphertext in registers */
+            for( i = 0; i < n; i++ )
+                b[i] = c[i] = _mm_loadu_si128( (const __m128i *) input + i );
+
+            vpaes_decrypt( ctx, b, n );
+
+            for( i = 0; i < n; i++ )
+            {
+                _mm_storeu_si128( (__m128i *) output + i, XOR( b[i], v ) );
+                v = c[i];
+            }
+
+            input += 16 * n;
+            output += 16 * n;
+            length -= 16 * n;
+        }
+    }
+
+    _mm_storeu_si128( (__m128i *) iv, v );
+
+    return( 0 );
+}
+
+/*
+ * AES-CTR at an absolute block offset, 4 blocks at a time
+ */
+int vpaes_crypt_ctr_at( vpaes_context *ctx,
+                        size_t length,
+                        const unsigned char nonce_counter[16],
+                        unsigned long long block_offset,
+                        const unsigned char *input,
+                        unsigned char *output )
+{
+    unsigned char counter[16], stream[64];
+    __m128i b[4];
+    unsigned int c;
+    size_t n, i;
+    int j, cb;
+
+    /* counter = nonce_counter + block_offset (mod 2^128) */
+    for( c = 0, j = 15; j >= 0; j-- )
+    {
+        c += nonce_counter[j] + (unsigned int)( block_offset & 0xFF );
+        counter[j] = (unsigned char) c;
+        c >>= 8;
+        block_offset >>= 8;
+    }
+
+    while( length > 0 )
+    {
+        for( i = 0; i < 4; i++ )
+        {
+            b[i] = _mm_loadu_si128( (const __m128i *) counter );
+
+            j = 15;
+            do {
+               counter[j]++;
+               cb = counter[j] == 0;
+            } while( j-- && cb );
+        }
+
+        n = ( length < 64 ) ? length : 64;
+        vpaes_encrypt( ctx, b, (int)( ( n + 15 ) / 16 ) );
+
+        for( i = 0; i < 4; i++ )
+            _mm_storeu_si128( (__m128i *) stream + i, b[i] );
+        xor_keystream( output, input, stream, n );
+
+        input += n;
+        output += n;
+        length -= n;
+    }
+
+    return( 0 );
+}
@@ -0,0 +1,121 @@
+/**
+ * \file vpaes.h
+ *
+ * \brief Constant-time AES on SSSE3 byte shuffles (vector permute AES)
+ *
+ * For x86-64 hosts with SSSE3 but no AES-NI. The calls mirror aes.h
+ * (separate encryption and decryption contexts, the same modes and
+ * error codes), so code written against aes_context switches over by
+ * renaming. The S-box is evaluated with pshufb nibble lookups instead of
+ * memory tables, so nothing leaks through the cache.
+ */
+#ifndef POLARSSL_VPAES_H
+#define POLARSSL_VPAES_H
+
+#include <string.h>
+#include <tmmintrin.h>
+
+#include "aes.h"
+
+/**
+ * \brief          vpaes context structure
+ */
+typedef struct
+{
+    int nr;                     /*!<  number of rounds                      */
+    __m128i rk[15];             /*!<  round keys, in the internal basis     */
+}
+vpaes_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Nonzero if the CPU supports SSSE3
+ */
+int CheckSSSE3Support( void );
+
+/**
+ * \brief          AES key schedule (encryption)
+ *
+ * \param ctx      context to be initialized
+ * \param key      encryption key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int vpaes_setkey_enc( vpaes_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          AES key schedule (decryption)
+ *
+ * \param ctx      context to be initialized
+ * \param key      decryption key
+ * \param keysize  must be 128, 192 or 256
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int vpaes_setkey_dec( vpaes_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          AES-ECB block encryption/decryption
+ *
+ * \param ctx      context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param input    16-byte input block
+ * \param output   16-byte output block
+ *
+ * \return         0 if successful
+ */
+int vpaes_crypt_ecb( vpaes_context *ctx,
+                     int mode,
+                     const unsigned char input[16],
+                     unsigned char output[16] );
+
+/**
+ * \brief          AES-CBC buffer encryption/decryption
+ *                 Length should be a multiple of the block
+ *                 size (16 bytes)
+ *
+ * \param ctx      context
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the input data
+ * \param iv       initialization vector (updated after use)
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int vpaes_crypt_cbc( vpaes_context *ctx,
+                     int mode,
+                     size_t length,
+                     unsigned char iv[16],
+                     const unsigned char *input,
+                     unsigned char *output );
+
+/**
+ * \brief          AES-CTR at an absolute block offset, same counter
+ *                 semantics as aes_crypt_ctr_at
+ *
+ * \param ctx           context (encryption schedule)
+ * \param length        The length of the data
+ * \param nonce_counter The 128-bit nonce and counter of block 0
+ * \param block_offset  Index of the first block of input in the message
+ * \param input         The input data stream
+ * \param output        The output data stream
+ *
+ * \return         0 if successful
+ */
+int vpaes_crypt_ctr_at( vpaes_context *ctx,
+                        size_t length,
+                        const unsigned char nonce_counter[16],
+                        unsigned long long block_offset,
+                        const unsigned char *input,
+                        unsigned char *output );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* vpaes.h */
@@ -0,0 +1,655 @@
+/*
+ *  XTS-AES (IEEE 1619-2007)
+ *
+ *  Every block of a data unit is independent once its tweak is known, and
+ *  the tweak of block j+1 is the tweak of block j times x in GF(2^128), so
+ *  the AES-NI path runs 8 blocks through the interleaved kernels while the
+ *  next tweaks are derived with a few SSE shifts. The table path walks the
+ *  same sequence one aes_crypt_ecb call at a time.
+ */
+
+#include "xts.h"
+
+#define XTS_MAX_LENGTH  ( (size_t) 1 << 28 )    /* 2^24 blocks */
+
+/*
+ * t * x in GF(2^128) with the little-endian tweak convention of XTS
+ */
+static inline __m128i xts_mul_alpha( __m128i t )
+{
+    __m128i c = _mm_srai_epi32( t, 31 );
+
+    c = _mm_shuffle_epi32( c, 0x93 );
+    c = _mm_and_si128( c, _mm_set_epi32( 1, 1, 1, 0x87 ) );
+
+    return( _mm_xor_si128( _mm_slli_epi32( t, 1 ), c ) );
+}
+
+static void xts_mul_alpha_bytes( unsigned char t[16] )
+{
+    unsigned char carry = 0, next;
+    int i;
+
+    for( i = 0; i < 16; i++ )
+    {
+        next = t[i] >> 7;
+        t[i] = (unsigned char)( ( t[i] << 1 ) | carry );
+        carry = next;
+    }
+
+    if( carry )
+        t[0] ^= 0x87;
+}
+
+/*
+ * One block: out = E(in ^ t) ^ t (or D)
+ */
+static void xts_block( xts_context *ctx, int mode, const unsigned char t[16],
+                       const unsigned char input[16], unsigned char output[16] )
+{
+    unsigned char buf[16];
+    int i;
+
+    for( i = 0; i < 16; i++ )
+        buf[i] = input[i] ^ t[i];
+
+    if( ctx->aesni && mode == AES_DECRYPT )
+        AES_ECB_decrypt( buf, buf, 16, (const char *) ctx->ctx1.ni, ctx->ctx1.nr );
+    else if( ctx->aesni )
+        AES_ECB_encrypt( buf, buf, 16, ctx->ctx1.ni, ctx->ctx1.nr );
+    else
+        aes_crypt_ecb( &ctx->ctx1, mode, buf, buf );
+
+    for( i = 0; i < 16; i++ )
+        output[i] = buf[i] ^ t[i];
+}
+
+/*
+ * Full blocks on AES-NI, 8 at a time. Returns the tweak of the block
+ * after the last one processed.
+ */
+static __m128i xts_aesni_blocks( xts_context *ctx, int mode, size_t blocks, __m128i t,
+                                 const unsigned char *input, unsigned char *output )
+{
+    const __m128i *k = (const __m128i *) ctx->ctx1.ni;
+    int nr = ctx->ctx1.nr;
+    __m128i b[8], tw[8];
+    int i;
+
+    for( ; blocks >= 8; blocks -= 8, input += 128, output += 128 )
+    {
+        for( i = 0; i < 8; i++ )
+        {
+            tw[i] = t;
+            b[i] = _mm_xor_si128( _mm_loadu_si128( (__m128i *) input + i ), t );
+            t = xts_mul_alpha( t );
+        }
+
+        if( mode == AES_DECRYPT )
+            AES_decrypt8( b, k, nr );
+        else
+            AES_encrypt8( b, k, nr );
+
+        for( i = 0; i < 8; i++ )
+            _mm_storeu_si128( (__m128i *) output + i, _mm_xor_si128( b[i], tw[i] ) );
+    }
+
+    if( blocks >= 4 )
+    {
+        for( i = 0; i < 4; i++ )
+        {
+            tw[i] = t;
+            b[i] = _mm_xor_si128( _mm_loadu_si128( (__m128i *) input + i ), t );
+            t = xts_mul_alpha( t );
+        }
+
+        if( mode == AES_DECRYPT )
+            AES_decrypt4( b, k, nr );
+        else
+            AES_encrypt4( b, k, nr );
+
+        for( i = 0; i < 4; i++ )
+            _mm_storeu_si128( (__m128i *) output + i, _mm_xor_si128( b[i], tw[i] ) );
+
+        blocks -= 4;
+        input += 64;
+        output += 64;
+    }
+
+    for( ; blocks > 0; blocks--, input += 16, output += 16 )
+    {
+        ALIGN16 unsigned char tb[16];
+
+        _mm_store_si128( (__m128i *) tb, t );
+        xts_block( ctx, mode, tb, input, output );
+        t = xts_mul_alpha( t );
+    }
+
+    return( t );
+}
+
+/*
+ * Encrypt/decrypt one data unit whose encrypted tweak is t
+ */
+static void xts_crypt_unit( xts_context *ctx, int mode, size_t length,
+                            unsigned char t[16],
+                            const unsigned char *input, unsigned char *output )
+{
+    size_t blocks = length / 16, tail = length % 16, i;
+    unsigned char cc[16], pp[16], t2[16];
+
+    /* With ciphertext stealing the last full block is handled below */
+    if( tail != 0 )
+        blocks--;
+
+    if( ctx->aesni )
+    {
+        __m128i tv = _mm_loadu_si128( (__m128i *) t );
+
+        tv = xts_aesni_blocks( ctx, mode, blocks, tv, input, output );
+        _mm_storeu_si128( (__m128i *) t, tv );
+    }
+    else
+    {
+        for( i = 0; i < blocks; i++ )
+        {
+            xts_block( ctx, mode, t, input + 16 * i, output + 16 * i );
+            xts_mul_alpha_bytes( t );
+        }
+    }
+
+    if( tail == 0 )
+        return;
+
+    input += 16 * blocks;
+    output += 16 * blocks;
+
+    /*
+     * Ciphertext stealing: the last full block uses tweak m-1 when
+     * encrypting and tweak m when decrypting, the combined block the other.
+     */
+    memcpy( t2, t, 16 );
+    xts_mul_alpha_bytes( t2 );
+
+    xts_block( ctx, mode, ( mode == AES_DECRYPT ) ? t2 : t, input, cc );
+
+    memcpy( pp, input + 16, tail );
+    memcpy( pp + tail, cc + tail, 16 - tail );
+    memcpy( output + 16, cc, tail );
+
+    xts_block( ctx, mode, ( mode == AES_DECRYPT ) ? t : t2, pp, output );
+}
+
+static int xts_setkey( xts_context *ctx, int mode, const unsigned char *key, unsigned int keysize )
+{
+    unsigned int half = keysize / 2;
+    int ret;
+
+    if( keysize != 256 && keysize != 512 )
+        return( POLARSSL_ERR_AES_INVALID_KEY_LENGTH );
+
+    if( mode == AES_DECRYPT )
+        ret = aes_setkey_dec( &ctx->ctx1, key, half );
+    else
+        ret = aes_setkey_enc( &ctx->ctx1, key, half );
+
+    if( ret != 0 || ( ret = aes_setkey_enc( &ctx->ctx2, key + half / 8, half ) ) != 0 )
+        return( ret );
+
+    ctx->aesni = CheckAESSupport();
+
+    return( 0 );
+}
+
+/*
+ * XTS key schedule (encryption)
+ */
+int xts_setkey_enc( xts_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    return( xts_setkey( ctx, AES_ENCRYPT, key, keysize ) );
+}
+
+/*
+ * XTS key schedule (decryption)
+ */
+int xts_setkey_dec( xts_context *ctx, const unsigned char *key, unsigned int keysize )
+{
+    return( xts_setkey( ctx, AES_DECRYPT, key, keysize ) );
+}
+
+/*
+ * XTS-AES encryption/decryption of one data unit
+ */
+int xts_crypt( xts_context *ctx,
+               int mode,
+               size_t length,
+               const unsigned char data_unit[16],
+               const unsigned char *input,
+               unsigned char *output )
+{
+    ALIGN16 unsigned char t[16];
+
+    if( length < 16 || length > XTS_MAX_LENGTH )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    if( ctx->aesni )
+        AES_ECB_encrypt( data_unit, t, 16, ctx->ctx2.ni, ctx->ctx2.nr );
+    else
+        aes_crypt_ecb( &ctx->ctx2, AES_ENCRYPT, data_unit, t );
+
+    xts_crypt_unit( ctx, mode, length, t, input, output );
+
+    return( 0 );
+}
+
+/*
+ * XTS-AES encryption/decryption of consecutive sectors
+ */
+int xts_crypt_sectors( xts_context *ctx,
+                       int mode,
+                       size_t sector_size,
+                       size_t num_sectors,
+                       unsigned long long sector,
+                       const unsigned char *input,
+                       unsigned char *output )
+{
+    ALIGN16 unsigned char t[8][16];
+    size_t i, j, n;
+
+    if( sector_size < 16 || sector_size > XTS_MAX_LENGTH )
+        return( POLARSSL_ERR_AES_INVALID_INPUT_LENGTH );
+
+    while( num_sectors > 0 )
+    {
+        n = ( num_sectors < 8 ) ? num_sectors : 8;
+
+        memset( t, 0, sizeof( t ) );
+        for( i = 0; i < n; i++ )
+            for( j = 0; j < 8; j++ )
+                t[i][j] = (unsigned char)( ( sector + i ) >> ( 8 * j ) );
+
+        if( ctx->aesni )
+            AES_ECB_encrypt( t[0], t[0], 16 * n, ctx->ctx2.ni, ctx->ctx2.nr );
+        else
+            for( i = 0; i < n; i++ )
+                aes_crypt_ecb( &ctx->ctx2, AES_ENCRYPT, t[i], t[i] );
+
+        for( i = 0; i < n; i++ )
+        {
+            xts_crypt_unit( ctx, mode, sector_size, t[i], input, output );
+            input += sector_size;
+            output += sector_size;
+        }
+
+        sector += n;
+        num_sectors -= n;
+    }
+
+    return( 0 );
+}
+
+#if defined(POLARSSL_SELF_TEST)
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * IEEE 1619-2007 Annex B vectors 1 to 4, 10 and 15 to 18
+ *
+ * Vectors 15 to 18 have 17 to 20 bytes per data unit and exercise
+ * ciphertext stealing. The plaintext is 00 01 02 ... except for
+ * vectors 1 to 3 (all 0x00, all 0x44); it is built at run time.
+ */
+#define NB_TESTS 9
+
+static const unsigned char xts_test_key[6][64] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22 },
+    { 0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8,
+      0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0,
+      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22 },
+    { 0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8,
+      0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0,
+      0xbf, 0xbe, 0xbd, 0xbc, 0xbb, 0xba, 0xb9, 0xb8,
+      0xb7, 0xb6, 0xb5, 0xb4, 0xb3, 0xb2, 0xb1, 0xb0 },
+    { 0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45,
+      0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26,
+      0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93,
+      0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95 },
+    { 0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45,
+      0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26,
+      0x62, 0x49, 0x77, 0x57, 0x24, 0x70, 0x93, 0x69,
+      0x99, 0x59, 0x57, 0x49, 0x66, 0x96, 0x76, 0x27,
+      0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93,
+      0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95,
+      0x02, 0x88, 0x41, 0x97, 0x16, 0x93, 0x99, 0x37,
+      0x51, 0x05, 0x82, 0x09, 0x74, 0x94, 0x45, 0x92 }
+};
+
+static const unsigned char xts_test_du[4][16] =
+{
+    { 0x00 },
+    { 0x33, 0x33, 0x33, 0x33, 0x33 },
+    { 0xff },
+    { 0x9a, 0x78, 0x56, 0x34, 0x12 }
+};
+
+static const int xts_test_key_index[NB_TESTS] = { 0, 1, 2, 4, 5, 3, 3, 3, 3 };
+static const unsigned int xts_test_keysize[NB_TESTS] =
+    { 256, 256, 256, 256, 512, 256, 256, 256, 256 };
+static const int xts_test_du_index[NB_TESTS] = { 0, 1, 1, 0, 2, 3, 3, 3, 3 };
+static const int xts_test_pt_byte[NB_TESTS] = { 0x00, 0x44, 0x44, -1, -1, -1, -1, -1, -1 };
+static const size_t xts_test_len[NB_TESTS] = { 32, 32, 32, 512, 512, 17, 18, 19, 20 };
+static const int xts_test_ct_index[NB_TESTS] = { 0, 1, 2, 0, 1, 3, 4, 5, 6 };
+
+static const unsigned char xts_test_ct[7][32] =
+{
+    { 0x91, 0x7c, 0xf6, 0x9e, 0xbd, 0x68, 0xb2, 0xec,
+      0x9b, 0x9f, 0xe9, 0xa3, 0xea, 0xdd, 0xa6, 0x92,
+      0xcd, 0x43, 0xd2, 0xf5, 0x95, 0x98, 0xed, 0x85,
+      0x8c, 0x02, 0xc2, 0x65, 0x2f, 0xbf, 0x92, 0x2e },
+    { 0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e,
+      0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+      0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4,
+      0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0 },
+    { 0xaf, 0x85, 0x33, 0x6b, 0x59, 0x7a, 0xfc, 0x1a,
+      0x90, 0x0b, 0x2e, 0xb2, 0x1e, 0xc9, 0x49, 0xd2,
+      0x92, 0xdf, 0x4c, 0x04, 0x7e, 0x0b, 0x21, 0x53,
+      0x21, 0x86, 0xa5, 0x97, 0x1a, 0x22, 0x7a, 0x89 },
+    { 0x6c, 0x16, 0x25, 0xdb, 0x46, 0x71, 0x52, 0x2d,
+      0x3d, 0x75, 0x99, 0x60, 0x1d, 0xe7, 0xca, 0x09,
+      0xed },
+    { 0xd0, 0x69, 0x44, 0x4b, 0x7a, 0x7e, 0x0c, 0xab,
+      0x09, 0xe2, 0x44, 0x47, 0xd2, 0x4d, 0xeb, 0x1f,
+      0xed, 0xbf },
+    { 0xe5, 0xdf, 0x13, 0x51, 0xc0, 0x54, 0x4b, 0xa1,
+      0x35, 0x0b, 0x33, 0x63, 0xcd, 0x8e, 0xf4, 0xbe,
+      0xed, 0xbf, 0x9d },
+    { 0x9d, 0x84, 0xc8, 0x13, 0xf7, 0x19, 0xaa, 0x2c,
+      0x7b, 0xe3, 0xf6, 0x61, 0x71, 0xc7, 0xc5, 0xc2,
+      0xed, 0xbf, 0x9d, 0xac }
+};
+
+static const unsigned char xts_test_ct_long[2][512] =
+{
+    { 0x27, 0xa7, 0x47, 0x9b, 0xef, 0xa1, 0xd4, 0x76,
+      0x48, 0x9f, 0x30, 0x8c, 0xd4, 0xcf, 0xa6, 0xe2,
+      0xa9, 0x6e, 0x4b, 0xbe, 0x32, 0x08, 0xff, 0x25,
+      0x28, 0x7d, 0xd3, 0x81, 0x96, 0x16, 0xe8, 0x9c,
+      0xc7, 0x8c, 0xf7, 0xf5, 0xe5, 0x43, 0x44, 0x5f,
+      0x83, 0x33, 0xd8, 0xfa, 0x7f, 0x56, 0x00, 0x00,
+      0x05, 0x27, 0x9f, 0xa5, 0xd8, 0xb5, 0xe4, 0xad,
+      0x40, 0xe7, 0x36, 0xdd, 0xb4, 0xd3, 0x54, 0x12,
+      0x32, 0x80, 0x63, 0xfd, 0x2a, 0xab, 0x53, 0xe5,
+      0xea, 0x1e, 0x0a, 0x9f, 0x33, 0x25, 0x00, 0xa5,
+      0xdf, 0x94, 0x87, 0xd0, 0x7a, 0x5c, 0x92, 0xcc,
+      0x51, 0x2c, 0x88, 0x66, 0xc7, 0xe8, 0x60, 0xce,
+      0x93, 0xfd, 0xf1, 0x66, 0xa2, 0x49, 0x12, 0xb4,
+      0x22, 0x97, 0x61, 0x46, 0xae, 0x20, 0xce, 0x84,
+      0x6b, 0xb7, 0xdc, 0x9b, 0xa9, 0x4a, 0x76, 0x7a,
+      0xae, 0xf2, 0x0c, 0x0d, 0x61, 0xad, 0x02, 0x65,
+      0x5e, 0xa9, 0x2d, 0xc4, 0xc4, 0xe4, 0x1a, 0x89,
+      0x52, 0xc6, 0x51, 0xd3, 0x31, 0x74, 0xbe, 0x51,
+      0xa1, 0x0c, 0x42, 0x11, 0x10, 0xe6, 0xd8, 0x15,
+      0x88, 0xed, 0xe8, 0x21, 0x03, 0xa2, 0x52, 0xd8,
+      0xa7, 0x50, 0xe8, 0x76, 0x8d, 0xef, 0xff, 0xed,
+      0x91, 0x22, 0x81, 0x0a, 0xae, 0xb9, 0x9f, 0x91,
+      0x72, 0xaf, 0x82, 0xb6, 0x04, 0xdc, 0x4b, 0x8e,
+      0x51, 0xbc, 0xb0, 0x82, 0x35, 0xa6, 0xf4, 0x34,
+      0x13, 0x32, 0xe4, 0xca, 0x60, 0x48, 0x2a, 0x4b,
+      0xa1, 0xa0, 0x3b, 0x3e, 0x65, 0x00, 0x8f, 0xc5,
+      0xda, 0x76, 0xb7, 0x0b, 0xf1, 0x69, 0x0d, 0xb4,
+      0xea, 0xe2, 0x9c, 0x5f, 0x1b, 0xad, 0xd0, 0x3c,
+      0x5c, 0xcf, 0x2a, 0x55, 0xd7, 0x05, 0xdd, 0xcd,
+      0x86, 0xd4, 0x49, 0x51, 0x1c, 0xeb, 0x7e, 0xc3,
+      0x0b, 0xf1, 0x2b, 0x1f, 0xa3, 0x5b, 0x91, 0x3f,
+      0x9f, 0x74, 0x7a, 0x8a, 0xfd, 0x1b, 0x13, 0x0e,
+      0x94, 0xbf, 0xf9, 0x4e, 0xff, 0xd0, 0x1a, 0x91,
+      0x73, 0x5c, 0xa1, 0x72, 0x6a, 0xcd, 0x0b, 0x19,
+      0x7c, 0x4e, 0x5b, 0x03, 0x39, 0x36, 0x97, 0xe1,
+      0x26, 0x82, 0x6f, 0xb6, 0xbb, 0xde, 0x8e, 0xcc,
+      0x1e, 0x08, 0x29, 0x85, 0x16, 0xe2, 0xc9, 0xed,
+      0x03, 0xff, 0x3c, 0x1b, 0x78, 0x60, 0xf6, 0xde,
+      0x76, 0xd4, 0xce, 0xcd, 0x94, 0xc8, 0x11, 0x98,
+      0x55, 0xef, 0x52, 0x97, 0xca, 0x67, 0xe9, 0xf3,
+      0xe7, 0xff, 0x72, 0xb1, 0xe9, 0x97, 0x85, 0xca,
+      0x0a, 0x7e, 0x77, 0x20, 0xc5, 0xb3, 0x6d, 0xc6,
+      0xd7, 0x2c, 0xac, 0x95, 0x74, 0xc8, 0xcb, 0xbc,
+      0x2f, 0x80, 0x1e, 0x23, 0xe5, 0x6f, 0xd3, 0x44,
+      0xb0, 0x7f, 0x22, 0x15, 0x4b, 0xeb, 0xa0, 0xf0,
+      0x8c, 0xe8, 0x89, 0x1e, 0x64, 0x3e, 0xd9, 0x95,
+      0xc9, 0x4d, 0x9a, 0x69, 0xc9, 0xf1, 0xb5, 0xf4,
+      0x99, 0x02, 0x7a, 0x78, 0x57, 0x2a, 0xee, 0xbd,
+      0x74, 0xd2, 0x0c, 0xc3, 0x98, 0x81, 0xc2, 0x13,
+      0xee, 0x77, 0x0b, 0x10, 0x10, 0xe4, 0xbe, 0xa7,
+      0x18, 0x84, 0x69, 0x77, 0xae, 0x11, 0x9f, 0x7a,
+      0x02, 0x3a, 0xb5, 0x8c, 0xca, 0x0a, 0xd7, 0x52,
+      0xaf, 0xe6, 0x56, 0xbb, 0x3c, 0x17, 0x25, 0x6a,
+      0x9f, 0x6e, 0x9b, 0xf1, 0x9f, 0xdd, 0x5a, 0x38,
+      0xfc, 0x82, 0xbb, 0xe8, 0x72, 0xc5, 0x53, 0x9e,
+      0xdb, 0x60, 0x9e, 0xf4, 0xf7, 0x9c, 0x20, 0x3e,
+      0xbb, 0x14, 0x0f, 0x2e, 0x58, 0x3c, 0xb2, 0xad,
+      0x15, 0xb4, 0xaa, 0x5b, 0x65, 0x50, 0x16, 0xa8,
+      0x44, 0x92, 0x77, 0xdb, 0xd4, 0x77, 0xef, 0x2c,
+      0x8d, 0x6c, 0x01, 0x7d, 0xb7, 0x38, 0xb1, 0x8d,
+      0xeb, 0x4a, 0x42, 0x7d, 0x19, 0x23, 0xce, 0x3f,
+      0xf2, 0x62, 0x73, 0x57, 0x79, 0xa4, 0x18, 0xf2,
+      0x0a, 0x28, 0x2d, 0xf9, 0x20, 0x14, 0x7b, 0xea,
+      0xbe, 0x42, 0x1e, 0xe5, 0x31, 0x9d, 0x05, 0x68 },
+    { 0x1c, 0x3b, 0x3a, 0x10, 0x2f, 0x77, 0x03, 0x86,
+      0xe4, 0x83, 0x6c, 0x99, 0xe3, 0x70, 0xcf, 0x9b,
+      0xea, 0x00, 0x80, 0x3f, 0x5e, 0x48, 0x23, 0x57,
+      0xa4, 0xae, 0x12, 0xd4, 0x14, 0xa3, 0xe6, 0x3b,
+      0x5d, 0x31, 0xe2, 0x76, 0xf8, 0xfe, 0x4a, 0x8d,
+      0x66, 0xb3, 0x17, 0xf9, 0xac, 0x68, 0x3f, 0x44,
+      0x68, 0x0a, 0x86, 0xac, 0x35, 0xad, 0xfc, 0x33,
+      0x45, 0xbe, 0xfe, 0xcb, 0x4b, 0xb1, 0x88, 0xfd,
+      0x57, 0x76, 0x92, 0x6c, 0x49, 0xa3, 0x09, 0x5e,
+      0xb1, 0x08, 0xfd, 0x10, 0x98, 0xba, 0xec, 0x70,
+      0xaa, 0xa6, 0x69, 0x99, 0xa7, 0x2a, 0x82, 0xf2,
+      0x7d, 0x84, 0x8b, 0x21, 0xd4, 0xa7, 0x41, 0xb0,
+      0xc5, 0xcd, 0x4d, 0x5f, 0xff, 0x9d, 0xac, 0x89,
+      0xae, 0xba, 0x12, 0x29, 0x61, 0xd0, 0x3a, 0x75,
+      0x71, 0x23, 0xe9, 0x87, 0x0f, 0x8a, 0xcf, 0x10,
+      0x00, 0x02, 0x08, 0x87, 0x89, 0x14, 0x29, 0xca,
+      0x2a, 0x3e, 0x7a, 0x7d, 0x7d, 0xf7, 0xb1, 0x03,
+      0x55, 0x16, 0x5c, 0x8b, 0x9a, 0x6d, 0x0a, 0x7d,
+      0xe8, 0xb0, 0x62, 0xc4, 0x50, 0x0d, 0xc4, 0xcd,
+      0x12, 0x0c, 0x0f, 0x74, 0x18, 0xda, 0xe3, 0xd0,
+      0xb5, 0x78, 0x1c, 0x34, 0x80, 0x3f, 0xa7, 0x54,
+      0x21, 0xc7, 0x90, 0xdf, 0xe1, 0xde, 0x18, 0x34,
+      0xf2, 0x80, 0xd7, 0x66, 0x7b, 0x32, 0x7f, 0x6c,
+      0x8c, 0xd7, 0x55, 0x7e, 0x12, 0xac, 0x3a, 0x0f,
+      0x93, 0xec, 0x05, 0xc5, 0x2e, 0x04, 0x93, 0xef,
+      0x31, 0xa1, 0x2d, 0x3d, 0x92, 0x60, 0xf7, 0x9a,
+      0x28, 0x9d, 0x6a, 0x37, 0x9b, 0xc7, 0x0c, 0x50,
+      0x84, 0x14, 0x73, 0xd1, 0xa8, 0xcc, 0x81, 0xec,
+      0x58, 0x3e, 0x96, 0x45, 0xe0, 0x7b, 0x8d, 0x96,
+      0x70, 0x65, 0x5b, 0xa5, 0xbb, 0xcf, 0xec, 0xc6,
+      0xdc, 0x39, 0x66, 0x38, 0x0a, 0xd8, 0xfe, 0xcb,
+      0x17, 0xb6, 0xba, 0x02, 0x46, 0x9a, 0x02, 0x0a,
+      0x84, 0xe1, 0x8e, 0x8f, 0x84, 0x25, 0x20, 0x70,
+      0xc1, 0x3e, 0x9f, 0x1f, 0x28, 0x9b, 0xe5, 0x4f,
+      0xbc, 0x48, 0x14, 0x57, 0x77, 0x8f, 0x61, 0x60,
+      0x15, 0xe1, 0x32, 0x7a, 0x02, 0xb1, 0x40, 0xf1,
+      0x50, 0x5e, 0xb3, 0x09, 0x32, 0x6d, 0x68, 0x37,
+      0x8f, 0x83, 0x74, 0x59, 0x5c, 0x84, 0x9d, 0x84,
+      0xf4, 0xc3, 0x33, 0xec, 0x44, 0x23, 0x88, 0x51,
+      0x43, 0xcb, 0x47, 0xbd, 0x71, 0xc5, 0xed, 0xae,
+      0x9b, 0xe6, 0x9a, 0x2f, 0xfe, 0xce, 0xb1, 0xbe,
+      0xc9, 0xde, 0x24, 0x4f, 0xbe, 0x15, 0x99, 0x2b,
+      0x11, 0xb7, 0x7c, 0x04, 0x0f, 0x12, 0xbd, 0x8f,
+      0x6a, 0x97, 0x5a, 0x44, 0xa0, 0xf9, 0x0c, 0x29,
+      0xa9, 0xab, 0xc3, 0xd4, 0xd8, 0x93, 0x92, 0x72,
+      0x84, 0xc5, 0x87, 0x54, 0xcc, 0xe2, 0x94, 0x52,
+      0x9f, 0x86, 0x14, 0xdc, 0xd2, 0xab, 0xa9, 0x91,
+      0x92, 0x5f, 0xed, 0xc4, 0xae, 0x74, 0xff, 0xac,
+      0x6e, 0x33, 0x3b, 0x93, 0xeb, 0x4a, 0xff, 0x04,
+      0x79, 0xda, 0x9a, 0x41, 0x0e, 0x44, 0x50, 0xe0,
+      0xdd, 0x7a, 0xe4, 0xc6, 0xe2, 0x91, 0x09, 0x00,
+      0x57, 0x5d, 0xa4, 0x01, 0xfc, 0x07, 0x05, 0x9f,
+      0x64, 0x5e, 0x8b, 0x7e, 0x9b, 0xfd, 0xef, 0x33,
+      0x94, 0x30, 0x54, 0xff, 0x84, 0x01, 0x14, 0x93,
+      0xc2, 0x7b, 0x34, 0x29, 0xea, 0xed, 0xb4, 0xed,
+      0x53, 0x76, 0x44, 0x1a, 0x77, 0xed, 0x43, 0x85,
+      0x1a, 0xd7, 0x7f, 0x16, 0xf5, 0x41, 0xdf, 0xd2,
+      0x69, 0xd5, 0x0d, 0x6a, 0x5f, 0x14, 0xfb, 0x0a,
+      0xab, 0x1c, 0xbb, 0x4c, 0x15, 0x50, 0xbe, 0x97,
+      0xf7, 0xab, 0x40, 0x66, 0x19, 0x3c, 0x4c, 0xaa,
+      0x77, 0x3d, 0xad, 0x38, 0x01, 0x4b, 0xd2, 0x09,
+      0x2f, 0xa7, 0x55, 0xc8, 0x24, 0xbb, 0x5e, 0x54,
+      0xc4, 0xf3, 0x6f, 0xfd, 0xa9, 0xfc, 0xea, 0x70,
+      0xb9, 0xc6, 0xe6, 0x93, 0xe1, 0x48, 0xc1, 0x51 }
+};
+
+/*
+ * Sector batches: 19 sectors (8 + 8 + 3 through the batched tweaks)
+ * starting just below a 32-bit boundary, whole-block and
+ * ciphertext-stealing sector sizes, keys of vectors 4 and 10
+ */
+#define XTS_SECTORS     19
+#define XTS_SECTOR_BASE 0xfffffff9ULL
+
+static const size_t xts_sector_size[2] = { 512, 520 };
+
+/*
+ * Checkup routine
+ */
+int xts_self_test( int verbose )
+{
+    xts_context ctx;
+    unsigned char pt[512], out[520], du[16];
+    unsigned char *buf, *ref, *batch;
+    const unsigned char *key, *ct;
+    unsigned int keysize;
+    size_t len, sz, size = XTS_SECTORS * 520;
+    unsigned long long s;
+    int i, j, k, path, ret = 0;
+
+    if( ( buf = malloc( 3 * size ) ) == NULL )
+        return( 1 );
+
+    ref = buf + size;
+    batch = ref + size;
+
+    /*
+     * The AES-NI path (when available) and the aes_crypt_ecb path
+     */
+    for( path = CheckAESSupport() ? 1 : 0; path >= 0; path-- )
+    {
+        for( i = 0; i < NB_TESTS; i++ )
+        {
+            len = xts_test_len[i];
+            key = xts_test_key[xts_test_key_index[i]];
+            ct = ( len > 32 ) ? xts_test_ct_long[xts_test_ct_index[i]]
+                              : xts_test_ct[xts_test_ct_index[i]];
+
+            for( j = 0; j < (int) len; j++ )
+                pt[j] = (unsigned char)( xts_test_pt_byte[i] < 0 ? j : xts_test_pt_byte[i] );
+
+            if( verbose != 0 )
+                printf( "  XTS-AES-%3d #%d (%s): ", xts_test_keysize[i] / 2, i + 1,
+                        path ? "aesni" : "table" );
+
+            xts_setkey_enc( &ctx, key, xts_test_keysize[i] );
+            ctx.aesni = path;
+            xts_crypt( &ctx, AES_ENCRYPT, len, xts_test_du[xts_test_du_index[i]], pt, out );
+
+            if( memcmp( out, ct, len ) != 0 )
+                goto fail;
+
+            xts_setkey_dec( &ctx, key, xts_test_keysize[i] );
+            ctx.aesni = path;
+            xts_crypt( &ctx, AES_DECRYPT, len, xts_test_du[xts_test_du_index[i]], ct, out );
+
+            if( memcmp( out, pt, len ) != 0 )
+                goto fail;
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+    }
+
+    /*
+     * xts_crypt_sectors against one xts_crypt call per sector; the
+     * table path must also reproduce the AES-NI output
+     */
+    for( i = 0; i < 4; i++ )
+    {
+        sz = xts_sector_size[i & 1];
+        key = xts_test_key[( i < 2 ) ? 4 : 5];
+        keysize = ( i < 2 ) ? 256 : 512;
+
+        for( j = 0; j < (int)( XTS_SECTORS * sz ); j++ )
+            buf[j] = (unsigned char)( j * 7 + 3 );
+
+        for( path = CheckAESSupport() ? 1 : 0; path >= 0; path-- )
+        {
+            if( verbose != 0 )
+                printf( "  XTS-AES-%3d %d x %d (%s): ", keysize / 2, XTS_SECTORS,
+                        (int) sz, path ? "aesni" : "table" );
+
+            xts_setkey_enc( &ctx, key, keysize );
+            ctx.aesni = path;
+
+            for( j = 0; j < XTS_SECTORS; j++ )
+            {
+                s = XTS_SECTOR_BASE + j;
+                memset( du, 0, sizeof( du ) );
+                for( k = 0; k < 8; k++ )
+                    du[k] = (unsigned char)( s >> ( 8 * k ) );
+
+                xts_crypt( &ctx, AES_ENCRYPT, sz, du, buf + j * sz, out );
+
+                if( path == 0 && CheckAESSupport() &&
+                    memcmp( out, ref + j * sz, sz ) != 0 )
+                    goto fail;
+
+                memcpy( ref + j * sz, out, sz );
+            }
+
+            xts_crypt_sectors( &ctx, AES_ENCRYPT, sz, XTS_SECTORS, XTS_SECTOR_BASE,
+                               buf, batch );
+
+            if( memcmp( batch, ref, XTS_SECTORS * sz ) != 0 )
+                goto fail;
+
+            xts_setkey_dec( &ctx, key, keysize );
+            ctx.aesni = path;
+            xts_crypt_sectors( &ctx, AES_DECRYPT, sz, XTS_SECTORS, XTS_SECTOR_BASE,
+                               ref, batch );
+
+            if( memcmp( batch, buf, XTS_SECTORS * sz ) != 0 )
+                goto fail;
+
+            if( verbose != 0 )
+                printf( "passed\n" );
+        }
+    }
+
+    goto exit;
+
+fail:
+    if( verbose != 0 )
+        printf( "failed\n" );
+
+    ret = 1;
+
+exit:
+    free( buf );
+
+    if( verbose != 0 )
+        printf( "\n" );
+
+    return( ret );
+}
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * \file xts.h
+ *
+ * \brief XTS-AES (IEEE 1619) for sector-based storage encryption
+ *
+ * Uses the interleaved AES-NI kernels when the CPU has them and falls
+ * back to the table implementation (aes_crypt_ecb) otherwise.
+ */
+#ifndef POLARSSL_XTS_H
+#define POLARSSL_XTS_H
+
+#include <string.h>
+
+#include "aes.h"
+#include "aesni.h"
+
+/**
+ * \brief          XTS context structure
+ *
+ *                 setkey fills in both backends and turns `aesni` on
+ *                 when the CPU supports it; clearing it afterwards
+ *                 forces the table path.
+ */
+typedef struct
+{
+    int aesni;                  /*!<  nonzero: AES-NI path in use       */
+    aes_context ctx1;           /*!<  data key schedule (both backends) */
+    aes_context ctx2;           /*!<  tweak key schedule (both backends) */
+}
+xts_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          XTS key schedule (encryption)
+ *
+ * \param ctx      XTS context to be initialized
+ * \param key      data key followed by tweak key
+ * \param keysize  total key size in bits: 256 or 512
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int xts_setkey_enc( xts_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          XTS key schedule (decryption)
+ *
+ * \param ctx      XTS context to be initialized
+ * \param key      data key followed by tweak key
+ * \param keysize  total key size in bits: 256 or 512
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ */
+int xts_setkey_dec( xts_context *ctx, const unsigned char *key, unsigned int keysize );
+
+/**
+ * \brief          XTS-AES encryption/decryption of one data unit.
+ *                 Lengths that are not a multiple of 16 use
+ *                 ciphertext stealing.
+ *
+ * \param ctx      XTS context, set up with the matching setkey
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param length   length of the data unit, 16 bytes to 2^24 blocks
+ * \param data_unit  128-bit data unit number, little-endian
+ * \param input    buffer holding the input data
+ * \param output   buffer holding the output data
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int xts_crypt( xts_context *ctx,
+               int mode,
+               size_t length,
+               const unsigned char data_unit[16],
+               const unsigned char *input,
+               unsigned char *output );
+
+/**
+ * \brief          XTS-AES encryption/decryption of consecutive sectors.
+ *                 Sector i of the batch is data unit `sector + i`; the
+ *                 tweaks of up to 8 sectors are computed together.
+ *
+ * \param ctx      XTS context, set up with the matching setkey
+ * \param mode     AES_ENCRYPT or AES_DECRYPT
+ * \param sector_size  bytes per sector, 16 bytes to 2^24 blocks
+ * \param num_sectors  number of sectors in input and output
+ * \param sector   data unit number of the first sector
+ * \param input    buffer holding num_sectors * sector_size bytes
+ * \param output   buffer holding num_sectors * sector_size bytes
+ *
+ * \return         0 if successful, or POLARSSL_ERR_AES_INVALID_INPUT_LENGTH
+ */
+int xts_crypt_sectors( xts_context *ctx,
+                       int mode,
+                       size_t sector_size,
+                       size_t num_sectors,
+                       unsigned long long sector,
+                       const unsigned char *input,
+                       unsigned char *output );
+
+/**
+ * \brief          Checkup routine
+ *
+ * \return         0 if successful, or 1 if the test failed
+ */
+int xts_self_test( int verbose );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* xts.h */
@@ -36,77 +36,326 @@
 #if defined(POLARSSL_ARC4_C)
 
 #include "arc4.h"
+#include "xor.h"
+
+/*
+ * Key schedule and keystream kernels, generated per table cell type
+ * (CELL, stored in ctx->m.M), unroll factor and key length. Byte cells
+ * keep the table in four cache lines; 32-bit cells avoid byte loads and
+ * partial stores at sixteen. Which is faster depends on the CPU, so
+ * every combination is built and test.c measures them.
+ */
+typedef void (*arc4_setup_fn)( arc4_context *ctx, const unsigned char *key,
+                               unsigned int keylen );
+typedef void (*arc4_prep_fn)( arc4_context *ctx, size_t length,
+                              unsigned char *keystream );
+
+struct arc4_kernel
+{
+    const char *name;
+    arc4_setup_fn setup;
+    unsigned int keylen;        /*!< key length setup is fixed to, or 0 */
+    arc4_setup_fn setup_any;    /*!< same cells, any key length         */
+    arc4_prep_fn prep;
+};
+
+/*
+ * KEYLEN is keylen, or a constant that lets the inner loop unroll
+ */
+#define ARC4_SETUP( NAME, CELL, M, KEYLEN )                             \
+static void NAME( arc4_context *ctx, const unsigned char *key,          \
+                  unsigned int keylen )                                 \
+{                                                                       \
+    unsigned int i, j, k, a;                                            \
+    CELL *m = ctx->m.M;                                                 \
+                                                                        \
+    (void) keylen;                                                      \
+    ctx->x = 0;                                                         \
+    ctx->y = 0;                                                         \
+                                                                        \
+    for( i = 0; i < 256; i++ )                                          \
+        m[i] = (CELL) i;                                                \
+                                                                        \
+    for( i = j = 0; i < 256; )                                          \
+    {                                                                   \
+        for( k = 0; k < ( KEYLEN ) && i < 256; k++, i++ )               \
+        {                                                               \
+            a = m[i];                                                   \
+            j = ( j + a + key[k] ) & 0xFF;                              \
+            m[i] = m[j];                                                \
+            m[j] = (CELL) a;                                            \
+        }                                                               \
+    }                                                                   \
+}
+
+ARC4_SETUP( arc4_setup_u8,      unsigned char, b, keylen )
+ARC4_SETUP( arc4_setup_u8_k16,  unsigned char, b, 16 )
+ARC4_SETUP( arc4_setup_u32,     unsigned int,  w, keylen )
+ARC4_SETUP( arc4_setup_u32_k16, unsigned int,  w, 16 )
+
+/*
+ * One keystream byte at keystream[i + o]
+ */
+#define ARC4_STEP( o )                                                  \
+{                                                                       \
+    x = ( x + 1 ) & 0xFF; a = m[x];                                     \
+    y = ( y + a ) & 0xFF; b = m[y];                                     \
+    m[x] = (CELL) b;                                                    \
+    m[y] = (CELL) a;                                                    \
+    keystream[i + o] = (unsigned char) m[( a + b ) & 0xFF];             \
+}
+
+#define ARC4_UNROLL_1   ARC4_STEP( 0 )
+#define ARC4_UNROLL_2   ARC4_UNROLL_1 ARC4_STEP( 1 )
+#define ARC4_UNROLL_4   ARC4_UNROLL_2 ARC4_STEP( 2 ) ARC4_STEP( 3 )
+#define ARC4_UNROLL_8   ARC4_UNROLL_4 ARC4_STEP( 4 ) ARC4_STEP( 5 ) \
+                        ARC4_STEP( 6 ) ARC4_STEP( 7 )
+
+#define ARC4_PREP( NAME, CELL_T, M, U )                                 \
+static void NAME( arc4_context *ctx, size_t length,                     \
+                  unsigned char *keystream )                            \
+{                                                                       \
+    typedef CELL_T CELL;                                                \
+    unsigned int x = ctx->x, y = ctx->y, a, b;                          \
+    CELL *m = ctx->m.M;                                                 \
+    size_t i;                                                           \
+                                                                        \
+    for( i = 0; i + U <= length; i += U )                               \
+    {                                                                   \
+        ARC4_UNROLL_##U                                                 \
+    }                                                                   \
+                                                                        \
+    for( ; i < length; i++ )                                            \
+        ARC4_STEP( 0 )                                                  \
+                                                                        \
+    ctx->x = (int) x;                                                   \
+    ctx->y = (int) y;                                                   \
+}
+
+ARC4_PREP( arc4_prep_u8x1,  unsigned char, b, 1 )
+ARC4_PREP( arc4_prep_u8x2,  unsigned char, b, 2 )
+ARC4_PREP( arc4_prep_u8x4,  unsigned char, b, 4 )
+ARC4_PREP( arc4_prep_u8x8,  unsigned char, b, 8 )
+ARC4_PREP( arc4_prep_u32x1, unsigned int,  w, 1 )
+ARC4_PREP( arc4_prep_u32x2, unsigned int,  w, 2 )
+ARC4_PREP( arc4_prep_u32x4, unsigned int,  w, 4 )
+ARC4_PREP( arc4_prep_u32x8, unsigned int,  w, 8 )
+
+#define ARC4_KERNEL( C, U )                                             \
+    { "u" #C "x" #U,        arc4_setup_u##C,     0, arc4_setup_u##C,    \
+      arc4_prep_u##C##x##U },                                           \
+    { "u" #C "x" #U "-k16", arc4_setup_u##C##_k16, 16, arc4_setup_u##C, \
+      arc4_prep_u##C##x##U }
+
+static const arc4_kernel arc4_kernels[] =
+{
+    ARC4_KERNEL( 8, 1 ),  ARC4_KERNEL( 8, 2 ),
+    ARC4_KERNEL( 8, 4 ),  ARC4_KERNEL( 8, 8 ),
+    ARC4_KERNEL( 32, 1 ), ARC4_KERNEL( 32, 2 ),
+    ARC4_KERNEL( 32, 4 ), ARC4_KERNEL( 32, 8 ),
+};
+
+#define ARC4_KERNELS ( (int)( sizeof( arc4_kernels ) / sizeof( arc4_kernels[0] ) ) )
+
+static const arc4_kernel *arc4_current = &arc4_kernels[0];
+
+const char *arc4_kernel_name( int i )
+{
+    if( i < 0 )
+        return( arc4_current->name );
+
+    return( i < ARC4_KERNELS ? arc4_kernels[i].name : NULL );
+}
+
+int arc4_kernel_select( const char *name )
+{
+    int i;
+
+    for( i = 0; i < ARC4_KERNELS; i++ )
+    {
+        if( strcmp( arc4_kernels[i].name, name ) == 0 )
+        {
+            arc4_current = &arc4_kernels[i];
+            return( 0 );
+        }
+    }
+
+    return( POLARSSL_ERR_ARC4_BAD_INPUT_DATA );
+}
 
 /*
  * ARC4 key schedule
  */
 void arc4_setup( arc4_context *ctx, const unsigned char *key, unsigned int keylen )
 {
-    int i, j, a;
-    unsigned int k;
-    unsigned char *m;
+    ctx->kernel = arc4_current;
+
+    /* An empty key repeats key[0], as the byte-at-a-time schedule did */
+    if( keylen == 0 )
+        keylen = 1;
 
+    if( arc4_current->keylen != 0 && keylen != arc4_current->keylen )
+        arc4_current->setup_any( ctx, key, keylen );
+    else
+        arc4_current->setup( ctx, key, keylen );
+}
+
+/*
+ * ARC4 generate keystream function
+ */
+int arc4_prep( arc4_context *ctx, size_t length, unsigned char *keystream)
+{
+    ctx->kernel->prep( ctx, length, keystream );
+
+    return( 0 );
+}
+
+/*
+ * One KSA step of stream s at index i
+ */
+#define KSA_STEP( t, j, key, k, len )                   \
+{                                                       \
+    a = t[i];                                           \
+    j = ( j + a + key[k] ) & 0xFF;                      \
+    t[i] = t[j];                                        \
+    t[j] = (unsigned char) a;                           \
+    if( ++k >= len ) k = 0;                             \
+}
+
+/*
+ * ARC4 key schedule, n streams in lockstep. All streams walk the same i
+ * and only the swap partners differ, so four streams advanced together
+ * give four independent dependency chains.
+ */
+int arc4_multi_setup( arc4_multi_context *ctx, int n,
+                      const unsigned char *const key[], const unsigned int keylen[] )
+{
+    int i, s, a;
+    unsigned int j0, j1, j2, j3, k0, k1, k2, k3;
+    unsigned char *t0, *t1, *t2, *t3;
+
+    if( n < 1 || n > ARC4_MULTI_MAX )
+        return( POLARSSL_ERR_ARC4_BAD_INPUT_DATA );
+
+    for( s = 0; s < n; s++ )
+        if( keylen[s] == 0 )
+            return( POLARSSL_ERR_ARC4_BAD_INPUT_DATA );
+
+    ctx->n = n;
     ctx->x = 0;
-    ctx->y = 0;
-    m = ctx->m;
+    memset( ctx->y, 0, sizeof( ctx->y ) );
 
-    for( i = 0; i < 256; i++ )
-        m[i] = (unsigned char) i;
+    for( s = 0; s < n; s++ )
+        for( i = 0; i < 256; i++ )
+            ctx->m[s][i] = (unsigned char) i;
 
-    j = k = 0;
+    for( s = 0; s + 4 <= n; s += 4 )
+    {
+        t0 = ctx->m[s];     t1 = ctx->m[s + 1];
+        t2 = ctx->m[s + 2]; t3 = ctx->m[s + 3];
+        j0 = j1 = j2 = j3 = k0 = k1 = k2 = k3 = 0;
+
+        for( i = 0; i < 256; i++ )
+        {
+            KSA_STEP( t0, j0, key[s],     k0, keylen[s] );
+            KSA_STEP( t1, j1, key[s + 1], k1, keylen[s + 1] );
+            KSA_STEP( t2, j2, key[s + 2], k2, keylen[s + 2] );
+            KSA_STEP( t3, j3, key[s + 3], k3, keylen[s + 3] );
+        }
+    }
 
-    for( i = 0; i < 256; i++, k++ )
+    for( ; s < n; s++ )
     {
-        if( k >= keylen ) k = 0;
+        t0 = ctx->m[s];
+        j0 = k0 = 0;
 
-        a = m[i];
-        j = ( j + a + key[k] ) & 0xFF;
-        m[i] = m[j];
-        m[j] = (unsigned char) a;
+        for( i = 0; i < 256; i++ )
+            KSA_STEP( t0, j0, key[s], k0, keylen[s] );
     }
+
+    return( 0 );
 }
 
 /*
- * ARC4 generate keystream function
+ * One PRGA step of stream s, x already advanced
  */
-int arc4_prep( arc4_context *ctx, size_t length, unsigned char *keystream)
+#define PRGA_STEP( t, y, out )                          \
+{                                                       \
+    a = t[x];                                           \
+    y = ( y + a ) & 0xFF;                               \
+    b = t[y];                                           \
+    t[x] = (unsigned char) b;                           \
+    t[y] = (unsigned char) a;                           \
+    out[i] = t[( a + b ) & 0xFF];                       \
+}
+
+/*
+ * ARC4 keystream, n streams in lockstep, four at a time: the four
+ * y chains are independent, so their loads and swaps overlap where a
+ * single stream waits on each one. The indices and output pointers of a
+ * group stay in registers; a remainder of fewer than four streams runs
+ * one by one.
+ */
+int arc4_multi_prep( arc4_multi_context *ctx, size_t length, unsigned char *const keystream[] )
 {
-    int x, y, a, b;
+    int x, s, a, b;
     size_t i;
-    unsigned char *m;
+    unsigned int y0, y1, y2, y3;
+    unsigned char *t0, *t1, *t2, *t3;
+    unsigned char *o0, *o1, *o2, *o3;
+
+    for( s = 0; s + 4 <= ctx->n; s += 4 )
+    {
+        t0 = ctx->m[s];     t1 = ctx->m[s + 1];
+        t2 = ctx->m[s + 2]; t3 = ctx->m[s + 3];
+        o0 = keystream[s];     o1 = keystream[s + 1];
+        o2 = keystream[s + 2]; o3 = keystream[s + 3];
+        y0 = ctx->y[s];     y1 = ctx->y[s + 1];
+        y2 = ctx->y[s + 2]; y3 = ctx->y[s + 3];
+        x = ctx->x;
+
+        for( i = 0; i < length; i++ )
+        {
+            x = ( x + 1 ) & 0xFF;
+            PRGA_STEP( t0, y0, o0 );
+            PRGA_STEP( t1, y1, o1 );
+            PRGA_STEP( t2, y2, o2 );
+            PRGA_STEP( t3, y3, o3 );
+        }
 
-    x = ctx->x;
-    y = ctx->y;
-    m = ctx->m;
+        ctx->y[s]     = (unsigned char) y0; ctx->y[s + 1] = (unsigned char) y1;
+        ctx->y[s + 2] = (unsigned char) y2; ctx->y[s + 3] = (unsigned char) y3;
+    }
 
-    for( i = 0; i < length; i++ )
+    for( ; s < ctx->n; s++ )
     {
-        x = ( x + 1 ) & 0xFF; a = m[x];
-        y = ( y + a ) & 0xFF; b = m[y];
+        t0 = ctx->m[s];
+        o0 = keystream[s];
+        y0 = ctx->y[s];
+        x = ctx->x;
 
-        m[x] = (unsigned char) b;
-        m[y] = (unsigned char) a;
+        for( i = 0; i < length; i++ )
+        {
+            x = ( x + 1 ) & 0xFF;
+            PRGA_STEP( t0, y0, o0 );
+        }
 
-        keystream[i] = m[(unsigned char)( a + b )];
+        ctx->y[s] = (unsigned char) y0;
     }
 
-    ctx->x = x;
-    ctx->y = y;
+    ctx->x = (int)( ( ctx->x + length ) & 0xFF );
 
     return( 0 );
 }
+
 /*
- * ARC4 cipher function
+ * ARC4 cipher function: the keystream is precomputed, so this is the
+ * shared SIMD XOR and runs at memory speed
  */
 int arc4_crypt( size_t length, const unsigned char *input, unsigned char *keystream,
 				unsigned char *output )
 {
-    size_t i;
-
-    for( i = 0; i < length; i++ )
-    {
-        output[i] = (unsigned char) input[i] ^ keystream[i];
-    }
+    xor_keystream( output, input, keystream, length );
 
     return( 0 );
 }
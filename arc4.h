@@ -29,17 +29,50 @@
 
 #include <string.h>
 
+#define ARC4_MULTI_MAX  16      /**< streams per arc4_multi_context */
+
+#define POLARSSL_ERR_ARC4_BAD_INPUT_DATA                   -0x0019  /**< Bad input parameters to function. */
+
+typedef struct arc4_kernel arc4_kernel;
+
 /**
  * \brief          ARC4 context structure
+ *
+ *                 The table holds bytes or 32-bit cells, depending on the
+ *                 kernel that arc4_setup picked; the context keeps using
+ *                 that kernel even if another one is selected later.
  */
 typedef struct
 {
     int x;                      /*!< permutation index */
     int y;                      /*!< permutation index */
-    unsigned char m[256];       /*!< permutation table */
+    const arc4_kernel *kernel;  /*!< kernel from arc4_setup */
+    union
+    {
+        unsigned char b[256];
+        unsigned int w[256];
+    }
+    m;                          /*!< permutation table */
 }
 arc4_context;
 
+/**
+ * \brief          Context for n independent ARC4 streams run in lockstep
+ *
+ *                 All streams share the index x; each has its own y and
+ *                 its own permutation table. The streams advance four at
+ *                 a time, one step each per iteration, so the serial
+ *                 chain of one stream overlaps with three others.
+ */
+typedef struct
+{
+    int n;                                  /*!< number of streams        */
+    int x;                                  /*!< shared permutation index */
+    unsigned char y[ARC4_MULTI_MAX];        /*!< per-stream index         */
+    unsigned char m[ARC4_MULTI_MAX][256];   /*!< per-stream tables        */
+}
+arc4_multi_context;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -55,6 +88,53 @@ void arc4_setup( arc4_context *ctx, const unsigned char *key, unsigned int keyle
 
 int arc4_prep( arc4_context *ctx, size_t length, unsigned char *keystream);
 
+/**
+ * \brief          Name of a key schedule/keystream kernel
+ *
+ *                 Kernels are named u<cell bits>x<unroll>, with a -k16
+ *                 suffix for a key schedule specialized to 16-byte keys
+ *                 (other key lengths fall back to the generic one).
+ *
+ * \param i        index from 0, or -1 for the kernel in use
+ *
+ * \return         the name, or NULL past the last kernel
+ */
+const char *arc4_kernel_name( int i );
+
+/**
+ * \brief          Use another kernel for the following arc4_setup calls
+ *
+ * \param name     kernel name, as returned by arc4_kernel_name
+ *
+ * \return         0 if successful, or POLARSSL_ERR_ARC4_BAD_INPUT_DATA
+ */
+int arc4_kernel_select( const char *name );
+
+/**
+ * \brief          ARC4 key schedule for n streams at once
+ *
+ * \param ctx      context to be initialized
+ * \param n        number of streams, 1 to ARC4_MULTI_MAX
+ * \param key      n secret keys
+ * \param keylen   n key lengths
+ *
+ * \return         0 if successful, or POLARSSL_ERR_ARC4_BAD_INPUT_DATA
+ */
+int arc4_multi_setup( arc4_multi_context *ctx, int n,
+                      const unsigned char *const key[], const unsigned int keylen[] );
+
+/**
+ * \brief          Next `length` keystream bytes of every stream
+ *
+ * \param ctx      context from arc4_multi_setup
+ * \param length   bytes per stream
+ * \param keystream n output buffers of `length` bytes; buffer s gets the
+ *                 same bytes as arc4_prep on stream s alone
+ *
+ * \return         0 if successful
+ */
+int arc4_multi_prep( arc4_multi_context *ctx, size_t length, unsigned char *const keystream[] );
+
 //TODO: Comments are deprecated here.
 /**
  * \brief          ARC4 cipher function
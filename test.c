@@ -4,8 +4,10 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sched.h>
 
 #include "arc4.h"
+#include "xor.h"
 #include "util.h"
 
 #define ITERATIONS 10
@@ -125,12 +127,340 @@ void rc4_test(int msg_length, int num_thread) {
 	printf("\n");
 }
 
+/*
+ * Streaming mode: instead of a keystream buffer as long as the message,
+ * one producer thread runs arc4_prep into a ring of RING_SLOTS chunks of
+ * RING_CHUNK bytes (about an L2 cache each), and the consumer threads XOR
+ * chunks as they become ready. Keystream memory is fixed and generation
+ * overlaps with the XOR.
+ *
+ * Slot c % RING_SLOTS carries chunk c. Its sequence number is c when the
+ * slot is free for chunk c, c + 1 once the keystream is in, and goes to
+ * c + RING_SLOTS when the chunk has been consumed.
+ */
+#define RING_CHUNK (256 * 1024)
+#define RING_SLOTS 8
+
+typedef struct {
+	unsigned long seq;
+} __attribute__((aligned(64))) RingSlot;
+
+typedef struct {
+	RingSlot slot[RING_SLOTS];
+	unsigned long next __attribute__((aligned(64)));	//next chunk to hand to a consumer
+	unsigned long chunks;
+	unsigned char *buf;
+} KeystreamRing;
+
+KeystreamRing ring;
+
+static void ring_wait(unsigned long *seq, unsigned long want) {
+	while(__atomic_load_n(seq, __ATOMIC_ACQUIRE) != want)
+		sched_yield();
+}
+
+void* rc4_producer_thread(void *a) {
+	for(unsigned long c = 0; c < ring.chunks; c++) {
+		RingSlot *slot = &ring.slot[c % RING_SLOTS];
+		size_t len = MESSAGE_LENGTH - c * RING_CHUNK;
+		
+		if(len > RING_CHUNK)
+			len = RING_CHUNK;
+		
+		ring_wait(&slot->seq, c);
+		arc4_prep(&rc4_ctx, len, ring.buf + (c % RING_SLOTS) * RING_CHUNK);
+		__atomic_store_n(&slot->seq, c + 1, __ATOMIC_RELEASE);
+	}
+	
+	return NULL;
+}
+
+void* rc4_consumer_thread(void *a) {
+	for(;;) {
+		unsigned long c = __atomic_fetch_add(&ring.next, 1, __ATOMIC_RELAXED);
+		RingSlot *slot = &ring.slot[c % RING_SLOTS];
+		size_t len = MESSAGE_LENGTH - c * RING_CHUNK;
+		
+		if(c >= ring.chunks)
+			break;
+		if(len > RING_CHUNK)
+			len = RING_CHUNK;
+		
+		ring_wait(&slot->seq, c + 1);
+		arc4_crypt(len, msg + c * RING_CHUNK, ring.buf + (c % RING_SLOTS) * RING_CHUNK,
+				   out + c * RING_CHUNK);
+		__atomic_store_n(&slot->seq, c + RING_SLOTS, __ATOMIC_RELEASE);
+	}
+	
+	return NULL;
+}
+
+//Same as rc4_test, but each timed run includes the keystream, from a fresh key
+void rc4_stream_test(int msg_length, int num_thread) {
+	printf("RC4 stream, %d, %d, ", msg_length, num_thread);
+
+	MESSAGE_LENGTH = msg_length;
+
+	msg = malloc(MESSAGE_LENGTH);
+	out = malloc(MESSAGE_LENGTH);
+	ring.buf = malloc(RING_SLOTS * RING_CHUNK);
+	ring.chunks = (MESSAGE_LENGTH + RING_CHUNK - 1) / RING_CHUNK;
+	
+	for(int i = 0; i < MESSAGE_LENGTH; i++) {
+		msg[i] = rand() % 255;
+	}
+
+	for(int iter = 0; iter < ITERATIONS; iter++) {
+		
+		struct timeval start, end;
+		pthread_t producer;
+		pthread_t threads[num_thread];
+		
+		for(int i = 0; i < KEY_LENGTH_BYTES; i++) {
+			key[i] = rand() % 255;
+		}
+		for(int i = 0; i < RING_SLOTS; i++) {
+			ring.slot[i].seq = i;
+		}
+		ring.next = 0;
+	
+		gettimeofday(&start, NULL);
+		
+		arc4_setup( &rc4_ctx, key, KEY_LENGTH_BYTES);
+		pthread_create(&producer, NULL, rc4_producer_thread, NULL);
+		for(int tid = 0; tid < num_thread; tid++) {
+			pthread_create(&threads[tid], NULL, rc4_consumer_thread, NULL);
+		}
+		
+		pthread_join(producer, NULL);
+		for(int tid = 0; tid < num_thread; tid++) {
+			pthread_join(threads[tid], NULL);
+		}
+		
+		gettimeofday(&end, NULL);
+		
+		print_time_diff(start, end);	
+	}
+	
+	MESSAGE_LENGTH = 0;
+
+	free(msg);
+	free(out);
+	free(ring.buf);
+	
+	printf("\n");
+}
+
+
+#define XOR_BIG (256 * 1048576)
+#define XOR_SMALL (64 * 1024)
+
+/*
+ * The XOR stage alone, per kernel: a XOR_BIG buffer (non-temporal stores)
+ * next to memcpy of the same size, which bounds what memory allows, and a
+ * cache-resident XOR_SMALL buffer repeated to the same volume.
+ */
+void xor_kernel_test(void) {
+	static const char *kernels[] = { "avx512", "avx2", "sse2", "generic" };
+	const char *chosen = xor_kernel_name();
+	unsigned char *a = malloc(XOR_BIG), *b = malloc(XOR_BIG), *c = malloc(XOR_BIG);
+	struct timeval start, end;
+	long long useconds;
+	
+	memset(a, 0x3C, XOR_BIG);
+	memset(b, 0x5A, XOR_BIG);
+	memset(c, 0, XOR_BIG);
+	
+	gettimeofday(&start, NULL);
+	memcpy(c, a, XOR_BIG);
+	gettimeofday(&end, NULL);
+	useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+	printf("XOR kernel, memcpy, %.1f MB/s\n", (double) XOR_BIG / useconds);
+	
+	for(int k = 0; k < 4; k++) {
+		double big, small;
+		
+		if(xor_kernel_select(kernels[k]) != 0)
+			continue;
+		
+		gettimeofday(&start, NULL);
+		xor_keystream(c, a, b, XOR_BIG);
+		gettimeofday(&end, NULL);
+		useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+		big = (double) XOR_BIG / useconds;
+		
+		gettimeofday(&start, NULL);
+		for(int r = 0; r < XOR_BIG / XOR_SMALL; r++)
+			xor_keystream(c, a, b, XOR_SMALL);
+		gettimeofday(&end, NULL);
+		useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+		small = (double) XOR_BIG / useconds;
+		
+		printf("XOR kernel, %s, %.1f MB/s, in cache %.1f MB/s\n", kernels[k], big, small);
+	}
+	
+	xor_kernel_select(chosen);
+	free(a);
+	free(b);
+	free(c);
+}
+
+#define MULTI_STREAMS 4096
+
+/*
+ * Keystream for MULTI_STREAMS independent streams with their own keys,
+ * e.g. one per packet: one arc4_setup/arc4_prep pair per stream, then
+ * arc4_multi_setup/arc4_multi_prep over groups of n streams. The key
+ * schedule is timed too, since every stream needs its own. Prints MB/s
+ * of keystream across all streams. Every stream is checked against
+ * arc4_setup/arc4_prep output computed up front.
+ */
+void rc4_multi_test(int stream_length) {
+	unsigned char *keys = malloc(MULTI_STREAMS * KEY_LENGTH_BYTES);
+	unsigned char *ref = malloc((size_t) MULTI_STREAMS * stream_length);
+	unsigned char *buf = malloc((size_t) MULTI_STREAMS * stream_length);
+	const unsigned char *key_ptr[ARC4_MULTI_MAX];
+	unsigned int key_len[ARC4_MULTI_MAX];
+	unsigned char *ks_ptr[ARC4_MULTI_MAX];
+	arc4_multi_context multi;
+	arc4_context ctx;
+	struct timeval start, end;
+	
+	for(int i = 0; i < MULTI_STREAMS * KEY_LENGTH_BYTES; i++) {
+		keys[i] = rand() % 255;
+	}
+	
+	for(int s = 0; s < MULTI_STREAMS; s++) {
+		arc4_setup(&ctx, keys + s * KEY_LENGTH_BYTES, KEY_LENGTH_BYTES);
+		arc4_prep(&ctx, stream_length, ref + (size_t) s * stream_length);
+	}
+	
+	for(int n = 1; n <= ARC4_MULTI_MAX; n *= 2) {
+		if(n == 2)
+			continue;
+		
+		gettimeofday(&start, NULL);
+		for(int s = 0; s < MULTI_STREAMS; s += n) {
+			if(n == 1) {
+				arc4_setup(&ctx, keys + s * KEY_LENGTH_BYTES, KEY_LENGTH_BYTES);
+				arc4_prep(&ctx, stream_length, buf + (size_t) s * stream_length);
+				continue;
+			}
+			for(int i = 0; i < n; i++) {
+				key_ptr[i] = keys + (s + i) * KEY_LENGTH_BYTES;
+				key_len[i] = KEY_LENGTH_BYTES;
+				ks_ptr[i] = buf + (size_t)(s + i) * stream_length;
+			}
+			arc4_multi_setup(&multi, n, key_ptr, key_len);
+			arc4_multi_prep(&multi, stream_length, ks_ptr);
+		}
+		gettimeofday(&end, NULL);
+		
+		long long useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+		
+		for(int s = 0; s < MULTI_STREAMS; s++) {
+			if(memcmp(ref + (size_t) s * stream_length, buf + (size_t) s * stream_length, stream_length) != 0) {
+				printf("RC4 multi-key, %d, %d streams, stream %d keystream mismatch\n", stream_length, n, s);
+				break;
+			}
+		}
+		
+		if(n == 1)
+			printf("RC4 multi-key, %d, sequential, ", stream_length);
+		else
+			printf("RC4 multi-key, %d, %d streams, ", stream_length, n);
+		printf("%.1f MB/s\n", (double) MULTI_STREAMS * stream_length / useconds);
+	}
+	
+	free(keys);
+	free(ref);
+	free(buf);
+}
+
+#define KERNEL_STREAM (64 * 1048576)
+#define KERNEL_PACKETS 16384
+#define KERNEL_PACKET 256
+
+/*
+ * Every arc4_kernel_name variant on two workloads: one key and a
+ * KERNEL_STREAM keystream, and KERNEL_PACKETS keys of KERNEL_PACKET bytes
+ * each, where the key schedule dominates. Each kernel's keystream is
+ * checked against the first one; the fastest per workload is reported.
+ */
+void rc4_kernel_test(void) {
+	char chosen[32];
+	unsigned char *keys = malloc(KERNEL_PACKETS * KEY_LENGTH_BYTES);
+	unsigned char *ref = malloc(KERNEL_STREAM);
+	unsigned char *buf = malloc(KERNEL_STREAM);
+	const char *name, *best_stream = NULL, *best_packet = NULL;
+	double stream_rate, packet_rate, best_stream_rate = 0, best_packet_rate = 0;
+	arc4_context ctx;
+	struct timeval start, end;
+	long long useconds;
+	
+	strcpy(chosen, arc4_kernel_name(-1));
+	for(int i = 0; i < KERNEL_PACKETS * KEY_LENGTH_BYTES; i++) {
+		keys[i] = rand() % 255;
+	}
+	
+	for(int k = 0; (name = arc4_kernel_name(k)) != NULL; k++) {
+		arc4_kernel_select(name);
+		
+		gettimeofday(&start, NULL);
+		arc4_setup(&ctx, keys, KEY_LENGTH_BYTES);
+		arc4_prep(&ctx, KERNEL_STREAM, buf);
+		gettimeofday(&end, NULL);
+		useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+		stream_rate = (double) KERNEL_STREAM / useconds;
+		
+		if(k == 0)
+			memcpy(ref, buf, KERNEL_STREAM);
+		else if(memcmp(ref, buf, KERNEL_STREAM) != 0)
+			printf("RC4 kernel, %s, keystream mismatch\n", name);
+		
+		gettimeofday(&start, NULL);
+		for(int p = 0; p < KERNEL_PACKETS; p++) {
+			arc4_setup(&ctx, keys + p * KEY_LENGTH_BYTES, KEY_LENGTH_BYTES);
+			arc4_prep(&ctx, KERNEL_PACKET, buf + (size_t) p * KERNEL_PACKET);
+		}
+		gettimeofday(&end, NULL);
+		useconds = 1000000LL * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec);
+		packet_rate = (double) KERNEL_PACKETS * KERNEL_PACKET / useconds;
+		
+		printf("RC4 kernel, %s, %.1f MB/s, %d-byte packets %.1f MB/s\n",
+			name, stream_rate, KERNEL_PACKET, packet_rate);
+		
+		if(stream_rate > best_stream_rate) {
+			best_stream_rate = stream_rate;
+			best_stream = name;
+		}
+		if(packet_rate > best_packet_rate) {
+			best_packet_rate = packet_rate;
+			best_packet = name;
+		}
+	}
+	
+	printf("RC4 kernel, fastest stream: %s, fastest %d-byte packets: %s\n",
+		best_stream, KERNEL_PACKET, best_packet);
+	
+	arc4_kernel_select(chosen);
+	free(keys);
+	free(ref);
+	free(buf);
+}
+
 
 int main(int argc, char* argv[]){
 
 	srand(1337);
 	//setbuf(stdout, NULL);
 	
+	printf("## XOR kernel: %s\n", xor_kernel_name());
+	xor_kernel_test();
+	
+	printf("## RC4 kernel: %s\n", arc4_kernel_name(-1));
+	rc4_kernel_test();
+	
 	
 	rc4_test(1048576, 1);
 	rc4_test(1048576, 2);
@@ -152,6 +482,32 @@ int main(int argc, char* argv[]){
 	rc4_test(1048576000, 4);
 	rc4_test(1048576000, 8);	
 	
+	//keystream from a fixed ring, overlapped with the XOR
+	rc4_stream_test(1048576, 1);
+	rc4_stream_test(1048576, 2);
+	rc4_stream_test(1048576, 4);
+	rc4_stream_test(1048576, 8);
+
+	rc4_stream_test(10485760, 1);
+	rc4_stream_test(10485760, 2);
+	rc4_stream_test(10485760, 4);
+	rc4_stream_test(10485760, 8);
+	
+	rc4_stream_test(104857600, 1);
+	rc4_stream_test(104857600, 2);
+	rc4_stream_test(104857600, 4);
+	rc4_stream_test(104857600, 8);
+	
+	rc4_stream_test(1048576000, 1);
+	rc4_stream_test(1048576000, 2);
+	rc4_stream_test(1048576000, 4);
+	rc4_stream_test(1048576000, 8);
+	
+	//thousands of short per-packet streams: one at a time vs n in lockstep
+	rc4_multi_test(64);
+	rc4_multi_test(1500);
+	rc4_multi_test(4096);
+	
 	//arc4_self_test( 1 );
 	arc4_self_test( 2 );
 	return 0;
@@ -0,0 +1,243 @@
+/*
+ *  Keystream application kernels
+ *
+ *  Each kernel XORs scalar bytes until the output is aligned to its
+ *  vector width, then runs four vectors per iteration with unaligned
+ *  loads and aligned stores (streaming stores past the non-temporal
+ *  threshold, fenced before returning), and finishes the last partial
+ *  vector in 8-byte words and bytes. The AVX2 and AVX-512 kernels are
+ *  compiled through target attributes, so the file builds without -m
+ *  flags and the same binary runs on any x86-64 host.
+ */
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include "xor.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define XOR_X86
+#include <immintrin.h>
+#endif
+
+#define XOR_NT_DEFAULT  ( 8 * 1048576 )     /**< if the LLC size is unknown */
+
+typedef void (*xor_fn)( unsigned char *output, const unsigned char *input,
+                        const unsigned char *keystream, size_t length, int nt );
+
+/*
+ * Bytes and native words, for heads, tails and hosts without SIMD
+ */
+static void xor_generic( unsigned char *output, const unsigned char *input,
+                         const unsigned char *keystream, size_t length, int nt )
+{
+    uint64_t a, b;
+    size_t i = 0;
+
+    (void) nt;
+
+    for( ; i + 8 <= length; i += 8 )
+    {
+        memcpy( &a, input + i, 8 );
+        memcpy( &b, keystream + i, 8 );
+        a ^= b;
+        memcpy( output + i, &a, 8 );
+    }
+
+    for( ; i < length; i++ )
+        output[i] = (unsigned char)( input[i] ^ keystream[i] );
+}
+
+/*
+ * Bytes to XOR before output is aligned to `width`
+ */
+static size_t xor_head( const unsigned char *output, size_t width, size_t length )
+{
+    size_t head = ( width - ( (uintptr_t) output & ( width - 1 ) ) ) & ( width - 1 );
+
+    return( head < length ? head : length );
+}
+
+#if defined(XOR_X86)
+
+#define XOR_AVX2    __attribute__ ((target ("avx2")))
+#define XOR_AVX512  __attribute__ ((target ("avx512f")))
+
+/*
+ * One kernel per width: V is the vector type, LOAD/XOR/STORE/STREAM
+ * its intrinsics
+ */
+#define XOR_KERNEL( NAME, ATTR, W, V, LOAD, XOR, STORE, STREAM )                 \
+ATTR static void NAME( unsigned char *output, const unsigned char *input,        \
+                       const unsigned char *keystream, size_t length, int nt )   \
+{                                                                                \
+    size_t i = xor_head( output, W, length );                                    \
+    V a0, a1, a2, a3;                                                            \
+                                                                                 \
+    xor_generic( output, input, keystream, i, 0 );                               \
+                                                                                 \
+    if( nt )                                                                     \
+    {                                                                            \
+        for( ; i + 4 * W <= length; i += 4 * W )                                 \
+        {                                                                        \
+            a0 = XOR( LOAD( (const V *)( input + i ) ),                          \
+                      LOAD( (const V *)( keystream + i ) ) );                    \
+            a1 = XOR( LOAD( (const V *)( input + i + W ) ),                      \
+                      LOAD( (const V *)( keystream + i + W ) ) );                \
+            a2 = XOR( LOAD( (const V *)( input + i + 2 * W ) ),                  \
+                      LOAD( (const V *)( keystream + i + 2 * W ) ) );            \
+            a3 = XOR( LOAD( (const V *)( input + i + 3 * W ) ),                  \
+                      LOAD( (const V *)( keystream + i + 3 * W ) ) );            \
+            STREAM( (V *)( output + i ), a0 );                                   \
+            STREAM( (V *)( output + i + W ), a1 );                               \
+            STREAM( (V *)( output + i + 2 * W ), a2 );                           \
+            STREAM( (V *)( output + i + 3 * W ), a3 );                           \
+        }                                                                        \
+        _mm_sfence();                                                            \
+    }                                                                            \
+                                                                                 \
+    for( ; i + 4 * W <= length; i += 4 * W )                                     \
+    {                                                                            \
+        a0 = XOR( LOAD( (const V *)( input + i ) ),                              \
+                  LOAD( (const V *)( keystream + i ) ) );                        \
+        a1 = XOR( LOAD( (const V *)( input + i + W ) ),                          \
+                  LOAD( (const V *)( keystream + i + W ) ) );                    \
+        a2 = XOR( LOAD( (const V *)( input + i + 2 * W ) ),                      \
+                  LOAD( (const V *)( keystream + i + 2 * W ) ) );                \
+        a3 = XOR( LOAD( (const V *)( input + i + 3 * W ) ),                      \
+                  LOAD( (const V *)( keystream + i + 3 * W ) ) );                \
+        STORE( (V *)( output + i ), a0 );                                        \
+        STORE( (V *)( output + i + W ), a1 );                                    \
+        STORE( (V *)( output + i + 2 * W ), a2 );                                \
+        STORE( (V *)( output + i + 3 * W ), a3 );                                \
+    }                                                                            \
+                                                                                 \
+    for( ; i + W <= length; i += W )                                             \
+        STORE( (V *)( output + i ), XOR( LOAD( (const V *)( input + i ) ),       \
+                                         LOAD( (const V *)( keystream + i ) ) ) ); \
+                                                                                 \
+    xor_generic( output + i, input + i, keystream + i, length - i, 0 );          \
+}
+
+XOR_KERNEL( xor_sse2, , 16, __m128i, _mm_loadu_si128, _mm_xor_si128,
+            _mm_store_si128, _mm_stream_si128 )
+XOR_KERNEL( xor_avx2, XOR_AVX2, 32, __m256i, _mm256_loadu_si256, _mm256_xor_si256,
+            _mm256_store_si256, _mm256_stream_si256 )
+XOR_KERNEL( xor_avx512, XOR_AVX512, 64, __m512i, _mm512_loadu_si512, _mm512_xor_si512,
+            _mm512_store_si512, _mm512_stream_si512 )
+
+#define cpuid_count(func,sub,ax,bx,cx,dx)\
+		__asm__ __volatile__ ("cpuid":\
+		"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func), "c" (sub))
+
+/*
+ * AVX2 and AVX-512 need the CPU flag and the OS saving the registers
+ */
+static int xor_width( void )
+{
+    unsigned int a, b, c, d, xcr0, xcr0_hi;
+
+    cpuid_count( 0, 0, a, b, c, d );
+    if( a < 7 )
+        return( 16 );
+
+    cpuid_count( 1, 0, a, b, c, d );
+    if( !( c & 0x8000000 ) )
+        return( 16 );
+    __asm__ __volatile__ ( "xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0) );
+    if( ( xcr0 & 0x6 ) != 0x6 )
+        return( 16 );
+
+    cpuid_count( 7, 0, a, b, c, d );
+    if( ( b & 0x10000 ) && ( xcr0 & 0xe6 ) == 0xe6 )
+        return( 64 );
+    if( b & 0x20 )
+        return( 32 );
+
+    return( 16 );
+}
+
+#endif /* XOR_X86 */
+
+typedef struct
+{
+    const char *name;
+    xor_fn fn;
+    int width;                  /*!< vector bytes the CPU must support */
+}
+xor_kernel;
+
+static const xor_kernel xor_kernels[] =
+{
+#if defined(XOR_X86)
+    { "avx512",  xor_avx512,  64 },
+    { "avx2",    xor_avx2,    32 },
+    { "sse2",    xor_sse2,    16 },
+#endif
+    { "generic", xor_generic,  0 },
+};
+
+#define XOR_KERNELS ( sizeof( xor_kernels ) / sizeof( xor_kernels[0] ) )
+
+static int xor_cpu_width = 0;
+static const xor_kernel *xor_current = &xor_kernels[XOR_KERNELS - 1];
+static size_t xor_nt_threshold = XOR_NT_DEFAULT;
+
+static void xor_probe( void ) __attribute__ ((constructor));
+
+static void xor_probe( void )
+{
+    size_t i;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    long llc = sysconf( _SC_LEVEL3_CACHE_SIZE );
+
+    if( llc > 0 )
+        xor_nt_threshold = (size_t) llc;
+#endif
+
+#if defined(XOR_X86)
+    xor_cpu_width = xor_width();
+#endif
+
+    for( i = 0; i < XOR_KERNELS; i++ )
+    {
+        if( xor_kernels[i].width <= xor_cpu_width )
+        {
+            xor_current = &xor_kernels[i];
+            break;
+        }
+    }
+}
+
+void xor_keystream( unsigned char *output, const unsigned char *input,
+                    const unsigned char *keystream, size_t length )
+{
+    xor_current->fn( output, input, keystream, length, length >= xor_nt_threshold );
+}
+
+const char *xor_kernel_name( void )
+{
+    return( xor_current->name );
+}
+
+int xor_kernel_select( const char *name )
+{
+    size_t i;
+
+    for( i = 0; i < XOR_KERNELS; i++ )
+    {
+        if( strcmp( xor_kernels[i].name, name ) == 0 &&
+            xor_kernels[i].width <= xor_cpu_width )
+        {
+            xor_current = &xor_kernels[i];
+            return( 0 );
+        }
+    }
+
+    return( POLARSSL_ERR_XOR_KERNEL_UNAVAILABLE );
+}
+
+void xor_set_nt_threshold( size_t bytes )
+{
+    xor_nt_threshold = bytes;
+}
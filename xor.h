@@ -0,0 +1,66 @@
+/**
+ * \file xor.h
+ *
+ * \brief Keystream application (output = input ^ keystream)
+ *
+ * Every stream mode ends by XORing a keystream into the data: ARC4 over
+ * a precomputed keystream, and the AES counter modes over their batches
+ * and partial last blocks. This is the one kernel they share. The widest
+ * of AVX-512, AVX2 and SSE2 that the CPU supports is chosen once, at
+ * startup. Buffers of at least the last-level cache size are written
+ * with non-temporal stores, so output that will not be read back soon
+ * does not evict the working set.
+ */
+#ifndef POLARSSL_XOR_H
+#define POLARSSL_XOR_H
+
+#include <string.h>
+
+#define POLARSSL_ERR_XOR_KERNEL_UNAVAILABLE                -0x001B  /**< Kernel unknown or not supported by this CPU. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          output = input ^ keystream over length bytes
+ *
+ *                 Any alignment and length is accepted; output may be
+ *                 the same buffer as input or keystream.
+ *
+ * \param output   buffer for the output data
+ * \param input    buffer holding the input data
+ * \param keystream buffer holding the keystream
+ * \param length   number of bytes
+ */
+void xor_keystream( unsigned char *output, const unsigned char *input,
+                    const unsigned char *keystream, size_t length );
+
+/**
+ * \brief          Name of the kernel in use ("avx512", "avx2", "sse2"
+ *                 or "generic")
+ */
+const char *xor_kernel_name( void );
+
+/**
+ * \brief          Use another kernel, e.g. to compare them
+ *
+ * \param name     kernel name, as returned by xor_kernel_name
+ *
+ * \return         0 if successful, or POLARSSL_ERR_XOR_KERNEL_UNAVAILABLE
+ */
+int xor_kernel_select( const char *name );
+
+/**
+ * \brief          Length from which non-temporal stores are used;
+ *                 the last-level cache size by default
+ *
+ * \param bytes    new threshold, 0 for always, (size_t) -1 for never
+ */
+void xor_set_nt_threshold( size_t bytes );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* xor.h */